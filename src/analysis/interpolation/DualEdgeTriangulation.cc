@@ -66,6 +66,7 @@ void DualEdgeTriangulation::performConsistencyTest()
 
 void DualEdgeTriangulation::addLine( Line3D* line, bool breakline )
 {
+  mLocationEdges.clear();
   int actpoint = -10;//number of the last point, which has been inserted from the line
   int currentpoint = -10;//number of the point, which is currently inserted from the line
   if ( line )
@@ -107,6 +108,7 @@ void DualEdgeTriangulation::addLine( Line3D* line, bool breakline )
 
 int DualEdgeTriangulation::addPoint( Point3D* p )
 {
+  mLocationEdges.clear();
   if ( p )
   {
 // QgsDebugMsg( QString("inserting point %1,%2//%3//%4").arg(mPointVector.count()).arg(p->getX()).arg(p->getY()).arg(p->getZ()));
@@ -425,29 +427,24 @@ int DualEdgeTriangulation::baseEdgeOfPoint( int point )
     {
       // QgsDebugMsg( "warning, endless loop" );
 
-      //use the secure and slow method
-      //qWarning( "******************warning, using the slow method in baseEdgeOfPoint****************************************" );
-      for ( int i = 0; i < mHalfEdge.count(); i++ )
+      //use the secure method
+      int edge = innerEdgeOfPoint( point );
+      if ( edge != -1 )
       {
-        if ( mHalfEdge[i]->getPoint() == point && mHalfEdge[mHalfEdge[i]->getNext()]->getPoint() != -1 )//we found it
-        {
-          return i;
-        }
+        return edge;
       }
     }
 
     int frompoint = mHalfEdge[mHalfEdge[actedge]->getDual()]->getPoint();
     int topoint = mHalfEdge[actedge]->getPoint();
 
-    if ( frompoint == -1 || topoint == -1 )//this would cause a crash. Therefore we use the slow method in this case
+    if ( frompoint == -1 || topoint == -1 )//this would cause a crash. Therefore we use the secure method in this case
     {
-      for ( int i = 0; i < mHalfEdge.count(); i++ )
+      int edge = innerEdgeOfPoint( point );
+      if ( edge != -1 )
       {
-        if ( mHalfEdge[i]->getPoint() == point && mHalfEdge[mHalfEdge[i]->getNext()]->getPoint() != -1 )//we found it
-        {
-          mEdgeInside = i;
-          return i;
-        }
+        mEdgeInside = edge;
+        return edge;
       }
     }
 
@@ -969,6 +966,7 @@ bool DualEdgeTriangulation::getTriangle( double x, double y, Point3D* p1, int* n
   if ( p1 && p2 && p3 )
   {
     Point3D point( x, y, 0 );
+    mEdgeInside = locationStartEdge( x, y, mEdgeInside );
     int edge = baseEdgeOfTriangle( &point );
     if ( edge == -10 )//the point is outside the convex hull
     {
@@ -1087,6 +1085,7 @@ bool DualEdgeTriangulation::getTriangle( double x, double y, Point3D* p1, Point3
   if ( p1 && p2 && p3 )
   {
     Point3D point( x, y, 0 );
+    mEdgeInside = locationStartEdge( x, y, mEdgeInside );
     int edge = baseEdgeOfTriangle( &point );
     if ( edge == -10 )//the point is outside the convex hull
     {
@@ -2591,6 +2590,7 @@ void DualEdgeTriangulation::triangulatePolygon( QList<int>* poly, QList<int>* fr
 bool DualEdgeTriangulation::pointInside( double x, double y )
 {
   Point3D point( x, y, 0 );
+  mEdgeInside = locationStartEdge( x, y, mEdgeInside );
   unsigned int actedge = mEdgeInside;//start with an edge which does not point to the virtual point
   int counter = 0;//number of consecutive successful left-of-tests
   int nulls = 0;//number of left-of-tests, which returned 0. 1 means, that the point is on a line, 2 means that it is on an existing point
@@ -2672,6 +2672,187 @@ bool DualEdgeTriangulation::pointInside( double x, double y )
   return true;
 }
 
+bool DualEdgeTriangulation::isInnerEdge( int edge ) const
+{
+  if ( edge < 0 || edge >= mHalfEdge.count() )
+  {
+    return false;
+  }
+  int next = mHalfEdge[edge]->getNext();
+  return mHalfEdge[edge]->getPoint() != -1 && mHalfEdge[next]->getPoint() != -1 && mHalfEdge[mHalfEdge[next]->getNext()]->getPoint() != -1;
+}
+
+int DualEdgeTriangulation::innerEdgeOfPoint( int point )
+{
+  if ( point < 0 )
+  {
+    return -1;
+  }
+  if ( point < mPointEdges.size() )
+  {
+    int edge = mPointEdges[point];
+    if ( edge != -1 && mHalfEdge[edge]->getPoint() == point && mHalfEdge[mHalfEdge[edge]->getNext()]->getPoint() != -1 )
+    {
+      return edge;
+    }
+  }
+
+  //the entry is missing or outdated, refresh the entries of all points with one pass over the edges
+  mPointEdges.fill( -1, mPointVector.count() );
+  for ( int i = 0; i < mHalfEdge.count(); i++ )
+  {
+    int p = mHalfEdge[i]->getPoint();
+    if ( p >= 0 && p < mPointEdges.size() && mPointEdges[p] == -1 && mHalfEdge[mHalfEdge[i]->getNext()]->getPoint() != -1 )
+    {
+      mPointEdges[p] = i;
+    }
+  }
+  return point < mPointEdges.size() ? mPointEdges[point] : -1;
+}
+
+void DualEdgeTriangulation::buildPointLocationIndex()
+{
+  mLocationEdges.clear();
+  int nPoints = mPointVector.count();
+  if ( nPoints < 3 )
+  {
+    return;
+  }
+
+  //about one point per cell
+  double width = xMax - xMin, height = yMax - yMin;
+  mLocationCellSize = sqrt( width * height / nPoints );
+  if ( mLocationCellSize <= 0 )
+  {
+    mLocationCellSize = qMax( width, height ) / nPoints;
+  }
+  if ( mLocationCellSize <= 0 )
+  {
+    return;
+  }
+  mLocationXMin = xMin;
+  mLocationYMin = yMin;
+  mLocationCols = qMin( int( width / mLocationCellSize ) + 1, nPoints );
+  mLocationRows = qMin( int( height / mLocationCellSize ) + 1, nPoints );
+  mLocationCellSize = qMax( mLocationCellSize, qMax( width / mLocationCols, height / mLocationRows ) );
+
+  //each cell starts at an inner edge pointing to a point of the cell, cells without point inherit the edge of a neighbour
+  QVector<int> edges( mLocationCols * mLocationRows, -1 );
+  for ( int i = 0; i < mHalfEdge.count(); i++ )
+  {
+    int p = mHalfEdge[i]->getPoint();
+    if ( p < 0 || !isInnerEdge( i ) )
+    {
+      continue;
+    }
+    int col = qBound( 0, int(( mPointVector[p]->getX() - mLocationXMin ) / mLocationCellSize ), mLocationCols - 1 );
+    int row = qBound( 0, int(( mPointVector[p]->getY() - mLocationYMin ) / mLocationCellSize ), mLocationRows - 1 );
+    if ( edges[row * mLocationCols + col] == -1 )
+    {
+      edges[row * mLocationCols + col] = i;
+    }
+  }
+  int lastEdge = mEdgeInside;
+  for ( int row = 0; row < mLocationRows; ++row )
+  {
+    for ( int col = 0; col < mLocationCols; ++col )
+    {
+      int& edge = edges[row * mLocationCols + col];
+      if ( edge == -1 )
+      {
+        edge = row > 0 && edges[( row - 1 ) * mLocationCols + col] != -1 ? edges[( row - 1 ) * mLocationCols + col] : lastEdge;
+      }
+      lastEdge = edge;
+    }
+  }
+  mLocationEdges = edges;
+}
+
+int DualEdgeTriangulation::locationStartEdge( double x, double y, int currentEdge ) const
+{
+  if ( mLocationEdges.isEmpty() )
+  {
+    return currentEdge;
+  }
+  int col = qBound( 0., floor(( x - mLocationXMin ) / mLocationCellSize ), mLocationCols - 1. );
+  int row = qBound( 0., floor(( y - mLocationYMin ) / mLocationCellSize ), mLocationRows - 1. );
+  int gridEdge = mLocationEdges[row * mLocationCols + col];
+  if ( !isInnerEdge( gridEdge ) )
+  {
+    return currentEdge;
+  }
+  if ( !isInnerEdge( currentEdge ) )
+  {
+    return gridEdge;
+  }
+
+  //keep the current edge for searches close to the previous one
+  Point3D* currentPoint = mPointVector[mHalfEdge[currentEdge]->getPoint()];
+  Point3D* gridPoint = mPointVector[mHalfEdge[gridEdge]->getPoint()];
+  double currentDist = ( currentPoint->getX() - x ) * ( currentPoint->getX() - x ) + ( currentPoint->getY() - y ) * ( currentPoint->getY() - y );
+  double gridDist = ( gridPoint->getX() - x ) * ( gridPoint->getX() - x ) + ( gridPoint->getY() - y ) * ( gridPoint->getY() - y );
+  return currentDist <= gridDist ? currentEdge : gridEdge;
+}
+
+bool DualEdgeTriangulation::locateTriangle( double x, double y, int& hintEdge, int* n1, int* n2, int* n3 ) const
+{
+  if ( mPointVector.size() < 3 )
+  {
+    return false;
+  }
+
+  //start from the previous triangle or from the grid, whichever is closer
+  int actedge = locationStartEdge( x, y, hintEdge );
+  if ( !isInnerEdge( actedge ) )
+  {
+    actedge = mEdgeInside;
+  }
+  if ( !isInnerEdge( actedge ) )
+  {
+    return false;
+  }
+
+  //same walk as in 'baseEdgeOfTriangle', but points on an edge or with unstable left-of-tests are accepted as inside
+  Point3D point( x, y, 0 );
+  int counter = 0;
+  int runs = 0;
+  while ( true )
+  {
+    if ( runs > nBaseOfRuns )//prevents endless loops
+    {
+      return false;
+    }
+
+    double leftofvalue = MathUtils::leftOf( &point, mPointVector[mHalfEdge[mHalfEdge[actedge]->getDual()]->getPoint()], mPointVector[mHalfEdge[actedge]->getPoint()] );
+    if ( leftofvalue < leftOfTresh )//point is on the left side or on the edge
+    {
+      counter += 1;
+      if ( counter == 3 )//three successful passes means that we have found the triangle
+      {
+        break;
+      }
+    }
+    else//point is on the right side
+    {
+      actedge = mHalfEdge[actedge]->getDual();
+      counter = 1;
+    }
+
+    actedge = mHalfEdge[actedge]->getNext();
+    if ( mHalfEdge[actedge]->getPoint() == -1 )//the half edge points to the virtual point, the point is outside the convex hull
+    {
+      return false;
+    }
+    runs++;
+  }
+
+  hintEdge = actedge;
+  *n1 = mHalfEdge[actedge]->getPoint();
+  *n2 = mHalfEdge[mHalfEdge[actedge]->getNext()]->getPoint();
+  *n3 = mHalfEdge[mHalfEdge[mHalfEdge[actedge]->getNext()]->getNext()]->getPoint();
+  return true;
+}
+
 #if 0
 bool DualEdgeTriangulation::readFromTAFF( QString filename )
 {
@@ -95,6 +95,10 @@ class ANALYSIS_EXPORT DualEdgeTriangulation: public Triangulation
     virtual void ruppertRefinement() override;
     /**Returns true, if the point with coordinates x and y is inside the convex hull and false otherwise*/
     bool pointInside( double x, double y ) override;
+    /**Builds a grid of start edges for the triangle search, which is used for searches far from the previous one. The grid is dropped when points or lines are added*/
+    void buildPointLocationIndex();
+    /**Finds the triangle containing the point with coordinates x and y without changing the search state of the triangulation, so that it can be called from several threads at once. 'hintEdge' is the edge returned by the previous search of the calling thread (or -1) and is set to an edge of the found triangle. Returns false if the point is outside the convex hull*/
+    bool locateTriangle( double x, double y, int& hintEdge, int* n1, int* n2, int* n3 ) const;
     /**Reads the dual edge structure of a taff file*/
     //bool readFromTAFF(QString fileName);
     /**Saves the dual edge structure to a taff file*/
@@ -176,6 +180,22 @@ class ANALYSIS_EXPORT DualEdgeTriangulation: public Triangulation
     int splitHalfEdge( int edge, float position );
     /**Returns true, if a half edge is on the convex hull and false otherwise*/
     bool edgeOnConvexHull( int edge );
+    /**Cell size and origin of the point location grid*/
+    double mLocationCellSize;
+    double mLocationXMin;
+    double mLocationYMin;
+    int mLocationCols;
+    int mLocationRows;
+    /**Start edge for the triangle search of each cell of the point location grid*/
+    QVector<int> mLocationEdges;
+    /**For each point, an edge pointing to it. Entries may be outdated and are verified before use*/
+    QVector<int> mPointEdges;
+    /**Returns true if the edge and the edges of its triangle do not point to the virtual point*/
+    bool isInnerEdge( int edge ) const;
+    /**Returns an edge pointing to 'point' whose next edge does not point to the virtual point, using mPointEdges*/
+    int innerEdgeOfPoint( int point );
+    /**Returns the start edge of the point location grid for the coordinates if its point is closer than the one of 'currentEdge', and 'currentEdge' otherwise*/
+    int locationStartEdge( double x, double y, int currentEdge ) const;
     /**Function needed for the ruppert algorithm. Tests, if point is in the circle through both endpoints of edge and the endpoint of edge->dual->next->point. If so, the function calls itself recursively for edge->next and edge->next->next. Stops, if it finds a forced edge or a convex hull edge*/
     void evaluateInfluenceRegion( Point3D* point, int edge, QSet<int> &set );
 };
@@ -196,6 +216,11 @@ inline DualEdgeTriangulation::DualEdgeTriangulation()
     , mEdgeWithPoint( 0 )
     , mUnstableEdge( 0 )
     , mTwiceInsPoint( 0 )
+    , mLocationCellSize( 0 )
+    , mLocationXMin( 0 )
+    , mLocationYMin( 0 )
+    , mLocationCols( 0 )
+    , mLocationRows( 0 )
 {
   mPointVector.reserve( mDefaultStorageForPoints );
   mHalfEdge.reserve( mDefaultStorageForHalfEdges );
@@ -217,6 +242,11 @@ inline DualEdgeTriangulation::DualEdgeTriangulation( int nop, Triangulation* dec
     , mEdgeWithPoint( 0 )
     , mUnstableEdge( 0 )
     , mTwiceInsPoint( 0 )
+    , mLocationCellSize( 0 )
+    , mLocationXMin( 0 )
+    , mLocationYMin( 0 )
+    , mLocationCols( 0 )
+    , mLocationRows( 0 )
 {
   mPointVector.reserve( nop );
   mHalfEdge.reserve( nop );
@@ -111,13 +111,9 @@ bool LinTriangleInterpolator::calcPoint( double x, double y, Point3D* point )
       return false;//point is outside the convex hull or numerical problems
     }
 
-    double a = ( pt1.getZ() * ( pt2.getY() - pt3.getY() ) + pt2.getZ() * ( pt3.getY() - pt1.getY() ) + pt3.getZ() * ( pt1.getY() - pt2.getY() ) ) / (( pt1.getX() - pt2.getX() ) * ( pt2.getY() - pt3.getY() ) - ( pt2.getX() - pt3.getX() ) * ( pt1.getY() - pt2.getY() ) );
-    double b = ( pt1.getZ() * ( pt2.getX() - pt3.getX() ) + pt2.getZ() * ( pt3.getX() - pt1.getX() ) + pt3.getZ() * ( pt1.getX() - pt2.getX() ) ) / (( pt1.getY() - pt2.getY() ) * ( pt2.getX() - pt3.getX() ) - ( pt2.getY() - pt3.getY() ) * ( pt1.getX() - pt2.getX() ) );
-    double c = pt1.getZ() - a * pt1.getX() - b * pt1.getY();
-
     point->setX( x );
     point->setY( y );
-    point->setZ( a*x + b*y + c );
+    point->setZ( planeZ( pt1, pt2, pt3, x, y ) );
     return true;
   }
   else
@@ -128,12 +124,10 @@ bool LinTriangleInterpolator::calcPoint( double x, double y, Point3D* point )
 
 }
 
-
-
-
-
-
-
-
-
-
+double LinTriangleInterpolator::planeZ( const Point3D& pt1, const Point3D& pt2, const Point3D& pt3, double x, double y )
+{
+  double a = ( pt1.getZ() * ( pt2.getY() - pt3.getY() ) + pt2.getZ() * ( pt3.getY() - pt1.getY() ) + pt3.getZ() * ( pt1.getY() - pt2.getY() ) ) / (( pt1.getX() - pt2.getX() ) * ( pt2.getY() - pt3.getY() ) - ( pt2.getX() - pt3.getX() ) * ( pt1.getY() - pt2.getY() ) );
+  double b = ( pt1.getZ() * ( pt2.getX() - pt3.getX() ) + pt2.getZ() * ( pt3.getX() - pt1.getX() ) + pt3.getZ() * ( pt1.getX() - pt2.getX() ) ) / (( pt1.getY() - pt2.getY() ) * ( pt2.getX() - pt3.getX() ) - ( pt2.getY() - pt3.getY() ) * ( pt1.getX() - pt2.getX() ) );
+  double c = pt1.getZ() - a * pt1.getX() - b * pt1.getY();
+  return a * x + b * y + c;
+}
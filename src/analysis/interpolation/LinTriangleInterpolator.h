@@ -38,6 +38,9 @@ class ANALYSIS_EXPORT LinTriangleInterpolator : public TriangleInterpolator
     virtual DualEdgeTriangulation* getTriangulation() const;
     /**Sets a Triangulation*/
     virtual void setTriangulation( DualEdgeTriangulation* tin );
+    /**Returns the z-value at x and y of the plane through the three points
+      @note added in 2.16*/
+    static double planeZ( const Point3D& pt1, const Point3D& pt2, const Point3D& pt3, double x, double y );
 
 
   protected:
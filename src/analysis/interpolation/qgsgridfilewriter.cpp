@@ -21,6 +21,38 @@
 #include <QFile>
 #include <QFileInfo>
 #include <QProgressDialog>
+#include <QThread>
+#include <QtConcurrentMap>
+#include <algorithm>
+
+class GridRowWorker
+{
+  public:
+    GridRowWorker( QgsInterpolator* interpolator, const QgsRectangle& extent, double cellSizeX, double cellSizeY, int nCols, int blockStart, double* values, char* valid )
+        : mInterpolator( interpolator ), mExtent( extent ), mCellSizeX( cellSizeX ), mCellSizeY( cellSizeY ), mNumColumns( nCols ), mBlockStart( blockStart ), mValues( values ), mValid( valid ) {}
+
+    void operator()( int row ) const
+    {
+      double* rowValues = mValues + ( row - mBlockStart ) * mNumColumns;
+      char* rowValid = mValid + ( row - mBlockStart ) * mNumColumns;
+      double y = mExtent.yMaximum() - mCellSizeY / 2.0 - row * mCellSizeY; //calculate value in the center of the cell
+      for ( int j = 0; j < mNumColumns; ++j )
+      {
+        double x = mExtent.xMinimum() + mCellSizeX / 2.0 + j * mCellSizeX;
+        rowValid[j] = mInterpolator->interpolatePoint( x, y, rowValues[j] ) == 0;
+      }
+    }
+
+  private:
+    QgsInterpolator* mInterpolator;
+    QgsRectangle mExtent;
+    double mCellSizeX;
+    double mCellSizeY;
+    int mNumColumns;
+    int mBlockStart;
+    double* mValues;
+    char* mValid;
+};
 
 QgsGridFileWriter::QgsGridFileWriter( QgsInterpolator* i, QString outputPath, QgsRectangle extent, int nCols, int nRows, double cellSizeX, double cellSizeY )
     : mInterpolator( i )
@@ -68,10 +100,6 @@ int QgsGridFileWriter::writeFile( bool showProgressDialog )
   outStream.setRealNumberPrecision( 8 );
   writeHeader( outStream );
 
-  double currentYValue = mInterpolationExtent.yMaximum() - mCellSizeY / 2.0; //calculate value in the center of the cell
-  double currentXValue;
-  double interpolatedValue;
-
   QProgressDialog* progressDialog = 0;
   if ( showProgressDialog )
   {
@@ -79,23 +107,47 @@ int QgsGridFileWriter::writeFile( bool showProgressDialog )
     progressDialog->setWindowModality( Qt::WindowModal );
   }
 
-  for ( int i = 0; i < mNumRows; ++i )
+  // Interpolators which support it are evaluated on all cores, in blocks of rows
+  bool concurrent = mInterpolator->prepareConcurrentInterpolation();
+  int blockRows = concurrent ? qMax( 1, QThread::idealThreadCount() ) * 4 : 1;
+  QVector<double> values( blockRows * mNumColumns );
+  QVector<char> valid( blockRows * mNumColumns );
+
+  for ( int blockStart = 0; blockStart < mNumRows; blockStart += blockRows )
   {
-    currentXValue = mInterpolationExtent.xMinimum() + mCellSizeX / 2.0; //calculate value in the center of the cell
-    for ( int j = 0; j < mNumColumns; ++j )
+    int blockEnd = qMin( blockStart + blockRows, mNumRows );
+    GridRowWorker worker( mInterpolator, mInterpolationExtent, mCellSizeX, mCellSizeY, mNumColumns, blockStart, values.data(), valid.data() );
+    QVector<int> rows;
+    for ( int i = blockStart; i < blockEnd; ++i )
     {
-      if ( mInterpolator->interpolatePoint( currentXValue, currentYValue, interpolatedValue ) == 0 )
-      {
-        outStream << interpolatedValue << " ";
-      }
-      else
+      rows.append( i );
+    }
+    if ( concurrent )
+    {
+      QtConcurrent::blockingMap( rows, worker );
+    }
+    else
+    {
+      std::for_each( rows.begin(), rows.end(), worker );
+    }
+
+    for ( int i = blockStart; i < blockEnd; ++i )
+    {
+      const double* rowValues = values.constData() + ( i - blockStart ) * mNumColumns;
+      const char* rowValid = valid.constData() + ( i - blockStart ) * mNumColumns;
+      for ( int j = 0; j < mNumColumns; ++j )
       {
-        outStream << "-9999 ";
+        if ( rowValid[j] )
+        {
+          outStream << rowValues[j] << " ";
+        }
+        else
+        {
+          outStream << "-9999 ";
+        }
       }
-      currentXValue += mCellSizeX;
+      outStream << endl;
     }
-    outStream << endl;
-    currentYValue -= mCellSizeY;
 
     if ( showProgressDialog )
     {
@@ -104,7 +156,7 @@ int QgsGridFileWriter::writeFile( bool showProgressDialog )
         outputFile.remove();
         return 3;
       }
-      progressDialog->setValue( i );
+      progressDialog->setValue( blockEnd - 1 );
     }
   }
 
@@ -16,15 +16,37 @@
  ***************************************************************************/
 
 #include "qgsidwinterpolator.h"
+#include <algorithm>
 #include <cmath>
 #include <limits>
+#include <vector>
 
-QgsIDWInterpolator::QgsIDWInterpolator( const QList<LayerData>& layerData ): QgsInterpolator( layerData ), mDistanceCoefficient( 2.0 )
+QgsIDWInterpolator::QgsIDWInterpolator( const QList<LayerData>& layerData )
+    : QgsInterpolator( layerData )
+    , mDistanceCoefficient( 2.0 )
+    , mNeighbourCount( 0 )
+    , mSearchRadius( 0 )
+    , mPointGridBuilt( false )
+    , mGridXMin( 0 )
+    , mGridYMin( 0 )
+    , mGridCellSize( 1 )
+    , mGridCols( 0 )
+    , mGridRows( 0 )
 {
 
 }
 
-QgsIDWInterpolator::QgsIDWInterpolator(): QgsInterpolator( QList<LayerData>() ), mDistanceCoefficient( 2.0 )
+QgsIDWInterpolator::QgsIDWInterpolator()
+    : QgsInterpolator( QList<LayerData>() )
+    , mDistanceCoefficient( 2.0 )
+    , mNeighbourCount( 0 )
+    , mSearchRadius( 0 )
+    , mPointGridBuilt( false )
+    , mGridXMin( 0 )
+    , mGridYMin( 0 )
+    , mGridCellSize( 1 )
+    , mGridCols( 0 )
+    , mGridRows( 0 )
 {
 
 }
@@ -34,22 +56,40 @@ QgsIDWInterpolator::~QgsIDWInterpolator()
 
 }
 
-int QgsIDWInterpolator::interpolatePoint( double x, double y, double& result )
+bool QgsIDWInterpolator::prepareConcurrentInterpolation()
 {
   if ( !mDataIsCached )
   {
     cacheBaseData();
   }
+  if ( !mPointGridBuilt && ( mNeighbourCount > 0 || mSearchRadius > 0 ) )
+  {
+    buildPointGrid();
+  }
+  return true;
+}
+
+int QgsIDWInterpolator::interpolatePoint( double x, double y, double& result )
+{
+  prepareConcurrentInterpolation();
+  if ( mNeighbourCount > 0 || mSearchRadius > 0 )
+  {
+    return interpolateLocal( x, y, result );
+  }
+  return interpolateGlobal( x, y, result );
+}
 
+int QgsIDWInterpolator::interpolateGlobal( double x, double y, double& result ) const
+{
   double currentWeight;
   double distance;
 
   double sumCounter = 0;
   double sumDenominator = 0;
 
-  QVector<vertexData>::iterator vertex_it = mCachedBaseData.begin();
+  QVector<vertexData>::const_iterator vertex_it = mCachedBaseData.constBegin();
 
-  for ( ; vertex_it != mCachedBaseData.end(); ++vertex_it )
+  for ( ; vertex_it != mCachedBaseData.constEnd(); ++vertex_it )
   {
     distance = sqrt(( vertex_it->x - x ) * ( vertex_it->x - x ) + ( vertex_it->y - y ) * ( vertex_it->y - y ) );
     if (( distance - 0 ) < std::numeric_limits<double>::min() )
@@ -70,3 +110,161 @@ int QgsIDWInterpolator::interpolatePoint( double x, double y, double& result )
   result = sumCounter / sumDenominator;
   return 0;
 }
+
+void QgsIDWInterpolator::buildPointGrid()
+{
+  mPointGridBuilt = true;
+  mGridCols = 0;
+  mGridRows = 0;
+  mGridCellOffsets.clear();
+  mGridPoints.clear();
+  int n = mCachedBaseData.size();
+  if ( n == 0 )
+  {
+    return;
+  }
+
+  double xMax = mCachedBaseData[0].x, yMax = mCachedBaseData[0].y;
+  mGridXMin = xMax;
+  mGridYMin = yMax;
+  foreach ( const vertexData& v, mCachedBaseData )
+  {
+    mGridXMin = qMin( mGridXMin, v.x );
+    mGridYMin = qMin( mGridYMin, v.y );
+    xMax = qMax( xMax, v.x );
+    yMax = qMax( yMax, v.y );
+  }
+  double width = xMax - mGridXMin, height = yMax - mGridYMin;
+
+  // About two points per cell
+  mGridCellSize = sqrt( 2. * width * height / n );
+  if ( mGridCellSize <= 0 )
+  {
+    mGridCellSize = 2. * qMax( width, height ) / n;
+  }
+  if ( mGridCellSize <= 0 )
+  {
+    mGridCellSize = 1.;
+  }
+  mGridCols = qMin( int( width / mGridCellSize ) + 1, n );
+  mGridRows = qMin( int( height / mGridCellSize ) + 1, n );
+  mGridCellSize = qMax( mGridCellSize, qMax( width / mGridCols, height / mGridRows ) );
+
+  // Counting sort of the points by cell
+  QVector<int> cells( n );
+  mGridCellOffsets.fill( 0, mGridCols * mGridRows + 1 );
+  for ( int i = 0; i < n; ++i )
+  {
+    int col = qMin( int(( mCachedBaseData[i].x - mGridXMin ) / mGridCellSize ), mGridCols - 1 );
+    int row = qMin( int(( mCachedBaseData[i].y - mGridYMin ) / mGridCellSize ), mGridRows - 1 );
+    cells[i] = row * mGridCols + col;
+    ++mGridCellOffsets[cells[i] + 1];
+  }
+  for ( int c = 0, nCells = mGridCols * mGridRows; c < nCells; ++c )
+  {
+    mGridCellOffsets[c + 1] += mGridCellOffsets[c];
+  }
+  QVector<int> fill = mGridCellOffsets;
+  mGridPoints.resize( n );
+  for ( int i = 0; i < n; ++i )
+  {
+    mGridPoints[fill[cells[i]]++] = mCachedBaseData[i];
+  }
+}
+
+int QgsIDWInterpolator::interpolateLocal( double x, double y, double& result ) const
+{
+  if ( mGridCols == 0 )
+  {
+    return 1;
+  }
+
+  double maxSqrDist = mSearchRadius > 0 ? mSearchRadius * mSearchRadius : std::numeric_limits<double>::infinity();
+  int k = mNeighbourCount > 0 ? mNeighbourCount : std::numeric_limits<int>::max();
+
+  // Max-heap of the nearest points found so far, ( squared distance, value )
+  std::vector< std::pair<double, double> > nearest;
+
+  int cx = qBound( 0, int( floor(( x - mGridXMin ) / mGridCellSize ) ), mGridCols - 1 );
+  int cy = qBound( 0, int( floor(( y - mGridYMin ) / mGridCellSize ) ), mGridRows - 1 );
+  for ( int ring = 0; ; ++ring )
+  {
+    int c0 = cx - ring, c1 = cx + ring, r0 = cy - ring, r1 = cy + ring;
+    for ( int r = qMax( r0, 0 ), rEnd = qMin( r1, mGridRows - 1 ); r <= rEnd; ++r )
+    {
+      // Full first and last rows of the ring, only the first and last column in between
+      bool fullRow = r == r0 || r == r1;
+      for ( int c = qMax( c0, 0 ), cEnd = qMin( c1, mGridCols - 1 ); c <= cEnd; ++c )
+      {
+        if ( !fullRow && c != c0 && c != c1 )
+        {
+          c = c1 - 1;
+          continue;
+        }
+        for ( int i = mGridCellOffsets[r * mGridCols + c], iEnd = mGridCellOffsets[r * mGridCols + c + 1]; i < iEnd; ++i )
+        {
+          const vertexData& v = mGridPoints[i];
+          double sqrDist = ( v.x - x ) * ( v.x - x ) + ( v.y - y ) * ( v.y - y );
+          if ( sqrDist < std::numeric_limits<double>::min() )
+          {
+            result = v.z;
+            return 0;
+          }
+          if ( sqrDist > maxSqrDist )
+          {
+            continue;
+          }
+          if ( int( nearest.size() ) < k )
+          {
+            nearest.push_back( std::make_pair( sqrDist, v.z ) );
+            std::push_heap( nearest.begin(), nearest.end() );
+          }
+          else if ( sqrDist < nearest.front().first )
+          {
+            std::pop_heap( nearest.begin(), nearest.end() );
+            nearest.back() = std::make_pair( sqrDist, v.z );
+            std::push_heap( nearest.begin(), nearest.end() );
+          }
+        }
+      }
+    }
+
+    // Distance from the point to the nearest cell outside of the visited rings
+    double bound = std::numeric_limits<double>::infinity();
+    if ( c0 > 0 )
+      bound = qMin( bound, x - ( mGridXMin + c0 * mGridCellSize ) );
+    if ( c1 < mGridCols - 1 )
+      bound = qMin( bound, mGridXMin + ( c1 + 1 ) * mGridCellSize - x );
+    if ( r0 > 0 )
+      bound = qMin( bound, y - ( mGridYMin + r0 * mGridCellSize ) );
+    if ( r1 < mGridRows - 1 )
+      bound = qMin( bound, mGridYMin + ( r1 + 1 ) * mGridCellSize - y );
+    if ( bound == std::numeric_limits<double>::infinity() )
+    {
+      break;
+    }
+    double sqrBound = bound > 0 ? bound * bound : 0;
+    if ( sqrBound > maxSqrDist || ( int( nearest.size() ) == k && sqrBound >= nearest.front().first ) )
+    {
+      break;
+    }
+  }
+
+  double sumCounter = 0;
+  double sumDenominator = 0;
+  double exponent = mDistanceCoefficient / 2.0;
+  for ( std::vector< std::pair<double, double> >::const_iterator it = nearest.begin(); it != nearest.end(); ++it )
+  {
+    double currentWeight = 1 / pow( it->first, exponent );
+    sumCounter += currentWeight * it->second;
+    sumDenominator += currentWeight;
+  }
+
+  if ( sumDenominator == 0.0 )
+  {
+    return 1;
+  }
+
+  result = sumCounter / sumDenominator;
+  return 0;
+}
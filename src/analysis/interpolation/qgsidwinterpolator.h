@@ -33,16 +33,47 @@ class ANALYSIS_EXPORT QgsIDWInterpolator: public QgsInterpolator
        @return 0 in case of success*/
     int interpolatePoint( double x, double y, double& result ) override;
 
+    bool prepareConcurrentInterpolation() override;
+
     void setDistanceCoefficient( double p ) {mDistanceCoefficient = p;}
 
+    /**Sets the number of nearest data points used for each interpolated point. 0 (the default) uses all points*/
+    void setNeighbourCount( int n ) { mNeighbourCount = n; }
+    int neighbourCount() const { return mNeighbourCount; }
+
+    /**Sets the radius around each interpolated point within which data points are used. 0 (the default) means no limit.
+       Points without data point within the radius are not interpolated*/
+    void setSearchRadius( double r ) { mSearchRadius = r; }
+    double searchRadius() const { return mSearchRadius; }
+
   private:
 
     QgsIDWInterpolator(); //forbidden
 
+    /**Interpolation from all data points*/
+    int interpolateGlobal( double x, double y, double& result ) const;
+    /**Interpolation from the nearest data points, using the point grid*/
+    int interpolateLocal( double x, double y, double& result ) const;
+    /**Builds the grid of the cached data points*/
+    void buildPointGrid();
+
     /**The parameter that sets how the values are weighted with distance.
        Smaller values mean sharper peaks at the data points. The default is a
        value of 2*/
     double mDistanceCoefficient;
+
+    int mNeighbourCount;
+    double mSearchRadius;
+
+    /**Uniform grid over the cached data points, in compressed row form*/
+    bool mPointGridBuilt;
+    double mGridXMin;
+    double mGridYMin;
+    double mGridCellSize;
+    int mGridCols;
+    int mGridRows;
+    QVector<int> mGridCellOffsets;
+    QVector<vertexData> mGridPoints;
 };
 
 #endif
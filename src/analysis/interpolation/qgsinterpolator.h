@@ -64,6 +64,10 @@ class ANALYSIS_EXPORT QgsInterpolator
        @return 0 in case of success*/
     virtual int interpolatePoint( double x, double y, double& result ) = 0;
 
+    /**Prepares the interpolator for interpolatePoint being called from several threads at once.
+       @return true if concurrent calls are supported, false if interpolatePoint must be called from one thread at a time*/
+    virtual bool prepareConcurrentInterpolation() { return false; }
+
     // @note not available in python bindings
     const QList<LayerData>& layerData() const { return mLayerData; }
 
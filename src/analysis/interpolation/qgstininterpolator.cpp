@@ -30,6 +30,7 @@
 QgsTINInterpolator::QgsTINInterpolator( const QList<LayerData>& inputData, TIN_INTERPOLATION interpolation, bool showProgressDialog )
     : QgsInterpolator( inputData )
     , mTriangulation( 0 )
+    , mDualEdgeTriangulation( 0 )
     , mTriangleInterpolator( 0 )
     , mIsInitialized( false )
     , mShowProgressDialog( showProgressDialog )
@@ -56,6 +57,21 @@ int QgsTINInterpolator::interpolatePoint( double x, double y, double& result )
     return 1;
   }
 
+  if ( mInterpolation == Linear )
+  {
+    //locate the triangle without changing the state of the triangulation, starting at the last triangle of this thread
+    int hintEdge = mHintEdges.hasLocalData() ? mHintEdges.localData() : -1;
+    int n1, n2, n3;
+    if ( !mDualEdgeTriangulation->locateTriangle( x, y, hintEdge, &n1, &n2, &n3 ) )
+    {
+      return 2;
+    }
+    mHintEdges.setLocalData( hintEdge );
+
+    result = LinTriangleInterpolator::planeZ( *mDualEdgeTriangulation->getPoint( n1 ), *mDualEdgeTriangulation->getPoint( n2 ), *mDualEdgeTriangulation->getPoint( n3 ), x, y );
+    return 0;
+  }
+
   Point3D r;
   if ( !mTriangleInterpolator->calcPoint( x, y, &r ) )
   {
@@ -65,9 +81,19 @@ int QgsTINInterpolator::interpolatePoint( double x, double y, double& result )
   return 0;
 }
 
+bool QgsTINInterpolator::prepareConcurrentInterpolation()
+{
+  if ( !mIsInitialized )
+  {
+    initialize();
+  }
+  return mInterpolation == Linear && mTriangleInterpolator;
+}
+
 void QgsTINInterpolator::initialize()
 {
   DualEdgeTriangulation* theDualEdgeTriangulation = new DualEdgeTriangulation( 100000, 0 );
+  mDualEdgeTriangulation = theDualEdgeTriangulation;
   if ( mInterpolation == CloughTocher )
   {
     NormVecDecorator* dec = new NormVecDecorator();
@@ -157,6 +183,7 @@ void QgsTINInterpolator::initialize()
   {
     mTriangleInterpolator = new LinTriangleInterpolator( theDualEdgeTriangulation );
   }
+  theDualEdgeTriangulation->buildPointLocationIndex();
   mIsInitialized = true;
 
   //debug
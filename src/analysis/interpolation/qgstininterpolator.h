@@ -20,7 +20,9 @@
 
 #include "qgsinterpolator.h"
 #include <QString>
+#include <QThreadStorage>
 
+class DualEdgeTriangulation;
 class Triangulation;
 class TriangleInterpolator;
 class QgsFeature;
@@ -45,11 +47,19 @@ class ANALYSIS_EXPORT QgsTINInterpolator: public QgsInterpolator
        @return 0 in case of success*/
     int interpolatePoint( double x, double y, double& result ) override;
 
+    /**Builds the triangulation and its point location index. Only linear interpolation can be evaluated concurrently,
+       Clough-Tocher interpolation keeps the state of the last triangle*/
+    bool prepareConcurrentInterpolation() override;
+
     void setExportTriangulationToFile( bool e ) {mExportTriangulationToFile = e;}
     void setTriangulationFilePath( const QString& filepath ) {mTriangulationFilePath = filepath;}
 
   private:
     Triangulation* mTriangulation;
+    /**The triangulation without decorator (owned by mTriangulation)*/
+    DualEdgeTriangulation* mDualEdgeTriangulation;
+    /**Edge of the last triangle found by each thread, start of the next search*/
+    QThreadStorage<int> mHintEdges;
     TriangleInterpolator* mTriangleInterpolator;
     bool mIsInitialized;
     bool mShowProgressDialog;
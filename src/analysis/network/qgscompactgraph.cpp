@@ -0,0 +1,77 @@
+/***************************************************************************
+    qgscompactgraph.cpp - Compressed sparse row graph representation
+                             -------------------
+    begin                : December 2015
+    copyright            : (C) 2015 by Sandro Mani
+    email                : manisandro@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgscompactgraph.h"
+#include "qgsgraph.h"
+
+QgsCompactGraph::QgsCompactGraph( const QgsGraph* graph )
+    : mCriterionCount( 0 )
+{
+  int nVertices = graph->vertexCount();
+  int nArcs = graph->arcCount();
+  for ( int i = 0; i < nArcs; ++i )
+  {
+    mCriterionCount = qMax( mCriterionCount, graph->arc( i ).properties().size() );
+  }
+
+  mVertexPoints.resize( nVertices );
+  mOutArcOffsets.resize( nVertices + 1 );
+  mArcIds.reserve( nArcs );
+  mArcOutVertices.reserve( nArcs );
+  mArcInVertices.reserve( nArcs );
+  mCompactArcIdx.fill( -1, nArcs );
+
+  // The outgoing arcs keep the order of the vertex arc lists
+  for ( int v = 0; v < nVertices; ++v )
+  {
+    const QgsGraphVertex& vertex = graph->vertex( v );
+    mVertexPoints[v] = vertex.point();
+    mOutArcOffsets[v] = mArcIds.size();
+    const QgsGraphArcIdList outArcs = vertex.outArc();
+    for ( QgsGraphArcIdList::const_iterator it = outArcs.constBegin(); it != outArcs.constEnd(); ++it )
+    {
+      mCompactArcIdx[*it] = mArcIds.size();
+      mArcIds.append( *it );
+      mArcOutVertices.append( v );
+      mArcInVertices.append( graph->arc( *it ).inVertex() );
+    }
+  }
+  mOutArcOffsets[nVertices] = mArcIds.size();
+
+  int nCompactArcs = mArcIds.size();
+  mArcCosts.fill( 0., ( mCriterionCount + 1 ) * nCompactArcs );
+  for ( int a = 0; a < nCompactArcs; ++a )
+  {
+    const QVector<QVariant> properties = graph->arc( mArcIds[a] ).properties();
+    for ( int c = 0, n = properties.size(); c < n; ++c )
+    {
+      mArcCosts[c * nCompactArcs + a] = properties[c].toDouble();
+    }
+  }
+}
+
+int QgsCompactGraph::findVertex( const QgsPoint& pt ) const
+{
+  for ( int i = 0, n = mVertexPoints.size(); i < n; ++i )
+  {
+    if ( mVertexPoints[i] == pt )
+    {
+      return i;
+    }
+  }
+  return -1;
+}
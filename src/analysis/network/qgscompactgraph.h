@@ -0,0 +1,87 @@
+/***************************************************************************
+    qgscompactgraph.h - Compressed sparse row graph representation
+                             -------------------
+    begin                : December 2015
+    copyright            : (C) 2015 by Sandro Mani
+    email                : manisandro@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSCOMPACTGRAPHH
+#define QGSCOMPACTGRAPHH
+
+#include <QVector>
+
+#include "qgspoint.h"
+
+class QgsGraph;
+
+/**
+ * \ingroup networkanalysis
+ * \class QgsCompactGraph
+ * \brief Read-only compressed sparse row representation of a QgsGraph.
+ *
+ * The outgoing arcs of each vertex are stored contiguously, the arc costs are stored as one contiguous array of
+ * doubles per criterion (arc property). Arcs are identified by their index in the source graph.
+ */
+class ANALYSIS_EXPORT QgsCompactGraph
+{
+  public:
+    /**
+     * Builds the compact representation of the graph. Arc properties which are missing or not convertible to double have a cost of 0.
+     */
+    explicit QgsCompactGraph( const QgsGraph* graph );
+
+    int vertexCount() const { return mVertexPoints.size(); }
+    int arcCount() const { return mArcIds.size(); }
+    /** Number of cost arrays, i.e. the largest number of properties of an arc */
+    int criterionCount() const { return mCriterionCount; }
+
+    const QgsPoint& vertexPoint( int vertexIdx ) const { return mVertexPoints[vertexIdx]; }
+    /** Index of the first outgoing arc of the vertex in the compact arc arrays */
+    int outArcBegin( int vertexIdx ) const { return mOutArcOffsets[vertexIdx]; }
+    /** Index past the last outgoing arc of the vertex in the compact arc arrays */
+    int outArcEnd( int vertexIdx ) const { return mOutArcOffsets[vertexIdx + 1]; }
+
+    /** Index of the arc in the source graph */
+    int arcId( int compactArcIdx ) const { return mArcIds[compactArcIdx]; }
+    int arcOutVertex( int compactArcIdx ) const { return mArcOutVertices[compactArcIdx]; }
+    int arcInVertex( int compactArcIdx ) const { return mArcInVertices[compactArcIdx]; }
+    /** Costs of all arcs for the criterion, indexed by compact arc index. Invalid criteria have a cost of 0 for all arcs */
+    const double* arcCosts( int criterionNum ) const
+    {
+      if ( criterionNum < 0 || criterionNum >= mCriterionCount )
+        criterionNum = mCriterionCount;
+      return mArcCosts.constData() + criterionNum * mArcIds.size();
+    }
+
+    /** Index in the compact arc arrays of the arc with the specified index in the source graph */
+    int compactArcIdx( int arcId ) const { return mCompactArcIdx[arcId]; }
+
+    /**
+     * find vertex by point
+     * \return vertex index
+     */
+    int findVertex( const QgsPoint& pt ) const;
+
+  private:
+    int mCriterionCount;
+    QVector<QgsPoint> mVertexPoints;
+    QVector<int> mOutArcOffsets;
+    QVector<int> mArcIds;
+    QVector<int> mArcOutVertices;
+    QVector<int> mArcInVertices;
+    /** Costs per criterion, followed by the zero costs returned for invalid criteria */
+    QVector<double> mArcCosts;
+    QVector<int> mCompactArcIdx;
+};
+
+#endif // QGSCOMPACTGRAPHH
@@ -15,17 +15,25 @@
  *                                                                         *
  ***************************************************************************/
 // C++ standard includes
+#include <functional>
 #include <limits>
+#include <queue>
+#include <vector>
 
 // QT includes
-#include <QMap>
 #include <QVector>
 #include <QPair>
+#include <QtAlgorithms>
+#include <QtConcurrentMap>
 
 //QGIS-uncludes
+#include "qgscompactgraph.h"
 #include "qgsgraph.h"
 #include "qgsgraphanalyzer.h"
 
+typedef QPair< double, int > CostVertex;
+typedef std::priority_queue< CostVertex, std::vector< CostVertex >, std::greater< CostVertex > > CostVertexQueue;
+
 void QgsGraphAnalyzer::dijkstra( const QgsGraph* source, int startPointIdx, int criterionNum, QVector<int>* resultTree, QVector<double>* resultCost )
 {
   QVector< double > * result = NULL;
@@ -48,26 +56,26 @@ void QgsGraphAnalyzer::dijkstra( const QgsGraph* source, int startPointIdx, int
     resultTree->insert( resultTree->begin(), source->vertexCount(), -1 );
   }
 
-  // QMultiMap< cost, vertexIdx > not_begin
-  // I use it and not create any struct or class.
-  QMultiMap< double, int > not_begin;
-  QMultiMap< double, int >::iterator it;
-
-  not_begin.insert( 0.0, startPointIdx );
+  // Binary heap of ( cost, vertexIdx ), outdated entries are skipped when popped
+  CostVertexQueue not_begin;
+  not_begin.push( CostVertex( 0.0, startPointIdx ) );
 
   while ( !not_begin.empty() )
   {
-    it = not_begin.begin();
-    double curCost = it.key();
-    int curVertex = it.value();
-    not_begin.erase( it );
+    double curCost = not_begin.top().first;
+    int curVertex = not_begin.top().second;
+    not_begin.pop();
+    if ( curCost > ( *result )[ curVertex ] )
+    {
+      continue;
+    }
 
     // edge index list
-    QgsGraphArcIdList l = source->vertex( curVertex ).outArc();
-    QgsGraphArcIdList::iterator arcIt;
-    for ( arcIt = l.begin(); arcIt != l.end(); ++arcIt )
+    const QgsGraphArcIdList l = source->vertex( curVertex ).outArc();
+    QgsGraphArcIdList::const_iterator arcIt;
+    for ( arcIt = l.constBegin(); arcIt != l.constEnd(); ++arcIt )
     {
-      const QgsGraphArc arc = source->arc( *arcIt );
+      const QgsGraphArc& arc = source->arc( *arcIt );
       double cost = arc.property( criterionNum ).toDouble() + curCost;
 
       if ( cost < ( *result )[ arc.inVertex()] )
@@ -77,7 +85,7 @@ void QgsGraphAnalyzer::dijkstra( const QgsGraph* source, int startPointIdx, int
         {
           ( *resultTree )[ arc.inVertex()] = *arcIt;
         }
-        not_begin.insert( cost, arc.inVertex() );
+        not_begin.push( CostVertex( cost, arc.inVertex() ) );
       }
     }
   }
@@ -87,6 +95,252 @@ void QgsGraphAnalyzer::dijkstra( const QgsGraph* source, int startPointIdx, int
   }
 }
 
+/**
+ * Dijkstra search on a compact graph from one or more start vertices, with the initial costs of startCosts or 0 if it is empty.
+ * Stop is called with each vertex whose cost is final, the search ends when it returns true. Arcs in inArcs are compact arc indices.
+ */
+template<class Stop>
+static void compactDijkstra( const QgsCompactGraph* source, const QVector<int>& startVertices, const QVector<double>& startCosts, int criterionNum, QVector<double>& costs, QVector<int>* inArcs, Stop& stop )
+{
+  costs.fill( std::numeric_limits<double>::infinity(), source->vertexCount() );
+  if ( inArcs )
+  {
+    inArcs->fill( -1, source->vertexCount() );
+  }
+
+  const double* arcCosts = source->arcCosts( criterionNum );
+  double* cost = costs.data();
+  int* inArc = inArcs ? inArcs->data() : 0;
+
+  CostVertexQueue queue;
+  for ( int i = 0, n = startVertices.size(); i < n; ++i )
+  {
+    double startCost = startCosts.isEmpty() ? 0.0 : startCosts[ i ];
+    if ( startCost < cost[ startVertices[ i ] ] )
+    {
+      cost[ startVertices[ i ] ] = startCost;
+      queue.push( CostVertex( startCost, startVertices[ i ] ) );
+    }
+  }
+
+  while ( !queue.empty() )
+  {
+    double curCost = queue.top().first;
+    int curVertex = queue.top().second;
+    queue.pop();
+    if ( curCost > cost[ curVertex ] )
+    {
+      continue;
+    }
+    if ( stop( curVertex, curCost ) )
+    {
+      break;
+    }
+
+    for ( int a = source->outArcBegin( curVertex ), aEnd = source->outArcEnd( curVertex ); a < aEnd; ++a )
+    {
+      int inVertex = source->arcInVertex( a );
+      double newCost = curCost + arcCosts[ a ];
+      if ( newCost < cost[ inVertex ] )
+      {
+        cost[ inVertex ] = newCost;
+        if ( inArc )
+        {
+          inArc[ inVertex ] = a;
+        }
+        queue.push( CostVertex( newCost, inVertex ) );
+      }
+    }
+  }
+}
+
+class StopAtVertex
+{
+  public:
+    StopAtVertex( int vertexIdx ) : mVertexIdx( vertexIdx ) {}
+    bool operator()( int vertexIdx, double ) const { return vertexIdx == mVertexIdx; }
+
+  private:
+    int mVertexIdx;
+};
+
+class StopAtAllVertices
+{
+  public:
+    StopAtAllVertices( const QVector<bool>& isTarget, int nTargets ) : mIsTarget( isTarget ), mRemaining( nTargets ) {}
+    bool operator()( int vertexIdx, double ) { return mIsTarget[ vertexIdx ] && --mRemaining == 0; }
+
+  private:
+    const QVector<bool>& mIsTarget;
+    int mRemaining;
+};
+
+class StopAboveCost
+{
+  public:
+    StopAboveCost( double maxCost ) : mMaxCost( maxCost ) {}
+    bool operator()( int, double cost ) const { return cost > mMaxCost; }
+
+  private:
+    double mMaxCost;
+};
+
+class CostMatrixWorker
+{
+  public:
+    CostMatrixWorker( const QgsCompactGraph* source, int criterionNum, const QVector<int>& origins, const QVector<int>& destinations, const QVector<bool>& isDestination, int nDestinations, QVector<double>* rows )
+        : mSource( source ), mCriterionNum( criterionNum ), mOrigins( origins ), mDestinations( destinations ), mIsDestination( isDestination ), mNDestinations( nDestinations ), mRows( rows ) {}
+
+    void operator()( int i ) const
+    {
+      QVector<double> costs;
+      StopAtAllVertices stop( mIsDestination, mNDestinations );
+      compactDijkstra( mSource, QVector<int>() << mOrigins[ i ], QVector<double>(), mCriterionNum, costs, 0, stop );
+      QVector<double>& row = mRows[ i ];
+      row.resize( mDestinations.size() );
+      for ( int j = 0, n = mDestinations.size(); j < n; ++j )
+      {
+        row[ j ] = costs[ mDestinations[ j ] ];
+      }
+    }
+
+  private:
+    const QgsCompactGraph* mSource;
+    int mCriterionNum;
+    const QVector<int>& mOrigins;
+    const QVector<int>& mDestinations;
+    const QVector<bool>& mIsDestination;
+    int mNDestinations;
+    QVector<double>* mRows;
+};
+
+void QgsGraphAnalyzer::dijkstra( const QgsCompactGraph* source, int startVertexIdx, int criterionNum, QVector<int>* resultTree, QVector<double>* resultCost, int targetVertexIdx )
+{
+  QVector< double > costs;
+  QVector< int > tree;
+  StopAtVertex stop( targetVertexIdx );
+  compactDijkstra( source, QVector<int>() << startVertexIdx, QVector<double>(), criterionNum, costs, &tree, stop );
+
+  if ( resultTree != NULL )
+  {
+    // Report the arcs by their index in the source graph
+    for ( int i = 0, n = tree.size(); i < n; ++i )
+    {
+      if ( tree[ i ] != -1 )
+      {
+        tree[ i ] = source->arcId( tree[ i ] );
+      }
+    }
+    *resultTree = tree;
+  }
+  if ( resultCost != NULL )
+  {
+    *resultCost = costs;
+  }
+}
+
+void QgsGraphAnalyzer::dijkstra( const QgsCompactGraph* source, const QVector<int>& startVertices, const QVector<double>& startCosts, int criterionNum, QVector<int>* resultTree, QVector<double>* resultCost, const QVector<int>& targetVertices )
+{
+  QVector<bool> isTarget( source->vertexCount(), false );
+  int nTargets = 0;
+  foreach ( int vertexIdx, targetVertices )
+  {
+    if ( !isTarget[ vertexIdx ] )
+    {
+      isTarget[ vertexIdx ] = true;
+      ++nTargets;
+    }
+  }
+
+  QVector< double > costs;
+  QVector< int > tree;
+  StopAtAllVertices stop( isTarget, nTargets );
+  compactDijkstra( source, startVertices, startCosts, criterionNum, costs, &tree, stop );
+
+  if ( resultTree != NULL )
+  {
+    // Report the arcs by their index in the source graph
+    for ( int i = 0, n = tree.size(); i < n; ++i )
+    {
+      if ( tree[ i ] != -1 )
+      {
+        tree[ i ] = source->arcId( tree[ i ] );
+      }
+    }
+    *resultTree = tree;
+  }
+  if ( resultCost != NULL )
+  {
+    *resultCost = costs;
+  }
+}
+
+QVector< QVector<double> > QgsGraphAnalyzer::costMatrix( const QgsCompactGraph* source, const QVector<int>& originVertices, const QVector<int>& destinationVertices, int criterionNum )
+{
+  QVector<bool> isDestination( source->vertexCount(), false );
+  int nDestinations = 0;
+  foreach ( int vertexIdx, destinationVertices )
+  {
+    if ( !isDestination[ vertexIdx ] )
+    {
+      isDestination[ vertexIdx ] = true;
+      ++nDestinations;
+    }
+  }
+
+  QVector< QVector<double> > matrix( originVertices.size() );
+  QVector<int> rows;
+  for ( int i = 0, n = originVertices.size(); i < n; ++i )
+  {
+    rows.append( i );
+  }
+  // One search per origin, each worker only writes its own row
+  QtConcurrent::blockingMap( rows, CostMatrixWorker( source, criterionNum, originVertices, destinationVertices, isDestination, nDestinations, matrix.data() ) );
+  return matrix;
+}
+
+QVector< QVector<int> > QgsGraphAnalyzer::isochrones( const QgsCompactGraph* source, const QVector<int>& startVertices, int criterionNum, const QVector<double>& thresholds )
+{
+  QVector< QVector<int> > result( thresholds.size() );
+  if ( thresholds.isEmpty() || startVertices.isEmpty() )
+  {
+    return result;
+  }
+
+  // Threshold indices by increasing threshold
+  QVector< QPair<double, int> > sortedThresholds;
+  for ( int i = 0, n = thresholds.size(); i < n; ++i )
+  {
+    sortedThresholds.append( qMakePair( thresholds[ i ], i ) );
+  }
+  qSort( sortedThresholds );
+  double maxCost = sortedThresholds.last().first;
+
+  // Vertices cheaper than the largest threshold are final when the search stops
+  QVector<double> costs;
+  StopAboveCost stop( maxCost );
+  compactDijkstra( source, startVertices, QVector<double>(), criterionNum, costs, 0, stop );
+
+  const double* arcCosts = source->arcCosts( criterionNum );
+  for ( int v = 0, nVertices = source->vertexCount(); v < nVertices; ++v )
+  {
+    if ( costs[ v ] > maxCost )
+    {
+      continue;
+    }
+    for ( int a = source->outArcBegin( v ), aEnd = source->outArcEnd( v ); a < aEnd; ++a )
+    {
+      // The cost at the end of the arc when traversing it, which may exceed the cost of its end vertex
+      double endCost = costs[ v ] + arcCosts[ a ];
+      for ( int k = sortedThresholds.size() - 1; k >= 0 && sortedThresholds[ k ].first >= endCost; --k )
+      {
+        result[ sortedThresholds[ k ].second ].append( source->arcId( a ) );
+      }
+    }
+  }
+  return result;
+}
+
 QgsGraph* QgsGraphAnalyzer::shortestTree( const QgsGraph* source, int startVertexIdx, int criterionNum )
 {
   QgsGraph *treeResult = new QgsGraph();
@@ -122,3 +376,52 @@ QgsGraph* QgsGraphAnalyzer::shortestTree( const QgsGraph* source, int startVerte
 
   return treeResult;
 }
+
+QgsGraph* QgsGraphAnalyzer::shortestTree( const QgsCompactGraph* source, int startVertexIdx, int criterionNum, int targetVertexIdx )
+{
+  QgsGraph *treeResult = new QgsGraph();
+  QVector<int> tree;
+
+  QgsGraphAnalyzer::dijkstra( source, startVertexIdx, criterionNum, &tree, NULL, targetVertexIdx );
+
+  if ( targetVertexIdx != -1 )
+  {
+    // Only keep the arcs on the path to the target
+    QVector<int> path( tree.size(), -1 );
+    for ( int v = targetVertexIdx; tree[ v ] != -1; v = source->arcOutVertex( source->compactArcIdx( tree[ v ] ) ) )
+    {
+      path[ v ] = tree[ v ];
+    }
+    tree = path;
+  }
+
+  // sourceVertexIdx2resultVertexIdx
+  QVector<int> source2result( tree.size(), -1 );
+
+  // Add reachable vertices to the result
+  source2result[ startVertexIdx ] = treeResult->addVertex( source->vertexPoint( startVertexIdx ) );
+  for ( int i = 0; i < source->vertexCount(); ++i )
+  {
+    if ( tree[ i ] != -1 )
+    {
+      source2result[ i ] = treeResult->addVertex( source->vertexPoint( i ) );
+    }
+  }
+
+  // Add arcs to result, with the costs of all criteria as properties
+  for ( int i = 0; i < source->vertexCount(); ++i )
+  {
+    if ( tree[ i ] != -1 )
+    {
+      int arcIdx = source->compactArcIdx( tree[ i ] );
+      QVector< QVariant > properties( source->criterionCount() );
+      for ( int c = 0; c < source->criterionCount(); ++c )
+      {
+        properties[ c ] = source->arcCosts( c )[ arcIdx ];
+      }
+      treeResult->addArc( source2result[ source->arcOutVertex( arcIdx )], source2result[ i ], properties );
+    }
+  }
+
+  return treeResult;
+}
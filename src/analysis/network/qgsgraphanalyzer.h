@@ -22,6 +22,7 @@
 #include <QVector>
 
 // forward-declaration
+class QgsCompactGraph;
 class QgsGraph;
 
 /** \ingroup networkanalysis
@@ -48,5 +49,58 @@ class ANALYSIS_EXPORT QgsGraphAnalyzer
      * @param criterionNum index of edge property as optimization criterion
      */
     static QgsGraph* shortestTree( const QgsGraph* source, int startVertexIdx, int criterionNum );
+
+    /**
+     * solve shortest path problem using dijkstra algorithm on the compact representation of a graph
+     * @param source The source graph
+     * @param startVertexIdx index of start vertex
+     * @param criterionNum index of arc property as optimization criterion
+     * @param resultTree array represents the shortest path tree. resultTree[ vertexIndex ] == inboundingArcIndex (in the graph the compact graph was built from) if vertex reacheble and resultTree[ vertexIndex ] == -1 others.
+     * @param resultCost array of cost paths
+     * @param targetVertexIdx if not -1, the search stops as soon as the shortest path to this vertex is known. Only the entries of vertices on that path are final then.
+     */
+    static void dijkstra( const QgsCompactGraph* source, int startVertexIdx, int criterionNum, QVector<int>* resultTree = NULL, QVector<double>* resultCost = NULL, int targetVertexIdx = -1 );
+
+    /**
+     * solve shortest path problem from several start vertices with initial costs, e.g. the costs from a point between vertices to them
+     * @param source The source graph
+     * @param startVertices indices of the start vertices
+     * @param startCosts initial cost of each start vertex
+     * @param criterionNum index of arc property as optimization criterion
+     * @param resultTree array represents the shortest path tree, as for a single start vertex. The path of a vertex leads back to the start vertex with resultTree[ vertexIndex ] == -1 it is reached from.
+     * @param resultCost array of cost paths, including the initial cost
+     * @param targetVertices if not empty, the search stops as soon as the shortest paths to all these vertices are known. Only the entries of vertices on these paths are final then.
+     * @note added in 2.16
+     */
+    static void dijkstra( const QgsCompactGraph* source, const QVector<int>& startVertices, const QVector<double>& startCosts, int criterionNum, QVector<int>* resultTree = NULL, QVector<double>* resultCost = NULL, const QVector<int>& targetVertices = QVector<int>() );
+
+    /**
+     * return shortest path tree with root-node in startVertexIdx
+     * @param source The source graph
+     * @param startVertexIdx index of start vertex
+     * @param criterionNum index of edge property as optimization criterion
+     * @param targetVertexIdx if not -1, the tree only contains the shortest path to this vertex. If the vertex is not reachable, the tree only contains the start vertex
+     */
+    static QgsGraph* shortestTree( const QgsCompactGraph* source, int startVertexIdx, int criterionNum, int targetVertexIdx = -1 );
+
+    /**
+     * compute the costs of the shortest paths from each origin to each destination. The origins are processed in parallel.
+     * @param source The source graph
+     * @param originVertices indices of the origin vertices
+     * @param destinationVertices indices of the destination vertices
+     * @param criterionNum index of arc property as optimization criterion
+     * @return matrix[ originIndex ][ destinationIndex ], infinity if the destination is not reachable
+     */
+    static QVector< QVector<double> > costMatrix( const QgsCompactGraph* source, const QVector<int>& originVertices, const QVector<int>& destinationVertices, int criterionNum );
+
+    /**
+     * compute the arcs reachable within several costs from the nearest of the start vertices, in one search
+     * @param source The source graph
+     * @param startVertices indices of the start vertices
+     * @param criterionNum index of arc property as optimization criterion
+     * @param thresholds the maximum costs
+     * @return for each threshold, the indices (in the graph the compact graph was built from) of the arcs which can be traversed completely within it, i.e. the cost of their start vertex plus their own cost does not exceed it
+     */
+    static QVector< QVector<int> > isochrones( const QgsCompactGraph* source, const QVector<int>& startVertices, int criterionNum, const QVector<double>& thresholds );
 };
 #endif //QGSGRAPHANALYZERH
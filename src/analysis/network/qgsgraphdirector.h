@@ -69,6 +69,13 @@ class ANALYSIS_EXPORT QgsGraphDirector : public QObject
       mProperterList.push_back( prop );
     }
 
+    /**
+     * Returns the properters, in the order of the arc properties they compute
+     * @note added in 2.16
+     * @note not available in python bindings
+     */
+    const QList<QgsArcProperter*>& properters() const { return mProperterList; }
+
     /**
      * return Director name
      */
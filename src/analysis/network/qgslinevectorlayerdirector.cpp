@@ -25,78 +25,221 @@
 #include <qgsdistancearea.h>
 
 // QT includes
+#include <QHash>
 #include <QString>
 #include <QtAlgorithms>
 
 //standard includes
+#include <cstring>
 #include <limits>
-#include <algorithm>
+#include <map>
 
-class QgsPointCompare
+/** Vertices closer than the topology tolerance share the same key */
+struct TopologyKey
 {
-  public:
-    QgsPointCompare( double tolerance ) :
-        mTolerance( tolerance )
-    {  }
-
-    bool operator()( const QgsPoint& p1, const QgsPoint& p2 ) const
-    {
-      if ( mTolerance <= 0 )
-        return p1.x() == p2.x() ? p1.y() < p2.y() : p1.x() < p2.x();
-
-      double tx1 = ceil( p1.x() / mTolerance );
-      double tx2 = ceil( p2.x() / mTolerance );
-      if ( tx1 == tx2 )
-        return ceil( p1.y() / mTolerance ) < ceil( p2.y() / mTolerance );
-      return tx1 < tx2;
-    }
-
-  private:
-    double mTolerance;
-};
-
-template <typename RandIter, typename Type, typename CompareOp > RandIter my_binary_search( RandIter begin, RandIter end, Type val, CompareOp comp )
-{
-  // result if not found
-  RandIter not_found = end;
-
-  while ( true )
+  TopologyKey( const QgsPoint& pt, double tolerance )
   {
-    RandIter avg = begin + ( end - begin ) / 2;
-    if ( begin == avg || end == avg )
+    if ( tolerance <= 0 )
     {
-      if ( !comp( *begin, val ) && !comp( val, *begin ) )
-        return begin;
-      if ( !comp( *end, val ) && !comp( val, *end ) )
-        return end;
-
-      return not_found;
+      x = pt.x();
+      y = pt.y();
     }
-    if ( comp( val, *avg ) )
-      end = avg;
-    else if ( comp( *avg, val ) )
-      begin = avg;
     else
-      return avg;
+    {
+      x = ceil( pt.x() / tolerance );
+      y = ceil( pt.y() / tolerance );
+    }
+    // -0.0 and +0.0 are equal but have different bit patterns, ceil yields -0.0 for small negative values
+    x += 0.0;
+    y += 0.0;
   }
+  bool operator==( const TopologyKey& other ) const { return x == other.x && y == other.y; }
+
+  double x;
+  double y;
+};
 
-  return not_found;
+inline uint qHash( const TopologyKey& key )
+{
+  // Hash the bit patterns, truncating the coordinates would put all vertices of a geographic layer in a few buckets
+  quint64 bx, by;
+  memcpy( &bx, &key.x, sizeof( bx ) );
+  memcpy( &by, &key.y, sizeof( by ) );
+  return qHash( bx ) ^( qHash( by ) * 31 );
 }
 
-struct TiePointInfo
+struct TieSegment
 {
-  QgsPoint mTiedPoint;
-  double mLength;
   QgsPoint mFirstPoint;
   QgsPoint mLastPoint;
+  int mFirstVertex;
+  int mLastVertex;
 };
 
-bool TiePointInfoCompare( const TiePointInfo& a, const TiePointInfo& b )
+/** Uniform grid over the segments of the layer, used to find the segment nearest to a tie point */
+class TieSegmentGrid
 {
-  if ( a.mFirstPoint == b.mFirstPoint )
-    return a.mLastPoint.x() == b.mLastPoint.x() ? a.mLastPoint.y() < b.mLastPoint.y() : a.mLastPoint.x() < b.mLastPoint.x();
+  public:
+    TieSegmentGrid( const QVector< TieSegment >& segments )
+        : mSegments( segments )
+        , mCols( 0 )
+        , mRows( 0 )
+    {
+      if ( segments.isEmpty() )
+        return;
+
+      QgsRectangle extent( segments[0].mFirstPoint, segments[0].mFirstPoint );
+      foreach ( const TieSegment& segment, segments )
+      {
+        extent.combineExtentWith( segment.mFirstPoint.x(), segment.mFirstPoint.y() );
+        extent.combineExtentWith( segment.mLastPoint.x(), segment.mLastPoint.y() );
+      }
+      mXMin = extent.xMinimum();
+      mYMin = extent.yMinimum();
+
+      // About one segment per cell
+      int n = segments.size();
+      mCellSize = sqrt( extent.width() * extent.height() / n );
+      if ( mCellSize <= 0 )
+        mCellSize = qMax( extent.width(), extent.height() ) / n;
+      if ( mCellSize <= 0 )
+        mCellSize = 1.;
+      mCols = qMin( int( extent.width() / mCellSize ) + 1, n );
+      mRows = qMin( int( extent.height() / mCellSize ) + 1, n );
+      mCellSize = qMax( mCellSize, qMax( extent.width() / mCols, extent.height() / mRows ) );
+
+      // Two passes: count the segments of each cell, then fill the cells
+      mCellOffsets.fill( 0, mCols * mRows + 1 );
+      for ( int pass = 0; pass < 2; ++pass )
+      {
+        QVector< int > fill;
+        if ( pass == 1 )
+        {
+          for ( int i = 0, nCells = mCols * mRows; i < nCells; ++i )
+            mCellOffsets[ i + 1 ] += mCellOffsets[ i ];
+          mCellSegments.resize( mCellOffsets.last() );
+          fill = mCellOffsets;
+        }
+        for ( int i = 0; i < n; ++i )
+        {
+          const TieSegment& segment = segments[ i ];
+          int c0 = col( qMin( segment.mFirstPoint.x(), segment.mLastPoint.x() ) );
+          int c1 = col( qMax( segment.mFirstPoint.x(), segment.mLastPoint.x() ) );
+          int r0 = row( qMin( segment.mFirstPoint.y(), segment.mLastPoint.y() ) );
+          int r1 = row( qMax( segment.mFirstPoint.y(), segment.mLastPoint.y() ) );
+          for ( int r = r0; r <= r1; ++r )
+          {
+            for ( int c = c0; c <= c1; ++c )
+            {
+              if ( pass == 0 )
+                ++mCellOffsets[ r * mCols + c + 1 ];
+              else
+                mCellSegments[ fill[ r * mCols + c ]++ ] = i;
+            }
+          }
+        }
+      }
+    }
+
+    /**
+     * Returns the index of the segment nearest to pt, or -1 if there are no segments.
+     * Of several segments at the same distance, the one with the lowest index is returned.
+     */
+    int nearestSegment( const QgsPoint& pt, QgsPoint& tiedPoint, double& sqrDist ) const
+    {
+      int best = -1;
+      sqrDist = std::numeric_limits<double>::infinity();
+      if ( mCols == 0 )
+        return best;
+
+      // Search rings of cells around the cell of the point until no unvisited cell can be nearer
+      int cx = col( pt.x() );
+      int cy = row( pt.y() );
+      for ( int ring = 0; ; ++ring )
+      {
+        int c0 = cx - ring, c1 = cx + ring, r0 = cy - ring, r1 = cy + ring;
+        for ( int r = qMax( r0, 0 ); r <= qMin( r1, mRows - 1 ); ++r )
+        {
+          if ( r == r0 || r == r1 )
+          {
+            for ( int c = qMax( c0, 0 ); c <= qMin( c1, mCols - 1 ); ++c )
+              testCell( r * mCols + c, pt, best, sqrDist, tiedPoint );
+          }
+          else
+          {
+            if ( c0 >= 0 )
+              testCell( r * mCols + c0, pt, best, sqrDist, tiedPoint );
+            if ( c1 < mCols )
+              testCell( r * mCols + c1, pt, best, sqrDist, tiedPoint );
+          }
+        }
+
+        // Distance from the point to the nearest cell outside of the visited rings
+        double bound = std::numeric_limits<double>::infinity();
+        if ( c0 > 0 )
+          bound = qMin( bound, pt.x() - ( mXMin + c0 * mCellSize ) );
+        if ( c1 < mCols - 1 )
+          bound = qMin( bound, mXMin + ( c1 + 1 ) * mCellSize - pt.x() );
+        if ( r0 > 0 )
+          bound = qMin( bound, pt.y() - ( mYMin + r0 * mCellSize ) );
+        if ( r1 < mRows - 1 )
+          bound = qMin( bound, mYMin + ( r1 + 1 ) * mCellSize - pt.y() );
+        if ( bound == std::numeric_limits<double>::infinity() || ( best != -1 && sqrDist <= bound * bound ) )
+          break;
+      }
+      return best;
+    }
+
+  private:
+    const QVector< TieSegment >& mSegments;
+    double mXMin;
+    double mYMin;
+    double mCellSize;
+    int mCols;
+    int mRows;
+    QVector< int > mCellOffsets;
+    QVector< int > mCellSegments;
+
+    void testCell( int cell, const QgsPoint& pt, int& best, double& sqrDist, QgsPoint& tiedPoint ) const
+    {
+      for ( int k = mCellOffsets[ cell ], kEnd = mCellOffsets[ cell + 1 ]; k < kEnd; ++k )
+      {
+        int i = mCellSegments[ k ];
+        const TieSegment& segment = mSegments[ i ];
+        QgsPoint closest;
+        double dist;
+        if ( segment.mFirstPoint == segment.mLastPoint )
+        {
+          dist = pt.sqrDist( segment.mFirstPoint );
+          closest = segment.mFirstPoint;
+        }
+        else
+        {
+          dist = pt.sqrDistToSegment( segment.mFirstPoint.x(), segment.mFirstPoint.y(),
+                                      segment.mLastPoint.x(), segment.mLastPoint.y(), closest );
+        }
+        if ( dist < sqrDist || ( dist == sqrDist && i < best ) )
+        {
+          sqrDist = dist;
+          best = i;
+          tiedPoint = closest;
+        }
+      }
+    }
+    int col( double x ) const { return ( int ) qBound( 0., floor(( x - mXMin ) / mCellSize ), mCols - 1. ); }
+    int row( double y ) const { return ( int ) qBound( 0., floor(( y - mYMin ) / mCellSize ), mRows - 1. ); }
+};
 
-  return a.mFirstPoint.x() == b.mFirstPoint.x() ? a.mFirstPoint.y() < b.mFirstPoint.y() : a.mFirstPoint.x() < b.mFirstPoint.x();
+static QgsMultiPolyline featurePolylines( const QgsFeature& feature )
+{
+  QgsMultiPolyline mpl;
+  if ( !feature.constGeometry() )
+    return mpl;
+  if ( feature.constGeometry()->wkbType() == QGis::WKBMultiLineString )
+    mpl = feature.constGeometry()->asMultiPolyline();
+  else if ( feature.constGeometry()->wkbType() == QGis::WKBLineString )
+    mpl.push_back( feature.constGeometry()->asPolyline() );
+  return mpl;
 }
 
 QgsLineVectorLayerDirector::QgsLineVectorLayerDirector( QgsVectorLayer *myLayer,
@@ -149,99 +292,94 @@ void QgsLineVectorLayerDirector::makeGraph( QgsGraphBuilderInterface *builder, c
 
   tiedPoint = QVector< QgsPoint >( additionalPoints.size(), QgsPoint( 0.0, 0.0 ) );
 
-  TiePointInfo tmpInfo;
-  tmpInfo.mLength = std::numeric_limits<double>::infinity();
-
-  QVector< TiePointInfo > pointLengthMap( additionalPoints.size(), tmpInfo );
-  QVector< TiePointInfo >::iterator pointLengthIt;
-
-  //Graph's points;
+  //Graph's points, vertices within the topology tolerance are merged into the first one
+  double tolerance = builder->topologyTolerance();
   QVector< QgsPoint > points;
+  QHash< TopologyKey, int > pointIndex;
+
+  //Segments of all features, and the range of segments of each feature
+  QVector< TieSegment > segments;
+  QHash< QgsFeatureId, QPair< int, int > > featureSegments;
 
   QgsFeatureIterator fit = vl->getFeatures( QgsFeatureRequest().setSubsetOfAttributes( QgsAttributeList() ) );
 
-  // begin: tie points to the graph
+  // begin: collect the vertices and segments
   QgsAttributeList la;
   QgsFeature feature;
   while ( fit.nextFeature( feature ) )
   {
-    QgsMultiPolyline mpl;
-    if ( feature.geometry()->wkbType() == QGis::WKBMultiLineString )
-      mpl = feature.geometry()->asMultiPolyline();
-    else if ( feature.geometry()->wkbType() == QGis::WKBLineString )
-      mpl.push_back( feature.geometry()->asPolyline() );
+    int firstSegment = segments.size();
+    QgsMultiPolyline mpl = featurePolylines( feature );
 
     QgsMultiPolyline::iterator mplIt;
     for ( mplIt = mpl.begin(); mplIt != mpl.end(); ++mplIt )
     {
-      QgsPoint pt1, pt2;
+      TieSegment segment;
       bool isFirstPoint = true;
       QgsPolyline::iterator pointIt;
       for ( pointIt = mplIt->begin(); pointIt != mplIt->end(); ++pointIt )
       {
-        pt2 = ct.transform( *pointIt );
-        points.push_back( pt2 );
+        segment.mLastPoint = ct.transform( *pointIt );
+        TopologyKey key( segment.mLastPoint, tolerance );
+        QHash< TopologyKey, int >::const_iterator idxIt = pointIndex.constFind( key );
+        if ( idxIt == pointIndex.constEnd() )
+        {
+          idxIt = pointIndex.insert( key, points.size() );
+          points.push_back( segment.mLastPoint );
+        }
+        segment.mLastVertex = idxIt.value();
 
         if ( !isFirstPoint )
         {
-          int i = 0;
-          for ( i = 0; i != additionalPoints.size(); ++i )
-          {
-            TiePointInfo info;
-            if ( pt1 == pt2 )
-            {
-              info.mLength = additionalPoints[ i ].sqrDist( pt1 );
-              info.mTiedPoint = pt1;
-            }
-            else
-            {
-              info.mLength = additionalPoints[ i ].sqrDistToSegment( pt1.x(), pt1.y(),
-                             pt2.x(), pt2.y(), info.mTiedPoint );
-            }
-
-            if ( pointLengthMap[ i ].mLength > info.mLength )
-            {
-              Q_UNUSED( info.mTiedPoint );
-              info.mFirstPoint = pt1;
-              info.mLastPoint = pt2;
-
-              pointLengthMap[ i ] = info;
-              tiedPoint[ i ] = info.mTiedPoint;
-            }
-          }
+          segments.push_back( segment );
         }
-        pt1 = pt2;
+        segment.mFirstPoint = segment.mLastPoint;
+        segment.mFirstVertex = segment.mLastVertex;
         isFirstPoint = false;
       }
     }
+    featureSegments.insert( feature.id(), qMakePair( firstSegment, segments.size() ) );
     emit buildProgress( ++step, featureCount );
   }
+  // end: collect the vertices and segments
+
+  // begin: tie points to the graph
+  QMultiHash< int, int > segmentTiePoints;
+  {
+    TieSegmentGrid grid( segments );
+    for ( int i = 0; i < additionalPoints.size(); ++i )
+    {
+      double sqrDist;
+      int segmentIdx = grid.nearestSegment( additionalPoints[ i ], tiedPoint[ i ], sqrDist );
+      if ( segmentIdx != -1 && tiedPoint[ i ] != QgsPoint( 0.0, 0.0 ) )
+      {
+        segmentTiePoints.insert( segmentIdx, i );
+      }
+    }
+  }
   // end: tie points to graph
 
   // add tied point to graph
-  int i = 0;
-  for ( i = 0; i < tiedPoint.size(); ++i )
+  QVector< int > tiedVertex( tiedPoint.size(), -1 );
+  for ( int i = 0; i < tiedPoint.size(); ++i )
   {
     if ( tiedPoint[ i ] != QgsPoint( 0.0, 0.0 ) )
     {
-      points.push_back( tiedPoint [ i ] );
+      TopologyKey key( tiedPoint[ i ], tolerance );
+      QHash< TopologyKey, int >::const_iterator idxIt = pointIndex.constFind( key );
+      if ( idxIt == pointIndex.constEnd() )
+      {
+        idxIt = pointIndex.insert( key, points.size() );
+        points.push_back( tiedPoint[ i ] );
+      }
+      tiedVertex[ i ] = idxIt.value();
+      tiedPoint[ i ] = points[ tiedVertex[ i ] ];
     }
   }
 
-  QgsPointCompare pointCompare( builder->topologyTolerance() );
-
-  qSort( points.begin(), points.end(), pointCompare );
-  QVector< QgsPoint >::iterator tmp = std::unique( points.begin(), points.end() );
-  points.resize( tmp - points.begin() );
-
-  for ( i = 0;i < points.size();++i )
+  for ( int i = 0; i < points.size(); ++i )
     builder->addVertex( i, points[ i ] );
 
-  for ( i = 0; i < tiedPoint.size() ; ++i )
-    tiedPoint[ i ] = *( my_binary_search( points.begin(), points.end(), tiedPoint[ i ], pointCompare ) );
-
-  qSort( pointLengthMap.begin(), pointLengthMap.end(), TiePointInfoCompare );
-
   {
     // fill attribute list 'la'
     QgsAttributeList tmpAttr;
@@ -299,96 +437,55 @@ void QgsLineVectorLayerDirector::makeGraph( QgsGraphBuilderInterface *builder, c
     }
 
     // begin features segments and add arc to the Graph;
-    QgsMultiPolyline mpl;
-    if ( feature.geometry()->wkbType() == QGis::WKBMultiLineString )
-      mpl = feature.geometry()->asMultiPolyline();
-    else if ( feature.geometry()->wkbType() == QGis::WKBLineString )
-      mpl.push_back( feature.geometry()->asPolyline() );
-
-    QgsMultiPolyline::iterator mplIt;
-    for ( mplIt = mpl.begin(); mplIt != mpl.end(); ++mplIt )
+    QPair< int, int > range = featureSegments.value( feature.id(), qMakePair( 0, 0 ) );
+    for ( int segmentIdx = range.first; segmentIdx < range.second; ++segmentIdx )
     {
-      QgsPoint pt1, pt2;
+      const TieSegment& segment = segments[ segmentIdx ];
 
+      std::map< double, int > pointsOnArc;
+      pointsOnArc[ 0.0 ] = segment.mFirstVertex;
+      pointsOnArc[ segment.mFirstPoint.sqrDist( segment.mLastPoint )] = segment.mLastVertex;
+
+      QMultiHash< int, int >::const_iterator tieIt = segmentTiePoints.constFind( segmentIdx );
+      for ( ; tieIt != segmentTiePoints.constEnd() && tieIt.key() == segmentIdx; ++tieIt )
+      {
+        pointsOnArc[ segment.mFirstPoint.sqrDist( tiedPoint[ tieIt.value()] )] = tiedVertex[ tieIt.value()];
+      }
+
+      std::map< double, int >::iterator pointsIt;
+      int pt1idx = -1, pt2idx = -1;
       bool isFirstPoint = true;
-      QgsPolyline::iterator pointIt;
-      for ( pointIt = mplIt->begin(); pointIt != mplIt->end(); ++pointIt )
+      for ( pointsIt = pointsOnArc.begin(); pointsIt != pointsOnArc.end(); ++pointsIt )
       {
-        pt2 = ct.transform( *pointIt );
+        pt2idx = pointsIt->second;
 
-        if ( !isFirstPoint )
+        if ( !isFirstPoint && pt1idx != pt2idx )
         {
-          std::map< double, QgsPoint > pointsOnArc;
-          pointsOnArc[ 0.0 ] = pt1;
-          pointsOnArc[ pt1.sqrDist( pt2 )] = pt2;
-
-          TiePointInfo t;
-          t.mFirstPoint = pt1;
-          t.mLastPoint  = pt2;
-          pointLengthIt = my_binary_search( pointLengthMap.begin(), pointLengthMap.end(), t, TiePointInfoCompare );
-
-          if ( pointLengthIt != pointLengthMap.end() )
+          const QgsPoint& pt1 = points[ pt1idx ];
+          const QgsPoint& pt2 = points[ pt2idx ];
+          double distance = builder->distanceArea()->measureLine( pt1, pt2 );
+          QVector< QVariant > prop;
+          QList< QgsArcProperter* >::const_iterator it;
+          for ( it = mProperterList.begin(); it != mProperterList.end(); ++it )
           {
-            QVector< TiePointInfo >::iterator it;
-            for ( it = pointLengthIt; it - pointLengthMap.begin() >= 0; --it )
-            {
-              if ( it->mFirstPoint == pt1 && it->mLastPoint == pt2 )
-              {
-                pointsOnArc[ pt1.sqrDist( it->mTiedPoint )] = it->mTiedPoint;
-              }
-            }
-            for ( it = pointLengthIt + 1; it != pointLengthMap.end(); ++it )
-            {
-              if ( it->mFirstPoint == pt1 && it->mLastPoint == pt2 )
-              {
-                pointsOnArc[ pt1.sqrDist( it->mTiedPoint )] = it->mTiedPoint;
-              }
-            }
+            prop.push_back(( *it )->property( distance, feature ) );
           }
 
-          std::map< double, QgsPoint >::iterator pointsIt;
-          QgsPoint pt1;
-          QgsPoint pt2;
-          int pt1idx = -1, pt2idx = -1;
-          bool isFirstPoint = true;
-          for ( pointsIt = pointsOnArc.begin(); pointsIt != pointsOnArc.end(); ++pointsIt )
+          if ( directionType == 1 ||
+               directionType == 3 )
           {
-            pt2 = pointsIt->second;
-            tmp = my_binary_search( points.begin(), points.end(), pt2, pointCompare );
-            pt2 = *tmp;
-            pt2idx = tmp - points.begin();
-
-            if ( !isFirstPoint && pt1 != pt2 )
-            {
-              double distance = builder->distanceArea()->measureLine( pt1, pt2 );
-              QVector< QVariant > prop;
-              QList< QgsArcProperter* >::const_iterator it;
-              for ( it = mProperterList.begin(); it != mProperterList.end(); ++it )
-              {
-                prop.push_back(( *it )->property( distance, feature ) );
-              }
-
-              if ( directionType == 1 ||
-                   directionType == 3 )
-              {
-                builder->addArc( pt1idx, pt1, pt2idx, pt2, prop );
-              }
-              if ( directionType == 2 ||
-                   directionType == 3 )
-              {
-                builder->addArc( pt2idx, pt2, pt1idx, pt1, prop );
-              }
-            }
-            pt1idx = pt2idx;
-            pt1 = pt2;
-            isFirstPoint = false;
+            builder->addArc( pt1idx, pt1, pt2idx, pt2, prop );
+          }
+          if ( directionType == 2 ||
+               directionType == 3 )
+          {
+            builder->addArc( pt2idx, pt2, pt1idx, pt1, prop );
           }
-        } // if ( !isFirstPoint )
-        pt1 = pt2;
+        }
+        pt1idx = pt2idx;
         isFirstPoint = false;
-      } // for (it = pl.begin(); it != pl.end(); ++it)
+      }
     }
     emit buildProgress( ++step, featureCount );
   } // while( vl->nextFeature(feature) )
 } // makeGraph( QgsGraphBuilderInterface *builder, const QVector< QgsPoint >& additionalPoints, QVector< QgsPoint >& tiedPoint )
-
@@ -35,7 +35,11 @@ float QgsAspectFilter::processNineCellWindow(
 {
   float derX = calcFirstDerX( x11, x21, x31, x12, x22, x32, x13, x23, x33 );
   float derY = calcFirstDerY( x11, x21, x31, x12, x22, x32, x13, x23, x33 );
+  return processDerivatives( derX, derY );
+}
 
+float QgsAspectFilter::processDerivatives( float derX, float derY )
+{
   if ( derX == mOutputNodataValue ||
        derY == mOutputNodataValue ||
        ( derX == 0.0 && derY == 0.0 ) )
@@ -48,3 +52,12 @@ float QgsAspectFilter::processNineCellWindow(
   }
 }
 
+void QgsAspectFilter::processNineCellRow( float* above, float* row, float* below, float* result, int n )
+{
+  for ( int j = 0; j < n; ++j )
+  {
+    float derX, derY;
+    calcFirstDers( above, row, below, j, derX, derY );
+    result[j] = QgsAspectFilter::processDerivatives( derX, derY );
+  }
+}
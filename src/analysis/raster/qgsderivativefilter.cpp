@@ -28,6 +28,13 @@ QgsDerivativeFilter::~QgsDerivativeFilter()
 
 }
 
+float QgsDerivativeFilter::processDerivatives( float derX, float derY )
+{
+  Q_UNUSED( derX );
+  Q_UNUSED( derY );
+  return mOutputNodataValue;
+}
+
 float QgsDerivativeFilter::calcFirstDerX( float* x11, float* x21, float* x31, float* x12, float* x22, float* x32, float* x13, float* x23, float* x33 )
 {
   //the basic formula would be simple, but we need to test for nodata values...
@@ -31,11 +31,41 @@ class ANALYSIS_EXPORT QgsDerivativeFilter : public QgsNineCellFilter
                                          float* x12, float* x22, float* x32,
                                          float* x13, float* x23, float* x33 ) override = 0;
 
-  protected:
+    /**Calculates the output value from the first order derivatives, which are equal to the output nodata value if they
+      could not be computed. Allows computing several products from the same derivatives. The default implementation returns nodata*/
+    virtual float processDerivatives( float derX, float derY );
+
     /**Calculates the first order derivative in x-direction according to Horn (1981)*/
     float calcFirstDerX( float* x11, float* x21, float* x31, float* x12, float* x22, float* x32, float* x13, float* x23, float* x33 );
     /**Calculates the first order derivative in y-direction according to Horn (1981)*/
     float calcFirstDerY( float* x11, float* x21, float* x31, float* x12, float* x22, float* x32, float* x13, float* x23, float* x33 );
+
+    /**Calculates both first order derivatives of the cell j of a row passed to processNineCellRow. Cells whose
+      neighbours are all valid take the plain Horn formula, the others calcFirstDerX and calcFirstDerY, with identical results.
+      Public, so that the terrain processor computes the derivatives shared by its products the same way
+      @note added in 2.16
+      @note not available in python bindings*/
+    inline void calcFirstDers( float* above, float* row, float* below, int j, float& derX, float& derY )
+    {
+      if ( above[j-1] != mInputNodataValue && above[j] != mInputNodataValue && above[j+1] != mInputNodataValue &&
+           row[j-1] != mInputNodataValue && row[j+1] != mInputNodataValue &&
+           below[j-1] != mInputNodataValue && below[j] != mInputNodataValue && below[j+1] != mInputNodataValue )
+      {
+        double sumX = ( above[j+1] - above[j-1] );
+        sumX += 2 * ( row[j+1] - row[j-1] );
+        sumX += ( below[j+1] - below[j-1] );
+        derX = sumX / ( 8 * mCellSizeX * mZFactor );
+        double sumY = ( above[j-1] - below[j-1] );
+        sumY += 2 * ( above[j] - below[j] );
+        sumY += ( above[j+1] - below[j+1] );
+        derY = sumY / ( 8 * mCellSizeY * mZFactor );
+      }
+      else
+      {
+        derX = calcFirstDerX( &above[j-1], &above[j], &above[j+1], &row[j-1], &row[j], &row[j+1], &below[j-1], &below[j], &below[j+1] );
+        derY = calcFirstDerY( &above[j-1], &above[j], &above[j+1], &row[j-1], &row[j], &row[j+1], &below[j-1], &below[j], &below[j+1] );
+      }
+    }
 };
 
 #endif // QGSDERIVATIVEFILTER_H
@@ -0,0 +1,227 @@
+/***************************************************************************
+                          qgsheightprofilesampler.cpp  -  Height profile sampling
+                          ---------------------------
+    begin                : October 2015
+    copyright            : (C) 2015 by Sandro Mani
+    email                : manisandro@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsheightprofilesampler.h"
+#include "qgscoordinatetransform.h"
+#include "qgscsexception.h"
+#include "qgslogger.h"
+#include "qgspoint.h"
+#include <QFileInfo>
+#include <qmath.h>
+#include <cstring>
+
+// Edge length of the cached pixel blocks
+static const int TILE_SIZE = 256;
+// Maximum number of cached pixels (i.e. 64MB of doubles)
+static const int TILE_CACHE_PIXELS = 8 * 1024 * 1024;
+
+QgsHeightProfileSampler::QgsHeightProfileSampler( const QString& rasterFile )
+    : mRasterFile( rasterFile )
+    , mRasterSize( 0 )
+    , mDataset( 0 )
+    , mBand( 0 )
+    , mVerticalUnit( QGis::Meters )
+    , mWidth( 0 )
+    , mHeight( 0 )
+    , mTileCache( TILE_CACHE_PIXELS )
+    , mLastTileKey( 0 )
+    , mLastTile( 0 )
+{
+  std::memset( mGtrans, 0, sizeof( mGtrans ) );
+
+  QFileInfo fileInfo( rasterFile );
+  mRasterModified = fileInfo.lastModified();
+  mRasterSize = fileInfo.size();
+
+  GDALDatasetH dataset = GDALOpen( rasterFile.toLocal8Bit().data(), GA_ReadOnly );
+  if ( !dataset )
+  {
+    QgsDebugMsg( "Failed to open raster file" );
+    return;
+  }
+  if ( GDALGetGeoTransform( dataset, &mGtrans[0] ) != CE_None )
+  {
+    QgsDebugMsg( "Failed to get raster geotransform" );
+    GDALClose( dataset );
+    return;
+  }
+  mCrs = QgsCoordinateReferenceSystem( QString( GDALGetProjectionRef( dataset ) ) );
+  if ( !mCrs.isValid() )
+  {
+    QgsDebugMsg( "Failed to get raster CRS" );
+    GDALClose( dataset );
+    return;
+  }
+  mBand = GDALGetRasterBand( dataset, 1 );
+  if ( !mBand )
+  {
+    QgsDebugMsg( "Failed to open raster band 0" );
+    GDALClose( dataset );
+    return;
+  }
+  mVerticalUnit = strcmp( GDALGetRasterUnitType( mBand ), "ft" ) == 0 ? QGis::Feet : QGis::Meters;
+  mWidth = GDALGetRasterXSize( dataset );
+  mHeight = GDALGetRasterYSize( dataset );
+  mDataset = dataset;
+}
+
+QgsHeightProfileSampler::~QgsHeightProfileSampler()
+{
+  if ( mDataset )
+  {
+    GDALClose( mDataset );
+  }
+}
+
+bool QgsHeightProfileSampler::isCurrent( const QString& rasterFile ) const
+{
+  if ( rasterFile != mRasterFile )
+  {
+    return false;
+  }
+  QFileInfo fileInfo( rasterFile );
+  return fileInfo.lastModified() == mRasterModified && fileInfo.size() == mRasterSize;
+}
+
+bool QgsHeightProfileSampler::sampleLine( const QList<QgsPoint>& points, const QVector<double>& segmentLengths, int nSamples, const QgsCoordinateReferenceSystem& crs, QVector<double>& heights )
+{
+  double totLength = 0;
+  foreach ( double length, segmentLengths )
+  {
+    totLength += length;
+  }
+
+  QVector<QgsPoint> samplePoints;
+  samplePoints.reserve( nSamples + 1 );
+  double x = 0;
+  for ( int i = 0, n = points.size() - 1; i < n; ++i )
+  {
+    if ( x >= segmentLengths[i] )
+    {
+      continue;
+    }
+
+    QgsVector dir = QgsVector( points[i + 1] - points[i] ).normal();
+    while ( x < segmentLengths[i] )
+    {
+      samplePoints.append( points[i] + dir * x );
+      x += totLength / nSamples;
+    }
+    x -= segmentLengths[i];
+  }
+  return sample( samplePoints, crs, heights );
+}
+
+bool QgsHeightProfileSampler::sample( const QVector<QgsPoint>& points, const QgsCoordinateReferenceSystem& crs, QVector<double>& heights )
+{
+  int n = points.size();
+  heights.fill( 0., n );
+  if ( !mDataset )
+  {
+    return false;
+  }
+
+  // Transform all positions to the raster CRS at once
+  QVector<double> px( n ), py( n ), pz( n, 0. );
+  for ( int i = 0; i < n; ++i )
+  {
+    px[i] = points[i].x();
+    py[i] = points[i].y();
+  }
+  try
+  {
+    QgsCoordinateTransform( crs, mCrs ).transformInPlace( px, py, pz );
+  }
+  catch ( const QgsCsException& )
+  {
+    QgsDebugMsg( "Failed to transform sample points to raster CRS" );
+    return false;
+  }
+
+  // Gather the four neighbouring pixel values and the interpolation weights of each sample
+  const double* gtrans = mGtrans;
+  QVector<double> v00( n, 0. ), v01( n, 0. ), v10( n, 0. ), v11( n, 0. );
+  QVector<double> lambdaC( n, 0. ), lambdaR( n, 0. );
+  for ( int i = 0; i < n; ++i )
+  {
+    // Transform raster geo position to pixel coordinates
+    double col = ( -gtrans[0] * gtrans[5] + gtrans[2] * gtrans[3] - gtrans[2] * py[i] + gtrans[5] * px[i] ) / ( gtrans[1] * gtrans[5] - gtrans[2] * gtrans[4] );
+    double row = ( -gtrans[0] * gtrans[4] + gtrans[1] * gtrans[3] - gtrans[1] * py[i] + gtrans[4] * px[i] ) / ( gtrans[2] * gtrans[4] - gtrans[1] * gtrans[5] );
+    int col0 = qFloor( col );
+    int row0 = qFloor( row );
+    if ( col0 < 0 || row0 < 0 || col0 + 1 >= mWidth || row0 + 1 >= mHeight )
+    {
+      continue;
+    }
+    if ( !pixelValue( col0, row0, v00[i] ) || !pixelValue( col0 + 1, row0, v01[i] ) ||
+         !pixelValue( col0, row0 + 1, v10[i] ) || !pixelValue( col0 + 1, row0 + 1, v11[i] ) )
+    {
+      QgsDebugMsg( "Failed to read pixel values" );
+      v00[i] = v01[i] = v10[i] = v11[i] = 0.;
+      continue;
+    }
+    lambdaC[i] = col - col0;
+    lambdaR[i] = row - row0;
+  }
+
+  // Interpolate values
+  const double* a = v00.constData();
+  const double* b = v01.constData();
+  const double* c = v10.constData();
+  const double* d = v11.constData();
+  const double* lc = lambdaC.constData();
+  const double* lr = lambdaR.constData();
+  double* h = heights.data();
+  for ( int i = 0; i < n; ++i )
+  {
+    h[i] = ( a[i] * ( 1. - lc[i] ) + b[i] * lc[i] ) * ( 1. - lr[i] )
+           + ( c[i] * ( 1. - lc[i] ) + d[i] * lc[i] ) * lr[i];
+  }
+  return true;
+}
+
+bool QgsHeightProfileSampler::pixelValue( int col, int row, double& value )
+{
+  int tileX = col / TILE_SIZE;
+  int tileY = row / TILE_SIZE;
+  quint64 key = ( quint64( tileY ) << 32 ) | quint64( tileX );
+  if ( !mLastTile || key != mLastTileKey )
+  {
+    Tile* tile = mTileCache.object( key );
+    if ( !tile )
+    {
+      int x0 = tileX * TILE_SIZE;
+      int y0 = tileY * TILE_SIZE;
+      int width = qMin( TILE_SIZE, mWidth - x0 );
+      int height = qMin( TILE_SIZE, mHeight - y0 );
+      tile = new Tile;
+      tile->width = width;
+      tile->values.resize( width * height );
+      if ( GDALRasterIO( mBand, GF_Read, x0, y0, width, height, tile->values.data(), width, height, GDT_Float64, 0, 0 ) != CE_None )
+      {
+        delete tile;
+        mLastTile = 0;
+        return false;
+      }
+      mTileCache.insert( key, tile, width * height );
+    }
+    mLastTile = tile;
+    mLastTileKey = key;
+  }
+  value = mLastTile->values[( row % TILE_SIZE ) * mLastTile->width + ( col % TILE_SIZE )];
+  return true;
+}
@@ -0,0 +1,92 @@
+/***************************************************************************
+                          qgsheightprofilesampler.h  -  Height profile sampling
+                          ---------------------------
+    begin                : October 2015
+    copyright            : (C) 2015 by Sandro Mani
+    email                : manisandro@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSHEIGHTPROFILESAMPLER_H
+#define QGSHEIGHTPROFILESAMPLER_H
+
+#include "gdal.h"
+#include "qgis.h"
+#include "qgscoordinatereferencesystem.h"
+
+#include <QCache>
+#include <QDateTime>
+#include <QList>
+#include <QString>
+#include <QVector>
+
+class QgsPoint;
+
+/**Samples the heights of a DEM along lines, with bilinear interpolation.
+ * The DEM stays open and the pixel blocks read are cached between calls, so that sampling
+ * repeatedly along nearby lines (i.e. while a line is being drawn) only reads newly covered blocks.*/
+class ANALYSIS_EXPORT QgsHeightProfileSampler
+{
+  public:
+    /**Opens the DEM, check isValid() for success*/
+    QgsHeightProfileSampler( const QString& rasterFile );
+    ~QgsHeightProfileSampler();
+
+    bool isValid() const { return mDataset != 0; }
+    const QString& rasterFile() const { return mRasterFile; }
+    /**Returns whether the sampler reads the given file as it is now, i.e. whether the file has not been modified
+     * since the sampler opened it. Otherwise the cached pixel blocks are outdated and a new sampler is needed.
+     * @note added in 2.16*/
+    bool isCurrent( const QString& rasterFile ) const;
+    /**Unit of the height values of the DEM*/
+    QGis::UnitType verticalUnit() const { return mVerticalUnit; }
+
+    /**Samples the DEM at the given points, specified in crs.
+     * Points whose interpolation window is not entirely inside the DEM get a height of 0.
+     * Nodata pixels are interpolated like any other pixel.
+      @return false if the points could not be transformed to the DEM CRS*/
+    bool sample( const QVector<QgsPoint>& points, const QgsCoordinateReferenceSystem& crs, QVector<double>& heights );
+
+    /**Samples the DEM at nSamples equidistant positions along the polyline, specified in crs.
+      @param segmentLengths the lengths of the polyline segments, which also define the sample spacing
+      @return false if the points could not be transformed to the DEM CRS*/
+    bool sampleLine( const QList<QgsPoint>& points, const QVector<double>& segmentLengths, int nSamples, const QgsCoordinateReferenceSystem& crs, QVector<double>& heights );
+
+  private:
+    struct Tile
+    {
+      int width;
+      QVector<double> values;
+    };
+
+    QString mRasterFile;
+    /**Modification time and size of the file when it was opened*/
+    QDateTime mRasterModified;
+    qint64 mRasterSize;
+    GDALDatasetH mDataset;
+    GDALRasterBandH mBand;
+    double mGtrans[6];
+    QgsCoordinateReferenceSystem mCrs;
+    QGis::UnitType mVerticalUnit;
+    int mWidth;
+    int mHeight;
+    QCache<quint64, Tile> mTileCache;
+    quint64 mLastTileKey;
+    const Tile* mLastTile;
+
+    /**Returns the value of the specified pixel, which must be inside the DEM, or false if reading failed*/
+    bool pixelValue( int col, int row, double& value );
+
+    QgsHeightProfileSampler( const QgsHeightProfileSampler& );
+    QgsHeightProfileSampler& operator=( const QgsHeightProfileSampler& );
+};
+
+#endif // QGSHEIGHTPROFILESAMPLER_H
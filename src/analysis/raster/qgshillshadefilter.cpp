@@ -35,15 +35,38 @@ float QgsHillshadeFilter::processNineCellWindow( float* x11, float* x21, float*
 {
   float derX = calcFirstDerX( x11, x21, x31, x12, x22, x32, x13, x23, x33 );
   float derY = calcFirstDerY( x11, x21, x31, x12, x22, x32, x13, x23, x33 );
+  return processDerivatives( derX, derY );
+}
+
+float QgsHillshadeFilter::processDerivatives( float derX, float derY )
+{
+  float zenith_rad = mLightAngle * M_PI / 180.0;
+  float azimuth_rad = mLightAzimuth * M_PI / 180.0;
+  return hillshade( derX, derY, cos( zenith_rad ), sin( zenith_rad ), azimuth_rad );
+}
+
+void QgsHillshadeFilter::processNineCellRow( float* above, float* row, float* below, float* result, int n )
+{
+  float zenith_rad = mLightAngle * M_PI / 180.0;
+  double cosZenith = cos( zenith_rad );
+  double sinZenith = sin( zenith_rad );
+  float azimuth_rad = mLightAzimuth * M_PI / 180.0;
+  for ( int j = 0; j < n; ++j )
+  {
+    float derX, derY;
+    calcFirstDers( above, row, below, j, derX, derY );
+    result[j] = hillshade( derX, derY, cosZenith, sinZenith, azimuth_rad );
+  }
+}
 
+float QgsHillshadeFilter::hillshade( float derX, float derY, double cosZenith, double sinZenith, float azimuth_rad ) const
+{
   if ( derX == mOutputNodataValue || derY == mOutputNodataValue )
   {
     return mOutputNodataValue;
   }
 
-  float zenith_rad = mLightAngle * M_PI / 180.0;
   float slope_rad = atan( sqrt( derX * derX + derY * derY ) );
-  float azimuth_rad = mLightAzimuth * M_PI / 180.0;
   float aspect_rad = 0;
   if ( derX == 0 && derY == 0 ) //aspect undefined, take a neutral value. Better solutions?
   {
@@ -53,5 +76,5 @@ float QgsHillshadeFilter::processNineCellWindow( float* x11, float* x21, float*
   {
     aspect_rad = M_PI + atan2( derX, derY );
   }
-  return qMax( 0.0, 255.0 * (( cos( zenith_rad ) * cos( slope_rad ) ) + ( sin( zenith_rad ) * sin( slope_rad ) * cos( azimuth_rad - aspect_rad ) ) ) );
+  return qMax( 0.0, 255.0 * (( cosZenith * cos( slope_rad ) ) + ( sinZenith * sin( slope_rad ) * cos( azimuth_rad - aspect_rad ) ) ) );
 }
@@ -32,6 +32,9 @@ class ANALYSIS_EXPORT QgsHillshadeFilter: public QgsDerivativeFilter
     float processNineCellWindow( float* x11, float* x21, float* x31,
                                  float* x12, float* x22, float* x32,
                                  float* x13, float* x23, float* x33 ) override;
+    float processDerivatives( float derX, float derY ) override;
+    /**Calculates the output values of a row, with the light direction evaluated once per row*/
+    void processNineCellRow( float* above, float* row, float* below, float* result, int n ) override;
 
     float lightAzimuth() const { return mLightAzimuth; }
     void setLightAzimuth( float azimuth ) { mLightAzimuth = azimuth; }
@@ -39,6 +42,8 @@ class ANALYSIS_EXPORT QgsHillshadeFilter: public QgsDerivativeFilter
     void setLightAngle( float angle ) { mLightAngle = angle; }
 
   private:
+    float hillshade( float derX, float derY, double cosZenith, double sinZenith, float azimuth_rad ) const;
+
     float mLightAzimuth;
     float mLightAngle;
 };
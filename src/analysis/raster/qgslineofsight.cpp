@@ -0,0 +1,80 @@
+/***************************************************************************
+                          qgslineofsight.cpp  -  Line of sight along height profiles
+                          ---------------------------
+    begin                : October 2015
+    copyright            : (C) 2015 by Sandro Mani
+    email                : manisandro@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgslineofsight.h"
+#include <limits>
+#include <QtConcurrentMap>
+
+class LineOfSightWorker
+{
+  public:
+    LineOfSightWorker( double observerHeight, double targetHeight, bool heightRelToTerr, double heightUnitsPerMeter )
+        : mObserverHeight( observerHeight ), mTargetHeight( targetHeight ), mHeightRelToTerr( heightRelToTerr ), mHeightUnitsPerMeter( heightUnitsPerMeter ) {}
+    void operator()( QgsLineOfSight::Profile& profile ) const
+    {
+      QgsLineOfSight::computeVisibility( profile.distances, profile.heights, mObserverHeight, mTargetHeight, mHeightRelToTerr, mHeightUnitsPerMeter, profile.visible );
+    }
+
+  private:
+    double mObserverHeight;
+    double mTargetHeight;
+    bool mHeightRelToTerr;
+    double mHeightUnitsPerMeter;
+};
+
+void QgsLineOfSight::computeVisibility( const QVector<double>& distances, const QVector<double>& heights,
+                                        double observerHeight, double targetHeight, bool heightRelToTerr,
+                                        double heightUnitsPerMeter, QVector<bool>& visible )
+{
+  int n = qMin( distances.size(), heights.size() );
+  visible.resize( n );
+  if ( n == 0 )
+  {
+    return;
+  }
+
+  static const double earthRadius = 6370000;
+
+  // Visibility of first point
+  visible[0] = ( heightRelToTerr ? targetHeight : targetHeight - heights[0] ) > 0;
+
+  // Terrain and target heights are lowered by the earth curvature. A target is visible if the
+  // line from the observer to it is at least as steep as the line to any terrain sample before it.
+  double x0 = distances[0];
+  double y0 = ( heightRelToTerr ? heights[0] - 0.87 * x0 * x0 / ( 2 * earthRadius ) * heightUnitsPerMeter : 0 ) + observerHeight;
+  double maxSlope = -std::numeric_limits<double>::infinity();
+  for ( int i = 1; i < n; ++i )
+  {
+    double dx = distances[i] - x0;
+    double terrainY = heights[i] - 0.87 * distances[i] * distances[i] / ( 2 * earthRadius ) * heightUnitsPerMeter;
+    double targetY = terrainY + targetHeight - ( heightRelToTerr ? 0 : heights[i] );
+    if ( dx <= 0 )
+    {
+      visible[i] = visible[i - 1];
+      continue;
+    }
+    visible[i] = ( targetY - y0 ) / dx >= maxSlope;
+    maxSlope = qMax( maxSlope, ( terrainY - y0 ) / dx );
+  }
+}
+
+void QgsLineOfSight::computeVisibility( QVector<Profile>& profiles,
+                                        double observerHeight, double targetHeight, bool heightRelToTerr,
+                                        double heightUnitsPerMeter )
+{
+  QtConcurrent::blockingMap( profiles, LineOfSightWorker( observerHeight, targetHeight, heightRelToTerr, heightUnitsPerMeter ) );
+}
@@ -0,0 +1,56 @@
+/***************************************************************************
+                          qgslineofsight.h  -  Line of sight along height profiles
+                          ---------------------------
+    begin                : October 2015
+    copyright            : (C) 2015 by Sandro Mani
+    email                : manisandro@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSLINEOFSIGHT_H
+#define QGSLINEOFSIGHT_H
+
+#include "qgis.h"
+
+#include <QVector>
+
+/**Computes which samples of a height profile are visible from an observer placed at the first sample.
+ * A single sweep tracks the steepest elevation angle of the terrain seen so far, so a profile of n samples is processed in O(n).*/
+class ANALYSIS_EXPORT QgsLineOfSight
+{
+  public:
+    /**A height profile and its visibility flags*/
+    struct Profile
+    {
+      /**Distances of the samples from the observer in meters, strictly increasing after the first sample*/
+      QVector<double> distances;
+      /**Terrain heights of the samples*/
+      QVector<double> heights;
+      /**Output: whether the target above each sample is visible*/
+      QVector<bool> visible;
+    };
+
+    /**Computes the visibility of the profile samples.
+      @param observerHeight height of the observer, in the unit of the terrain heights
+      @param targetHeight height of the targets, in the unit of the terrain heights
+      @param heightRelToTerr whether the heights are relative to the terrain or to the sea level
+      @param heightUnitsPerMeter conversion factor from meters to the unit of the terrain heights, used for the earth curvature correction*/
+    static void computeVisibility( const QVector<double>& distances, const QVector<double>& heights,
+                                   double observerHeight, double targetHeight, bool heightRelToTerr,
+                                   double heightUnitsPerMeter, QVector<bool>& visible );
+
+    /**Computes the visibility of many profiles concurrently, see the above.*/
+    static void computeVisibility( QVector<Profile>& profiles,
+                                   double observerHeight, double targetHeight, bool heightRelToTerr,
+                                   double heightUnitsPerMeter );
+};
+
+#endif // QGSLINEOFSIGHT_H
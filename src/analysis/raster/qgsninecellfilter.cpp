@@ -16,6 +16,7 @@
  ***************************************************************************/
 
 #include "qgsninecellfilter.h"
+#include "qgsninecelltiler.h"
 #include "qgscoordinatetransform.h"
 #include "qgslogger.h"
 #include "cpl_string.h"
@@ -40,6 +41,7 @@ QgsNineCellFilter::QgsNineCellFilter( const QString& inputFile, const QString& o
     , mInputNodataValue( -1.0 )
     , mOutputNodataValue( -1.0 )
     , mZFactor( -1 )
+    , mTiledExecution( true )
 {
 
 }
@@ -50,6 +52,7 @@ QgsNineCellFilter::QgsNineCellFilter()
     , mInputNodataValue( -1.0 )
     , mOutputNodataValue( -1.0 )
     , mZFactor( -1 )
+    , mTiledExecution( true )
 {
 }
 
@@ -58,6 +61,28 @@ QgsNineCellFilter::~QgsNineCellFilter()
 
 }
 
+class NineCellFilterRowKernel
+{
+  public:
+    NineCellFilterRowKernel( QgsNineCellFilter* filter ) : mFilter( filter ) {}
+    void operator()( float* above, float* row, float* below, int n, float* const* result ) const
+    {
+      mFilter->processNineCellRow( above, row, below, result[0], n );
+    }
+
+  private:
+    QgsNineCellFilter* mFilter;
+};
+
+void QgsNineCellFilter::processNineCellRow( float* above, float* row, float* below, float* result, int n )
+{
+  for ( int j = 0; j < n; ++j )
+  {
+    result[j] = processNineCellWindow( &above[j-1], &above[j], &above[j+1], &row[j-1], &row[j],
+                                       &row[j+1], &below[j-1], &below[j], &below[j+1] );
+  }
+}
+
 int QgsNineCellFilter::processRaster( QProgressDialog* p )
 {
   GDALAllRegister();
@@ -126,38 +151,7 @@ int QgsNineCellFilter::processRaster( QProgressDialog* p )
   // Autocompute the zFactor if it is -1
   if ( mZFactor == -1 )
   {
-    QString proj( GDALGetProjectionRef( inputDataset ) );
-    QgsCoordinateReferenceSystem rasterCrs( proj );
-    QGis::UnitType vertUnit = strcmp( GDALGetRasterUnitType( rasterBand ), "ft" ) == 0 ? QGis::Feet : QGis::Meters;
-    if ( rasterCrs.mapUnits() == QGis::Meters && vertUnit == QGis::Feet )
-    {
-      mZFactor = QGis::fromUnitToUnitFactor( QGis::Meters, QGis::Feet );
-    }
-    else if ( rasterCrs.mapUnits() == QGis::Feet && vertUnit == QGis::Meters )
-    {
-      mZFactor = QGis::fromUnitToUnitFactor( QGis::Feet, QGis::Meters );
-    }
-    else if ( rasterCrs.mapUnits() == QGis::Degrees && vertUnit == QGis::Meters )
-    {
-      // Take latitude in the middle of the window
-      double px = 0.5 * ( colStart + colEnd );
-      double py = 0.5 * ( rowStart + rowEnd );
-      double latitude = gtrans[3] + px * gtrans[4] + py * gtrans[5];
-      mZFactor = ( 111320 * std::cos( latitude * M_PI / 180. ) );
-    }
-    else if ( rasterCrs.mapUnits() == QGis::Degrees && vertUnit == QGis::Feet )
-    {
-      // Take latitude in the middle of the window
-      double px = 0.5 * ( colStart + colEnd );
-      double py = 0.5 * ( rowStart + rowEnd );
-      double latitude = gtrans[3] + px * gtrans[4] + py * gtrans[5];
-      mZFactor = (( 111320 * std::cos( latitude * M_PI / 180. ) ) ) * QGis::fromUnitToUnitFactor( QGis::Meters, QGis::Feet );
-    }
-    else
-    {
-      QgsDebugMsg( "Warning: Failed to automatically compute zFactor, defaulting to 1" );
-      mZFactor = 1;
-    }
+    mZFactor = computeZFactor( inputDataset, rasterBand, rowStart, rowEnd, colStart, colEnd );
   }
 
   if ( ySize < 3 ) //we require at least three rows (should be true for most datasets)
@@ -167,6 +161,23 @@ int QgsNineCellFilter::processRaster( QProgressDialog* p )
     return 6;
   }
 
+  if ( mTiledExecution )
+  {
+    QVector<GDALRasterBandH> outputBands;
+    outputBands.append( outputRasterBand );
+    bool completed = QgsNineCellTiler::process<float>( rasterBand, colStart, rowStart, xSize, ySize, mInputNodataValue,
+                     outputBands, GDT_Float32, NineCellFilterRowKernel( this ), p );
+    GDALClose( inputDataset );
+    if ( !completed )
+    {
+      //delete the dataset without closing (because it is faster)
+      GDALDeleteDataset( outputDriver, TO8F( mOutputFile ) );
+      return 7;
+    }
+    GDALClose( outputDataset );
+    return 0;
+  }
+
   //keep only three scanlines in memory at a time
   float* scanLine1 = ( float * ) CPLMalloc( sizeof( float ) * xSize );
   float* scanLine2 = ( float * ) CPLMalloc( sizeof( float ) * xSize );
@@ -271,6 +282,49 @@ int QgsNineCellFilter::processRaster( QProgressDialog* p )
   return 0;
 }
 
+double QgsNineCellFilter::computeZFactor( GDALDatasetH dataset, GDALRasterBandH band, int rowStart, int rowEnd, int colStart, int colEnd )
+{
+  double gtrans[6] = {};
+  if ( GDALGetGeoTransform( dataset, &gtrans[0] ) != CE_None )
+  {
+    return 1;
+  }
+  double zFactor = 1;
+  QString proj( GDALGetProjectionRef( dataset ) );
+  QgsCoordinateReferenceSystem rasterCrs( proj );
+  QGis::UnitType vertUnit = strcmp( GDALGetRasterUnitType( band ), "ft" ) == 0 ? QGis::Feet : QGis::Meters;
+  if ( rasterCrs.mapUnits() == QGis::Meters && vertUnit == QGis::Feet )
+  {
+    zFactor = QGis::fromUnitToUnitFactor( QGis::Meters, QGis::Feet );
+  }
+  else if ( rasterCrs.mapUnits() == QGis::Feet && vertUnit == QGis::Meters )
+  {
+    zFactor = QGis::fromUnitToUnitFactor( QGis::Feet, QGis::Meters );
+  }
+  else if ( rasterCrs.mapUnits() == QGis::Degrees && vertUnit == QGis::Meters )
+  {
+    // Take latitude in the middle of the window
+    double px = 0.5 * ( colStart + colEnd );
+    double py = 0.5 * ( rowStart + rowEnd );
+    double latitude = gtrans[3] + px * gtrans[4] + py * gtrans[5];
+    zFactor = ( 111320 * std::cos( latitude * M_PI / 180. ) );
+  }
+  else if ( rasterCrs.mapUnits() == QGis::Degrees && vertUnit == QGis::Feet )
+  {
+    // Take latitude in the middle of the window
+    double px = 0.5 * ( colStart + colEnd );
+    double py = 0.5 * ( rowStart + rowEnd );
+    double latitude = gtrans[3] + px * gtrans[4] + py * gtrans[5];
+    zFactor = (( 111320 * std::cos( latitude * M_PI / 180. ) ) ) * QGis::fromUnitToUnitFactor( QGis::Meters, QGis::Feet );
+  }
+  else
+  {
+    QgsDebugMsg( "Warning: Failed to automatically compute zFactor, defaulting to 1" );
+    zFactor = 1;
+  }
+  return zFactor;
+}
+
 GDALDatasetH QgsNineCellFilter::openInputFile( int& nCellsX, int& nCellsY )
 {
   GDALDatasetH inputDataset = GDALOpen( TO8F( mInputFile ), GA_ReadOnly );
@@ -54,12 +54,26 @@ class ANALYSIS_EXPORT QgsNineCellFilter
     double outputNodataValue() const { return mOutputNodataValue; }
     void setOutputNodataValue( double value ) { mOutputNodataValue = value; }
 
+    bool tiledExecution() const { return mTiledExecution; }
+    /**Whether the raster is processed in block aligned tiles on the global thread pool (default) or one scanline at a time*/
+    void setTiledExecution( bool tiled ) { mTiledExecution = tiled; }
+
     /**Calculates output value from nine input values. The input values and the output value can be equal to the
       nodata value if not present or outside of the border. Must be implemented by subclasses*/
     virtual float processNineCellWindow( float* x11, float* x21, float* x31,
                                          float* x12, float* x22, float* x32,
                                          float* x13, float* x23, float* x33 ) = 0;
 
+    /**Calculates the output values of n consecutive cells of a row. above, row and below point to the first cell in the
+      respective input row, the values at index -1 and n are the neighbours of the first and last cell. The default
+      implementation calls processNineCellWindow for each cell. Must be thread safe, as rows are processed concurrently*/
+    virtual void processNineCellRow( float* above, float* row, float* below, float* result, int n );
+
+    /**Computes the window of the raster which contains the specified region of the raster. An empty region yields the whole raster*/
+    static bool computeWindow( GDALDatasetH dataset, const QgsRectangle &region, const QgsCoordinateReferenceSystem &regionCrs, int& rowStart, int& rowEnd, int& colStart, int& colEnd );
+    /**Computes the factor which converts the height unit of the band to the map unit of the dataset, evaluated in the middle of the window*/
+    static double computeZFactor( GDALDatasetH dataset, GDALRasterBandH band, int rowStart, int rowEnd, int colStart, int colEnd );
+
   private:
     //default constructor forbidden. We need input file, output file and format obligatory
     QgsNineCellFilter();
@@ -72,8 +86,6 @@ class ANALYSIS_EXPORT QgsNineCellFilter
     /**Opens the output file and sets the same geotransform and CRS as the input data
       @return the output dataset or NULL in case of error*/
     GDALDatasetH openOutputFile( GDALDatasetH inputDataset, GDALDriverH outputDriver , int colStart, int rowStart, int xSize, int ySize );
-    /**Computes the window of the raster which contains the specified region of the raster*/
-    bool computeWindow( GDALDatasetH dataset, const QgsRectangle &region, const QgsCoordinateReferenceSystem &regionCrs, int& rowStart, int& rowEnd, int& colStart, int& colEnd );
 
   protected:
 
@@ -91,6 +103,7 @@ class ANALYSIS_EXPORT QgsNineCellFilter
     float mOutputNodataValue;
     /**Scale factor for z-value if x-/y- units are different to z-units (111120 for degree->meters and 370400 for degree->feet)*/
     double mZFactor;
+    bool mTiledExecution;
 };
 
 #endif // QGSNINECELLFILTER_H
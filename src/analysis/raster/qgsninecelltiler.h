@@ -0,0 +1,205 @@
+/***************************************************************************
+                          qgsninecelltiler.h  -  Tiled execution of nine cell kernels
+                          ---------------------------
+    begin                : December 2015
+    copyright            : (C) 2015 by Sandro Mani
+    email                : manisandro@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSNINECELLTILER_H
+#define QGSNINECELLTILER_H
+
+#include "gdal.h"
+#include <QFuture>
+#include <QProgressDialog>
+#include <QVarLengthArray>
+#include <QVector>
+#include <QtConcurrentMap>
+
+/**Drives a nine cell row kernel over a raster window (not part of the public API).
+ * The window is read in strips aligned to the GDAL blocks of the input band, surrounded by a one cell halo which is
+ * nodata outside of the window. Each strip is cut into column tiles which are processed on the global thread pool,
+ * while the main thread writes the previous strip and reads the next one. Strips are written in order.
+ *
+ * The kernel is called as kernel( above, row, below, n, out ) for n consecutive cells of a row, where above, row and
+ * below point to the first cell in the respective input row (index -1 and n are valid) and out[b] points to the
+ * first output cell of band b.*/
+class QgsNineCellTiler
+{
+  public:
+    /**@return false if the processing was canceled*/
+    template<class T, class RowKernel>
+    static bool process( GDALRasterBandH inputBand, int colStart, int rowStart, int xSize, int ySize, float inputNodataValue,
+                         const QVector<GDALRasterBandH>& outputBands, GDALDataType outputType, const RowKernel& kernel, QProgressDialog* p )
+    {
+      int blockX = 0, blockY = 0;
+      GDALGetBlockSize( inputBand, &blockX, &blockY );
+      blockX = qMax( 1, blockX );
+      blockY = qMax( 1, blockY );
+
+      // Strips of at least 64 rows, unless they get bigger than 32MB
+      int stripHeight = blockY * (( 64 + blockY - 1 ) / blockY );
+      int maxStripHeight = qMax( 1, int( 32 * 1024 * 1024 / ( sizeof( float ) * ( xSize + 2 ) ) ) );
+      if ( stripHeight > maxStripHeight )
+      {
+        stripHeight = qMax( 1, maxStripHeight / blockY ) * blockY;
+      }
+      // Tiles of at least 256 columns, aligned to the blocks unless the blocks span the full rows
+      int tileWidth = blockX < xSize ? blockX * (( 256 + blockX - 1 ) / blockX ) : 256;
+
+      QVector<Strip<T> > strips( 2 );
+      for ( int i = 0; i < 2; ++i )
+      {
+        strips[i].input.resize(( xSize + 2 ) * ( stripHeight + 2 ) );
+        strips[i].output.resize( outputBands.size() * xSize * stripHeight );
+        // Tiles are aligned to absolute raster columns
+        for ( int x = 0; x < xSize; )
+        {
+          int xEnd = qMin( xSize, ( ( colStart + x ) / tileWidth + 1 ) * tileWidth - colStart );
+          Tile<T> tile = { &strips[i], x, xEnd - x };
+          strips[i].tiles.append( tile );
+          x = xEnd;
+        }
+      }
+
+      if ( p )
+      {
+        p->setMaximum( ySize );
+      }
+
+      Worker<T, RowKernel> worker( kernel, xSize, stripHeight, outputBands.size() );
+      // The first strip ends at a strip boundary in absolute raster rows
+      int row = 0;
+      int nRows = qMin( ySize, stripHeight - rowStart % stripHeight );
+      readStrip( inputBand, colStart, rowStart, xSize, ySize, inputNodataValue, row, nRows, strips[0] );
+
+      bool canceled = false;
+      Strip<T>* previous = 0;
+      for ( int i = 0; row < ySize; ++i )
+      {
+        Strip<T>& current = strips[i % 2];
+        QFuture<void> future = QtConcurrent::map( current.tiles, worker );
+
+        // Write the previous and read the next strip while the current one is processed
+        if ( previous )
+        {
+          writeStrip( outputBands, outputType, xSize, stripHeight, *previous );
+          if ( p )
+          {
+            p->setValue( previous->row + previous->nRows );
+          }
+        }
+        int nextRow = row + nRows;
+        int nextRows = qMin( ySize - nextRow, stripHeight );
+        canceled = p && p->wasCanceled();
+        if ( nextRow < ySize && !canceled )
+        {
+          readStrip( inputBand, colStart, rowStart, xSize, ySize, inputNodataValue, nextRow, nextRows, strips[( i + 1 ) % 2] );
+        }
+        future.waitForFinished();
+        previous = &current;
+        if ( canceled )
+        {
+          break;
+        }
+        row = nextRow;
+        nRows = nextRows;
+      }
+      if ( previous && !canceled )
+      {
+        writeStrip( outputBands, outputType, xSize, stripHeight, *previous );
+        if ( p )
+        {
+          p->setValue( ySize );
+        }
+      }
+      return !canceled;
+    }
+
+  private:
+    template<class T> struct Strip;
+
+    template<class T>
+    struct Tile
+    {
+      Strip<T>* strip;
+      int col;
+      int width;
+    };
+
+    template<class T>
+    struct Strip
+    {
+      Strip() : row( 0 ), nRows( 0 ) {}
+      int row;
+      int nRows;
+      QVector<float> input;
+      QVector<T> output;
+      QVector< Tile<T> > tiles;
+    };
+
+    template<class T, class RowKernel>
+    class Worker
+    {
+      public:
+        Worker( const RowKernel& kernel, int xSize, int stripHeight, int nBands )
+            : mKernel( kernel ), mXSize( xSize ), mStripHeight( stripHeight ), mNBands( nBands ) {}
+        void operator()( Tile<T>& tile ) const
+        {
+          int stride = mXSize + 2;
+          QVarLengthArray<T*, 4> out( mNBands );
+          for ( int r = 0; r < tile.strip->nRows; ++r )
+          {
+            float* above = tile.strip->input.data() + r * stride + 1 + tile.col;
+            for ( int b = 0; b < mNBands; ++b )
+            {
+              out[b] = tile.strip->output.data() + ( b * mStripHeight + r ) * mXSize + tile.col;
+            }
+            mKernel( above, above + stride, above + 2 * stride, tile.width, out.data() );
+          }
+        }
+
+      private:
+        const RowKernel& mKernel;
+        int mXSize;
+        int mStripHeight;
+        int mNBands;
+    };
+
+    /**Reads rows [row - 1, row + nRows] of the window, rows and columns outside of the window are set to nodata*/
+    template<class T>
+    static void readStrip( GDALRasterBandH band, int colStart, int rowStart, int xSize, int ySize, float nodata, int row, int nRows, Strip<T>& strip )
+    {
+      strip.row = row;
+      strip.nRows = nRows;
+      strip.input.fill( nodata );
+      int stride = xSize + 2;
+      int r0 = qMax( 0, row - 1 );
+      int r1 = qMin( ySize, row + nRows + 1 );
+      CPLErr err = GDALRasterIO( band, GF_Read, colStart, rowStart + r0, xSize, r1 - r0,
+                                 strip.input.data() + ( r0 - row + 1 ) * stride + 1, xSize, r1 - r0, GDT_Float32, 0, stride * sizeof( float ) );
+      Q_UNUSED( err );
+    }
+
+    template<class T>
+    static void writeStrip( const QVector<GDALRasterBandH>& bands, GDALDataType type, int xSize, int stripHeight, Strip<T>& strip )
+    {
+      for ( int b = 0, n = bands.size(); b < n; ++b )
+      {
+        CPLErr err = GDALRasterIO( bands[b], GF_Write, 0, strip.row, xSize, strip.nRows,
+                                   strip.output.data() + b * stripHeight * xSize, xSize, strip.nRows, type, 0, 0 );
+        Q_UNUSED( err );
+      }
+    }
+};
+
+#endif // QGSNINECELLTILER_H
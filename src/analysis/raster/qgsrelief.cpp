@@ -18,6 +18,7 @@
 #include "qgsrelief.h"
 #include "qgsaspectfilter.h"
 #include "qgshillshadefilter.h"
+#include "qgsninecelltiler.h"
 #include "qgsslopefilter.h"
 #include "qgis.h"
 #include "cpl_string.h"
@@ -42,6 +43,7 @@ QgsRelief::QgsRelief( const QString& inputFile, const QString& outputFile, const
     , mInputNodataValue( -1 )
     , mOutputNodataValue( -1 )
     , mZFactor( -1.0 )
+    , mTiledExecution( true )
 {
   mSlopeFilter = new QgsSlopeFilter( inputFile, outputFile, outputFormat, filterRegion, filterRegionCrs );
   mAspectFilter = new QgsAspectFilter( inputFile, outputFile, outputFormat, filterRegion, filterRegionCrs );
@@ -83,6 +85,31 @@ void QgsRelief::setDefaultReliefColors()
   addReliefColorClass( ReliefColor( QColor( 255, 255, 255 ), 4000, 9000 ) );
 }
 
+class QgsRelief::RowKernel
+{
+  public:
+    RowKernel( QgsRelief* relief ) : mRelief( relief ) {}
+    void operator()( float* above, float* row, float* below, int n, unsigned char* const* result ) const
+    {
+      unsigned char* red = result[0];
+      unsigned char* green = result[1];
+      unsigned char* blue = result[2];
+      for ( int j = 0; j < n; ++j )
+      {
+        if ( !mRelief->processNineCellWindow( &above[j-1], &above[j], &above[j+1], &row[j-1], &row[j], &row[j+1],
+                                              &below[j-1], &below[j], &below[j+1], &red[j], &green[j], &blue[j] ) )
+        {
+          red[j] = mRelief->mOutputNodataValue;
+          green[j] = mRelief->mOutputNodataValue;
+          blue[j] = mRelief->mOutputNodataValue;
+        }
+      }
+    }
+
+  private:
+    QgsRelief* mRelief;
+};
+
 int QgsRelief::processRaster( QProgressDialog* p )
 {
   //open input file
@@ -166,6 +193,23 @@ int QgsRelief::processRaster( QProgressDialog* p )
     return 6;
   }
 
+  if ( mTiledExecution )
+  {
+    QVector<GDALRasterBandH> outputBands;
+    outputBands << outputRedBand << outputGreenBand << outputBlueBand;
+    bool completed = QgsNineCellTiler::process<unsigned char>( rasterBand, 0, 0, xSize, ySize, mInputNodataValue,
+                     outputBands, GDT_Byte, RowKernel( this ), p );
+    GDALClose( inputDataset );
+    if ( !completed )
+    {
+      //delete the dataset without closing (because it is faster)
+      GDALDeleteDataset( outputDriver, TO8F( mOutputFile ) );
+      return 7;
+    }
+    GDALClose( outputDataset );
+    return 0;
+  }
+
   //keep only three scanlines in memory at a time
   float* scanLine1 = ( float * ) CPLMalloc( sizeof( float ) * xSize );
   float* scanLine2 = ( float * ) CPLMalloc( sizeof( float ) * xSize );
@@ -54,6 +54,10 @@ class ANALYSIS_EXPORT QgsRelief
     double zFactor() const { return mZFactor; }
     void setZFactor( double factor ) { mZFactor = factor; }
 
+    bool tiledExecution() const { return mTiledExecution; }
+    /**Whether the raster is processed in block aligned tiles on the global thread pool (default) or one scanline at a time*/
+    void setTiledExecution( bool tiled ) { mTiledExecution = tiled; }
+
     void clearReliefColors();
     void addReliefColorClass( const ReliefColor& color );
     const QList< ReliefColor >& reliefColors() const { return mReliefColors; }
@@ -67,6 +71,7 @@ class ANALYSIS_EXPORT QgsRelief
     bool exportFrequencyDistributionToCsv( const QString& file );
 
   private:
+    class RowKernel;
 
     QString mInputFile;
     QString mOutputFile;
@@ -80,6 +85,7 @@ class ANALYSIS_EXPORT QgsRelief
     float mOutputNodataValue;
 
     double mZFactor;
+    bool mTiledExecution;
 
     QgsSlopeFilter* mSlopeFilter;
     QgsAspectFilter* mAspectFilter;
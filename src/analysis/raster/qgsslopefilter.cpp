@@ -33,7 +33,11 @@ float QgsSlopeFilter::processNineCellWindow( float* x11, float* x21, float* x31,
 {
   float derX = calcFirstDerX( x11, x21, x31, x12, x22, x32, x13, x23, x33 );
   float derY = calcFirstDerY( x11, x21, x31, x12, x22, x32, x13, x23, x33 );
+  return processDerivatives( derX, derY );
+}
 
+float QgsSlopeFilter::processDerivatives( float derX, float derY )
+{
   if ( derX == mOutputNodataValue || derY == mOutputNodataValue )
   {
     return mOutputNodataValue;
@@ -42,3 +46,12 @@ float QgsSlopeFilter::processNineCellWindow( float* x11, float* x21, float* x31,
   return atan( sqrt( derX * derX + derY * derY ) ) * 180.0 / M_PI;
 }
 
+void QgsSlopeFilter::processNineCellRow( float* above, float* row, float* below, float* result, int n )
+{
+  for ( int j = 0; j < n; ++j )
+  {
+    float derX, derY;
+    calcFirstDers( above, row, below, j, derX, derY );
+    result[j] = QgsSlopeFilter::processDerivatives( derX, derY );
+  }
+}
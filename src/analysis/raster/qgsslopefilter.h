@@ -32,6 +32,9 @@ class ANALYSIS_EXPORT QgsSlopeFilter: public QgsDerivativeFilter
     float processNineCellWindow( float* x11, float* x21, float* x31,
                                  float* x12, float* x22, float* x32,
                                  float* x13, float* x23, float* x33 ) override;
+    float processDerivatives( float derX, float derY ) override;
+    /**Calculates the output values of a row without a virtual call per cell*/
+    void processNineCellRow( float* above, float* row, float* below, float* result, int n ) override;
 };
 
 #endif // QGSSLOPEFILTER_H
@@ -0,0 +1,283 @@
+/***************************************************************************
+                          qgsterrainprocessor.cpp  -  Multi-product terrain analysis
+                          ---------------------------
+    begin                : December 2015
+    copyright            : (C) 2015 by Sandro Mani
+    email                : manisandro@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsterrainprocessor.h"
+#include "qgsaspectfilter.h"
+#include "qgshillshadefilter.h"
+#include "qgsninecelltiler.h"
+#include "qgsruggednessfilter.h"
+#include "qgsslopefilter.h"
+#include "qgstotalcurvaturefilter.h"
+#include "cpl_string.h"
+#include <QFile>
+#include <QProgressDialog>
+#include <QVarLengthArray>
+
+#if defined(GDAL_VERSION_NUM) && GDAL_VERSION_NUM >= 1800
+#define TO8F(x) (x).toUtf8().constData()
+#else
+#define TO8F(x) QFile::encodeName( x ).constData()
+#endif
+
+class QgsTerrainProcessor::RowKernel
+{
+  public:
+    RowKernel( const QList<Output>& outputs )
+        : mDerivativeFilter( 0 )
+    {
+      foreach ( const Output& output, outputs )
+      {
+        QgsDerivativeFilter* derivativeFilter = dynamic_cast<QgsDerivativeFilter*>( output.filter );
+        mFilters.append( output.filter );
+        mDerivativeFilters.append( derivativeFilter );
+        if ( !mDerivativeFilter )
+        {
+          mDerivativeFilter = derivativeFilter;
+        }
+      }
+    }
+    void operator()( float* above, float* row, float* below, int n, float* const* result ) const
+    {
+      // Derivatives are computed once and shared by all derivative based products
+      QVarLengthArray<float, 1024> derX( mDerivativeFilter ? n : 0 );
+      QVarLengthArray<float, 1024> derY( mDerivativeFilter ? n : 0 );
+      if ( mDerivativeFilter )
+      {
+        for ( int j = 0; j < n; ++j )
+        {
+          mDerivativeFilter->calcFirstDers( above, row, below, j, derX[j], derY[j] );
+        }
+      }
+      for ( int k = 0, nOutputs = mFilters.size(); k < nOutputs; ++k )
+      {
+        if ( mDerivativeFilters[k] )
+        {
+          float* out = result[k];
+          for ( int j = 0; j < n; ++j )
+          {
+            out[j] = mDerivativeFilters[k]->processDerivatives( derX[j], derY[j] );
+          }
+        }
+        else
+        {
+          mFilters[k]->processNineCellRow( above, row, below, result[k], n );
+        }
+      }
+    }
+
+  private:
+    QVector<QgsNineCellFilter*> mFilters;
+    QVector<QgsDerivativeFilter*> mDerivativeFilters;
+    QgsDerivativeFilter* mDerivativeFilter;
+};
+
+
+QgsTerrainProcessor::QgsTerrainProcessor( const QString& inputFile, const QString& outputFormat, const QgsRectangle &filterRegion, const QgsCoordinateReferenceSystem& filterRegionCrs )
+    : mInputFile( inputFile )
+    , mOutputFormat( outputFormat )
+    , mFilterRegion( filterRegion )
+    , mFilterRegionCrs( filterRegionCrs )
+    , mZFactor( -1 )
+{
+}
+
+QgsTerrainProcessor::~QgsTerrainProcessor()
+{
+  clearProducts();
+}
+
+void QgsTerrainProcessor::addProduct( Product product, const QString& outputFile, double lightAzimuth, double lightAngle )
+{
+  Output output;
+  output.product = product;
+  output.file = outputFile;
+  switch ( product )
+  {
+    case Slope:
+      output.filter = new QgsSlopeFilter( mInputFile, outputFile, mOutputFormat, mFilterRegion, mFilterRegionCrs );
+      break;
+    case Aspect:
+      output.filter = new QgsAspectFilter( mInputFile, outputFile, mOutputFormat, mFilterRegion, mFilterRegionCrs );
+      break;
+    case Hillshade:
+      output.filter = new QgsHillshadeFilter( mInputFile, outputFile, mOutputFormat, lightAzimuth, lightAngle, mFilterRegion, mFilterRegionCrs );
+      break;
+    case TotalCurvature:
+      output.filter = new QgsTotalCurvatureFilter( mInputFile, outputFile, mOutputFormat, mFilterRegion, mFilterRegionCrs );
+      break;
+    case Ruggedness:
+      output.filter = new QgsRuggednessFilter( mInputFile, outputFile, mOutputFormat, mFilterRegion, mFilterRegionCrs );
+      break;
+  }
+  mOutputs.append( output );
+}
+
+void QgsTerrainProcessor::clearProducts()
+{
+  foreach ( const Output& output, mOutputs )
+  {
+    delete output.filter;
+  }
+  mOutputs.clear();
+}
+
+int QgsTerrainProcessor::processRaster( QProgressDialog* p )
+{
+  if ( mOutputs.isEmpty() )
+  {
+    return 0;
+  }
+
+  GDALAllRegister();
+
+  //open input file
+  GDALDatasetH inputDataset = GDALOpen( TO8F( mInputFile ), GA_ReadOnly );
+  if ( inputDataset == NULL || GDALGetRasterCount( inputDataset ) < 1 )
+  {
+    if ( inputDataset )
+    {
+      GDALClose( inputDataset );
+    }
+    return 1; //opening of input file failed
+  }
+
+  //output driver
+  GDALDriverH outputDriver = GDALGetDriverByName( mOutputFormat.toLocal8Bit().data() );
+  if ( outputDriver == NULL || !CSLFetchBoolean( GDALGetMetadata( outputDriver, NULL ), GDAL_DCAP_CREATE, false ) )
+  {
+    GDALClose( inputDataset );
+    return 2;
+  }
+
+  //determine the window
+  int rowStart, rowEnd, colStart, colEnd;
+  if ( !QgsNineCellFilter::computeWindow( inputDataset, mFilterRegion, mFilterRegionCrs, rowStart, rowEnd, colStart, colEnd ) )
+  {
+    GDALClose( inputDataset );
+    return 2;
+  }
+  int xSize = colEnd - colStart;
+  int ySize = rowEnd - rowStart;
+
+  //open first raster band for reading (operation is only for single band raster)
+  GDALRasterBandH rasterBand = GDALGetRasterBand( inputDataset, 1 );
+  if ( rasterBand == NULL )
+  {
+    GDALClose( inputDataset );
+    return 4;
+  }
+  float inputNodataValue = GDALGetRasterNoDataValue( rasterBand, NULL );
+
+  if ( ySize < 3 ) //we require at least three rows (should be true for most datasets)
+  {
+    GDALClose( inputDataset );
+    return 6;
+  }
+
+  double gtrans[6] = {};
+  if ( GDALGetGeoTransform( inputDataset, &gtrans[0] ) != CE_None )
+  {
+    GDALClose( inputDataset );
+    return 1;
+  }
+  double zFactor = mZFactor;
+  if ( zFactor == -1 )
+  {
+    zFactor = QgsNineCellFilter::computeZFactor( inputDataset, rasterBand, rowStart, rowEnd, colStart, colEnd );
+  }
+
+  //create the output files and set up the filters of the products
+  QList<GDALDatasetH> outputDatasets;
+  QVector<GDALRasterBandH> outputBands;
+  int result = 0;
+  foreach ( const Output& output, mOutputs )
+  {
+    GDALDatasetH outputDataset = openOutputFile( inputDataset, outputDriver, output.file, colStart, rowStart, xSize, ySize );
+    if ( outputDataset == NULL )
+    {
+      result = 3; //create operation on output file failed
+      break;
+    }
+    outputDatasets.append( outputDataset );
+    GDALRasterBandH outputRasterBand = GDALGetRasterBand( outputDataset, 1 );
+    if ( outputRasterBand == NULL )
+    {
+      result = 5;
+      break;
+    }
+    //try to set -9999 as nodata value
+    GDALSetRasterNoDataValue( outputRasterBand, -9999 );
+    outputBands.append( outputRasterBand );
+
+    output.filter->setCellSizeX( qAbs( gtrans[1] ) );
+    output.filter->setCellSizeY( qAbs( gtrans[5] ) );
+    output.filter->setZFactor( zFactor );
+    output.filter->setInputNodataValue( inputNodataValue );
+    output.filter->setOutputNodataValue( GDALGetRasterNoDataValue( outputRasterBand, NULL ) );
+  }
+
+  if ( result == 0 )
+  {
+    RowKernel kernel( mOutputs );
+    if ( !QgsNineCellTiler::process<float>( rasterBand, colStart, rowStart, xSize, ySize, inputNodataValue,
+                                            outputBands, GDT_Float32, kernel, p ) )
+    {
+      result = 7;
+    }
+  }
+
+  GDALClose( inputDataset );
+  for ( int i = 0, n = outputDatasets.size(); i < n; ++i )
+  {
+    GDALClose( outputDatasets[i] );
+    if ( result != 0 )
+    {
+      GDALDeleteDataset( outputDriver, TO8F( mOutputs[i].file ) );
+    }
+  }
+  return result;
+}
+
+GDALDatasetH QgsTerrainProcessor::openOutputFile( GDALDatasetH inputDataset, GDALDriverH outputDriver, const QString& outputFile, int colStart, int rowStart, int xSize, int ySize )
+{
+  //open output file
+  char **papszOptions = NULL;
+  papszOptions = CSLSetNameValue( papszOptions, "COMPRESS", "LZW" );
+  GDALDatasetH outputDataset = GDALCreate( outputDriver, TO8F( outputFile ), xSize, ySize, 1, GDT_Float32, papszOptions );
+  CSLDestroy( papszOptions );
+  if ( outputDataset == NULL )
+  {
+    return outputDataset;
+  }
+
+  //get geotransform from inputDataset
+  double geotransform[6];
+  if ( GDALGetGeoTransform( inputDataset, geotransform ) != CE_None )
+  {
+    GDALClose( outputDataset );
+    return NULL;
+  }
+
+  // Shift for origin of window
+  geotransform[0] += colStart * geotransform[1] + rowStart * geotransform[2];
+  geotransform[3] += colStart * geotransform[4] + rowStart * geotransform[5];
+
+  GDALSetGeoTransform( outputDataset, geotransform );
+  GDALSetProjection( outputDataset, GDALGetProjectionRef( inputDataset ) );
+
+  return outputDataset;
+}
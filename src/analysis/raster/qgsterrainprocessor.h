@@ -0,0 +1,86 @@
+/***************************************************************************
+                          qgsterrainprocessor.h  -  Multi-product terrain analysis
+                          ---------------------------
+    begin                : December 2015
+    copyright            : (C) 2015 by Sandro Mani
+    email                : manisandro@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSTERRAINPROCESSOR_H
+#define QGSTERRAINPROCESSOR_H
+
+#include <QList>
+#include <QString>
+#include "gdal.h"
+#include "qgscoordinatereferencesystem.h"
+#include "qgsrectangle.h"
+
+class QgsNineCellFilter;
+class QProgressDialog;
+
+/**Computes several terrain products (i.e. slope, aspect and hillshade) of a DEM in a single pass.
+The DEM is read once, the first order derivatives are computed once per cell and shared by all derivative based
+products, and each product is written to its own output file.*/
+class ANALYSIS_EXPORT QgsTerrainProcessor
+{
+  public:
+    enum Product
+    {
+      Slope,
+      Aspect,
+      Hillshade,
+      TotalCurvature,
+      Ruggedness
+    };
+
+    QgsTerrainProcessor( const QString& inputFile, const QString& outputFormat, const QgsRectangle &filterRegion = QgsRectangle(), const QgsCoordinateReferenceSystem& filterRegionCrs = QgsCoordinateReferenceSystem() );
+    ~QgsTerrainProcessor();
+
+    /**Adds a product to compute, which is written to outputFile. lightAzimuth and lightAngle are only used for hillshades*/
+    void addProduct( Product product, const QString& outputFile, double lightAzimuth = 300, double lightAngle = 40 );
+    void clearProducts();
+
+    double zFactor() const { return mZFactor; }
+    /** Set to -1 to automatically compute */
+    void setZFactor( double factor ) { mZFactor = factor; }
+
+    /**Starts the calculation, reads from the input file and stores the results in the output files of the products
+      @param p progress dialog that receives update and that is checked for abort. 0 if no progress bar is needed.
+      @return 0 in case of success*/
+    int processRaster( QProgressDialog* p );
+
+  private:
+    class RowKernel;
+
+    struct Output
+    {
+      Product product;
+      QString file;
+      QgsNineCellFilter* filter;
+    };
+
+    QString mInputFile;
+    QString mOutputFormat;
+    QgsRectangle mFilterRegion;
+    QgsCoordinateReferenceSystem mFilterRegionCrs;
+    double mZFactor;
+    QList<Output> mOutputs;
+
+    /**Creates an output file with the geotransform of the window and the CRS of the input data
+      @return the output dataset or NULL in case of error*/
+    GDALDatasetH openOutputFile( GDALDatasetH inputDataset, GDALDriverH outputDriver, const QString& outputFile, int colStart, int rowStart, int xSize, int ySize );
+
+    QgsTerrainProcessor( const QgsTerrainProcessor& );
+    QgsTerrainProcessor& operator=( const QgsTerrainProcessor& );
+};
+
+#endif // QGSTERRAINPROCESSOR_H
@@ -26,29 +26,769 @@
 #include <cstring>
 #include <limits>
 #include <QProgressDialog>
+#include <QThreadPool>
 #include <QVector>
+#include <QtConcurrentMap>
 
 
-static inline double geoToPixelX( double gtrans[6], double x, double y )
+static inline double geoToPixelX( const double gtrans[6], double x, double y )
 {
   return ( -gtrans[0] * gtrans[5] + gtrans[2] * gtrans[3] - gtrans[2] * y + gtrans[5] * x ) / ( gtrans[1] * gtrans[5] - gtrans[2] * gtrans[4] );
 }
 
-static inline double geoToPixelY( double gtrans[6], double x, double y )
+static inline double geoToPixelY( const double gtrans[6], double x, double y )
 {
   return ( -gtrans[0] * gtrans[4] + gtrans[1] * gtrans[3] - gtrans[1] * y + gtrans[4] * x ) / ( gtrans[2] * gtrans[4] - gtrans[1] * gtrans[5] );
 }
 
-static inline double pixelToGeoX( double gtrans[6], double px, double py )
+static inline double pixelToGeoX( const double gtrans[6], double px, double py )
 {
   return gtrans[0] + px * gtrans[1] + py * gtrans[2];
 }
 
-static inline double pixelToGeoY( double gtrans[6], double px, double py )
+static inline double pixelToGeoY( const double gtrans[6], double px, double py )
 {
   return gtrans[3] + px * gtrans[4] + py * gtrans[5];
 }
 
+// Number of consecutive perimeter rays processed by one task
+static const int VIEWSHED_SECTOR_RAYS = 64;
+
+// Default memory limit, heightmaps (plus sweep state) larger than this are streamed in tiles instead of being read at once
+static const qint64 VIEWSHED_MAX_INMEMORY_BYTES = 1073741824;
+
+// Default edge length of the tiles of a streamed viewshed, in output pixels
+static const int VIEWSHED_TILE_SIZE = 512;
+
+// Read-only parameters shared by all sector tasks of a viewshed sweep
+struct ViewshedSweep
+{
+  const double* colDistSqr;
+  const double* rowDistSqr;
+  int colStart;
+  int colEnd;
+  int rowStart;
+  int rowEnd;
+  int obs[2];
+  int roi;
+  float noDataValue;
+  double observerHeight;
+  double targetHeight;
+  bool heightRelToTerr;
+  double gtrans[6];
+  double observerX;
+  double observerY;
+  double earthRadius;
+};
+
+struct ViewshedSector
+{
+  int firstRay;
+  int endRay;
+};
+
+// Heightmap, filter mask and sweep result of the whole window, held in memory
+struct ViewshedMemoryGrid
+{
+  const float* heightmap;
+  int heightmapSize;
+  const unsigned char* filterMask;
+  QAtomicInt* result;
+  int hmapWidth;
+  int maskWidth;
+  int colStart;
+  int rowStart;
+
+  inline bool cell( int col, int row, float& elev, QAtomicInt*& cellResult ) const
+  {
+    if ( filterMask && !filterMask[( row - rowStart ) * maskWidth + ( col - colStart )] )
+    {
+      return false;
+    }
+    int idx = ( row - rowStart ) * hmapWidth + ( col - colStart );
+    if ( idx >= heightmapSize )
+    {
+      return false;
+    }
+    elev = heightmap[idx];
+    cellResult = result + idx;
+    return true;
+  }
+};
+
+// A tile of a streamed viewshed. Offsets and sizes are relative to the window, in output pixels.
+struct ViewshedTile
+{
+  int x0;
+  int y0;
+  int width;
+  int height;
+  QVector<float> heights;
+  QVector<unsigned char> filterMask;
+  QVector<QAtomicInt> result;
+  const float* heightsData;
+  const unsigned char* filterMaskData;
+  QAtomicInt* resultData;
+};
+
+// Window split into tiles, of which only those touched by the rays currently processed are resident
+struct ViewshedTiledGrid
+{
+  ViewshedTile* const* tiles;
+  int tileWidth;
+  int tileHeight;
+  int nTilesX;
+  int width;
+  int height;
+  int colStart;
+  int rowStart;
+
+  inline bool cell( int col, int row, float& elev, QAtomicInt*& cellResult ) const
+  {
+    int x = col - colStart;
+    int y = row - rowStart;
+    if ( x >= width || y >= height )
+    {
+      return false;
+    }
+    const ViewshedTile* tile = tiles[( y / tileHeight ) * nTilesX + x / tileWidth];
+    if ( !tile )
+    {
+      return false;
+    }
+    int idx = ( y - tile->y0 ) * tile->width + ( x - tile->x0 );
+    if ( tile->filterMaskData && !tile->filterMaskData[idx] )
+    {
+      return false;
+    }
+    elev = tile->heightsData[idx];
+    cellResult = tile->resultData + idx;
+    return true;
+  }
+};
+
+// Heightmap shared by several observers, with a result buffer covering the window of a single observer
+struct ViewshedSharedGrid
+{
+  const float* heightmap;
+  int hmapWidth;
+  int hmapHeight;
+  int colStart;
+  int rowStart;
+  QAtomicInt* result;
+  int resultWidth;
+  int resultColStart;
+  int resultRowStart;
+
+  inline bool cell( int col, int row, float& elev, QAtomicInt*& cellResult ) const
+  {
+    int x = col - colStart;
+    int y = row - rowStart;
+    if ( x >= hmapWidth || y >= hmapHeight )
+    {
+      return false;
+    }
+    elev = heightmap[y * hmapWidth + x];
+    cellResult = result + ( row - resultRowStart ) * resultWidth + ( col - resultColStart );
+    return true;
+  }
+};
+
+static inline void viewshedRayTarget( int radiusNumber, int roi, const int obs[2], int target[2] )
+{
+  if ( radiusNumber <= roi )
+  {
+    target[0] = obs[0] + roi;
+    target[1] = obs[1] + radiusNumber;
+  }
+  else if ( radiusNumber <= 3 * roi )
+  {
+    target[0] = obs[0] + 2 * roi - radiusNumber;
+    target[1] = obs[1] + roi;
+  }
+  else if ( radiusNumber <= 5 * roi )
+  {
+    target[0] = obs[0] - roi;
+    target[1] = obs[1] + 4 * roi - radiusNumber;
+  }
+  else if ( radiusNumber <= 7 * roi )
+  {
+    target[0] = obs[0] + radiusNumber - 6 * roi;
+    target[1] = obs[1] - roi;
+  }
+  else
+  {
+    target[0] = obs[0] + roi;
+    target[1] = obs[1] + radiusNumber - 8 * roi;
+  }
+}
+
+// Offset of the minor coordinate at step i along a ray
+static inline int viewshedRayOffset( int i, double slope )
+{
+  if ( i * slope > 0 )
+  {
+    return int( qCeil( i * slope - 0.5 ) );
+  }
+  else
+  {
+    return int( qFloor( i * slope + 0.5 ) );
+  }
+}
+
+static inline void viewshedStoreResult( QAtomicInt& cell, int value )
+{
+  // Keep the result of the ray with the highest number, as the serial sweep would
+  int current = cell;
+  while ( value > current && !cell.testAndSetOrdered( current, value ) )
+  {
+    current = cell;
+  }
+}
+
+template<class Grid>
+class ViewshedSectorWorker
+{
+  public:
+    ViewshedSectorWorker( const ViewshedSweep* sweep, const Grid* grid ) : mSweep( sweep ), mGrid( grid ) {}
+
+    void operator()( const ViewshedSector& sector ) const
+    {
+      for ( int radiusNumber = sector.firstRay; radiusNumber < sector.endRay; ++radiusNumber )
+      {
+        processRay( radiusNumber );
+      }
+    }
+
+  private:
+    const ViewshedSweep* mSweep;
+    const Grid* mGrid;
+
+    void processRay( int radiusNumber ) const
+    {
+      const ViewshedSweep& s = *mSweep;
+      const int* obs = s.obs;
+      int target[2];
+      viewshedRayTarget( radiusNumber, s.roi, obs, target );
+
+      // Line of sight from observer to target.
+      int delta[2] = {target[0] - obs[0], target[1] - obs[1]};
+      int inciny = qAbs( delta[0] ) < qAbs( delta[1] );
+
+      // Step along coord (X or Y) that varies most from observer to target.
+      // That coord is inciny. Slope is how fast the other coord varies.
+      double slope = ( double ) delta[1 - inciny] / ( double ) delta[inciny];
+      int step = delta[inciny] > 0 ? 1 : -1;
+      double horizon_slope = -99999; // Slope (in vertical plane) to horizon so far.
+
+      // i = 0 would be the observer, which is always visible.
+      for ( int i = step; true; i += step )
+      {
+        int p[2];
+        p[inciny] = obs[inciny] + i;
+        p[1 - inciny] = obs[1 - inciny] + viewshedRayOffset( i, slope );
+
+        if ( p[0] < s.colStart || p[0] > s.colEnd || p[1] < s.rowStart || p[1] > s.rowEnd )
+        {
+          break;
+        }
+
+        //Is the point in the outside of the viewshed area?
+        double dx = qAbs( p[0] - obs[0] ), dy = qAbs( p[1] - obs[1] );
+        if ( !( dx <= s.roi && dy <= s.roi && dx * dx + dy * dy <= double( s.roi ) * double( s.roi ) ) )
+        {
+          break;
+        }
+
+        // Skip cells outside the filter region or the heightmap
+        float pElev;
+        QAtomicInt* cellResult;
+        if ( !mGrid->cell( p[0], p[1], pElev, cellResult ) )
+        {
+          continue;
+        }
+        if ( pElev == s.noDataValue )
+        {
+          continue;
+        }
+
+        // Earth curvature correction
+        double geoDistSqr;
+        if ( s.colDistSqr )
+        {
+          geoDistSqr = s.colDistSqr[p[0] - s.colStart] + s.rowDistSqr[p[1] - s.rowStart];
+        }
+        else
+        {
+          double pGeoX = pixelToGeoX( s.gtrans, p[0], p[1] );
+          double pGeoY = pixelToGeoY( s.gtrans, p[0], p[1] );
+          geoDistSqr = ( s.observerX - pGeoX ) * ( s.observerX - pGeoX ) + ( s.observerY - pGeoY ) * ( s.observerY - pGeoY );
+        }
+        // http://www.swisstopo.admin.ch/internet/swisstopo/de/home/topics/survey/faq/curvature.html
+        pElev -= 0.87 * geoDistSqr / ( 2 * s.earthRadius );
+
+        // Update the slope if the current slope is greater than the old one
+        double slopeToP = double( pElev - s.observerHeight ) / double( qAbs( p[inciny] - obs[inciny] ) );
+        horizon_slope = qMax( horizon_slope, slopeToP );
+
+        double horizon_alt =  s.observerHeight + horizon_slope * qAbs( p[inciny] - obs[inciny] );
+        double tHeight = s.targetHeight;
+        if ( s.heightRelToTerr )
+          tHeight += pElev;
+        viewshedStoreResult( *cellResult, 2 * radiusNumber + ( tHeight >= horizon_alt ? 1 : 0 ) );
+      }
+    }
+};
+
+class ViewshedMaskWorker
+{
+  public:
+    ViewshedMaskWorker( const QPolygon& poly, int colMin, int colMax, int colStart, int rowStart, int maskWidth, unsigned char* mask )
+        : mPoly( poly ), mColMin( colMin ), mColMax( colMax ), mColStart( colStart ), mRowStart( rowStart ), mMaskWidth( maskWidth ), mMask( mask ) {}
+
+    void operator()( int row ) const
+    {
+      unsigned char* maskRow = mMask + ( row - mRowStart ) * mMaskWidth - mColStart;
+      for ( int col = mColMin; col <= mColMax; ++col )
+      {
+        maskRow[col] = mPoly.containsPoint( QPoint( col, row ), Qt::OddEvenFill );
+      }
+    }
+
+  private:
+    const QPolygon& mPoly;
+    int mColMin;
+    int mColMax;
+    int mColStart;
+    int mRowStart;
+    int mMaskWidth;
+    unsigned char* mMask;
+};
+
+// Rasterizes the filter polygon into the mask covering the given (absolute) cell rectangle
+static void viewshedRasterizeFilter( const QPolygon& filterPoly, const QRect& rect, unsigned char* mask )
+{
+  std::memset( mask, 0, rect.width() * rect.height() );
+  QRect maskRect = filterPoly.boundingRect().intersected( rect );
+  QVector<int> maskRows;
+  for ( int row = maskRect.top(); row <= maskRect.bottom(); ++row )
+  {
+    maskRows.append( row );
+  }
+  QtConcurrent::blockingMap( maskRows, ViewshedMaskWorker( filterPoly, maskRect.left(), maskRect.right(), rect.left(), rect.top(), rect.width(), mask ) );
+}
+
+static int viewshedWaveSize()
+{
+  return qMax( 1, QThreadPool::globalInstance()->maxThreadCount() ) * 4 * VIEWSHED_SECTOR_RAYS;
+}
+
+// Processes the rays [firstRay, endRay) in sector chunks on the global thread pool
+template<class Grid>
+static void viewshedSweepRays( const ViewshedSweep& sweep, const Grid& grid, int firstRay, int endRay )
+{
+  QVector<ViewshedSector> sectors;
+  for ( int ray = firstRay; ray < endRay; ray += VIEWSHED_SECTOR_RAYS )
+  {
+    ViewshedSector sector;
+    sector.firstRay = ray;
+    sector.endRay = qMin( endRay, ray + VIEWSHED_SECTOR_RAYS );
+    sectors.append( sector );
+  }
+  QtConcurrent::blockingMap( sectors, ViewshedSectorWorker<Grid>( &sweep, &grid ) );
+}
+
+// Reads the given window of the scaled heightmap, which averages the srcWidth x srcHeight source pixels at
+// srcColStart, srcRowStart down to scaledWidth x scaledHeight pixels. x0, y0, width and height are relative to the
+// window, in scaled pixels. Parts of the heightmap are read with the resampling ratio of the whole window, so that
+// tiles match the corresponding parts of the whole heightmap.
+static bool viewshedReadHeights( GDALRasterBandH inputBand, int srcColStart, int srcRowStart, int srcWidth, int srcHeight, int scaledWidth, int scaledHeight, int x0, int y0, int width, int height, float* buffer )
+{
+  GDALRasterIOExtraArg rioargs;
+  INIT_RASTERIO_EXTRA_ARG( rioargs );
+  rioargs.eResampleAlg = GRIORA_Average;
+  if ( x0 == 0 && y0 == 0 && width == scaledWidth && height == scaledHeight )
+  {
+    return GDALRasterIOEx( inputBand, GF_Read, srcColStart, srcRowStart, srcWidth, srcHeight, buffer, width, height, GDT_Float32, 0, 0, &rioargs ) == CE_None;
+  }
+  double xRatio = double( srcWidth ) / scaledWidth;
+  double yRatio = double( srcHeight ) / scaledHeight;
+  rioargs.bFloatingPointWindowValidity = TRUE;
+  rioargs.dfXOff = srcColStart + x0 * xRatio;
+  rioargs.dfYOff = srcRowStart + y0 * yRatio;
+  rioargs.dfXSize = width * xRatio;
+  rioargs.dfYSize = height * yRatio;
+  int xOff = qFloor( rioargs.dfXOff );
+  int yOff = qFloor( rioargs.dfYOff );
+  int xEnd = qMin( srcColStart + srcWidth, qCeil( rioargs.dfXOff + rioargs.dfXSize ) );
+  int yEnd = qMin( srcRowStart + srcHeight, qCeil( rioargs.dfYOff + rioargs.dfYSize ) );
+  return GDALRasterIOEx( inputBand, GF_Read, xOff, yOff, xEnd - xOff, yEnd - yOff, buffer, width, height, GDT_Float32, 0, 0, &rioargs ) == CE_None;
+}
+
+// Tile edge length which covers whole blocks of the input band where possible
+static int viewshedTileSize( int blockSize, int accuracyFactor )
+{
+  if ( accuracyFactor == 1 && blockSize > 0 && blockSize <= VIEWSHED_TILE_SIZE && blockSize % 16 == 0 )
+  {
+    return ( VIEWSHED_TILE_SIZE / blockSize ) * blockSize;
+  }
+  return VIEWSHED_TILE_SIZE;
+}
+
+// Determines (conservatively) the first and last ray passing through each tile, by walking each ray tile slab by tile slab
+static void viewshedTileRayRanges( const ViewshedSweep& s, int width, int height, int tileWidth, int tileHeight, int nTilesX, QVector<int>& firstRay, QVector<int>& lastRay )
+{
+  const int start[2] = { s.colStart, s.rowStart };
+  const int size[2] = { width, height };
+  const int tileSize[2] = { tileWidth, tileHeight };
+  for ( int radiusNumber = 0; radiusNumber < 8 * s.roi; ++radiusNumber )
+  {
+    int target[2];
+    viewshedRayTarget( radiusNumber, s.roi, s.obs, target );
+    int delta[2] = {target[0] - s.obs[0], target[1] - s.obs[1]};
+    int inciny = qAbs( delta[0] ) < qAbs( delta[1] );
+    int other = 1 - inciny;
+    double slope = ( double ) delta[other] / ( double ) delta[inciny];
+    int step = delta[inciny] > 0 ? 1 : -1;
+
+    for ( int i = step; qAbs( i ) <= s.roi; )
+    {
+      int a = s.obs[inciny] + i - start[inciny];
+      if ( a < 0 || a >= size[inciny] )
+      {
+        break;
+      }
+      int slab = a / tileSize[inciny];
+      int aEnd = step > 0 ? qMin(( slab + 1 ) * tileSize[inciny], size[inciny] ) - 1 : slab * tileSize[inciny];
+      int iEnd = aEnd + start[inciny] - s.obs[inciny];
+      if ( qAbs( iEnd ) > s.roi )
+      {
+        iEnd = step * s.roi;
+      }
+      int b0 = s.obs[other] + viewshedRayOffset( i, slope ) - start[other];
+      int b1 = s.obs[other] + viewshedRayOffset( iEnd, slope ) - start[other];
+      int t0 = qBound( 0, qMin( b0, b1 ), size[other] - 1 ) / tileSize[other];
+      int t1 = qBound( 0, qMax( b0, b1 ), size[other] - 1 ) / tileSize[other];
+      for ( int t = t0; t <= t1; ++t )
+      {
+        int tile = inciny ? slab * nTilesX + t : t * nTilesX + slab;
+        firstRay[tile] = qMin( firstRay[tile], radiusNumber );
+        lastRay[tile] = qMax( lastRay[tile], radiusNumber );
+      }
+      i = iEnd + step;
+    }
+  }
+}
+
+// Writes the final values of a tile (or of an untouched region if result is 0) to the output band
+static bool viewshedWriteTile( GDALRasterBandH outputBand, const ViewshedSweep& s, int x0, int y0, int width, int height, const QAtomicInt* result, bool displayVisible )
+{
+  QVector<unsigned char> viewshed( width * height, 255 * !displayVisible );
+  if ( result )
+  {
+    for ( int i = 0, n = viewshed.size(); i < n; ++i )
+    {
+      int value = result[i];
+      if ( value >= 0 )
+      {
+        viewshed[i] = ( value & 1 ) ? 255 : 0;
+      }
+    }
+  }
+  // The observer is always visible from itself
+  int obsX = s.obs[0] - s.colStart - x0;
+  int obsY = s.obs[1] - s.rowStart - y0;
+  if ( obsX >= 0 && obsX < width && obsY >= 0 && obsY < height )
+  {
+    viewshed[obsY * width + obsX] = 255;
+  }
+  return GDALRasterIO( outputBand, GF_Write, x0, y0, width, height, viewshed.data(), width, height, GDT_Byte, 0, 0 ) == CE_None;
+}
+
+// Computes the raster window covering the square of the given radius around the observer
+static void viewshedWindow( const double gtrans[6], const QgsPoint& observerPos, double radius, int terWidth, int terHeight, int& colStart, int& rowStart, int& colEnd, int& rowEnd )
+{
+  QList<QgsPoint> cornerPoints = QList<QgsPoint>()
+                                 << QgsPoint( observerPos.x() - radius, observerPos.y() - radius )
+                                 << QgsPoint( observerPos.x() + radius, observerPos.y() - radius )
+                                 << QgsPoint( observerPos.x() + radius, observerPos.y() + radius )
+                                 << QgsPoint( observerPos.x() - radius, observerPos.y() + radius );
+  colStart = std::numeric_limits<int>::max();
+  rowStart = std::numeric_limits<int>::max();
+  colEnd = -std::numeric_limits<int>::max();
+  rowEnd = -std::numeric_limits<int>::max();
+  foreach ( const QgsPoint& p, cornerPoints )
+  {
+    double x = geoToPixelX( gtrans, p.x(), p.y() );
+    double y = geoToPixelY( gtrans, p.x(), p.y() );
+    colStart = qMin( colStart, qFloor( x ) );
+    colEnd = qMax( colEnd, qCeil( x ) );
+    rowStart = qMin( rowStart, qFloor( y ) );
+    rowEnd = qMax( rowEnd, qCeil( y ) );
+  }
+  colStart = qMax( 0, colStart );
+  colEnd = qMin( terWidth - 1, colEnd );
+  rowStart = qMax( 0, rowStart );
+  rowEnd = qMin( terHeight - 1, rowEnd );
+}
+
+// Precomputes the squared geo distances to the observer per column and per row.
+// These are only separable for north-up rasters, otherwise the tables are left empty.
+static void viewshedDistanceTables( const double gtrans[6], const QgsPoint& observerPos, int colStart, int colEnd, int rowStart, int rowEnd, QVector<double>& colDistSqr, QVector<double>& rowDistSqr )
+{
+  if ( gtrans[2] != 0. || gtrans[4] != 0. )
+  {
+    return;
+  }
+  colDistSqr.resize( colEnd - colStart + 1 );
+  for ( int col = colStart; col <= colEnd; ++col )
+  {
+    double dx = observerPos.x() - pixelToGeoX( gtrans, col, 0 );
+    colDistSqr[col - colStart] = dx * dx;
+  }
+  rowDistSqr.resize( rowEnd - rowStart + 1 );
+  for ( int row = rowStart; row <= rowEnd; ++row )
+  {
+    double dy = observerPos.y() - pixelToGeoY( gtrans, 0, row );
+    rowDistSqr[row - rowStart] = dy * dy;
+  }
+}
+
+// Creates the output dataset covering the (scaled) window, with the georeferencing of the input
+static GDALDatasetH viewshedCreateOutput( GDALDatasetH inputDataset, const QString& outputFile, const QString& outputFormat, int width, int height, GDALDataType dataType, char** options, const double gtrans[6], int colStart, int rowStart )
+{
+  GDALDriverH outputDriver = GDALGetDriverByName( outputFormat.toLocal8Bit().data() );
+  if ( outputDriver == 0 )
+  {
+    QgsDebugMsg( "Failed to get driver for output" );
+    return NULL;
+  }
+  if ( !CSLFetchBoolean( GDALGetMetadata( outputDriver, NULL ), GDAL_DCAP_CREATE, false ) )
+  {
+    QgsDebugMsg( "Driver for output does not support creation" );
+    return NULL;
+  }
+  GDALDatasetH outputDataset = GDALCreate( outputDriver, outputFile.toLocal8Bit().data(), width, height, 1, dataType, options );
+  if ( outputDataset == NULL )
+  {
+    QgsDebugMsg( "Failed to open output dataset" );
+    return NULL;
+  }
+
+  double outgtrans[6];
+  std::memcpy( outgtrans, gtrans, sizeof( outgtrans ) );
+
+  // Shift for origin of window
+  outgtrans[0] += colStart * outgtrans[1] + rowStart * outgtrans[2];
+  outgtrans[3] += colStart * outgtrans[4] + rowStart * outgtrans[5];
+
+  GDALSetGeoTransform( outputDataset, outgtrans );
+  GDALSetProjection( outputDataset, GDALGetProjectionRef( inputDataset ) );
+  return outputDataset;
+}
+
+/**
+ * Streams the sweep over a heightmap which is too large to be held in memory.
+ * The rays are processed in waves in ascending order. Before each wave the tiles its rays pass through are read,
+ * after each wave the tiles no later ray passes through are written to the output and released. The resident
+ * set is hence bounded by the tiles along the wedge of rays of one wave (plus the tiles around the observer and
+ * along the first rays, which are also touched by the last rays).
+ */
+static bool viewshedSweepTiled( GDALRasterBandH inputBand, GDALRasterBandH outputBand, int srcColStart, int srcRowStart, int srcWidth, int srcHeight, int width, int height, int tileWidth, int tileHeight, const QPolygon& filterPoly, const ViewshedSweep& sweep, bool displayVisible, QProgressDialog* progress )
+{
+  int nTilesX = ( width + tileWidth - 1 ) / tileWidth;
+  int nTilesY = ( height + tileHeight - 1 ) / tileHeight;
+  int nRays = 8 * sweep.roi;
+  QVector<int> firstRay( nTilesX * nTilesY, std::numeric_limits<int>::max() );
+  QVector<int> lastRay( nTilesX * nTilesY, -1 );
+  viewshedTileRayRanges( sweep, width, height, tileWidth, tileHeight, nTilesX, firstRay, lastRay );
+
+  QVector<ViewshedTile*> tiles( nTilesX * nTilesY, 0 );
+  ViewshedTiledGrid grid;
+  grid.tiles = tiles.constData();
+  grid.tileWidth = tileWidth;
+  grid.tileHeight = tileHeight;
+  grid.nTilesX = nTilesX;
+  grid.width = width;
+  grid.height = height;
+  grid.colStart = sweep.colStart;
+  grid.rowStart = sweep.rowStart;
+
+  bool success = true;
+  // Tiles no ray passes through only get the default value
+  for ( int t = 0, n = tiles.size(); t < n && success; ++t )
+  {
+    if ( lastRay[t] < 0 )
+    {
+      int x0 = ( t % nTilesX ) * tileWidth;
+      int y0 = ( t / nTilesX ) * tileHeight;
+      success = viewshedWriteTile( outputBand, sweep, x0, y0, qMin( tileWidth, width - x0 ), qMin( tileHeight, height - y0 ), 0, displayVisible );
+    }
+  }
+
+  int waveSize = viewshedWaveSize();
+  for ( int waveStart = 0; waveStart < nRays && success; waveStart += waveSize )
+  {
+    if ( progress )
+    {
+      if ( progress->wasCanceled() )
+      {
+        QgsDebugMsg( "Canceled" );
+        success = false;
+        break;
+      }
+      progress->setValue( waveStart );
+    }
+    int waveEnd = qMin( nRays, waveStart + waveSize );
+
+    // Load the tiles needed by the rays of this wave
+    for ( int t = 0, n = tiles.size(); t < n && success; ++t )
+    {
+      if ( tiles[t] || firstRay[t] >= waveEnd || lastRay[t] < waveStart )
+      {
+        continue;
+      }
+      ViewshedTile* tile = new ViewshedTile;
+      tile->x0 = ( t % nTilesX ) * tileWidth;
+      tile->y0 = ( t / nTilesX ) * tileHeight;
+      tile->width = qMin( tileWidth, width - tile->x0 );
+      tile->height = qMin( tileHeight, height - tile->y0 );
+      tile->heights.fill( sweep.noDataValue, tile->width * tile->height );
+      success = viewshedReadHeights( inputBand, srcColStart, srcRowStart, srcWidth, srcHeight, width, height, tile->x0, tile->y0, tile->width, tile->height, tile->heights.data() );
+      tile->heightsData = tile->heights.constData();
+      tile->filterMaskData = 0;
+      if ( !filterPoly.isEmpty() )
+      {
+        tile->filterMask.resize( tile->width * tile->height );
+        viewshedRasterizeFilter( filterPoly, QRect( sweep.colStart + tile->x0, sweep.rowStart + tile->y0, tile->width, tile->height ), tile->filterMask.data() );
+        tile->filterMaskData = tile->filterMask.constData();
+      }
+      tile->result = QVector<QAtomicInt>( tile->width * tile->height, QAtomicInt( -1 ) );
+      tile->resultData = tile->result.data();
+      tiles[t] = tile;
+    }
+    if ( !success )
+    {
+      QgsDebugMsg( "Failed to fetch raster pixels" );
+      break;
+    }
+
+    viewshedSweepRays( sweep, grid, waveStart, waveEnd );
+
+    // Write and release the tiles which no later ray passes through
+    for ( int t = 0, n = tiles.size(); t < n && success; ++t )
+    {
+      if ( tiles[t] && lastRay[t] < waveEnd )
+      {
+        ViewshedTile* tile = tiles[t];
+        success = viewshedWriteTile( outputBand, sweep, tile->x0, tile->y0, tile->width, tile->height, tile->resultData, displayVisible );
+        delete tile;
+        tiles[t] = 0;
+      }
+    }
+    if ( !success )
+    {
+      QgsDebugMsg( "Failed to write to output dataset" );
+    }
+  }
+  qDeleteAll( tiles );
+  return success;
+}
+
+// An observer of a cumulative viewshed. The distance tables of the sweep are set up by the worker.
+struct ViewshedObserver
+{
+  int index;
+  QgsPoint pos;
+  ViewshedSweep sweep;
+};
+
+// Computes the viewshed of one observer over the shared heightmap and adds it to the cumulative result
+class ViewshedObserverWorker
+{
+  public:
+    ViewshedObserverWorker( const float* heightmap, int hmapWidth, int hmapHeight, int colStart, int rowStart, QAtomicInt* cumulative, QgsViewshed::CumulativeMode mode )
+        : mHeightmap( heightmap ), mHmapWidth( hmapWidth ), mHmapHeight( hmapHeight ), mColStart( colStart ), mRowStart( rowStart ), mCumulative( cumulative ), mMode( mode ) {}
+
+    void operator()( const ViewshedObserver& observer ) const
+    {
+      ViewshedSweep sweep = observer.sweep;
+      QVector<double> colDistSqr;
+      QVector<double> rowDistSqr;
+      viewshedDistanceTables( sweep.gtrans, observer.pos, sweep.colStart, sweep.colEnd, sweep.rowStart, sweep.rowEnd, colDistSqr, rowDistSqr );
+      sweep.colDistSqr = colDistSqr.isEmpty() ? 0 : colDistSqr.constData();
+      sweep.rowDistSqr = rowDistSqr.isEmpty() ? 0 : rowDistSqr.constData();
+
+      int width = sweep.colEnd - sweep.colStart + 1;
+      int height = sweep.rowEnd - sweep.rowStart + 1;
+      QVector<QAtomicInt> result( width * height, QAtomicInt( -1 ) );
+
+      ViewshedSharedGrid grid;
+      grid.heightmap = mHeightmap;
+      grid.hmapWidth = mHmapWidth;
+      grid.hmapHeight = mHmapHeight;
+      grid.colStart = mColStart;
+      grid.rowStart = mRowStart;
+      grid.result = result.data();
+      grid.resultWidth = width;
+      grid.resultColStart = sweep.colStart;
+      grid.resultRowStart = sweep.rowStart;
+
+      // Observers run concurrently, hence each sweeps its rays serially
+      ViewshedSector allRays;
+      allRays.firstRay = 0;
+      allRays.endRay = 8 * sweep.roi;
+      ViewshedSectorWorker<ViewshedSharedGrid> sectorWorker( &sweep, &grid );
+      sectorWorker( allRays );
+
+      // The observer is always visible from itself
+      result[( sweep.obs[1] - sweep.rowStart ) * width + ( sweep.obs[0] - sweep.colStart )] = 1;
+
+      quint32 bit = quint32( 1 ) << observer.index;
+      for ( int y = 0; y < height; ++y )
+      {
+        int row = sweep.rowStart + y - mRowStart;
+        if ( row >= mHmapHeight )
+        {
+          break;
+        }
+        for ( int x = 0; x < width; ++x )
+        {
+          int col = sweep.colStart + x - mColStart;
+          int value = result[y * width + x];
+          if ( col >= mHmapWidth || value < 0 || !( value & 1 ) )
+          {
+            continue;
+          }
+          QAtomicInt& cell = mCumulative[row * mHmapWidth + col];
+          if ( mMode == QgsViewshed::CountObservers )
+          {
+            cell.fetchAndAddRelaxed( 1 );
+          }
+          else
+          {
+            int current = cell;
+            while ( !cell.testAndSetOrdered( current, int( quint32( current ) | bit ) ) )
+            {
+              current = cell;
+            }
+          }
+        }
+      }
+    }
+
+  private:
+    const float* mHeightmap;
+    int mHmapWidth;
+    int mHmapHeight;
+    int mColStart;
+    int mRowStart;
+    QAtomicInt* mCumulative;
+    QgsViewshed::CumulativeMode mMode;
+};
+
+qint64 QgsViewshed::sMaxInMemoryBytes = VIEWSHED_MAX_INMEMORY_BYTES;
+
 bool QgsViewshed::computeViewshed( const QString &inputFile, const QString &outputFile, const QString &outputFormat, QgsPoint observerPos, const QgsCoordinateReferenceSystem &observerPosCrs, double observerHeight, double targetHeight, bool heightRelToTerr, double radius, const QGis::UnitType distanceElevUnit, const QVector<QgsPoint> &filterRegion, bool displayVisible, int accuracyFactor, QProgressDialog *progress )
 {
   // Open input file
@@ -109,28 +849,8 @@ bool QgsViewshed::computeViewshed( const QString &inputFile, const QString &outp
     earthRadius *= QGis::fromUnitToUnitFactor( QGis::Meters, datasetCrs.mapUnits() );
   }
 
-  QList<QgsPoint> cornerPoints = QList<QgsPoint>()
-                                 << QgsPoint( observerPos.x() - radius, observerPos.y() - radius )
-                                 << QgsPoint( observerPos.x() + radius, observerPos.y() - radius )
-                                 << QgsPoint( observerPos.x() + radius, observerPos.y() + radius )
-                                 << QgsPoint( observerPos.x() - radius, observerPos.y() + radius );
-  int colStart = std::numeric_limits<int>::max();
-  int rowStart = std::numeric_limits<int>::max();
-  int colEnd = -std::numeric_limits<int>::max();
-  int rowEnd = -std::numeric_limits<int>::max();
-  foreach ( const QgsPoint& p, cornerPoints )
-  {
-    double x = geoToPixelX( gtrans, p.x(), p.y() );
-    double y = geoToPixelY( gtrans, p.x(), p.y() );
-    colStart = qMin( colStart, qFloor( x ) );
-    colEnd = qMax( colEnd, qCeil( x ) );
-    rowStart = qMin( rowStart, qFloor( y ) );
-    rowEnd = qMax( rowEnd, qCeil( y ) );
-  }
-  colStart = qMax( 0, colStart );
-  colEnd = qMin( terWidth - 1, colEnd );
-  rowStart = qMax( 0, rowStart );
-  rowEnd = qMin( terHeight - 1, rowEnd );
+  int colStart, rowStart, colEnd, rowEnd;
+  viewshedWindow( gtrans, observerPos, radius, terWidth, terHeight, colStart, rowStart, colEnd, rowEnd );
   int hmapWidth = colEnd - colStart + 1;
   int hmapHeight = rowEnd - rowStart + 1;
   QPolygon filterPoly;
@@ -149,26 +869,40 @@ bool QgsViewshed::computeViewshed( const QString &inputFile, const QString &outp
 
   int scaledHmapHeight = hmapHeight / accuracyFactor;
   int scaledHmapWidth = hmapWidth / accuracyFactor;
+  int srcColStart = colStart;
+  int srcRowStart = rowStart;
+  int srcWidth = hmapWidth;
+  int srcHeight = hmapHeight;
 
   // Read input heightmap
-  // Allow at most 1GB allocated
-  if ( scaledHmapWidth * scaledHmapHeight * sizeof( float ) > 1073741824 )
+  // Hold at most sMaxInMemoryBytes in memory, stream larger heightmaps in tiles.
+  // The in-memory sweep needs per cell the height, the sweep result and the output value,
+  // plus the filter mask over the scaled window and the distance tables.
+  qint64 scaledCells = qint64( scaledHmapWidth ) * scaledHmapHeight;
+  qint64 scaledWindowWidth = colEnd / accuracyFactor - colStart / accuracyFactor + 1;
+  qint64 scaledWindowHeight = rowEnd / accuracyFactor - rowStart / accuracyFactor + 1;
+  qint64 requiredBytes = scaledCells * ( sizeof( float ) + sizeof( QAtomicInt ) + sizeof( unsigned char ) );
+  requiredBytes += ( scaledWindowWidth + scaledWindowHeight ) * sizeof( double );
+  if ( !filterPoly.isEmpty() )
   {
-    GDALClose( inputDataset );
-    QgsDebugMsg( "Too much memory required" );
-    return false;
+    requiredBytes += scaledWindowWidth * scaledWindowHeight * sizeof( unsigned char );
   }
-  QVector<float> heightmap( scaledHmapWidth * scaledHmapHeight, noDataValue );
-  GDALRasterIOExtraArg rioargs;
-  INIT_RASTERIO_EXTRA_ARG( rioargs );
-  rioargs.eResampleAlg = GRIORA_Average;
-  CPLErr err = GDALRasterIOEx( inputBand, GF_Read, colStart, rowStart, hmapWidth, hmapHeight, heightmap.data(), scaledHmapWidth, scaledHmapHeight, GDT_Float32, 0, 0, &rioargs );
-  if ( err != CE_None )
+  bool tiled = requiredBytes > sMaxInMemoryBytes;
+  QVector<float> heightmap;
+  if ( !tiled )
   {
-    GDALClose( inputDataset );
-    QgsDebugMsg( "Failed to fetch raster pixels" );
-    return false;
+    heightmap.fill( noDataValue, scaledHmapWidth * scaledHmapHeight );
+    if ( !viewshedReadHeights( inputBand, srcColStart, srcRowStart, srcWidth, srcHeight, scaledHmapWidth, scaledHmapHeight, 0, 0, scaledHmapWidth, scaledHmapHeight, heightmap.data() ) )
+    {
+      GDALClose( inputDataset );
+      QgsDebugMsg( "Failed to fetch raster pixels" );
+      return false;
+    }
   }
+  int blockXSize = 0, blockYSize = 0;
+  GDALGetBlockSize( inputBand, &blockXSize, &blockYSize );
+  int tileWidth = viewshedTileSize( blockXSize, accuracyFactor );
+  int tileHeight = viewshedTileSize( blockYSize, accuracyFactor );
 
   // Adjust for reduced resolution
   gtrans[1] *= accuracyFactor;
@@ -189,38 +923,22 @@ bool QgsViewshed::computeViewshed( const QString &inputFile, const QString &outp
   }
 
   // Prepare output
-  GDALDriverH outputDriver = GDALGetDriverByName( outputFormat.toLocal8Bit().data() );
-  if ( outputDriver == 0 )
+  char **papszOptions = CSLSetNameValue( 0, "COMPRESS", "LZW" );
+  if ( tiled )
   {
-    GDALClose( inputDataset );
-    QgsDebugMsg( "Failed to get driver for output" );
-    return false;
+    // Let the output blocks coincide with the tiles of the sweep
+    papszOptions = CSLSetNameValue( papszOptions, "TILED", "YES" );
+    papszOptions = CSLSetNameValue( papszOptions, "BLOCKXSIZE", QString::number( tileWidth ).toLocal8Bit().data() );
+    papszOptions = CSLSetNameValue( papszOptions, "BLOCKYSIZE", QString::number( tileHeight ).toLocal8Bit().data() );
   }
-  if ( !CSLFetchBoolean( GDALGetMetadata( outputDriver, NULL ), GDAL_DCAP_CREATE, false ) )
-  {
-    GDALClose( inputDataset );
-    QgsDebugMsg( "Driver for output does not support creation" );
-    return false;
-  }
-  char **papszOptions = CSLSetNameValue( 0, "COMPRESS", "LZW" );
-  GDALDatasetH outputDataset = GDALCreate( outputDriver, outputFile.toLocal8Bit().data(), hmapWidth, hmapHeight, 1, GDT_Byte, papszOptions );
+  GDALDatasetH outputDataset = viewshedCreateOutput( inputDataset, outputFile, outputFormat, hmapWidth, hmapHeight, GDT_Byte, papszOptions, gtrans, colStart, rowStart );
+  CSLDestroy( papszOptions );
   if ( outputDataset == NULL )
   {
     GDALClose( inputDataset );
-    QgsDebugMsg( "Failed to open output dataset" );
     return false;
   }
 
-  double outgtrans[6];
-  std::memcpy( outgtrans, gtrans, sizeof( gtrans ) );
-
-  // Shift for origin of window
-  outgtrans[0] += colStart * outgtrans[1] + rowStart * outgtrans[2];
-  outgtrans[3] += colStart * outgtrans[4] + rowStart * outgtrans[5];
-
-  GDALSetGeoTransform( outputDataset, outgtrans );
-  GDALSetProjection( outputDataset, GDALGetProjectionRef( inputDataset ) );
-
   GDALRasterBandH outputBand = GDALGetRasterBand( outputDataset, 1 );
   if ( outputBand == 0 )
   {
@@ -233,7 +951,18 @@ bool QgsViewshed::computeViewshed( const QString &inputFile, const QString &outp
 
   // Offset observer elevation by position at point
   if ( heightRelToTerr )
-    observerHeight += heightmap[( obs[1] - rowStart ) * hmapWidth + ( obs[0] - colStart )];
+  {
+    if ( tiled )
+    {
+      float obsElev = noDataValue;
+      viewshedReadHeights( inputBand, srcColStart, srcRowStart, srcWidth, srcHeight, hmapWidth, hmapHeight, obs[0] - colStart, obs[1] - rowStart, 1, 1, &obsElev );
+      observerHeight += obsElev;
+    }
+    else
+    {
+      observerHeight += heightmap[( obs[1] - rowStart ) * hmapWidth + ( obs[0] - colStart )];
+    }
+  }
 
 
   // Compute viewshed
@@ -242,8 +971,66 @@ bool QgsViewshed::computeViewshed( const QString &inputFile, const QString &outp
   {
     progress->setRange( 0, 8 * roi );
   }
-  QVector<unsigned char> viewshed( hmapWidth * hmapHeight, 255 * !displayVisible );
-  for ( int radiusNumber = 0; radiusNumber < 8 * roi; ++radiusNumber )
+
+  int windowWidth = colEnd - colStart + 1;
+  int windowHeight = rowEnd - rowStart + 1;
+  QVector<double> colDistSqr;
+  QVector<double> rowDistSqr;
+  viewshedDistanceTables( gtrans, observerPos, colStart, colEnd, rowStart, rowEnd, colDistSqr, rowDistSqr );
+
+  ViewshedSweep sweep;
+  sweep.colDistSqr = colDistSqr.isEmpty() ? 0 : colDistSqr.constData();
+  sweep.rowDistSqr = rowDistSqr.isEmpty() ? 0 : rowDistSqr.constData();
+  sweep.colStart = colStart;
+  sweep.colEnd = colEnd;
+  sweep.rowStart = rowStart;
+  sweep.rowEnd = rowEnd;
+  sweep.obs[0] = obs[0];
+  sweep.obs[1] = obs[1];
+  sweep.roi = roi;
+  sweep.noDataValue = noDataValue;
+  sweep.observerHeight = observerHeight;
+  sweep.targetHeight = targetHeight;
+  sweep.heightRelToTerr = heightRelToTerr;
+  std::memcpy( sweep.gtrans, gtrans, sizeof( gtrans ) );
+  sweep.observerX = observerPos.x();
+  sweep.observerY = observerPos.y();
+  sweep.earthRadius = earthRadius;
+
+  if ( tiled )
+  {
+    bool success = viewshedSweepTiled( inputBand, outputBand, srcColStart, srcRowStart, srcWidth, srcHeight, hmapWidth, hmapHeight, tileWidth, tileHeight, filterPoly, sweep, displayVisible, progress );
+    GDALClose( inputDataset );
+    GDALClose( outputDataset );
+    return success;
+  }
+
+  // Rasterize the filter polygon once instead of testing it for every ray step
+  QVector<unsigned char> filterMask;
+  if ( !filterPoly.isEmpty() )
+  {
+    filterMask.resize( windowWidth * windowHeight );
+    viewshedRasterizeFilter( filterPoly, QRect( colStart, rowStart, windowWidth, windowHeight ), filterMask.data() );
+  }
+
+  // Each cell records 2 * ray + visibility of the last ray which wrote it, so that
+  // resolving overlapping rays with an atomic max yields the serial sweep result
+  QVector<QAtomicInt> sweepResult( hmapWidth * hmapHeight, QAtomicInt( -1 ) );
+
+  ViewshedMemoryGrid grid;
+  grid.heightmap = heightmap.constData();
+  grid.heightmapSize = heightmap.size();
+  grid.filterMask = filterMask.isEmpty() ? 0 : filterMask.constData();
+  grid.result = sweepResult.data();
+  grid.hmapWidth = hmapWidth;
+  grid.maskWidth = windowWidth;
+  grid.colStart = colStart;
+  grid.rowStart = rowStart;
+
+  // Process the rays in waves of sector chunks, checking for cancellation in between
+  int nRays = 8 * roi;
+  int waveSize = viewshedWaveSize();
+  for ( int waveStart = 0; waveStart < nRays; waveStart += waveSize )
   {
     if ( progress )
     {
@@ -254,122 +1041,245 @@ bool QgsViewshed::computeViewshed( const QString &inputFile, const QString &outp
         GDALClose( outputDataset );
         return false;
       }
-      progress->setValue( radiusNumber );
-    }
-    int target[2];
-    if ( radiusNumber <= roi )
-    {
-      target[0] = obs[0] + roi;
-      target[1] = obs[1] + radiusNumber;
-    }
-    else if ( radiusNumber <= 3 * roi )
-    {
-      target[0] = obs[0] + 2 * roi - radiusNumber;
-      target[1] = obs[1] + roi;
-    }
-    else if ( radiusNumber <= 5 * roi )
-    {
-      target[0] = obs[0] - roi;
-      target[1] = obs[1] + 4 * roi - radiusNumber;
-    }
-    else if ( radiusNumber <= 7 * roi )
-    {
-      target[0] = obs[0] + radiusNumber - 6 * roi;
-      target[1] = obs[1] - roi;
-    }
-    else if ( radiusNumber < 8 * roi )
-    {
-      target[0] = obs[0] + roi;
-      target[1] = obs[1] + radiusNumber - 8 * roi;
+      progress->setValue( waveStart );
     }
-    else
+    viewshedSweepRays( sweep, grid, waveStart, qMin( nRays, waveStart + waveSize ) );
+  }
+
+  QVector<unsigned char> viewshed( hmapWidth * hmapHeight, 255 * !displayVisible );
+  for ( int i = 0, n = viewshed.size(); i < n; ++i )
+  {
+    int value = sweepResult[i];
+    if ( value >= 0 )
     {
-      break; // All terrain points processed.
+      viewshed[i] = ( value & 1 ) ? 255 : 0;
     }
+  }
+  // The observer is always visible from itself
+  viewshed[( obs[1] - rowStart ) * hmapWidth + ( obs[0] - colStart )] = 255;
 
-    // Line of sight from observer to target.
-    int delta[2] = {target[0] - obs[0], target[1] - obs[1]};
-    int inciny = qAbs( delta[0] ) < qAbs( delta[1] );
 
-    // Step along coord (X or Y) that varies most from observer to target.
-    // That coord is inciny. Slope is how fast the other coord varies.
-    double slope = ( double ) delta[1 - inciny] / ( double ) delta[inciny];
-    int step = delta[inciny] > 0 ? 1 : -1;
-    double horizon_slope = -99999; // Slope (in vertical plane) to horizon so far.
+  // Write output
+  CPLErr err = GDALRasterIO( outputBand, GF_Write, 0, 0, hmapWidth, hmapHeight, viewshed.data(), hmapWidth, hmapHeight, GDT_Byte, 0, 0 );
+  GDALClose( inputDataset );
+  GDALClose( outputDataset );
+  if ( err != CE_None )
+  {
+    QgsDebugMsg( "Failed to write to output dataset" );
+    return false;
+  }
+  return true;
+}
+
+bool QgsViewshed::computeCumulativeViewshed( const QString &inputFile, const QString &outputFile, const QString &outputFormat, const QList<QgsPoint> &observerPositions, const QgsCoordinateReferenceSystem &observerPosCrs, double observerHeight, double targetHeight, bool heightRelToTerr, double radius, const QGis::UnitType distanceElevUnit, CumulativeMode mode, int accuracyFactor, QProgressDialog *progress )
+{
+  if ( observerPositions.isEmpty() )
+  {
+    QgsDebugMsg( "No observers specified" );
+    return false;
+  }
+  if ( mode == ObserverBitmask && observerPositions.size() > 32 )
+  {
+    QgsDebugMsg( "At most 32 observers are supported in bitmask mode" );
+    return false;
+  }
+
+  // Open input file
+  GDALDatasetH inputDataset = GDALOpen( inputFile.toLocal8Bit().data(), GA_ReadOnly );
+  if ( inputDataset == 0 )
+  {
+    QgsDebugMsg( "Failed to open input dataset" );
+    return false;
+  }
+
+  // Transform measurements to dataset CRS
+  QgsCoordinateReferenceSystem datasetCrs( QString( GDALGetProjectionRef( inputDataset ) ) );
+  if ( !datasetCrs.isValid() )
+  {
+    QgsDebugMsg( "Could not determine input dataset CRS" );
+    GDALClose( inputDataset );
+    return false;
+  }
+  QgsCoordinateTransform ct( observerPosCrs, datasetCrs );
+  if ( datasetCrs.mapUnits() != distanceElevUnit )
+  {
+    observerHeight *= QGis::fromUnitToUnitFactor( distanceElevUnit, datasetCrs.mapUnits() );
+    targetHeight *= QGis::fromUnitToUnitFactor( distanceElevUnit, datasetCrs.mapUnits() );
+    radius *= QGis::fromUnitToUnitFactor( distanceElevUnit, datasetCrs.mapUnits() );
+  }
+
+  // Open input band
+  GDALRasterBandH inputBand = GDALGetRasterBand( inputDataset, 1 );
+  if ( inputBand == NULL )
+  {
+    GDALClose( inputDataset );
+    QgsDebugMsg( "Failed to open input dataset band 1" );
+    return false;
+  }
+  float noDataValue = GDALGetRasterNoDataValue( inputBand, NULL );
 
-    // i = 0 would be the observer, which is always visible.
-    for ( int i = step; true; i += step )
+  double gtrans[6] = {};
+  if ( GDALGetGeoTransform( inputDataset, &gtrans[0] ) != CE_None )
+  {
+    GDALClose( inputDataset );
+    QgsDebugMsg( "Failed to query input dataset geotransform" );
+    return false;
+  }
+  int terWidth = GDALGetRasterXSize( inputDataset );
+  int terHeight = GDALGetRasterYSize( inputDataset );
+  double earthRadius = 6370000;
+  if ( datasetCrs.mapUnits() != QGis::Meters )
+  {
+    earthRadius *= QGis::fromUnitToUnitFactor( QGis::Meters, datasetCrs.mapUnits() );
+  }
+
+  // Compute the window of each observer, and the window covering all of them
+  QVector<ViewshedObserver> observers( observerPositions.size() );
+  int colStart = std::numeric_limits<int>::max();
+  int rowStart = std::numeric_limits<int>::max();
+  int colEnd = -std::numeric_limits<int>::max();
+  int rowEnd = -std::numeric_limits<int>::max();
+  for ( int i = 0, n = observers.size(); i < n; ++i )
+  {
+    ViewshedObserver& observer = observers[i];
+    observer.index = i;
+    observer.pos = ct.transform( observerPositions[i] );
+    ViewshedSweep& sweep = observer.sweep;
+    viewshedWindow( gtrans, observer.pos, radius, terWidth, terHeight, sweep.colStart, sweep.rowStart, sweep.colEnd, sweep.rowEnd );
+    sweep.obs[0] = qRound( geoToPixelX( gtrans, observer.pos.x(), observer.pos.y() ) );
+    sweep.obs[1] = qRound( geoToPixelY( gtrans, observer.pos.x(), observer.pos.y() ) );
+    if ( sweep.obs[0] < sweep.colStart || sweep.obs[0] > sweep.colEnd || sweep.obs[1] < sweep.rowStart || sweep.obs[1] > sweep.rowEnd )
     {
-      int p[2];
-      p[inciny] = obs[inciny] + i;
+      GDALClose( inputDataset );
+      QgsDebugMsg( QString( "Observer %1 is outside vieweshed area, reprojection distortion?" ).arg( i ) );
+      return false;
+    }
+    colStart = qMin( colStart, sweep.colStart );
+    colEnd = qMax( colEnd, sweep.colEnd );
+    rowStart = qMin( rowStart, sweep.rowStart );
+    rowEnd = qMax( rowEnd, sweep.rowEnd );
+  }
+  int hmapWidth = ( colEnd - colStart + 1 ) / accuracyFactor;
+  int hmapHeight = ( rowEnd - rowStart + 1 ) / accuracyFactor;
 
-      if ( i * slope > 0 )
-      {
-        p[1 - inciny] = obs[1 - inciny] + int( qCeil( i * slope - 0.5 ) );
-      }
-      else
-      {
-        p[1 - inciny] = obs[1 - inciny] + int( qFloor( i * slope + 0.5 ) );
-      }
+  // Read input heightmap once for all observers
+  // Allow at most sMaxInMemoryBytes allocated: the heightmap, the cumulative result and the output values,
+  // plus the sweep result of each observer processed concurrently
+  qint64 sharedBytes = qint64( hmapWidth ) * hmapHeight * ( sizeof( float ) + sizeof( QAtomicInt ) + sizeof( quint32 ) );
+  qint64 observerBytes = 0;
+  foreach ( const ViewshedObserver& observer, observers )
+  {
+    const ViewshedSweep& sweep = observer.sweep;
+    qint64 observerCells = qint64(( sweep.colEnd - sweep.colStart ) / accuracyFactor + 2 ) * (( sweep.rowEnd - sweep.rowStart ) / accuracyFactor + 2 );
+    observerBytes = qMax( observerBytes, observerCells * qint64( sizeof( QAtomicInt ) ) );
+  }
+  int waveSize = qMax( 1, QThreadPool::globalInstance()->maxThreadCount() );
+  if ( sharedBytes < sMaxInMemoryBytes )
+  {
+    waveSize = qMin( qint64( waveSize ), ( sMaxInMemoryBytes - sharedBytes ) / observerBytes );
+  }
+  if ( sharedBytes >= sMaxInMemoryBytes || waveSize < 1 )
+  {
+    GDALClose( inputDataset );
+    QgsDebugMsg( "Too much memory required" );
+    return false;
+  }
+  QVector<float> heightmap( hmapWidth * hmapHeight, noDataValue );
+  if ( !viewshedReadHeights( inputBand, colStart, rowStart, colEnd - colStart + 1, rowEnd - rowStart + 1, hmapWidth, hmapHeight, 0, 0, hmapWidth, hmapHeight, heightmap.data() ) )
+  {
+    GDALClose( inputDataset );
+    QgsDebugMsg( "Failed to fetch raster pixels" );
+    return false;
+  }
 
-      if ( p[0] < colStart || p[0] > colEnd || p[1] < rowStart || p[1] > rowEnd )
-      {
-        break;
-      }
+  // Adjust for reduced resolution
+  gtrans[1] *= accuracyFactor;
+  gtrans[2] *= accuracyFactor;
+  gtrans[4] *= accuracyFactor;
+  gtrans[5] *= accuracyFactor;
+  colStart /= accuracyFactor;
+  rowStart /= accuracyFactor;
+  for ( int i = 0, n = observers.size(); i < n; ++i )
+  {
+    ViewshedSweep& sweep = observers[i].sweep;
+    int roi = .5 * qMin(( sweep.colEnd - sweep.colStart + 1 ) / accuracyFactor, ( sweep.rowEnd - sweep.rowStart + 1 ) / accuracyFactor );
+    sweep.colStart /= accuracyFactor;
+    sweep.colEnd /= accuracyFactor;
+    sweep.rowStart /= accuracyFactor;
+    sweep.rowEnd /= accuracyFactor;
+    sweep.obs[0] /= accuracyFactor;
+    sweep.obs[1] /= accuracyFactor;
+    sweep.roi = roi;
+    sweep.colDistSqr = 0;
+    sweep.rowDistSqr = 0;
+    sweep.noDataValue = noDataValue;
+    sweep.observerHeight = observerHeight;
+    sweep.targetHeight = targetHeight;
+    sweep.heightRelToTerr = heightRelToTerr;
+    std::memcpy( sweep.gtrans, gtrans, sizeof( gtrans ) );
+    sweep.observerX = observers[i].pos.x();
+    sweep.observerY = observers[i].pos.y();
+    sweep.earthRadius = earthRadius;
 
-      //Is the point in the outside of the viewshed area?
-      double dx = qAbs( p[0] - obs[0] ), dy = qAbs( p[1] - obs[1] );
-      if ( !( dx <= roi && dy <= roi && dx * dx + dy * dy <= double( roi ) * double( roi ) ) )
-      {
-        break;
-      }
-      if ( !filterPoly.isEmpty() && !filterPoly.containsPoint( QPoint( p[0], p[1] ), Qt::OddEvenFill ) )
-      {
-        continue;
-      }
+    // Offset observer elevation by position at point
+    int obsCol = sweep.obs[0] - colStart;
+    int obsRow = sweep.obs[1] - rowStart;
+    if ( heightRelToTerr && obsCol >= 0 && obsCol < hmapWidth && obsRow >= 0 && obsRow < hmapHeight )
+    {
+      sweep.observerHeight += heightmap[obsRow * hmapWidth + obsCol];
+    }
+  }
 
-      int idx = ( p[1] - rowStart ) * hmapWidth + ( p[0] - colStart );
-      if ( idx >= heightmap.size() )
-      {
-        continue;
-      }
-      float pElev = heightmap[idx];
-      if ( pElev == noDataValue )
-      {
-        continue;
-      }
+  // Prepare output
+  char **papszOptions = CSLSetNameValue( 0, "COMPRESS", "LZW" );
+  GDALDatasetH outputDataset = viewshedCreateOutput( inputDataset, outputFile, outputFormat, hmapWidth, hmapHeight, GDT_UInt32, papszOptions, gtrans, colStart, rowStart );
+  CSLDestroy( papszOptions );
+  if ( outputDataset == NULL )
+  {
+    GDALClose( inputDataset );
+    return false;
+  }
+  GDALRasterBandH outputBand = GDALGetRasterBand( outputDataset, 1 );
+  if ( outputBand == 0 )
+  {
+    GDALClose( inputDataset );
+    GDALClose( outputDataset );
+    QgsDebugMsg( "Failed to get output dataset band 1" );
+    return false;
+  }
+  GDALSetRasterNoDataValue( outputBand, 0 );
 
-      // Earth curvature correction
-      double pGeoX = pixelToGeoX( gtrans, p[0], p[1] );
-      double pGeoY = pixelToGeoY( gtrans, p[0], p[1] );
-      double geoDistSqr = ( observerPos.x() - pGeoX ) * ( observerPos.x() - pGeoX ) + ( observerPos.y() - pGeoY ) * ( observerPos.y() - pGeoY );
-      // http://www.swisstopo.admin.ch/internet/swisstopo/de/home/topics/survey/faq/curvature.html
-      pElev -= 0.87 * geoDistSqr / ( 2 * earthRadius );
-
-      // Update the slope if the current slope is greater than the old one
-      double s = double( pElev - observerHeight ) / double( qAbs( p[inciny] - obs[inciny] ) );
-      horizon_slope = qMax( horizon_slope, s );
-
-      double horizon_alt =  observerHeight + horizon_slope * qAbs( p[inciny] - obs[inciny] );
-      double tHeight = targetHeight;
-      if ( heightRelToTerr )
-        tHeight += pElev;
-      if ( tHeight >= horizon_alt )
-      {
-        viewshed[( p[1] - rowStart ) * hmapWidth + ( p[0] - colStart )] = 255;
-      }
-      else
+  // Compute the viewsheds, as many observers at a time as there are threads (and memory)
+  if ( progress )
+  {
+    progress->setRange( 0, observers.size() );
+  }
+  QVector<QAtomicInt> cumulative( hmapWidth * hmapHeight, QAtomicInt( 0 ) );
+  ViewshedObserverWorker worker( heightmap.constData(), hmapWidth, hmapHeight, colStart, rowStart, cumulative.data(), mode );
+  for ( int waveStart = 0, n = observers.size(); waveStart < n; waveStart += waveSize )
+  {
+    if ( progress )
+    {
+      if ( progress->wasCanceled() )
       {
-        viewshed[( p[1] - rowStart ) * hmapWidth + ( p[0] - colStart )] = 0;
+        QgsDebugMsg( "Canceled" );
+        GDALClose( inputDataset );
+        GDALClose( outputDataset );
+        return false;
       }
+      progress->setValue( waveStart );
     }
+    QVector<ViewshedObserver> wave = observers.mid( waveStart, waveSize );
+    QtConcurrent::blockingMap( wave, worker );
   }
-  // The observer is always visible from itself
-  viewshed[( obs[1] - rowStart ) * hmapWidth + ( obs[0] - colStart )] = 255;
-
 
   // Write output
-  err = GDALRasterIO( outputBand, GF_Write, 0, 0, hmapWidth, hmapHeight, viewshed.data(), hmapWidth, hmapHeight, GDT_Byte, 0, 0 );
+  QVector<quint32> values( cumulative.size() );
+  for ( int i = 0, n = values.size(); i < n; ++i )
+  {
+    values[i] = quint32( int( cumulative[i] ) );
+  }
+  CPLErr err = GDALRasterIO( outputBand, GF_Write, 0, 0, hmapWidth, hmapHeight, values.data(), hmapWidth, hmapHeight, GDT_UInt32, 0, 0 );
   GDALClose( inputDataset );
   GDALClose( outputDataset );
   if ( err != CE_None )
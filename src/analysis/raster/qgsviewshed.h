@@ -24,11 +24,19 @@ class QProgressDialog;
 
 #include "qgis.h"
 
+#include <QList>
 #include <QVector>
 
 class ANALYSIS_EXPORT QgsViewshed
 {
   public:
+    /** How the viewsheds of several observers are combined */
+    enum CumulativeMode
+    {
+      CountObservers, /**< Each cell holds the number of observers which see it */
+      ObserverBitmask /**< Bit i of each cell is set if observer i sees it (at most 32 observers) */
+    };
+
     static bool computeViewshed( const QString& inputFile,
                                  const QString& outputFile, const QString& outputFormat,
                                  QgsPoint observerPos, const QgsCoordinateReferenceSystem& observerPosCrs,
@@ -37,6 +45,24 @@ class ANALYSIS_EXPORT QgsViewshed
                                  const QVector<QgsPoint> &filterRegion = QVector<QgsPoint>(), bool displayVisible = true, int accuracyFactor = 1,
                                  QProgressDialog* progress = 0 );
 
+    /** Computes the viewsheds of several observers and combines them into a single UInt32 band, see CumulativeMode.
+     * The DEM window covering all observers is read once and the observers are processed concurrently.
+     * Cells seen by no observer are 0, which is also the nodata value of the output. */
+    static bool computeCumulativeViewshed( const QString& inputFile,
+                                           const QString& outputFile, const QString& outputFormat,
+                                           const QList<QgsPoint>& observerPositions, const QgsCoordinateReferenceSystem& observerPosCrs,
+                                           double observerHeight, double targetHeight, bool heightRelToTerr, double radius,
+                                           const QGis::UnitType distanceElevUnit, CumulativeMode mode = CountObservers, int accuracyFactor = 1,
+                                           QProgressDialog* progress = 0 );
+
+    /** Sets the memory (in bytes) a viewshed may use for the heightmap and the sweep state. Larger viewsheds are
+     * streamed in tiles, larger cumulative viewsheds fail. Defaults to 1GB.
+     * @note added in 2.16 */
+    static void setMaxInMemoryBytes( qint64 bytes ) { sMaxInMemoryBytes = bytes; }
+    static qint64 maxInMemoryBytes() { return sMaxInMemoryBytes; }
+
+  private:
+    static qint64 sMaxInMemoryBytes;
 };
 
 #endif // QGSVIEWSHED_H
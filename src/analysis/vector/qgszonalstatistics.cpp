@@ -21,8 +21,16 @@
 #include "qgsvectorlayer.h"
 #include "gdal.h"
 #include "cpl_string.h"
+#include <qmath.h>
+#include <algorithm>
+#include <limits>
+#include <QCache>
+#include <QMutex>
 #include <QProgressDialog>
 #include <QFile>
+#include <QStringList>
+#include <QThread>
+#include <QtConcurrentMap>
 
 #if defined(GDAL_VERSION_NUM) && GDAL_VERSION_NUM >= 1800
 #define TO8F(x) (x).toUtf8().constData()
@@ -30,12 +38,357 @@
 #define TO8F(x) QFile::encodeName( x ).constData()
 #endif
 
-QgsZonalStatistics::QgsZonalStatistics( QgsVectorLayer* polygonLayer, const QString& rasterFile, const QString& attributePrefix, int rasterBand )
+// Statistics of the pixels of one zone, weighted by the covered pixel fraction
+struct ZoneStatistics
+{
+  ZoneStatistics() : count( 0 ), sum( 0 ), sumSquares( 0 ), min( std::numeric_limits<double>::max() ), max( -std::numeric_limits<double>::max() ) {}
+
+  void addValue( double value, double weight, double histogramMin, double histogramBinWidth )
+  {
+    count += weight;
+    sum += value * weight;
+    sumSquares += value * value * weight;
+    if ( weight > 0 )
+    {
+      min = qMin( min, value );
+      max = qMax( max, value );
+      if ( !histogram.isEmpty() && value >= histogramMin )
+      {
+        int bin = ( int )(( value - histogramMin ) / histogramBinWidth );
+        if ( bin == histogram.size() && value == histogramMin + histogram.size() * histogramBinWidth )
+        {
+          --bin; //the maximum belongs to the last bin
+        }
+        if ( bin < histogram.size() )
+        {
+          histogram[bin] += weight;
+        }
+      }
+    }
+  }
+
+  double count;
+  double sum;
+  double sumSquares;
+  double min;
+  double max;
+  QVector<double> histogram;
+};
+
+// A polygon to evaluate, with its rings and the raster window covering it
+struct Zone
+{
+  QgsFeatureId id;
+  QList<QgsPolyline> rings;
+  QVector<bool> holes;
+  int offsetX;
+  int offsetY;
+  int nCellsX;
+  int nCellsY;
+  int blockIndex;
+  ZoneStatistics statistics;
+
+  bool operator<( const Zone& other ) const { return blockIndex < other.blockIndex; }
+};
+
+// Thread safe cache of raster blocks, read as float values
+class ZonalBlockCache
+{
+  public:
+    ZonalBlockCache( GDALRasterBandH band, int rasterXSize, int rasterYSize )
+        : mBand( band ), mRasterXSize( rasterXSize ), mRasterYSize( rasterYSize )
+    {
+      GDALGetBlockSize( band, &mBlockXSize, &mBlockYSize );
+      mBlockXSize = qBound( 1, mBlockXSize, rasterXSize );
+      mBlockYSize = qBound( 1, mBlockYSize, rasterYSize );
+      //read scanline or strip organised rasters in several rows at once
+      if ( mBlockXSize * mBlockYSize < sMinBlockPixels )
+      {
+        mBlockYSize = qMin( rasterYSize, mBlockYSize * qMax( 1, sMinBlockPixels / ( mBlockXSize * mBlockYSize ) ) );
+      }
+      mBlocksX = ( rasterXSize + mBlockXSize - 1 ) / mBlockXSize;
+      mBlocks.setMaxCost( sMaxCachedPixels );
+    }
+
+    int blockXSize() const { return mBlockXSize; }
+    int blockYSize() const { return mBlockYSize; }
+    int blocksX() const { return mBlocksX; }
+    /**Width of the blocks of a block column, which is smaller than the block size at the right border*/
+    int blockWidth( int blockCol ) const { return qMin( mBlockXSize, mRasterXSize - blockCol * mBlockXSize ); }
+
+    /**Returns the values of a block, or an empty vector if it could not be read*/
+    QVector<float> block( int blockCol, int blockRow )
+    {
+      int key = blockRow * mBlocksX + blockCol;
+      QMutexLocker locker( &mMutex );
+      QVector<float>* cached = mBlocks.object( key );
+      if ( cached )
+      {
+        return *cached;
+      }
+
+      int width = blockWidth( blockCol );
+      int height = qMin( mBlockYSize, mRasterYSize - blockRow * mBlockYSize );
+      QVector<float> values( width * height );
+      if ( GDALRasterIO( mBand, GF_Read, blockCol * mBlockXSize, blockRow * mBlockYSize, width, height, values.data(), width, height, GDT_Float32, 0, 0 ) != CE_None )
+      {
+        values.clear();
+      }
+      if ( values.size() <= mBlocks.maxCost() )
+      {
+        mBlocks.insert( key, new QVector<float>( values ), values.size() );
+      }
+      return values;
+    }
+
+  private:
+    static const int sMinBlockPixels = 65536;
+    static const int sMaxCachedPixels = 32 * 1024 * 1024;
+
+    GDALRasterBandH mBand;
+    int mRasterXSize;
+    int mRasterYSize;
+    int mBlockXSize;
+    int mBlockYSize;
+    int mBlocksX;
+    QMutex mMutex;
+    QCache<int, QVector<float> > mBlocks;
+};
+
+// Calculates the statistics of a zone from the pixels whose centre is inside the polygon, or from the precise pixel
+// coverage if at most one pixel centre is inside
+class ZonalStatisticsWorker
+{
+  public:
+    ZonalStatisticsWorker( ZonalBlockCache* cache, const QgsRectangle& rasterBBox, double cellSizeX, double cellSizeY, float nodataValue,
+                           int histogramBins, double histogramMin, double histogramMax )
+        : mCache( cache ), mRasterBBox( rasterBBox ), mCellSizeX( cellSizeX ), mCellSizeY( cellSizeY ), mNodataValue( nodataValue )
+        , mHistogramBins( histogramBins ), mHistogramMin( histogramMin ), mHistogramBinWidth( histogramBins > 0 ? ( histogramMax - histogramMin ) / histogramBins : 0 ) {}
+
+    void operator()( Zone& zone ) const
+    {
+      zone.statistics = ZoneStatistics();
+      zone.statistics.histogram.fill( 0, mHistogramBinWidth > 0 ? mHistogramBins : 0 );
+      statisticsFromMiddlePoints( zone );
+      if ( zone.statistics.count <= 1 )
+      {
+        //the cell resolution is probably larger than the polygon area. We switch to precise pixel - polygon intersection in this case
+        zone.statistics = ZoneStatistics();
+        zone.statistics.histogram.fill( 0, mHistogramBinWidth > 0 ? mHistogramBins : 0 );
+        statisticsFromPreciseIntersection( zone );
+      }
+      //the rings are not needed anymore
+      zone.rings.clear();
+      zone.holes.clear();
+    }
+
+  private:
+    ZonalBlockCache* mCache;
+    QgsRectangle mRasterBBox;
+    double mCellSizeX;
+    double mCellSizeY;
+    float mNodataValue;
+    int mHistogramBins;
+    double mHistogramMin;
+    double mHistogramBinWidth;
+
+    bool validPixel( float value ) const
+    {
+      return value != mNodataValue && !qIsNaN( value );
+    }
+
+    // Appends the column ranges [start, end) of the pixels whose centre on the row is inside the polygon (even-odd rule)
+    void rowSpans( const Zone& zone, int row, QVector<int>& spans ) const
+    {
+      double y = mRasterBBox.yMaximum() - ( row + 0.5 ) * mCellSizeY;
+      QVector<double> crossings;
+      foreach ( const QgsPolyline& ring, zone.rings )
+      {
+        for ( int i = 1, n = ring.size(); i < n; ++i )
+        {
+          const QgsPoint& p1 = ring[i - 1];
+          const QgsPoint& p2 = ring[i];
+          if (( p1.y() > y ) != ( p2.y() > y ) )
+          {
+            crossings.append( p1.x() + ( y - p1.y() ) * ( p2.x() - p1.x() ) / ( p2.y() - p1.y() ) );
+          }
+        }
+      }
+      std::sort( crossings.begin(), crossings.end() );
+      int colEnd = zone.offsetX + zone.nCellsX;
+      for ( int i = 0; i + 1 < crossings.size(); i += 2 )
+      {
+        int start = ( int ) qBound( double( zone.offsetX ), ceil(( crossings[i] - mRasterBBox.xMinimum() ) / mCellSizeX - 0.5 ), double( colEnd ) );
+        int end = ( int ) qBound( double( zone.offsetX ), ceil(( crossings[i + 1] - mRasterBBox.xMinimum() ) / mCellSizeX - 0.5 ), double( colEnd ) );
+        if ( start < end )
+        {
+          spans << start << end;
+        }
+      }
+    }
+
+    void statisticsFromMiddlePoints( Zone& zone ) const
+    {
+      int blockXSize = mCache->blockXSize();
+      int blockYSize = mCache->blockYSize();
+      int rowEnd = zone.offsetY + zone.nCellsY;
+      int colEnd = zone.offsetX + zone.nCellsX;
+
+      //process the zone in strips of block rows, so that each block is fetched once
+      for ( int blockRow = zone.offsetY / blockYSize; blockRow * blockYSize < rowEnd; ++blockRow )
+      {
+        int stripStart = qMax( zone.offsetY, blockRow * blockYSize );
+        int stripEnd = qMin( rowEnd, ( blockRow + 1 ) * blockYSize );
+        QVector< QVector<int> > spans( stripEnd - stripStart );
+        for ( int row = stripStart; row < stripEnd; ++row )
+        {
+          rowSpans( zone, row, spans[row - stripStart] );
+        }
+
+        for ( int blockCol = zone.offsetX / blockXSize; blockCol * blockXSize < colEnd; ++blockCol )
+        {
+          int blockColStart = blockCol * blockXSize;
+          int blockColEnd = blockColStart + mCache->blockWidth( blockCol );
+          QVector<float> block;
+          bool fetched = false;
+          for ( int row = stripStart; row < stripEnd; ++row )
+          {
+            const QVector<int>& rowSpans = spans[row - stripStart];
+            for ( int i = 0; i < rowSpans.size(); i += 2 )
+            {
+              int start = qMax( rowSpans[i], blockColStart );
+              int end = qMin( rowSpans[i + 1], blockColEnd );
+              if ( start >= end )
+              {
+                continue;
+              }
+              if ( !fetched )
+              {
+                block = mCache->block( blockCol, blockRow );
+                fetched = true;
+              }
+              if ( block.isEmpty() )
+              {
+                continue;
+              }
+              const float* values = block.constData() + ( row - blockRow * blockYSize ) * ( blockColEnd - blockColStart ) - blockColStart;
+              for ( int col = start; col < end; ++col )
+              {
+                if ( validPixel( values[col] ) )
+                {
+                  zone.statistics.addValue( values[col], 1.0, mHistogramMin, mHistogramBinWidth );
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+
+    void statisticsFromPreciseIntersection( Zone& zone ) const
+    {
+      int blockXSize = mCache->blockXSize();
+      int blockYSize = mCache->blockYSize();
+      double pixelArea = mCellSizeX * mCellSizeY;
+      for ( int row = zone.offsetY; row < zone.offsetY + zone.nCellsY; ++row )
+      {
+        double yMax = mRasterBBox.yMaximum() - row * mCellSizeY;
+        for ( int col = zone.offsetX; col < zone.offsetX + zone.nCellsX; ++col )
+        {
+          int blockCol = col / blockXSize;
+          QVector<float> block = mCache->block( blockCol, row / blockYSize );
+          if ( block.isEmpty() )
+          {
+            continue;
+          }
+          float value = block[( row % blockYSize ) * mCache->blockWidth( blockCol ) + col % blockXSize];
+          if ( !validPixel( value ) )
+          {
+            continue;
+          }
+          double xMin = mRasterBBox.xMinimum() + col * mCellSizeX;
+          QgsRectangle pixelRect( xMin, yMax - mCellSizeY, xMin + mCellSizeX, yMax );
+          double intersectionArea = 0;
+          for ( int i = 0; i < zone.rings.size(); ++i )
+          {
+            double ringArea = clippedRingArea( zone.rings[i], pixelRect );
+            intersectionArea += zone.holes[i] ? -ringArea : ringArea;
+          }
+          if ( intersectionArea > 0 )
+          {
+            zone.statistics.addValue( value, intersectionArea / pixelArea, mHistogramMin, mHistogramBinWidth );
+          }
+        }
+      }
+    }
+
+    // Area of a ring clipped to a rectangle (Sutherland-Hodgman)
+    static double clippedRingArea( const QgsPolyline& ring, const QgsRectangle& rect )
+    {
+      QgsPolyline clipped = ring;
+      for ( int side = 0; side < 4 && !clipped.isEmpty(); ++side )
+      {
+        QgsPolyline input = clipped;
+        clipped.clear();
+        for ( int i = 0, n = input.size(); i < n; ++i )
+        {
+          const QgsPoint& current = input[i];
+          const QgsPoint& previous = input[( i + n - 1 ) % n];
+          bool currentInside = insideEdge( current, rect, side );
+          if ( currentInside != insideEdge( previous, rect, side ) )
+          {
+            clipped.append( edgeIntersection( previous, current, rect, side ) );
+          }
+          if ( currentInside )
+          {
+            clipped.append( current );
+          }
+        }
+      }
+
+      double area = 0;
+      for ( int i = 0, n = clipped.size(); i < n; ++i )
+      {
+        const QgsPoint& p1 = clipped[i];
+        const QgsPoint& p2 = clipped[( i + 1 ) % n];
+        area += p1.x() * p2.y() - p2.x() * p1.y();
+      }
+      return qAbs( area ) / 2.0;
+    }
+
+    static bool insideEdge( const QgsPoint& p, const QgsRectangle& rect, int side )
+    {
+      switch ( side )
+      {
+        case 0: return p.x() >= rect.xMinimum();
+        case 1: return p.x() <= rect.xMaximum();
+        case 2: return p.y() >= rect.yMinimum();
+        default: return p.y() <= rect.yMaximum();
+      }
+    }
+
+    static QgsPoint edgeIntersection( const QgsPoint& p1, const QgsPoint& p2, const QgsRectangle& rect, int side )
+    {
+      if ( side < 2 )
+      {
+        double x = side == 0 ? rect.xMinimum() : rect.xMaximum();
+        return QgsPoint( x, p1.y() + ( x - p1.x() ) * ( p2.y() - p1.y() ) / ( p2.x() - p1.x() ) );
+      }
+      double y = side == 2 ? rect.yMinimum() : rect.yMaximum();
+      return QgsPoint( p1.x() + ( y - p1.y() ) * ( p2.x() - p1.x() ) / ( p2.y() - p1.y() ), y );
+    }
+};
+
+QgsZonalStatistics::QgsZonalStatistics( QgsVectorLayer* polygonLayer, const QString& rasterFile, const QString& attributePrefix, int rasterBand, Statistics stats )
     : mRasterFilePath( rasterFile )
     , mRasterBand( rasterBand )
     , mPolygonLayer( polygonLayer )
     , mAttributePrefix( attributePrefix )
     , mInputNodataValue( -1 )
+    , mStatistics( stats )
+    , mHistogramBins( 10 )
+    , mHistogramMin( 0 )
+    , mHistogramMax( 1 )
 {
 
 }
@@ -44,6 +397,10 @@ QgsZonalStatistics::QgsZonalStatistics()
     : mRasterBand( 0 )
     , mPolygonLayer( 0 )
     , mInputNodataValue( -1 )
+    , mStatistics( Default )
+    , mHistogramBins( 10 )
+    , mHistogramMin( 0 )
+    , mHistogramMax( 1 )
 {
 
 }
@@ -53,6 +410,13 @@ QgsZonalStatistics::~QgsZonalStatistics()
 
 }
 
+void QgsZonalStatistics::setHistogramParameters( int nBins, double minValue, double maxValue )
+{
+  mHistogramBins = nBins;
+  mHistogramMin = minValue;
+  mHistogramMax = maxValue;
+}
+
 int QgsZonalStatistics::calculateStatistics( QProgressDialog* p )
 {
   if ( !mPolygonLayer || mPolygonLayer->geometryType() != QGis::Polygon )
@@ -110,27 +474,42 @@ int QgsZonalStatistics::calculateStatistics( QProgressDialog* p )
   QgsRectangle rasterBBox( geoTransform[0], geoTransform[3] - ( nCellsYGDAL * cellsizeY ),
                            geoTransform[0] + ( nCellsXGDAL * cellsizeX ), geoTransform[3] );
 
-  //add the new count, sum, mean fields to the provider
+  //add the new fields to the provider
+  QList< QPair<Statistic, QString> > statisticFields;
+  statisticFields << qMakePair( Count, QString( "count" ) ) << qMakePair( Sum, QString( "sum" ) ) << qMakePair( Mean, QString( "mean" ) )
+  << qMakePair( Min, QString( "min" ) ) << qMakePair( Max, QString( "max" ) ) << qMakePair( StDev, QString( "stdev" ) ) << qMakePair( Histogram, QString( "hist" ) );
   QList<QgsField> newFieldList;
-  QString countFieldName = getUniqueFieldName( mAttributePrefix + "count" );
-  QString sumFieldName = getUniqueFieldName( mAttributePrefix + "sum" );
-  QString meanFieldName = getUniqueFieldName( mAttributePrefix + "mean" );
-  QgsField countField( countFieldName, QVariant::Double, "double precision" );
-  QgsField sumField( sumFieldName, QVariant::Double, "double precision" );
-  QgsField meanField( meanFieldName, QVariant::Double, "double precision" );
-  newFieldList.push_back( countField );
-  newFieldList.push_back( sumField );
-  newFieldList.push_back( meanField );
+  QMap<Statistic, QString> fieldNames;
+  for ( int i = 0; i < statisticFields.size(); ++i )
+  {
+    if ( !mStatistics.testFlag( statisticFields[i].first ) )
+    {
+      continue;
+    }
+    QString fieldName = getUniqueFieldName( mAttributePrefix + statisticFields[i].second );
+    fieldNames.insert( statisticFields[i].first, fieldName );
+    if ( statisticFields[i].first == Histogram )
+    {
+      newFieldList.push_back( QgsField( fieldName, QVariant::String, "string" ) );
+    }
+    else
+    {
+      newFieldList.push_back( QgsField( fieldName, QVariant::Double, "double precision" ) );
+    }
+  }
   vectorProvider->addAttributes( newFieldList );
 
   //index of the new fields
-  int countIndex = vectorProvider->fieldNameIndex( countFieldName );
-  int sumIndex = vectorProvider->fieldNameIndex( sumFieldName );
-  int meanIndex = vectorProvider->fieldNameIndex( meanFieldName );
-
-  if ( countIndex == -1 || sumIndex == -1 || meanIndex == -1 )
+  QMap<Statistic, int> fieldIndices;
+  for ( QMap<Statistic, QString>::const_iterator it = fieldNames.constBegin(); it != fieldNames.constEnd(); ++it )
   {
-    return 8;
+    int index = vectorProvider->fieldNameIndex( it.value() );
+    if ( index == -1 )
+    {
+      GDALClose( inputDataset );
+      return 8;
+    }
+    fieldIndices.insert( it.key(), index );
   }
 
   //progress dialog
@@ -140,90 +519,109 @@ int QgsZonalStatistics::calculateStatistics( QProgressDialog* p )
     p->setMaximum( featureCount );
   }
 
+  ZonalBlockCache blockCache( rasterBand, nCellsXGDAL, nCellsYGDAL );
 
-  //iterate over each polygon
+  //collect the polygons with the raster window they cover
+  QVector<Zone> zones;
   QgsFeatureRequest request;
   request.setSubsetOfAttributes( QgsAttributeList() );
   QgsFeatureIterator fi = vectorProvider->getFeatures( request );
   QgsFeature f;
-  double count = 0;
-  double sum = 0;
-  double mean = 0;
-  int featureCounter = 0;
-
   while ( fi.nextFeature( f ) )
   {
-    if ( p )
-    {
-      p->setValue( featureCounter );
-    }
-
-    if ( p && p->wasCanceled() )
-    {
-      break;
-    }
-
     QgsGeometry* featureGeometry = f.geometry();
     if ( !featureGeometry )
     {
-      ++featureCounter;
       continue;
     }
 
     QgsRectangle featureRect = featureGeometry->boundingBox().intersect( &rasterBBox );
     if ( featureRect.isEmpty() )
     {
-      ++featureCounter;
       continue;
     }
 
-    int offsetX, offsetY, nCellsX, nCellsY;
-    if ( cellInfoForBBox( rasterBBox, featureRect, cellsizeX, cellsizeY, offsetX, offsetY, nCellsX, nCellsY ) != 0 )
+    Zone zone;
+    zone.id = f.id();
+    if ( cellInfoForBBox( rasterBBox, featureRect, cellsizeX, cellsizeY, zone.offsetX, zone.offsetY, zone.nCellsX, zone.nCellsY ) != 0 )
     {
-      ++featureCounter;
       continue;
     }
 
     //avoid access to cells outside of the raster (may occur because of rounding)
-    if (( offsetX + nCellsX ) > nCellsXGDAL )
+    zone.nCellsX = qMin( zone.nCellsX, nCellsXGDAL - zone.offsetX );
+    zone.nCellsY = qMin( zone.nCellsY, nCellsYGDAL - zone.offsetY );
+
+    QgsMultiPolygon polygons;
+    if ( featureGeometry->isMultipart() )
     {
-      nCellsX = nCellsXGDAL - offsetX;
+      polygons = featureGeometry->asMultiPolygon();
     }
-    if (( offsetY + nCellsY ) > nCellsYGDAL )
+    else
     {
-      nCellsY = nCellsYGDAL - offsetY;
+      polygons.append( featureGeometry->asPolygon() );
     }
-
-    statisticsFromMiddlePointTest( rasterBand, featureGeometry, offsetX, offsetY, nCellsX, nCellsY, cellsizeX, cellsizeY,
-                                   rasterBBox, sum, count );
-
-    if ( count <= 1 )
+    foreach ( const QgsPolygon& polygon, polygons )
     {
-      //the cell resolution is probably larger than the polygon area. We switch to precise pixel - polygon intersection in this case
-      statisticsFromPreciseIntersection( rasterBand, featureGeometry, offsetX, offsetY, nCellsX, nCellsY, cellsizeX, cellsizeY,
-                                         rasterBBox, sum, count );
+      for ( int i = 0; i < polygon.size(); ++i )
+      {
+        zone.rings.append( polygon[i] );
+        zone.holes.append( i > 0 );
+      }
     }
+    zone.blockIndex = ( zone.offsetY / blockCache.blockYSize() ) * blockCache.blocksX() + zone.offsetX / blockCache.blockXSize();
+    zones.append( zone );
+  }
 
+  //neighbouring zones share raster blocks, so process them together
+  std::stable_sort( zones.begin(), zones.end() );
 
-    if ( count == 0 )
-    {
-      mean = 0;
-    }
-    else
-    {
-      mean = sum / count;
-    }
+  ZonalStatisticsWorker worker( &blockCache, rasterBBox, cellsizeX, cellsizeY, mInputNodataValue, mHistogramBins, mHistogramMin, mHistogramMax );
+  int batchSize = QThread::idealThreadCount() * 64;
+  bool canceled = false;
+  for ( int batchStart = 0; batchStart < zones.size() && !canceled; batchStart += batchSize )
+  {
+    QVector<Zone>::iterator batchBegin = zones.begin() + batchStart;
+    QVector<Zone>::iterator batchEnd = zones.begin() + qMin( zones.size(), batchStart + batchSize );
+    QtConcurrent::blockingMap( batchBegin, batchEnd, worker );
 
-    //write the statistics value to the vector data provider
+    //write the statistics values to the vector data provider
     QgsChangedAttributesMap changeMap;
-    QgsAttributeMap changeAttributeMap;
-    changeAttributeMap.insert( countIndex, QVariant( count ) );
-    changeAttributeMap.insert( sumIndex, QVariant( sum ) );
-    changeAttributeMap.insert( meanIndex, QVariant( mean ) );
-    changeMap.insert( f.id(), changeAttributeMap );
+    for ( QVector<Zone>::const_iterator it = batchBegin; it != batchEnd; ++it )
+    {
+      const ZoneStatistics& stats = it->statistics;
+      double mean = stats.count == 0 ? 0 : stats.sum / stats.count;
+      QgsAttributeMap changeAttributeMap;
+      if ( fieldIndices.contains( Count ) )
+        changeAttributeMap.insert( fieldIndices[Count], QVariant( stats.count ) );
+      if ( fieldIndices.contains( Sum ) )
+        changeAttributeMap.insert( fieldIndices[Sum], QVariant( stats.sum ) );
+      if ( fieldIndices.contains( Mean ) )
+        changeAttributeMap.insert( fieldIndices[Mean], QVariant( mean ) );
+      if ( fieldIndices.contains( Min ) )
+        changeAttributeMap.insert( fieldIndices[Min], stats.count > 0 ? QVariant( stats.min ) : QVariant( QVariant::Double ) );
+      if ( fieldIndices.contains( Max ) )
+        changeAttributeMap.insert( fieldIndices[Max], stats.count > 0 ? QVariant( stats.max ) : QVariant( QVariant::Double ) );
+      if ( fieldIndices.contains( StDev ) )
+        changeAttributeMap.insert( fieldIndices[StDev], stats.count > 0 ? QVariant( sqrt( qMax( 0.0, stats.sumSquares / stats.count - mean * mean ) ) ) : QVariant( QVariant::Double ) );
+      if ( fieldIndices.contains( Histogram ) )
+      {
+        QStringList bins;
+        foreach ( double binCount, stats.histogram )
+        {
+          bins.append( QString::number( binCount ) );
+        }
+        changeAttributeMap.insert( fieldIndices[Histogram], bins.join( "," ) );
+      }
+      changeMap.insert( it->id, changeAttributeMap );
+    }
     vectorProvider->changeAttributeValues( changeMap );
 
-    ++featureCounter;
+    if ( p )
+    {
+      p->setValue( featureCount * ( batchEnd - zones.begin() ) / zones.size() );
+      canceled = p->wasCanceled();
+    }
   }
 
   if ( p )
@@ -234,7 +632,7 @@ int QgsZonalStatistics::calculateStatistics( QProgressDialog* p )
   GDALClose( inputDataset );
   mPolygonLayer->updateFields();
 
-  if ( p && p->wasCanceled() )
+  if ( canceled )
   {
     return 9;
   }
@@ -266,123 +664,6 @@ int QgsZonalStatistics::cellInfoForBBox( const QgsRectangle& rasterBBox, const Q
   return 0;
 }
 
-void QgsZonalStatistics::statisticsFromMiddlePointTest( void* band, QgsGeometry* poly, int pixelOffsetX,
-    int pixelOffsetY, int nCellsX, int nCellsY, double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, double& sum, double& count )
-{
-  double cellCenterX, cellCenterY;
-
-  float* scanLine = ( float * ) CPLMalloc( sizeof( float ) * nCellsX );
-  cellCenterY = rasterBBox.yMaximum() - pixelOffsetY * cellSizeY - cellSizeY / 2;
-  count = 0;
-  sum = 0;
-
-  const GEOSGeometry* polyGeos = poly->asGeos();
-  if ( !polyGeos )
-  {
-    return;
-  }
-
-  GEOSContextHandle_t geosctxt = QgsGeometry::getGEOSHandler();
-  const GEOSPreparedGeometry* polyGeosPrepared = GEOSPrepare_r( geosctxt, poly->asGeos() );
-  if ( !polyGeosPrepared )
-  {
-    return;
-  }
-
-  GEOSCoordSequence* cellCenterCoords = 0;
-  GEOSGeometry* currentCellCenter = 0;
-
-  for ( int i = 0; i < nCellsY; ++i )
-  {
-    if ( GDALRasterIO( band, GF_Read, pixelOffsetX, pixelOffsetY + i, nCellsX, 1, scanLine, nCellsX, 1, GDT_Float32, 0, 0 )
-         != CPLE_None )
-    {
-      continue;
-    }
-    cellCenterX = rasterBBox.xMinimum() + pixelOffsetX * cellSizeX + cellSizeX / 2;
-    for ( int j = 0; j < nCellsX; ++j )
-    {
-      if ( validPixel( scanLine[j] ) )
-      {
-        GEOSGeom_destroy_r( geosctxt, currentCellCenter );
-        cellCenterCoords = GEOSCoordSeq_create_r( geosctxt, 1, 2 );
-        GEOSCoordSeq_setX_r( geosctxt, cellCenterCoords, 0, cellCenterX );
-        GEOSCoordSeq_setY_r( geosctxt, cellCenterCoords, 0, cellCenterY );
-        currentCellCenter = GEOSGeom_createPoint_r( geosctxt, cellCenterCoords );
-        if ( GEOSPreparedContains_r( geosctxt, polyGeosPrepared, currentCellCenter ) )
-        {
-          sum += scanLine[j];
-          ++count;
-        }
-      }
-      cellCenterX += cellSizeX;
-    }
-    cellCenterY -= cellSizeY;
-  }
-  GEOSGeom_destroy_r( geosctxt, currentCellCenter );
-  CPLFree( scanLine );
-  GEOSPreparedGeom_destroy_r( geosctxt, polyGeosPrepared );
-}
-
-void QgsZonalStatistics::statisticsFromPreciseIntersection( void* band, QgsGeometry* poly, int pixelOffsetX,
-    int pixelOffsetY, int nCellsX, int nCellsY, double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, double& sum, double& count )
-{
-  sum = 0;
-  count = 0;
-  double currentY = rasterBBox.yMaximum() - pixelOffsetY * cellSizeY - cellSizeY / 2;
-  float* pixelData = ( float * ) CPLMalloc( sizeof( float ) );
-  QgsGeometry* pixelRectGeometry = 0;
-
-  double hCellSizeX = cellSizeX / 2.0;
-  double hCellSizeY = cellSizeY / 2.0;
-  double pixelArea = cellSizeX * cellSizeY;
-  double weight = 0;
-
-  for ( int row = 0; row < nCellsY; ++row )
-  {
-    double currentX = rasterBBox.xMinimum() + cellSizeX / 2.0 + pixelOffsetX * cellSizeX;
-    for ( int col = 0; col < nCellsX; ++col )
-    {
-      CPLErr err = GDALRasterIO( band, GF_Read, pixelOffsetX + col, pixelOffsetY + row, nCellsX, 1, pixelData, 1, 1, GDT_Float32, 0, 0 );
-      Q_UNUSED( err );
-      if ( !validPixel( *pixelData ) )
-        continue;
-
-      pixelRectGeometry = QgsGeometry::fromRect( QgsRectangle( currentX - hCellSizeX, currentY - hCellSizeY, currentX + hCellSizeX, currentY + hCellSizeY ) );
-      if ( pixelRectGeometry )
-      {
-        //intersection
-        QgsGeometry *intersectGeometry = pixelRectGeometry->intersection( poly );
-        if ( intersectGeometry )
-        {
-          double intersectionArea = intersectGeometry->area();
-          if ( intersectionArea >= 0.0 )
-          {
-            weight = intersectionArea / pixelArea;
-            count += weight;
-            sum += *pixelData * weight;
-          }
-          delete intersectGeometry;
-        }
-        delete pixelRectGeometry;
-        pixelRectGeometry = 0;
-      }
-      currentX += cellSizeX;
-    }
-    currentY -= cellSizeY;
-  }
-  CPLFree( pixelData );
-}
-
-bool QgsZonalStatistics::validPixel( float value ) const
-{
-  if ( value == mInputNodataValue || qIsNaN( value ) )
-  {
-    return false;
-  }
-  return true;
-}
-
 QString QgsZonalStatistics::getUniqueFieldName( QString fieldName )
 {
   QgsVectorDataProvider* dp = mPolygonLayer->dataProvider();
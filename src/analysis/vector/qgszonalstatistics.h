@@ -25,13 +25,32 @@ class QgsGeometry;
 class QgsVectorLayer;
 class QProgressDialog;
 
-/**A class that calculates raster statistics (count, sum, mean) for a polygon or multipolygon layer and appends the results as attributes*/
+/**A class that calculates raster statistics (count, sum, mean and optionally min, max, standard deviation and histogram) for a polygon or multipolygon layer and appends the results as attributes.
+ The polygons are processed in parallel in the order of the raster blocks they cover, sharing a cache of raster blocks*/
 class ANALYSIS_EXPORT QgsZonalStatistics
 {
   public:
-    QgsZonalStatistics( QgsVectorLayer* polygonLayer, const QString& rasterFile, const QString& attributePrefix = "", int rasterBand = 1 );
+    /**Statistics to calculate*/
+    enum Statistic
+    {
+      Count = 1,
+      Sum = 2,
+      Mean = 4,
+      Min = 8,
+      Max = 16,
+      StDev = 32,
+      /**Pixel counts of the bins set with setHistogramParameters, as comma separated list*/
+      Histogram = 64,
+      Default = Count | Sum | Mean
+    };
+    Q_DECLARE_FLAGS( Statistics, Statistic )
+
+    QgsZonalStatistics( QgsVectorLayer* polygonLayer, const QString& rasterFile, const QString& attributePrefix = "", int rasterBand = 1, Statistics stats = Default );
     ~QgsZonalStatistics();
 
+    /**Sets the number of bins and the value range of the histogram statistic. Values outside the range are not counted*/
+    void setHistogramParameters( int nBins, double minValue, double maxValue );
+
     /**Starts the calculation
       @return 0 in case of success*/
     int calculateStatistics( QProgressDialog* p );
@@ -43,20 +62,6 @@ class ANALYSIS_EXPORT QgsZonalStatistics
     int cellInfoForBBox( const QgsRectangle& rasterBBox, const QgsRectangle& featureBBox, double cellSizeX, double cellSizeY,
                          int& offsetX, int& offsetY, int& nCellsX, int& nCellsY ) const;
 
-    /**Returns statistics by considering the pixels where the center point is within the polygon (fast)*/
-    void statisticsFromMiddlePointTest( void* band, QgsGeometry* poly, int pixelOffsetX, int pixelOffsetY, int nCellsX, int nCellsY,
-                                        double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, double& sum, double& count );
-
-    void statisticsFromMiddlePointTest_improved( void* band, QgsGeometry* poly, int pixelOffsetX, int pixelOffsetY, int nCellsX, int nCellsY,
-        double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, double& sum, double& count );
-
-    /**Returns statistics with precise pixel - polygon intersection test (slow) */
-    void statisticsFromPreciseIntersection( void* band, QgsGeometry* poly, int pixelOffsetX, int pixelOffsetY, int nCellsX, int nCellsY,
-                                            double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, double& sum, double& count );
-
-    /**Tests whether a pixel's value should be included in the result*/
-    bool validPixel( float value ) const;
-
     QString getUniqueFieldName( QString fieldName );
 
     QString mRasterFilePath;
@@ -66,7 +71,12 @@ class ANALYSIS_EXPORT QgsZonalStatistics
     QString mAttributePrefix;
     /**The nodata value of the input layer*/
     float mInputNodataValue;
-
+    Statistics mStatistics;
+    int mHistogramBins;
+    double mHistogramMin;
+    double mHistogramMax;
 };
 
+Q_DECLARE_OPERATORS_FOR_FLAGS( QgsZonalStatistics::Statistics )
+
 #endif // QGSZONALSTATISTICS_H
@@ -1276,6 +1276,7 @@ void QgisApp::createOverview()
   mapCanvas()->setWheelAction(( QgsMapCanvas::WheelAction ) action, zoomFactor );
 
   mapCanvas()->setCachingEnabled( mySettings.value( "/Qgis/enable_render_caching", true ).toBool() );
+  mapCanvas()->setTiledCachingEnabled( mySettings.value( "/Qgis/enable_tiled_render_caching", false ).toBool() );
 
   mapCanvas()->setParallelRenderingEnabled( mySettings.value( "/Qgis/parallel_rendering", true ).toBool() );
 
@@ -6556,6 +6557,7 @@ void QgisApp::showOptionsDialog( QWidget *parent, QString currentPage )
     mapCanvas()->setWheelAction(( QgsMapCanvas::WheelAction ) action, zoomFactor );
 
     mapCanvas()->setCachingEnabled( mySettings.value( "/Qgis/enable_render_caching", true ).toBool() );
+    mapCanvas()->setTiledCachingEnabled( mySettings.value( "/Qgis/enable_tiled_render_caching", false ).toBool() );
 
     mapCanvas()->setParallelRenderingEnabled( mySettings.value( "/Qgis/parallel_rendering", true ).toBool() );
 
@@ -18,7 +18,9 @@
 #include "qgscoordinatetransform.h"
 #include "qgscoordinateformat.h"
 #include "qgsdistancearea.h"
+#include "qgsheightprofilesampler.h"
 #include "qgsimageannotationitem.h"
+#include "qgslineofsight.h"
 #include "qgsmapcanvas.h"
 #include "qgsmaplayerregistry.h"
 #include "qgsmeasureheightprofiledialog.h"
@@ -26,7 +28,6 @@
 #include "qgslogger.h"
 #include "qgsrubberband.h"
 #include "qgsproject.h"
-#include <gdal.h>
 #include <QApplication>
 #include <QClipboard>
 #include <QComboBox>
@@ -80,7 +81,7 @@ class PaddedPlotMarker : public QwtPlotMarker
 
 
 QgsMeasureHeightProfileDialog::QgsMeasureHeightProfileDialog( QgsMeasureHeightProfileTool *tool, QWidget *parent, Qt::WindowFlags f )
-    : QDialog( parent, f ), mTool( tool ), mLineOfSightMarker( 0 ), mNSamples( 1000 )
+    : QDialog( parent, f ), mTool( tool ), mSampler( 0 ), mLineOfSightMarker( 0 ), mNSamples( 1000 ), mInteractive( false )
 {
   setWindowTitle( tr( "Height profile" ) );
   setAttribute( Qt::WA_ShowWithoutActivating );
@@ -182,8 +183,14 @@ QgsMeasureHeightProfileDialog::QgsMeasureHeightProfileDialog( QgsMeasureHeightPr
   restoreGeometry( QSettings().value( "/Windows/MeasureHeightProfile/geometry" ).toByteArray() );
 }
 
-void QgsMeasureHeightProfileDialog::setPoints( const QList<QgsPoint>& points, const QgsCoordinateReferenceSystem &crs )
+QgsMeasureHeightProfileDialog::~QgsMeasureHeightProfileDialog()
 {
+  delete mSampler;
+}
+
+void QgsMeasureHeightProfileDialog::setPoints( const QList<QgsPoint>& points, const QgsCoordinateReferenceSystem &crs, bool interactive )
+{
+  mInteractive = interactive;
   mPoints = points;
   mPointsCrs = crs;
   mTotLength = 0;
@@ -263,112 +270,51 @@ void QgsMeasureHeightProfileDialog::replot()
   QgsMapLayer* layer = QgsMapLayerRegistry::instance()->mapLayer( layerid );
   if ( !layer || layer->type() != QgsMapLayer::RasterLayer )
   {
-    QgisApp::instance()->messageBar()->pushMessage( tr( "No heightmap is defined in the project." ), tr( "Right-click a raster layer in the layer tree and select it to be used as heightmap." ), QgsMessageBar::INFO, 10 );
+    if ( !mInteractive )
+    {
+      QgisApp::instance()->messageBar()->pushMessage( tr( "No heightmap is defined in the project." ), tr( "Right-click a raster layer in the layer tree and select it to be used as heightmap." ), QgsMessageBar::INFO, 10 );
+    }
     return;
   }
   QString rasterFile = layer->source();
-  GDALDatasetH raster = GDALOpen( rasterFile.toLocal8Bit().data(), GA_ReadOnly );
-  if ( !raster )
-  {
-    QMessageBox::warning( 0, tr( "Error" ), tr( "Failed to open raster file: %1" ).arg( rasterFile ) );
-    return;
-  }
-
-  double gtrans[6] = {};
-  if ( GDALGetGeoTransform( raster, &gtrans[0] ) != CE_None )
+  if ( !mSampler || !mSampler->isCurrent( rasterFile ) )
   {
-    QgsDebugMsg( "Failed to get raster geotransform" );
-    GDALClose( raster );
-    return;
+    delete mSampler;
+    mSampler = new QgsHeightProfileSampler( rasterFile );
   }
-
-  QString proj( GDALGetProjectionRef( raster ) );
-  QgsCoordinateReferenceSystem rasterCrs( proj );
-  if ( !rasterCrs.isValid() )
+  if ( !mSampler->isValid() )
   {
-    QgsDebugMsg( "Failed to get raster CRS" );
-    GDALClose( raster );
+    if ( !mInteractive )
+    {
+      QMessageBox::warning( 0, tr( "Error" ), tr( "Failed to open raster file: %1" ).arg( rasterFile ) );
+    }
     return;
   }
 
-  GDALRasterBandH band = GDALGetRasterBand( raster, 1 );
-  if ( !band )
+  QVector<double> heights;
+  if ( !mSampler->sampleLine( mPoints, mSegmentLengths, mNSamples, mPointsCrs, heights ) || heights.isEmpty() )
   {
-    QgsDebugMsg( "Failed to open raster band 0" );
-    GDALClose( raster );
     return;
   }
 
-  // Get vertical unit
-  QGis::UnitType vertUnit = strcmp( GDALGetRasterUnitType( band ), "ft" ) == 0 ? QGis::Feet : QGis::Meters;
-  double heightConversion = QGis::fromUnitToUnitFactor( vertUnit, vertDisplayUnit );
-  mPlot->setAxisTitle( QwtPlot::yLeft, vertDisplayUnit == QGis::Feet ? tr( "Height [ft AMSL]" ) : tr( "Height [m AMSL]" ) );
-  mObserverHeightSpinBox->setSuffix( vertDisplayUnit == QGis::Feet ? " ft" : " m" );
-  mTargetHeightSpinBox->setSuffix( vertDisplayUnit == QGis::Feet ? " ft" : " m" );
+  double heightConversion = QGis::fromUnitToUnitFactor( mSampler->verticalUnit(), vertDisplayUnit );
 
+  int nSamples = heights.size();
 #if QWT_VERSION < 0x060000
-  QVector<double> xSamples, ySamples;
-#else
-  QVector<QPointF> samples;
-#endif
-  double x = 0;
-  for ( int i = 0, n = mPoints.size() - 1; i < n; ++i )
+  QVector<double> xSamples( nSamples ), ySamples( nSamples );
+  for ( int i = 0; i < nSamples; ++i )
   {
-    if ( x >= mSegmentLengths[i] )
-    {
-      continue;
-    }
-
-    QgsVector dir = QgsVector( mPoints[i + 1] - mPoints[i] ).normal();
-    while ( x < mSegmentLengths[i] )
-    {
-      QgsPoint p = mPoints[i] + dir * x;
-      // Transform geo position to raster CRS
-      QgsPoint pRaster = QgsCoordinateTransform( mPointsCrs, rasterCrs ).transform( p );
-
-
-      // Transform raster geo position to pixel coordinates
-      double col = ( -gtrans[0] * gtrans[5] + gtrans[2] * gtrans[3] - gtrans[2] * pRaster.y() + gtrans[5] * pRaster.x() ) / ( gtrans[1] * gtrans[5] - gtrans[2] * gtrans[4] );
-      double row = ( -gtrans[0] * gtrans[4] + gtrans[1] * gtrans[3] - gtrans[1] * pRaster.y() + gtrans[4] * pRaster.x() ) / ( gtrans[2] * gtrans[4] - gtrans[1] * gtrans[5] );
-
-      double pixValues[4] = {};
-      if ( CE_None != GDALRasterIO( band, GF_Read,
-                                    qFloor( col ), qFloor( row ), 2, 2, &pixValues[0], 2, 2, GDT_Float64, 0, 0 ) )
-      {
-        QgsDebugMsg( "Failed to read pixel values" );
-#if QWT_VERSION < 0x060000
-        xSamples.append( xSamples.size() );
-        ySamples.append( 0 );
-#else
-        samples.append( QPointF( samples.size(), 0 ) );
-#endif
-      }
-      else
-      {
-        // Interpolate values
-        double lambdaR = row - qFloor( row );
-        double lambdaC = col - qFloor( col );
-
-        double value = ( pixValues[0] * ( 1. - lambdaC ) + pixValues[1] * lambdaC ) * ( 1. - lambdaR )
-                       + ( pixValues[2] * ( 1. - lambdaC ) + pixValues[3] * lambdaC ) * ( lambdaR );
-#if QWT_VERSION < 0x060000
-        xSamples.append( xSamples.size() );
-        ySamples.append( value * heightConversion );
-#else
-        samples.append( QPointF( samples.size(), value * heightConversion ) );
-#endif
-      }
-      x += mTotLength / mNSamples;
-    }
-    x -= mSegmentLengths[i];
+    xSamples[i] = i;
+    ySamples[i] = heights[i] * heightConversion;
   }
-
-#if QWT_VERSION < 0x060000
   mPlotCurve->setData( xSamples, ySamples );
-  int nSamples = xSamples.size();
 #else
+  QVector<QPointF> samples( nSamples );
+  for ( int i = 0; i < nSamples; ++i )
+  {
+    samples[i] = QPointF( i, heights[i] * heightConversion );
+  }
   static_cast<QwtPointSeriesData*>( mPlotCurve->data() )->setSamples( samples );
-  int nSamples = samples.size();
 #endif
   mPlotMarker->setValue( 0, 0 );
   mPlot->setAxisScaleDraw( QwtPlot::xBottom, new ScaleDraw( mTotLength, nSamples ) );
@@ -377,10 +323,10 @@ void QgsMeasureHeightProfileDialog::replot()
   while ( nSamples / step > 10 ) step *= 2.;
   mPlot->setAxisScale( QwtPlot::xBottom, 0, nSamples, step );
 
-  GDALClose( raster );
-
   // Node markers
-  x = 0;
+  qDeleteAll( mNodeMarkers );
+  mNodeMarkers.clear();
+  double x = 0;
   for ( int i = 0, n = mPoints.size() - 2; i < n; ++i )
   {
     x += mSegmentLengths[i];
@@ -426,52 +372,32 @@ void QgsMeasureHeightProfileDialog::updateLineOfSight( )
 #else
   QVector<QPointF> samples = static_cast<QwtPointSeriesData*>( mPlotCurve->data() )->samples();
 #endif
+  if ( samples.isEmpty() )
+  {
+    mPlot->replot();
+    return;
+  }
 
-  QVector< QVector<QPointF> > losSampleSet;
-  losSampleSet.append( QVector<QPointF>() );
   double targetHeight = mTargetHeightSpinBox->value();
   bool heightRelToGround = static_cast<HeightMode>( mHeightModeCombo->itemData( mHeightModeCombo->currentIndex() ).toInt() ) == HeightRelToGround;
 
-  QVector<double> pX; pX.reserve( nSamples );
-  QVector<double> pY; pY.reserve( nSamples );
-  double earthRadius = 6370000;
-  double meterToDisplayUnit = QGis::fromUnitToUnitFactor( QGis::Meters, QgsCoordinateFormat::instance()->getHeightDisplayUnit() );
+  QVector<double> distances; distances.reserve( nSamples );
+  QVector<double> heights; heights.reserve( nSamples );
   foreach ( const QPointF& p, samples )
   {
-    pX.append( p.x() / mNSamples * mTotLength );
-    double hCorr = 0.87 * pX.last() * pX.last() / ( 2 * earthRadius ) * meterToDisplayUnit;
-    pY.append( p.y() - hCorr );
+    distances.append( p.x() / mNSamples * mTotLength );
+    heights.append( p.y() );
   }
+  double meterToDisplayUnit = QGis::fromUnitToUnitFactor( QGis::Meters, QgsCoordinateFormat::instance()->getHeightDisplayUnit() );
+  QVector<bool> visible;
+  QgsLineOfSight::computeVisibility( distances, heights, mObserverHeightSpinBox->value(), targetHeight, heightRelToGround, meterToDisplayUnit, visible );
 
-  // Visibility of first point
-  double y = pY.front() + targetHeight - ( heightRelToGround ? 0 : samples.front().y() );
-  if ( y > pY.front() )
-    losSampleSet.back().append( samples.front() );
-  else
-    losSampleSet.append( QVector<QPointF>() );
-
-  QPointF p1( pX.front(), ( heightRelToGround ? pY.front() : 0 ) + mObserverHeightSpinBox->value() );
-  for ( int i = 1; i < nSamples; ++i )
+  // Split the samples into alternating visible / invisible runs, starting with a visible one
+  QVector< QVector<QPointF> > losSampleSet;
+  losSampleSet.append( QVector<QPointF>() );
+  for ( int i = 0; i < nSamples; ++i )
   {
-    QPointF p2( pX[i], pY[i] + targetHeight );
-    if ( !heightRelToGround )
-      p2.ry() -= samples[i].y();
-    // For each sample position along line [p1, p2], check if y is below terrain
-    // X = p1.x() + d * (p2.x() - p1.x())
-    // Y = p1.y() + d * (p2.y() - p1.y())
-    // => d = (X - p1.x()) / (p2.x() - p1.x())
-    // => Y = p1.y() + (X - p1.x()) / (p2.x() - p1.x()) * (p2.y() - p1.y())
-    bool visible = true;
-    for ( int j = 1; j < i; ++j )
-    {
-      double Y = p1.y() + ( pX[j] - p1.x() ) / ( p2.x() - p1.x() ) * ( p2.y() - p1.y() );
-      if ( Y < pY[j] )
-      {
-        visible = false;
-        break;
-      }
-    }
-    if (( visible && losSampleSet.size() % 2 == 0 ) || ( !visible && losSampleSet.size() % 2 == 1 ) )
+    if (( visible[i] && losSampleSet.size() % 2 == 0 ) || ( !visible[i] && losSampleSet.size() % 2 == 1 ) )
     {
       losSampleSet.append( QVector<QPointF>() );
     }
@@ -482,6 +408,12 @@ void QgsMeasureHeightProfileDialog::updateLineOfSight( )
   int iColor = 0;
   foreach ( const QVector<QPointF>& losSamples, losSampleSet )
   {
+    if ( losSamples.isEmpty() )
+    {
+      // Observer position itself is invisible
+      iColor = ( iColor + 1 ) % 2;
+      continue;
+    }
     QwtPlotCurve* curve = new QwtPlotCurve( tr( "Line of sight" ) );
     curve->setRenderHint( QwtPlotItem::RenderAntialiased );
     QPen losPen;
@@ -24,6 +24,7 @@
 class QComboBox;
 class QDoubleSpinBox;
 class QGroupBox;
+class QgsHeightProfileSampler;
 class QgsMeasureHeightProfileTool;
 class QgsPoint;
 class QgsRubberBand;
@@ -37,7 +38,9 @@ class APP_EXPORT QgsMeasureHeightProfileDialog : public QDialog
     Q_OBJECT
   public:
     QgsMeasureHeightProfileDialog( QgsMeasureHeightProfileTool* tool, QWidget* parent = 0, Qt::WindowFlags f = 0 );
-    void setPoints( const QList<QgsPoint> &points, const QgsCoordinateReferenceSystem& crs );
+    ~QgsMeasureHeightProfileDialog();
+    /**Sets the profile line. If interactive is true, the line is still being drawn and no errors are reported*/
+    void setPoints( const QList<QgsPoint> &points, const QgsCoordinateReferenceSystem& crs, bool interactive = false );
     void setMarkerPos( int segment, const QgsPoint& p );
     void clear();
 
@@ -53,6 +56,7 @@ class APP_EXPORT QgsMeasureHeightProfileDialog : public QDialog
     enum HeightMode { HeightRelToGround, HeightRelToSeaLevel };
 
     QgsMeasureHeightProfileTool* mTool;
+    QgsHeightProfileSampler* mSampler;
     QwtPlot* mPlot;
     QwtPlotCurve* mPlotCurve;
     QVector<QwtPlotCurve*> mLinesOfSight;
@@ -65,6 +69,7 @@ class APP_EXPORT QgsMeasureHeightProfileDialog : public QDialog
     double mTotLength;
     QgsCoordinateReferenceSystem mPointsCrs;
     int mNSamples;
+    bool mInteractive;
     QGroupBox* mLineOfSightGroupBoxgroupBox;
     QDoubleSpinBox* mObserverHeightSpinBox;
     QDoubleSpinBox* mTargetHeightSpinBox;
@@ -48,6 +48,7 @@ QgsMeasureHeightProfileTool::QgsMeasureHeightProfileTool( QgsMapCanvas *canvas )
   mDialog = new QgsMeasureHeightProfileDialog( this, 0, Qt::WindowStaysOnTopHint );
   connect( mDrawTool, SIGNAL( finished() ), this, SLOT( drawFinished() ) );
   connect( mDrawTool, SIGNAL( cleared() ), this, SLOT( drawCleared() ) );
+  connect( mDrawTool, SIGNAL( geometryChanged() ), this, SLOT( drawChanged() ) );
 }
 
 QgsMeasureHeightProfileTool::~QgsMeasureHeightProfileTool()
@@ -172,6 +173,21 @@ void QgsMeasureHeightProfileTool::drawCleared()
   mDialog->clear();
 }
 
+void QgsMeasureHeightProfileTool::drawChanged()
+{
+  // Update the profile while the line is being drawn
+  if ( mDrawTool->getStatus() != QgsMapToolDrawShape::StatusDrawing || mDrawTool->getPartCount() == 0 )
+  {
+    return;
+  }
+  QList<QgsPoint> points;
+  mDrawTool->getPart( 0, points );
+  if ( points.size() > 1 )
+  {
+    mDialog->setPoints( points, mCanvas->mapSettings().destinationCrs(), true );
+  }
+}
+
 void QgsMeasureHeightProfileTool::drawFinished()
 {
   QList<QgsPoint> points;
@@ -52,6 +52,7 @@ class APP_EXPORT QgsMeasureHeightProfileTool : public QgsMapTool
     bool mPicking;
 
   private slots:
+    void drawChanged();
     void drawCleared();
     void drawFinished();
 };
@@ -25,6 +25,8 @@ QgsCoordinateTransformCache* QgsCoordinateTransformCache::sInstance = 0;
 
 QgsCoordinateTransformCache* QgsCoordinateTransformCache::instance()
 {
+  static QMutex sInstanceMutex;
+  QMutexLocker locker( &sInstanceMutex );
   if ( sInstance == 0 )
   {
     sInstance = new QgsCoordinateTransformCache();
@@ -51,6 +53,7 @@ QgsCoordinateTransformCache::~QgsCoordinateTransformCache()
 
 const QgsCoordinateTransform* QgsCoordinateTransformCache::transform( const QString& srcAuthId, const QString& destAuthId, int srcDatumTransform, int destDatumTransform )
 {
+  QMutexLocker locker( &mMutex );
   QList< QgsCoordinateTransform* > values =
     mTransforms.values( qMakePair( srcAuthId, destAuthId ) );
 
@@ -78,6 +81,7 @@ const QgsCoordinateTransform* QgsCoordinateTransformCache::transform( const QStr
 
 void QgsCoordinateTransformCache::invalidateCrs( const QString& crsAuthId )
 {
+  QMutexLocker locker( &mMutex );
   //get keys to remove first
   QHash< QPair< QString, QString >, QgsCoordinateTransform* >::const_iterator it = mTransforms.constBegin();
   QList< QPair< QString, QString > > updateList;
@@ -116,20 +120,27 @@ QgsCRSCache::~QgsCRSCache()
 void QgsCRSCache::updateCRSCache( const QString& authid )
 {
   QgsCoordinateReferenceSystem s;
-  if ( s.createFromOgcWmsCrs( authid ) )
+  bool valid = s.createFromOgcWmsCrs( authid );
   {
-    mCRS.insert( authid, s );
-  }
-  else
-  {
-    mCRS.remove( authid );
+    QMutexLocker locker( &mMutex );
+    if ( valid )
+    {
+      mCRS.insert( authid, s );
+    }
+    else
+    {
+      mCRS.remove( authid );
+    }
   }
 
+  //not locked, the transform cache looks up crs while holding its own lock
+
   QgsCoordinateTransformCache::instance()->invalidateCrs( authid );
 }
 
 const QgsCoordinateReferenceSystem& QgsCRSCache::crsByAuthId( const QString& authid )
 {
+  QMutexLocker locker( &mMutex );
   QHash< QString, QgsCoordinateReferenceSystem >::const_iterator crsIt = mCRS.find( authid );
   if ( crsIt == mCRS.constEnd() )
   {
@@ -153,6 +164,7 @@ const QgsCoordinateReferenceSystem& QgsCRSCache::crsByEpsgId( long epsg )
 
 const QgsCoordinateReferenceSystem& QgsCRSCache::crsBySrsId( long srsid )
 {
+  QMutexLocker locker( &mMutex );
   QHash< long, QgsCoordinateReferenceSystem >::const_iterator crsIt = mCRSSrsId.find( srsid );
   if ( crsIt == mCRSSrsId.constEnd() )
   {
@@ -171,6 +183,7 @@ const QgsCoordinateReferenceSystem& QgsCRSCache::crsBySrsId( long srsid )
 
 const QgsCoordinateReferenceSystem& QgsCRSCache::crsByProj4( const QString& proj4 )
 {
+  QMutexLocker locker( &mMutex );
   QHash< QString, QgsCoordinateReferenceSystem >::const_iterator crsIt = mCRSProj4.find( proj4 );
   if ( crsIt == mCRSProj4.constEnd() )
   {
@@ -189,6 +202,7 @@ const QgsCoordinateReferenceSystem& QgsCRSCache::crsByProj4( const QString& proj
 
 const QgsCoordinateReferenceSystem& QgsCRSCache::crsByWkt( const QString& wkt )
 {
+  QMutexLocker locker( &mMutex );
   QHash< QString, QgsCoordinateReferenceSystem >::const_iterator crsIt = mCRSWkt.find( wkt );
   if ( crsIt == mCRSWkt.constEnd() )
   {
@@ -207,6 +221,7 @@ const QgsCoordinateReferenceSystem& QgsCRSCache::crsByWkt( const QString& wkt )
 
 const QgsCoordinateReferenceSystem& QgsCRSCache::crsByOgcWms( const QString& ogcwms )
 {
+  QMutexLocker locker( &mMutex );
   QHash< QString, QgsCoordinateReferenceSystem >::const_iterator crsIt = mCRSOgcWms.find( ogcwms );
   if ( crsIt == mCRSOgcWms.constEnd() )
   {
@@ -231,6 +246,7 @@ QgsEllipsoidCache* QgsEllipsoidCache::instance()
 
 const QgsEllipsoidCache::Params& QgsEllipsoidCache::getParams( const QString& ellipsoid )
 {
+  QMutexLocker locker( &mMutex );
   QMap<QString, Params>::iterator it = mParams.find( ellipsoid );
   if ( it != mParams.end() )
   {
@@ -20,11 +20,12 @@
 
 #include "qgscoordinatereferencesystem.h"
 #include <QHash>
+#include <QMutex>
 
 class QgsCoordinateTransform;
 
 /**Cache coordinate transform by authid of source/dest transformation to avoid the
-overhead of initialisation for each redraw*/
+overhead of initialisation for each redraw. The cache can be used from any thread.*/
 class CORE_EXPORT QgsCoordinateTransformCache
 {
   public:
@@ -51,8 +52,11 @@ class CORE_EXPORT QgsCoordinateTransformCache
 
 
     QMultiHash< QPair< QString, QString >, QgsCoordinateTransform* > mTransforms; //same auth_id pairs might have different datum transformations
+    QMutex mMutex;
 };
 
+/**Cache of coordinate reference systems. The cache can be used from any thread, the returned
+references stay valid until the cache is destroyed.*/
 class CORE_EXPORT QgsCRSCache
 {
   public:
@@ -79,6 +83,7 @@ class CORE_EXPORT QgsCRSCache
     QHash< QString, QgsCoordinateReferenceSystem > mCRSOgcWms;
     /**CRS that is not initialised (returned in case of error)*/
     QgsCoordinateReferenceSystem mInvalidCRS;
+    QMutex mMutex;
 };
 
 class CORE_EXPORT QgsEllipsoidCache
@@ -96,6 +101,7 @@ class CORE_EXPORT QgsEllipsoidCache
 
   private:
     QMap<QString, Params> mParams;
+    QMutex mMutex;
 };
 
 #endif // QGSCRSCACHE_H
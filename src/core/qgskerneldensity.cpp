@@ -0,0 +1,281 @@
+/***************************************************************************
+    qgskerneldensity.cpp
+    ---------------------
+    begin                : December 2015
+    copyright            : (C) 2015 by Sandro Mani
+    email                : manisandro@gmail.com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgskerneldensity.h"
+#include <qmath.h>
+#include <QtConcurrentMap>
+
+#include <algorithm>
+
+// Accumulates the points overlapping a tile into the values of the rows of the tile within a strip
+class QgsKernelDensityTileWorker
+{
+  public:
+    QgsKernelDensityTileWorker( const QgsKernelDensity* density, int firstRow, int lastRow, float* values, double* tileMaxima )
+        : mPoints( density->mPoints.constData() ), mStamps( &density->mStamps ), mWidth( density->mWidth ), mHeight( density->mHeight )
+        , mTilePoints( &density->mTilePoints ), mTilesX( density->mTilesX ), mFirstRow( firstRow ), mLastRow( lastRow )
+        , mValues( values ), mTileMaxima( tileMaxima ) {}
+
+    void operator()( int tile ) const
+    {
+      const int tileSize = QgsKernelDensity::sTileSize;
+      int x0 = ( tile % mTilesX ) * tileSize;
+      int y0 = qMax(( tile / mTilesX ) * tileSize, mFirstRow );
+      int x1 = qMin( x0 + tileSize, mWidth );
+      int y1 = qMin(( tile / mTilesX ) * tileSize + tileSize, qMin( mHeight, mLastRow ) );
+      int tileWidth = x1 - x0;
+
+      //accumulate in double precision, many small contributions would get lost in float
+      QVector<double> sums( tileWidth * ( y1 - y0 ), 0. );
+      QVector<uchar> covered( sums.size(), 0 );
+      double* sumData = sums.data();
+      uchar* coveredData = covered.data();
+      const QVector<int>& pointIndices = mTilePoints->at( tile );
+      for ( int i = 0, n = pointIndices.size(); i < n; ++i )
+      {
+        const QgsKernelDensity::Point& point = mPoints[pointIndices[i]];
+        const QgsKernelDensity::Stamp& stamp = mStamps->constFind( point.radius ).value();
+        int stampSize = 2 * point.radius + 1;
+        int sy0 = qMax( y0, point.y - point.radius ), sy1 = qMin( y1, point.y + point.radius + 1 );
+        for ( int y = sy0; y < sy1; ++y )
+        {
+          int stampRowIdx = y - point.y + point.radius;
+          int halfWidth = stamp.halfWidths[stampRowIdx];
+          int sx0 = qMax( x0, point.x - halfWidth ), sx1 = qMin( x1, point.x + halfWidth + 1 );
+          const float* stampRow = stamp.values.constData() + stampRowIdx * stampSize - point.x + point.radius;
+          double* sumRow = sumData + ( y - y0 ) * tileWidth - x0;
+          uchar* coveredRow = coveredData + ( y - y0 ) * tileWidth - x0;
+          for ( int x = sx0; x < sx1; ++x )
+          {
+            sumRow[x] += point.weight * stampRow[x];
+            coveredRow[x] = 1;
+          }
+        }
+      }
+
+      //pixels outside the radius of all points keep the no data value
+      double maximum = 0;
+      for ( int y = y0; y < y1; ++y )
+      {
+        const double* sumRow = sumData + ( y - y0 ) * tileWidth;
+        const uchar* coveredRow = coveredData + ( y - y0 ) * tileWidth;
+        float* valueRow = mValues + ( y - mFirstRow ) * mWidth + x0;
+        for ( int x = 0; x < tileWidth; ++x )
+        {
+          if ( coveredRow[x] )
+          {
+            valueRow[x] = sumRow[x];
+            maximum = qMax( maximum, sumRow[x] );
+          }
+        }
+      }
+      mTileMaxima[tile] = maximum;
+    }
+
+  private:
+    const QgsKernelDensity::Point* mPoints;
+    const QMap<int, QgsKernelDensity::Stamp>* mStamps;
+    int mWidth;
+    int mHeight;
+    const QVector< QVector<int> >* mTilePoints;
+    int mTilesX;
+    int mFirstRow;
+    int mLastRow;
+    float* mValues;
+    double* mTileMaxima;
+};
+
+
+QgsKernelDensity::QgsKernelDensity( int width, int height, KernelShape shape, OutputValues outputValues, double decay )
+    : mWidth( qMax( 0, width ) )
+    , mHeight( qMax( 0, height ) )
+    , mShape( shape )
+    , mOutputValues( outputValues )
+    , mDecay( decay )
+    , mTilesX( 0 )
+    , mPrepared( false )
+    , mMaximumValue( 0 )
+{
+}
+
+void QgsKernelDensity::addPoint( int x, int y, int radius, double weight )
+{
+  //points whose kernel does not reach the grid are ignored
+  if ( radius < 1 || x + radius < 0 || y + radius < 0 || x - radius >= mWidth || y - radius >= mHeight )
+  {
+    return;
+  }
+  Point point = { x, y, radius, ( float ) weight };
+  mPoints.append( point );
+  mPrepared = false;
+}
+
+void QgsKernelDensity::clear()
+{
+  mPoints.clear();
+  mTilePoints.clear();
+  mPrepared = false;
+  mValues.clear();
+  mMaximumValue = 0;
+}
+
+void QgsKernelDensity::prepare()
+{
+  if ( mPrepared )
+  {
+    return;
+  }
+
+  //assign the points to the tiles they overlap and prepare the kernel stamps
+  mTilesX = ( mWidth + sTileSize - 1 ) / sTileSize;
+  int tilesY = ( mHeight + sTileSize - 1 ) / sTileSize;
+  mTilePoints = QVector< QVector<int> >( mTilesX * tilesY );
+  for ( int i = 0, n = mPoints.size(); i < n; ++i )
+  {
+    const Point& point = mPoints[i];
+    int tx0 = qMax( 0, point.x - point.radius ) / sTileSize;
+    int tx1 = qMin( mWidth - 1, point.x + point.radius ) / sTileSize;
+    int ty0 = qMax( 0, point.y - point.radius ) / sTileSize;
+    int ty1 = qMin( mHeight - 1, point.y + point.radius ) / sTileSize;
+    for ( int ty = ty0; ty <= ty1; ++ty )
+    {
+      for ( int tx = tx0; tx <= tx1; ++tx )
+      {
+        mTilePoints[ty * mTilesX + tx].append( i );
+      }
+    }
+
+    if ( !mStamps.contains( point.radius ) )
+    {
+      int radius = point.radius;
+      int stampSize = 2 * radius + 1;
+      Stamp stamp;
+      stamp.values.fill( 0.f, stampSize * stampSize );
+      stamp.halfWidths.fill( 0, stampSize );
+      for ( int dy = -radius; dy <= radius; ++dy )
+      {
+        //the pixels with dx^2 + dy^2 <= radius^2 are within the radius
+        int halfWidth = 0;
+        while (( halfWidth + 1 ) * ( halfWidth + 1 ) + dy * dy <= radius * radius )
+        {
+          ++halfWidth;
+        }
+        stamp.halfWidths[dy + radius] = halfWidth;
+        for ( int dx = -halfWidth; dx <= halfWidth; ++dx )
+        {
+          double distance = sqrt( double( dx * dx + dy * dy ) );
+          stamp.values[( dy + radius ) * stampSize + dx + radius] = kernelValue( distance, radius );
+        }
+      }
+      mStamps.insert( radius, stamp );
+    }
+  }
+  mPrepared = true;
+}
+
+double QgsKernelDensity::accumulateRows( int firstRow, int rowCount, float* values, float noDataValue )
+{
+  std::fill( values, values + rowCount * mWidth, noDataValue );
+  if ( rowCount <= 0 || mWidth == 0 )
+  {
+    return 0;
+  }
+  prepare();
+
+  //the tiles overlapping the rows which are reached by any point
+  QVector<int> tiles;
+  int ty0 = firstRow / sTileSize, ty1 = ( firstRow + rowCount - 1 ) / sTileSize;
+  for ( int i = ty0 * mTilesX, n = ( ty1 + 1 ) * mTilesX; i < n; ++i )
+  {
+    if ( !mTilePoints[i].isEmpty() )
+    {
+      tiles.append( i );
+    }
+  }
+  QVector<double> tileMaxima( mTilePoints.size(), 0. );
+  QtConcurrent::blockingMap( tiles, QgsKernelDensityTileWorker( this, firstRow, firstRow + rowCount, values, tileMaxima.data() ) );
+
+  double maximum = 0;
+  foreach ( int tile, tiles )
+  {
+    maximum = qMax( maximum, tileMaxima[tile] );
+  }
+  return maximum;
+}
+
+void QgsKernelDensity::calculate()
+{
+  mValues.resize( mWidth * mHeight );
+  mMaximumValue = accumulateRows( 0, mHeight, mValues.data(), 0 );
+}
+
+QVector<float> QgsKernelDensity::calculateRows( int firstRow, int rowCount, float noDataValue, double* maximum )
+{
+  firstRow = qBound( 0, firstRow, mHeight );
+  rowCount = qBound( 0, rowCount, mHeight - firstRow );
+  QVector<float> values( rowCount * mWidth );
+  double rowsMaximum = accumulateRows( firstRow, rowCount, values.data(), noDataValue );
+  if ( maximum )
+  {
+    *maximum = rowsMaximum;
+  }
+  return values;
+}
+
+/* The kernel functions below are taken from "Kernel Smoothing" by Wand and Jones (1995), p. 175
+ *
+ * Each kernel is multiplied by a normalizing constant "k", which normalizes the kernel area
+ * to 1 for a given bandwidth size.
+ *
+ * k is calculated by polar double integration of the kernel function
+ * between a radius of 0 to the specified bandwidth and equating the area to 1. */
+
+double QgsKernelDensity::kernelValue( double distance, int radius ) const
+{
+  double bandwidth = radius;
+  double scaledDistance = distance / bandwidth;
+  bool scaled = mOutputValues == Scaled;
+  switch ( mShape )
+  {
+    case Uniform:
+      return scaled ? 2. / ( M_PI * bandwidth ) * ( 0.5 / bandwidth ) : 1.0;
+
+    case Quartic:
+    {
+      double value = pow( 1. - scaledDistance * scaledDistance, 2 );
+      return scaled ? 116. / ( 5. * M_PI * bandwidth * bandwidth ) * ( 15. / 16. ) * value : value;
+    }
+
+    case Triweight:
+    {
+      double value = pow( 1. - scaledDistance * scaledDistance, 3 );
+      return scaled ? 128. / ( 35. * M_PI * bandwidth * bandwidth ) * ( 35. / 32. ) * value : value;
+    }
+
+    case Epanechnikov:
+    {
+      double value = 1. - scaledDistance * scaledDistance;
+      return scaled ? 8. / ( 3. * M_PI * bandwidth * bandwidth ) * ( 3. / 4. ) * value : value;
+    }
+
+    case Triangular:
+    {
+      // the normalizing constant includes the non-standard "decay" parameter, negative decays ("coolmap") are not normalized
+      double value = 1. - ( 1. - mDecay ) * scaledDistance;
+      return scaled && mDecay >= 0 ? 3. / (( 1. + 2. * mDecay ) * M_PI * bandwidth * bandwidth ) * value : value;
+    }
+  }
+  return 0;
+}
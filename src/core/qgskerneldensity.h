@@ -0,0 +1,139 @@
+/***************************************************************************
+    qgskerneldensity.h
+    ---------------------
+    begin                : December 2015
+    copyright            : (C) 2015 by Sandro Mani
+    email                : manisandro@gmail.com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QGSKERNELDENSITY_H
+#define QGSKERNELDENSITY_H
+
+#include <QMap>
+#include <QVector>
+
+/** \ingroup core
+ * \class QgsKernelDensity
+ * \brief Calculates a kernel density surface of weighted points on a pixel grid.
+ *
+ * Points are collected with addPoint() and accumulated by calculate(), which stamps a precomputed
+ * kernel per radius onto tiles of the grid. The tiles are processed in parallel. Large grids can be
+ * calculated in strips of rows with calculateRows().
+ */
+class CORE_EXPORT QgsKernelDensity
+{
+  public:
+    /** Kernel shape */
+    enum KernelShape
+    {
+      Quartic,
+      Triangular,
+      Uniform,
+      Triweight,
+      Epanechnikov
+    };
+
+    /** Kernel output values */
+    enum OutputValues
+    {
+      /** The kernel value is 1 at the point */
+      Raw,
+      /** The kernel is normalized to a volume of 1 */
+      Scaled
+    };
+
+    /**
+     * @param width grid width in pixels
+     * @param height grid height in pixels
+     * @param shape kernel shape
+     * @param outputValues kernel scaling
+     * @param decay decay ratio of the triangular kernel
+     */
+    QgsKernelDensity( int width, int height, KernelShape shape = Quartic, OutputValues outputValues = Raw, double decay = 1.0 );
+
+    int width() const { return mWidth; }
+    int height() const { return mHeight; }
+
+    /** Adds a point at pixel x, y with a radius in pixels. Points outside the grid contribute to the pixels within their radius. */
+    void addPoint( int x, int y, int radius, double weight = 1.0 );
+
+    /** Returns the number of points added since the last clear() */
+    int pointCount() const { return mPoints.size(); }
+
+    /** Removes all points and values */
+    void clear();
+
+    /** Accumulates the kernels of all points into the grid values */
+    void calculate();
+
+    /**
+     * Accumulates the kernels of all points into some rows of the grid, without keeping the grid in memory.
+     * @param firstRow first row to calculate
+     * @param rowCount number of rows
+     * @param noDataValue value of the pixels not within the radius of any point
+     * @param maximum if not null, receives the maximum value of the rows
+     * @return rowCount * width() values, row by row
+     * @note added in 2.16
+     */
+    QVector<float> calculateRows( int firstRow, int rowCount, float noDataValue = 0, double* maximum = 0 );
+
+    /** The values calculated by calculate(), row by row */
+    const QVector<float>& values() const { return mValues; }
+
+    /** The maximum value calculated by calculate() */
+    double maximumValue() const { return mMaximumValue; }
+
+    /** Returns the kernel value at a distance from the point, for a kernel of the given radius */
+    double kernelValue( double distance, int radius ) const;
+
+  private:
+    struct Point
+    {
+      int x;
+      int y;
+      int radius;
+      float weight;
+    };
+
+    /** Kernel values of the (2 * radius + 1)^2 pixels around a point */
+    struct Stamp
+    {
+      QVector<float> values;
+      /** Per row of the stamp, the pixels with |dx| <= halfWidth are within the radius */
+      QVector<int> halfWidths;
+    };
+
+    friend class QgsKernelDensityTileWorker;
+
+    static const int sTileSize = 256;
+
+    int mWidth;
+    int mHeight;
+    KernelShape mShape;
+    OutputValues mOutputValues;
+    double mDecay;
+
+    QVector<Point> mPoints;
+    /** Stamps per radius */
+    QMap<int, Stamp> mStamps;
+    /** Indices of the points overlapping each tile */
+    QVector< QVector<int> > mTilePoints;
+    int mTilesX;
+    /** Whether the stamps and tiles are up to date with the points */
+    bool mPrepared;
+    QVector<float> mValues;
+    double mMaximumValue;
+
+    /** Prepares the stamps and assigns the points to the tiles they overlap */
+    void prepare();
+    /** Accumulates rows into values, returns the maximum */
+    double accumulateRows( int firstRow, int rowCount, float* values, float noDataValue );
+};
+
+#endif // QGSKERNELDENSITY_H
@@ -20,10 +20,23 @@
 #include "qgsredlininglayer.h"
 #include "qgslogger.h"
 
+#include <QThreadStorage>
+
 QgsMapLayerRegistry* QgsMapLayerRegistry::sInstance = 0;
+bool QgsMapLayerRegistry::sThreadLocalInstances = false;
+
+static QThreadStorage<QgsMapLayerRegistry*> sThreadInstances;
 
 QgsMapLayerRegistry* QgsMapLayerRegistry::instance()
 {
+  if ( sThreadLocalInstances )
+  {
+    if ( !sThreadInstances.hasLocalData() )
+    {
+      sThreadInstances.setLocalData( new QgsMapLayerRegistry() );
+    }
+    return sThreadInstances.localData();
+  }
   if ( sInstance == 0 )
   {
     sInstance = new QgsMapLayerRegistry();
@@ -31,6 +44,11 @@ QgsMapLayerRegistry* QgsMapLayerRegistry::instance()
   return sInstance;
 }
 
+void QgsMapLayerRegistry::setThreadLocalInstances( bool threadLocal )
+{
+  sThreadLocalInstances = threadLocal;
+}
+
 void QgsMapLayerRegistry::cleanup()
 {
   delete sInstance;
@@ -40,6 +40,12 @@ class CORE_EXPORT QgsMapLayerRegistry : public QObject
     static QgsMapLayerRegistry* instance();
     static void cleanup();
 
+    /** Sets whether instance() returns a separate registry for each calling thread, e.g. for a server
+     * processing requests in parallel threads. The registry of a thread is deleted when the thread finishes.
+     * Must be set before instance() is used in several threads.
+     * @note added in 2.16 */
+    static void setThreadLocalInstances( bool threadLocal );
+
     ~QgsMapLayerRegistry();
 
     //! Return the number of registered layers.
@@ -243,6 +249,7 @@ class CORE_EXPORT QgsMapLayerRegistry : public QObject
 
   private:
     static QgsMapLayerRegistry* sInstance;
+    static bool sThreadLocalInstances;
 
     QMap<QString, QgsMapLayer*> mMapLayers;
     QSet<QgsMapLayer*> mOwnedLayers;
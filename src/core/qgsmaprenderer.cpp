@@ -1275,6 +1275,12 @@ const QgsMapSettings& QgsMapRenderer::mapSettings()
   mMapSettings.setCrsTransformEnabled( hasCrsTransformEnabled() );
   mMapSettings.setDestinationCrs( destinationCrs() );
   mMapSettings.setMapUnits( mapUnits() );
+  // setting the destination CRS cleared the datum transforms
+  QHash< QString, QgsLayerCoordinateTransform >::const_iterator ltIt = mLayerCoordinateTransformInfo.constBegin();
+  for ( ; ltIt != mLayerCoordinateTransformInfo.constEnd(); ++ltIt )
+  {
+    mMapSettings.datumTransformStore().addEntry( ltIt.key(), ltIt->srcAuthId, ltIt->destAuthId, ltIt->srcDatumTransform, ltIt->destDatumTransform );
+  }
   return mMapSettings;
 }
 
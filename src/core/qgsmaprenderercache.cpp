@@ -17,12 +17,24 @@
 
 #include "qgsmaplayerregistry.h"
 #include "qgsmaplayer.h"
+#include "qgsmapsettings.h"
+
+#include <QPainter>
+#include <qmath.h>
 
 QgsMapRendererCache::QgsMapRendererCache()
+    : mTiled( false )
 {
   clear();
 }
 
+void QgsMapRendererCache::setTiled( bool tiled )
+{
+  QMutexLocker lock( &mMutex );
+  clearInternal();
+  mTiled = tiled;
+}
+
 void QgsMapRendererCache::clear()
 {
   QMutexLocker lock( &mMutex );
@@ -35,7 +47,7 @@ void QgsMapRendererCache::clearInternal()
   mScale = 0;
 
   // make sure we are disconnected from all layers
-  foreach ( QString layerId, mCachedImages.keys() )
+  foreach ( QString layerId, mCachedImages.keys() + mCachedTiles.keys() )
   {
     QgsMapLayer* layer = QgsMapLayerRegistry::instance()->mapLayer( layerId );
     if ( layer )
@@ -44,6 +56,8 @@ void QgsMapRendererCache::clearInternal()
     }
   }
   mCachedImages.clear();
+  mCachedTiles.clear();
+  mTileGridValid = false;
 }
 
 bool QgsMapRendererCache::init( QgsRectangle extent, double scale )
@@ -64,25 +78,179 @@ bool QgsMapRendererCache::init( QgsRectangle extent, double scale )
   return false;
 }
 
+bool QgsMapRendererCache::init( const QgsMapSettings& settings )
+{
+  if ( !mTiled )
+  {
+    bool sameParameters = init( settings.visibleExtent(), settings.scale() );
+    QMutexLocker lock( &mMutex );
+    mViewRect = QRect( QPoint( 0, 0 ), settings.outputSize() );
+    return sameParameters;
+  }
+
+  QMutexLocker lock( &mMutex );
+
+  QgsRectangle extent = settings.visibleExtent();
+  double mupp = settings.mapUnitsPerPixel();
+  bool sameGrid = mTileGridValid && mupp == mMapUnitsPerPixel && settings.scale() == mScale &&
+                  settings.outputDpi() == mDpi && settings.outputImageFormat() == mImageFormat;
+  if ( sameGrid )
+  {
+    // the tiles can only be reused if the view moved by whole pixels, otherwise they would need to be resampled
+    double x = ( extent.xMinimum() - mGridOrigin.x() ) / mupp;
+    double y = ( mGridOrigin.y() - extent.yMaximum() ) / mupp;
+    sameGrid = qAbs( x ) < 1e8 && qAbs( y ) < 1e8 && qAbs( x - qRound( x ) ) < 0.01 && qAbs( y - qRound( y ) ) < 0.01;
+    if ( sameGrid )
+    {
+      bool sameExtent = extent == mExtent && settings.outputSize() == mViewRect.size();
+      mExtent = extent;
+      mViewRect = QRect( QPoint( qRound( x ), qRound( y ) ), settings.outputSize() );
+      removeDistantTiles();
+      return sameExtent;
+    }
+  }
+
+  clearInternal();
+
+  // set new params
+  mExtent = extent;
+  mScale = settings.scale();
+  mMapUnitsPerPixel = mupp;
+  mDpi = settings.outputDpi();
+  mImageFormat = settings.outputImageFormat();
+  mGridOrigin = QgsPoint( extent.xMinimum(), extent.yMaximum() );
+  mViewRect = QRect( QPoint( 0, 0 ), settings.outputSize() );
+  // rotated views are cached as whole images
+  mTileGridValid = settings.rotation() == 0;
+
+  return false;
+}
+
+void QgsMapRendererCache::removeDistantTiles()
+{
+  // keep the tiles within one view size around the view
+  QRect keepRect = mViewRect.adjusted( -mViewRect.width(), -mViewRect.height(), mViewRect.width(), mViewRect.height() );
+  for ( QHash<QString, QHash<TileIndex, Tile> >::iterator layerIt = mCachedTiles.begin(); layerIt != mCachedTiles.end(); ++layerIt )
+  {
+    QHash<TileIndex, Tile>::iterator it = layerIt->begin();
+    while ( it != layerIt->end() )
+    {
+      QRect tileRect( it.key().first * sTileSize, it.key().second * sTileSize, sTileSize, sTileSize );
+      if ( keepRect.intersects( tileRect ) )
+        ++it;
+      else
+        it = layerIt->erase( it );
+    }
+  }
+}
+
 void QgsMapRendererCache::setCacheImage( QString layerId, const QImage& img )
 {
   QMutexLocker lock( &mMutex );
-  mCachedImages[layerId] = img;
+  if ( useTiles() && img.size() == mViewRect.size() )
+  {
+    // copy the image into the tiles of the view
+    QHash<TileIndex, Tile>& tiles = mCachedTiles[layerId];
+    int col0 = qFloor( double( mViewRect.left() ) / sTileSize ), col1 = qFloor( double( mViewRect.right() ) / sTileSize );
+    int row0 = qFloor( double( mViewRect.top() ) / sTileSize ), row1 = qFloor( double( mViewRect.bottom() ) / sTileSize );
+    for ( int row = row0; row <= row1; ++row )
+    {
+      for ( int col = col0; col <= col1; ++col )
+      {
+        QRect tileRect( col * sTileSize, row * sTileSize, sTileSize, sTileSize );
+        QRect part = tileRect.intersected( mViewRect );
+        Tile& tile = tiles[qMakePair( col, row )];
+        if ( tile.image.isNull() )
+        {
+          tile.image = QImage( sTileSize, sTileSize, img.format() );
+          tile.image.fill( 0 );
+        }
+        QPainter painter( &tile.image );
+        painter.setCompositionMode( QPainter::CompositionMode_Source );
+        painter.drawImage( part.translated( -tileRect.topLeft() ), img, part.translated( -mViewRect.topLeft() ) );
+        painter.end();
+        tile.valid |= part.translated( -tileRect.topLeft() );
+      }
+    }
+  }
+  else
+  {
+    mCachedImages[layerId] = img;
+  }
 
   // connect to the layer to listen to layer's repaintRequested() signals
   QgsMapLayer* layer = QgsMapLayerRegistry::instance()->mapLayer( layerId );
   if ( layer )
   {
-    connect( layer, SIGNAL( repaintRequested() ), this, SLOT( layerRequestedRepaint() ) );
+    connect( layer, SIGNAL( repaintRequested() ), this, SLOT( layerRequestedRepaint() ), Qt::UniqueConnection );
   }
 }
 
 QImage QgsMapRendererCache::cacheImage( QString layerId )
 {
+  if ( useTiles() )
+  {
+    if ( !missingRegion( layerId ).isEmpty() )
+      return QImage();
+
+    QImage img;
+    {
+      QMutexLocker lock( &mMutex );
+      img = QImage( mViewRect.size(), mImageFormat );
+    }
+    img.fill( 0 );
+    drawCachedTiles( layerId, img );
+    return img;
+  }
   QMutexLocker lock( &mMutex );
   return mCachedImages.value( layerId );
 }
 
+QRegion QgsMapRendererCache::missingRegion( QString layerId )
+{
+  QMutexLocker lock( &mMutex );
+  if ( !useTiles() )
+  {
+    return mCachedImages.contains( layerId ) ? QRegion() : QRegion( QRect( QPoint( 0, 0 ), mViewRect.size() ) );
+  }
+
+  QRegion missing( mViewRect );
+  QHash<QString, QHash<TileIndex, Tile> >::const_iterator layerIt = mCachedTiles.constFind( layerId );
+  if ( layerIt != mCachedTiles.constEnd() )
+  {
+    for ( QHash<TileIndex, Tile>::const_iterator it = layerIt->constBegin(); it != layerIt->constEnd(); ++it )
+    {
+      missing -= it->valid.translated( it.key().first * sTileSize, it.key().second * sTileSize );
+    }
+  }
+  return missing.translated( -mViewRect.topLeft() );
+}
+
+void QgsMapRendererCache::drawCachedTiles( QString layerId, QImage& img )
+{
+  QMutexLocker lock( &mMutex );
+  if ( !useTiles() )
+    return;
+
+  QHash<QString, QHash<TileIndex, Tile> >::const_iterator layerIt = mCachedTiles.constFind( layerId );
+  if ( layerIt == mCachedTiles.constEnd() )
+    return;
+
+  QPainter painter( &img );
+  painter.setCompositionMode( QPainter::CompositionMode_Source );
+  for ( QHash<TileIndex, Tile>::const_iterator it = layerIt->constBegin(); it != layerIt->constEnd(); ++it )
+  {
+    QPoint tileOrigin( it.key().first * sTileSize, it.key().second * sTileSize );
+    if ( !mViewRect.intersects( QRect( tileOrigin, QSize( sTileSize, sTileSize ) ) ) )
+      continue;
+
+    foreach ( const QRect& rect, it->valid.rects() )
+    {
+      painter.drawImage( rect.translated( tileOrigin - mViewRect.topLeft() ), it->image, rect );
+    }
+  }
+}
+
 void QgsMapRendererCache::layerRequestedRepaint()
 {
   QgsMapLayer* layer = qobject_cast<QgsMapLayer*>( sender() );
@@ -95,6 +263,7 @@ void QgsMapRendererCache::clearCacheImage( QString layerId )
   QMutexLocker lock( &mMutex );
 
   mCachedImages.remove( layerId );
+  mCachedTiles.remove( layerId );
 
   QgsMapLayer* layer = QgsMapLayerRegistry::instance()->mapLayer( layerId );
   if ( layer )
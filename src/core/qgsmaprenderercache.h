@@ -16,12 +16,18 @@
 #ifndef QGSMAPRENDERERCACHE_H
 #define QGSMAPRENDERERCACHE_H
 
+#include <QHash>
 #include <QMap>
 #include <QImage>
 #include <QMutex>
+#include <QPair>
+#include <QRegion>
 
+#include "qgspoint.h"
 #include "qgsrectangle.h"
 
+class QgsMapSettings;
+
 
 /**
  * This class is responsible for keeping cache of rendered images of individual layers.
@@ -30,6 +36,10 @@
  * the cache listens to repaintRequested() signals from layer. If triggered, the cache
  * removes the rendered image (and disconnects from the layer).
  *
+ * In tiled mode, layer images are split into tiles of a fixed pixel grid at the current scale.
+ * When the view is panned, the tiles which are still visible are kept and only the
+ * missing region of the view needs to be rendered.
+ *
  * The class is thread-safe (multiple classes can access the same instance safely).
  *
  * @note added in 2.4
@@ -48,12 +58,34 @@ class CORE_EXPORT QgsMapRendererCache : public QObject
     //! @return flag whether the parameters are the same as last time
     bool init( QgsRectangle extent, double scale );
 
+    //! initialize cache from the map settings. In tiled mode, the tiles are kept if the
+    //! view was only moved by whole pixels at the same scale.
+    //! @return flag whether the parameters are the same as last time
+    //! @note added in 2.16
+    bool init( const QgsMapSettings& settings );
+
+    //! set whether layer images are cached in tiles which survive panning. Clears the cache.
+    //! @note added in 2.16
+    void setTiled( bool tiled );
+
+    //! whether layer images are cached in tiles
+    //! @note added in 2.16
+    bool isTiled() const { return mTiled; }
+
     //! set cached image for the specified layer ID
     void setCacheImage( QString layerId, const QImage& img );
 
     //! get cached image for the specified layer ID. Returns null image if it is not cached.
     QImage cacheImage( QString layerId );
 
+    //! get the region of the view in pixels which is not cached for the specified layer ID
+    //! @note added in 2.16
+    QRegion missingRegion( QString layerId );
+
+    //! draw the cached parts of the view for the specified layer ID onto an image of the view
+    //! @note added in 2.16
+    void drawCachedTiles( QString layerId, QImage& img );
+
     //! remove layer from the cache
     void clearCacheImage( QString layerId );
 
@@ -65,11 +97,40 @@ class CORE_EXPORT QgsMapRendererCache : public QObject
     //! invalidate cache contents (without locking)
     void clearInternal();
 
+    //! whether the current parameters allow caching tiles (without locking)
+    bool useTiles() const { return mTiled && mTileGridValid; }
+
+    //! remove the tiles far from the view (without locking)
+    void removeDistantTiles();
+
   protected:
+    //! Part of a layer image, with the region of the tile which has been rendered
+    struct Tile
+    {
+      QImage image;
+      QRegion valid;
+    };
+    //! column and row of a tile in the grid
+    typedef QPair<int, int> TileIndex;
+
+    static const int sTileSize = 256;
+
     QMutex mMutex;
     QgsRectangle mExtent;
     double mScale;
     QMap<QString, QImage> mCachedImages;
+
+    bool mTiled;
+    //! whether the tile grid matches the current parameters
+    bool mTileGridValid;
+    //! map coordinates of the top left corner of the tile grid
+    QgsPoint mGridOrigin;
+    double mMapUnitsPerPixel;
+    int mDpi;
+    QImage::Format mImageFormat;
+    //! pixel position of the view in the tile grid
+    QRect mViewRect;
+    QHash<QString, QHash<TileIndex, Tile> > mCachedTiles;
 };
 
 
@@ -74,9 +74,7 @@ void QgsMapRendererCustomPainterJob::start()
 
   if ( mSettings.testFlag( QgsMapSettings::DrawLabeling ) )
   {
-    mLabelingEngine = new QgsPalLabeling;
-    mLabelingEngine->loadEngineSettings();
-    mLabelingEngine->init( mSettings );
+    mLabelingEngine = createLabelingEngine();
   }
 
   mLayerJobs = prepareJobs( mPainter, mLabelingEngine );
@@ -30,13 +30,101 @@
 #include "qgsmaplayerstylemanager.h"
 #include "qgsmaprenderercache.h"
 #include "qgspallabeling.h"
+#include "qgsvectorlayer.h"
 #include "qgsvectorlayerrenderer.h"
+#include "qgscategorizedsymbolrendererv2.h"
+#include "qgsgraduatedsymbolrendererv2.h"
+#include "qgssinglesymbolrendererv2.h"
+#include "qgssymbollayerv2.h"
+
+#include <cmath>
+
+//! conservative estimate of how far (in pixels) the symbol reaches beyond the rendered geometry, or -1 if unknown
+static double symbolReach( QgsSymbolV2* symbol, double pixelsPerMM )
+{
+  if ( !symbol )
+    return -1;
+
+  double reach = 0;
+  for ( int i = 0; i < symbol->symbolLayerCount(); ++i )
+  {
+    QgsSymbolLayerV2* layer = symbol->symbolLayer( i );
+    if ( layer->hasDataDefinedProperties() )
+      return -1;
+
+    QgsSymbolV2::OutputUnit unit = layer->outputUnit();
+    if ( unit != QgsSymbolV2::MM && unit != QgsSymbolV2::Pixel )
+      return -1;
+
+    double layerReach = layer->estimateMaxBleed();
+    if ( QgsMarkerSymbolLayerV2* marker = dynamic_cast<QgsMarkerSymbolLayerV2*>( layer ) )
+    {
+      // the anchor point may shift the marker by half of its size
+      QPointF offset = marker->offset();
+      layerReach += marker->size() * sqrt( 2.0 ) + sqrt( offset.x() * offset.x() + offset.y() * offset.y() );
+    }
+    else if ( QgsLineSymbolLayerV2* line = dynamic_cast<QgsLineSymbolLayerV2*>( layer ) )
+    {
+      layerReach = qMax( layerReach, line->width() / 2 + qAbs( line->offset() ) );
+    }
+
+    if ( layer->subSymbol() )
+    {
+      double subReach = symbolReach( layer->subSymbol(), pixelsPerMM );
+      if ( subReach < 0 )
+        return -1;
+      layerReach += subReach;
+    }
+
+    reach = qMax( reach, unit == QgsSymbolV2::MM ? layerReach * pixelsPerMM : layerReach );
+  }
+  return reach;
+}
+
+//! how far (in pixels) the symbols of a layer reach beyond its features, or -1 if the layer
+//! has to be rendered in full (e.g. renderers whose output depends on all features in the view)
+static double layerSymbolReach( QgsMapLayer* ml, const QgsMapSettings& settings )
+{
+  // rasters are drawn aligned to the output pixels, so a partial render matches the full render
+  if ( ml->type() == QgsMapLayer::RasterLayer )
+    return 0;
+
+  QgsVectorLayer* vl = qobject_cast<QgsVectorLayer*>( ml );
+  if ( !vl || !vl->rendererV2() || vl->diagramRenderer() )
+    return -1;
+
+  QgsFeatureRendererV2* renderer = vl->rendererV2();
+  QString sizeScaleField;
+  if ( QgsSingleSymbolRendererV2* r = dynamic_cast<QgsSingleSymbolRendererV2*>( renderer ) )
+    sizeScaleField = r->sizeScaleField();
+  else if ( QgsCategorizedSymbolRendererV2* r = dynamic_cast<QgsCategorizedSymbolRendererV2*>( renderer ) )
+    sizeScaleField = r->sizeScaleField();
+  else if ( QgsGraduatedSymbolRendererV2* r = dynamic_cast<QgsGraduatedSymbolRendererV2*>( renderer ) )
+    sizeScaleField = r->sizeScaleField();
+  else
+    return -1;
+
+  if ( !sizeScaleField.isEmpty() )
+    return -1;
+
+  double pixelsPerMM = settings.outputDpi() / 25.4;
+  double reach = 0;
+  foreach ( QgsSymbolV2* symbol, renderer->symbols() )
+  {
+    double symReach = symbolReach( symbol, pixelsPerMM );
+    if ( symReach < 0 )
+      return -1;
+    reach = qMax( reach, symReach );
+  }
+  return reach;
+}
 
 
 QgsMapRendererJob::QgsMapRendererJob( const QgsMapSettings& settings )
     : mSettings( settings )
     , mCache( 0 )
     , mRenderingTime( 0 )
+    , mLabelingEngineSettings( 0 )
 {
 }
 
@@ -63,6 +151,30 @@ const QgsMapSettings& QgsMapRendererJob::mapSettings() const
 }
 
 
+QgsPalLabeling* QgsMapRendererJob::createLabelingEngine()
+{
+  QgsPalLabeling* labelingEngine = new QgsPalLabeling;
+  if ( mLabelingEngineSettings )
+  {
+    int candPoint, candLine, candPolygon;
+    mLabelingEngineSettings->numCandidatePositions( candPoint, candLine, candPolygon );
+    labelingEngine->setNumCandidatePositions( candPoint, candLine, candPolygon );
+    labelingEngine->setSearchMethod( mLabelingEngineSettings->searchMethod() );
+    labelingEngine->setShowingCandidates( mLabelingEngineSettings->isShowingCandidates() );
+    labelingEngine->setShowingShadowRectangles( mLabelingEngineSettings->isShowingShadowRectangles() );
+    labelingEngine->setShowingAllLabels( mLabelingEngineSettings->isShowingAllLabels() );
+    labelingEngine->setShowingPartialsLabels( mLabelingEngineSettings->isShowingPartialsLabels() );
+    labelingEngine->setDrawingOutlineLabels( mLabelingEngineSettings->isDrawingOutlineLabels() );
+  }
+  else
+  {
+    labelingEngine->loadEngineSettings();
+  }
+  labelingEngine->init( mSettings );
+  return labelingEngine;
+}
+
+
 bool QgsMapRendererJob::reprojectToLayerExtent( const QgsCoordinateTransform* ct, bool layerCrsGeographic, QgsRectangle& extent, QgsRectangle& r2 )
 {
   bool split = false;
@@ -145,7 +257,7 @@ LayerRenderJobs QgsMapRendererJob::prepareJobs( QPainter* painter, QgsPalLabelin
 
   if ( mCache )
   {
-    bool cacheValid = mCache->init( mSettings.visibleExtent(), mSettings.scale() );
+    bool cacheValid = mCache->init( mSettings );
     QgsDebugMsg( QString( "CACHE VALID: %1" ).arg( cacheValid ) );
     Q_UNUSED( cacheValid );
   }
@@ -180,9 +292,53 @@ LayerRenderJobs QgsMapRendererJob::prepareJobs( QPainter* painter, QgsPalLabelin
       continue;
     }
 
+    // Force render of layers that are being edited
+    // or if there's a labeling engine that needs the layer to register features
+    if ( mCache && ( ml->type() == QgsMapLayer::VectorLayer || ml->type() == QgsMapLayer::RedliningLayer ) )
+    {
+      QgsVectorLayer* vl = qobject_cast<QgsVectorLayer *>( ml );
+      if ( vl->isEditable() || ( labelingEngine && labelingEngine->willUseLayer( vl ) ) )
+        mCache->clearCacheImage( ml->id() );
+    }
+
     QgsRectangle r1 = mSettings.visibleExtent(), r2;
     const QgsCoordinateTransform* ct = 0;
 
+    // with a tiled cache, only the parts of the view which are not cached need to be rendered
+    QRegion missingRegion;
+    bool renderMissingRegion = false;
+    if ( mCache )
+    {
+      missingRegion = mCache->missingRegion( ml->id() );
+      renderMissingRegion = !missingRegion.isEmpty() && missingRegion != QRegion( QRect( QPoint( 0, 0 ), mSettings.outputSize() ) );
+    }
+    int margin = 0;
+    if ( renderMissingRegion )
+    {
+      double reach = layerSymbolReach( ml, mSettings );
+      if ( reach < 0 )
+      {
+        // the output of the layer depends on the whole view (or symbols of unknown size),
+        // so the cached tiles would not match a partial render
+        mCache->clearCacheImage( ml->id() );
+        missingRegion = mCache->missingRegion( ml->id() );
+        renderMissingRegion = false;
+      }
+      else
+      {
+        margin = int( ceil( reach ) ) + 2;
+      }
+    }
+    if ( renderMissingRegion )
+    {
+      // features just outside of the missing region may have symbols reaching into it
+      QRect missingRect = missingRegion.boundingRect().adjusted( -margin, -margin, margin, margin );
+      const QgsMapToPixel& mtp = mSettings.mapToPixel();
+      QgsRectangle missingExtent( mtp.toMapCoordinates( missingRect.left(), missingRect.top() ),
+                                  mtp.toMapCoordinates( missingRect.right() + 1, missingRect.bottom() + 1 ) );
+      r1 = missingExtent.intersect( &r1 );
+    }
+
     if ( mSettings.hasCrsTransformEnabled() )
     {
       ct = mSettings.layerTransform( ml );
@@ -198,15 +354,6 @@ LayerRenderJobs QgsMapRendererJob::prepareJobs( QPainter* painter, QgsPalLabelin
       }
     }
 
-    // Force render of layers that are being edited
-    // or if there's a labeling engine that needs the layer to register features
-    if ( mCache && ( ml->type() == QgsMapLayer::VectorLayer || ml->type() == QgsMapLayer::RedliningLayer ) )
-    {
-      QgsVectorLayer* vl = qobject_cast<QgsVectorLayer *>( ml );
-      if ( vl->isEditable() || ( labelingEngine && labelingEngine->willUseLayer( vl ) ) )
-        mCache->clearCacheImage( ml->id() );
-    }
-
     layerJobs.append( LayerRenderJob() );
     LayerRenderJob& job = layerJobs.last();
     job.cached = false;
@@ -221,10 +368,11 @@ LayerRenderJobs QgsMapRendererJob::prepareJobs( QPainter* painter, QgsPalLabelin
     job.context.setExtent( r1 );
 
     // if we can use the cache, let's do it and avoid rendering!
-    if ( mCache && !mCache->cacheImage( ml->id() ).isNull() )
+    QImage cachedImage = mCache && missingRegion.isEmpty() ? mCache->cacheImage( ml->id() ) : QImage();
+    if ( !cachedImage.isNull() )
     {
       job.cached = true;
-      job.img = new QImage( mCache->cacheImage( ml->id() ) );
+      job.img = new QImage( cachedImage );
       job.renderer = 0;
       job.context.setPainter( 0 );
       continue;
@@ -250,8 +398,17 @@ LayerRenderJobs QgsMapRendererJob::prepareJobs( QPainter* painter, QgsPalLabelin
       mypFlattenedImage->fill( 0 );
 
       job.img = mypFlattenedImage;
+      if ( renderMissingRegion )
+      {
+        // the cached parts are drawn from the tiles, before the layer painter becomes the active painter of the image
+        mCache->drawCachedTiles( ml->id(), *job.img );
+      }
       QPainter* mypPainter = new QPainter( job.img );
       mypPainter->setRenderHint( QPainter::Antialiasing, mSettings.testFlag( QgsMapSettings::Antialiasing ) );
+      if ( renderMissingRegion )
+      {
+        mypPainter->setClipRegion( missingRegion );
+      }
       job.context.setPainter( mypPainter );
     }
 
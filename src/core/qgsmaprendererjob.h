@@ -133,6 +133,13 @@ class CORE_EXPORT QgsMapRendererJob : public QObject
      */
     const QgsMapSettings& mapSettings() const;
 
+    /**
+     * Set a labeling engine whose engine settings (search method, candidates, ...) are used instead
+     * of the settings stored in the current project. Does not take ownership of the object.
+     * @note added in 2.16
+     */
+    void setLabelingEngineSettings( QgsPalLabeling* engine ) { mLabelingEngineSettings = engine; }
+
   signals:
 
     //! emitted when asynchronous rendering is finished (or canceled).
@@ -148,6 +155,9 @@ class CORE_EXPORT QgsMapRendererJob : public QObject
      */
     static bool reprojectToLayerExtent( const QgsCoordinateTransform* ct, bool layerCrsGeographic, QgsRectangle& extent, QgsRectangle& r2 );
 
+    //! creates the labeling engine for the job, initialized with the engine settings
+    QgsPalLabeling* createLabelingEngine();
+
     //! @note not available in python bindings
     LayerRenderJobs prepareJobs( QPainter* painter, QgsPalLabeling* labelingEngine );
 
@@ -177,6 +187,9 @@ class CORE_EXPORT QgsMapRendererJob : public QObject
 
     QTime mRenderingStart;
     int mRenderingTime;
+
+    //! labeling engine to take the engine settings from, 0 to use the project settings
+    QgsPalLabeling* mLabelingEngineSettings;
 };
 
 
@@ -0,0 +1,386 @@
+/***************************************************************************
+    qgssqlexpressioncompiler.cpp
+    ---------------------
+    begin                : October 2016
+    copyright            : (C) 2016 by Sandro Mani
+    email                : manisandro@gmail.com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgssqlexpressioncompiler.h"
+#include "qgsgeometry.h"
+#include "qgsogcutils.h"
+#include <QScopedPointer>
+#include <QSettings>
+
+QgsSqlExpressionCompiler::QgsSqlExpressionCompiler( const QgsFields& fields )
+    : mFields( fields )
+{
+}
+
+QgsSqlExpressionCompiler::~QgsSqlExpressionCompiler()
+{
+}
+
+bool QgsSqlExpressionCompiler::compileExpressions()
+{
+  return QSettings().value( "/qgis/compileExpressions", true ).toBool();
+}
+
+QgsSqlExpressionCompiler::Result QgsSqlExpressionCompiler::compile( const QgsExpression* exp )
+{
+  mResult.clear();
+  mFilterRect = QgsRectangle();
+  if ( !exp || !exp->rootNode() )
+  {
+    return None;
+  }
+
+  //the conjuncts at the top level are compiled separately, the ones which cannot be compiled are
+  //left to the client side evaluation
+  QStringList clauses;
+  bool complete = true;
+  compileConjunction( exp->rootNode(), clauses, complete );
+  if ( clauses.isEmpty() && mFilterRect.isNull() )
+  {
+    return Fail;
+  }
+  mResult = clauses.join( " AND " );
+  return complete ? Complete : Partial;
+}
+
+void QgsSqlExpressionCompiler::compileConjunction( const QgsExpression::Node* node, QStringList& clauses, bool& complete )
+{
+  if ( node->nodeType() == QgsExpression::ntBinaryOperator )
+  {
+    const QgsExpression::NodeBinaryOperator* n = static_cast<const QgsExpression::NodeBinaryOperator*>( node );
+    if ( n->op() == QgsExpression::boAnd )
+    {
+      compileConjunction( n->opLeft(), clauses, complete );
+      compileConjunction( n->opRight(), clauses, complete );
+      return;
+    }
+  }
+
+  QgsRectangle rect;
+  if ( spatialPredicateRect( node, rect ) )
+  {
+    //the database only checks the bounding boxes, the predicate is evaluated on the client side
+    mFilterRect = mFilterRect.isNull() ? rect : mFilterRect.intersect( &rect );
+    complete = false;
+    return;
+  }
+
+  QString clause;
+  Result result = compileNode( node, clause );
+  if ( result == Complete || result == Partial )
+  {
+    clauses.append( "(" + clause + ")" );
+  }
+  if ( result != Complete )
+  {
+    complete = false;
+  }
+}
+
+QgsSqlExpressionCompiler::Result QgsSqlExpressionCompiler::compileNode( const QgsExpression::Node* node, QString& result )
+{
+  switch ( node->nodeType() )
+  {
+    case QgsExpression::ntUnaryOperator:
+    {
+      const QgsExpression::NodeUnaryOperator* n = static_cast<const QgsExpression::NodeUnaryOperator*>( node );
+      if ( n->op() != QgsExpression::uoNot )
+      {
+        return Fail;
+      }
+      //the negation of a superset is no superset
+      QString operand;
+      if ( compileNode( n->operand(), operand ) != Complete )
+      {
+        return Fail;
+      }
+      result = "NOT (" + operand + ")";
+      return Complete;
+    }
+
+    case QgsExpression::ntBinaryOperator:
+    {
+      const QgsExpression::NodeBinaryOperator* n = static_cast<const QgsExpression::NodeBinaryOperator*>( node );
+      QString left, right;
+      switch ( n->op() )
+      {
+        case QgsExpression::boAnd:
+        {
+          Result resultLeft = compileNode( n->opLeft(), left );
+          Result resultRight = compileNode( n->opRight(), right );
+          if ( resultLeft == Complete && resultRight == Complete )
+          {
+            result = QString( "(%1) AND (%2)" ).arg( left, right );
+            return Complete;
+          }
+          //leaving out one side of the conjunction gives a superset
+          if ( resultLeft == Fail && resultRight == Fail )
+          {
+            return Fail;
+          }
+          if ( resultLeft == Fail )
+          {
+            result = right;
+          }
+          else if ( resultRight == Fail )
+          {
+            result = left;
+          }
+          else
+          {
+            result = QString( "(%1) AND (%2)" ).arg( left, right );
+          }
+          return Partial;
+        }
+
+        case QgsExpression::boOr:
+        {
+          Result resultLeft = compileNode( n->opLeft(), left );
+          Result resultRight = compileNode( n->opRight(), right );
+          if ( resultLeft == Fail || resultRight == Fail )
+          {
+            return Fail;
+          }
+          result = QString( "(%1) OR (%2)" ).arg( left, right );
+          return resultLeft == Complete && resultRight == Complete ? Complete : Partial;
+        }
+
+        case QgsExpression::boEQ:
+        case QgsExpression::boNE:
+        case QgsExpression::boLE:
+        case QgsExpression::boGE:
+        case QgsExpression::boLT:
+        case QgsExpression::boGT:
+        {
+          OperandType typeLeft = compileOperand( n->opLeft(), left );
+          OperandType typeRight = compileOperand( n->opRight(), right );
+          if ( typeLeft != typeRight || ( typeLeft != NumericOperand && typeLeft != StringOperand ) )
+          {
+            return Fail;
+          }
+          //the expression orders strings with QString::compare, the database with its collation.
+          //two string columns may both hold numbers, which the expression compares as numbers
+          if ( typeLeft == StringOperand && ( ( n->op() != QgsExpression::boEQ && n->op() != QgsExpression::boNE ) ||
+                                              ( n->opLeft()->nodeType() != QgsExpression::ntLiteral && n->opRight()->nodeType() != QgsExpression::ntLiteral ) ) )
+          {
+            return Fail;
+          }
+          result = QString( "%1 %2 %3" ).arg( left, QgsExpression::BinaryOperatorText[n->op()], right );
+          return Complete;
+        }
+
+        case QgsExpression::boIs:
+        case QgsExpression::boIsNot:
+        {
+          if ( compileOperand( n->opLeft(), left ) == InvalidOperand || compileOperand( n->opRight(), right ) != NullOperand )
+          {
+            return Fail;
+          }
+          result = left + ( n->op() == QgsExpression::boIs ? " IS NULL" : " IS NOT NULL" );
+          return Complete;
+        }
+
+        case QgsExpression::boLike:
+        case QgsExpression::boNotLike:
+        case QgsExpression::boILike:
+        case QgsExpression::boNotILike:
+        {
+          if ( compileOperand( n->opLeft(), left ) != StringOperand || n->opLeft()->nodeType() != QgsExpression::ntColumnRef ||
+               n->opRight()->nodeType() != QgsExpression::ntLiteral )
+          {
+            return Fail;
+          }
+          QVariant pattern = static_cast<const QgsExpression::NodeLiteral*>( n->opRight() )->value();
+          //the expression has no escape character in patterns
+          if ( pattern.type() != QVariant::String || pattern.toString().contains( '\\' ) )
+          {
+            return Fail;
+          }
+          return compileLike( n->op(), left, pattern.toString(), result );
+        }
+
+        default:
+          return Fail;
+      }
+    }
+
+    case QgsExpression::ntInOperator:
+    {
+      const QgsExpression::NodeInOperator* n = static_cast<const QgsExpression::NodeInOperator*>( node );
+      QString left;
+      OperandType type = compileOperand( n->node(), left );
+      QList<QgsExpression::Node*> list = n->list()->list();
+      if ( list.isEmpty() || ( type != NumericOperand && type != StringOperand ) )
+      {
+        return Fail;
+      }
+      QStringList values;
+      foreach ( const QgsExpression::Node* item, list )
+      {
+        QString value;
+        if ( compileOperand( item, value ) != type || ( type == StringOperand && item->nodeType() != QgsExpression::ntLiteral ) )
+        {
+          return Fail;
+        }
+        values.append( value );
+      }
+      result = QString( "%1 %2 (%3)" ).arg( left, n->isNotIn() ? "NOT IN" : "IN", values.join( "," ) );
+      return Complete;
+    }
+
+    default:
+      return Fail;
+  }
+}
+
+QgsSqlExpressionCompiler::OperandType QgsSqlExpressionCompiler::compileOperand( const QgsExpression::Node* node, QString& result )
+{
+  if ( node->nodeType() == QgsExpression::ntColumnRef )
+  {
+    const QgsExpression::NodeColumnRef* n = static_cast<const QgsExpression::NodeColumnRef*>( node );
+    int idx = mFields.indexFromName( n->name() );
+    if ( idx < 0 )
+    {
+      return InvalidOperand;
+    }
+    result = quotedIdentifier( n->name() );
+    return fieldType( mFields[idx] );
+  }
+  else if ( node->nodeType() == QgsExpression::ntLiteral )
+  {
+    QVariant value = static_cast<const QgsExpression::NodeLiteral*>( node )->value();
+    if ( value.isNull() )
+    {
+      result = "NULL";
+      return NullOperand;
+    }
+    switch ( value.type() )
+    {
+      case QVariant::Int:
+      case QVariant::LongLong:
+        result = value.toString();
+        return NumericOperand;
+      case QVariant::Double:
+      {
+        //all significant digits, qgsDoubleToString rounds small values and adds digits to others
+        double v = value.toDouble();
+        if ( qIsNaN( v ) || qIsInf( v ) )
+        {
+          return InvalidOperand;
+        }
+        result = QString::number( v, 'g', 17 );
+        return NumericOperand;
+      }
+      case QVariant::String:
+      {
+        //the expression compares numeric strings as numbers
+        bool numeric;
+        value.toString().toDouble( &numeric );
+        if ( numeric )
+        {
+          return InvalidOperand;
+        }
+        result = quotedValue( value );
+        return StringOperand;
+      }
+      default:
+        return InvalidOperand;
+    }
+  }
+  else if ( node->nodeType() == QgsExpression::ntUnaryOperator )
+  {
+    const QgsExpression::NodeUnaryOperator* n = static_cast<const QgsExpression::NodeUnaryOperator*>( node );
+    if ( n->op() == QgsExpression::uoMinus && n->operand()->nodeType() == QgsExpression::ntLiteral &&
+         compileOperand( n->operand(), result ) == NumericOperand )
+    {
+      result = "(-" + result + ")";
+      return NumericOperand;
+    }
+  }
+  return InvalidOperand;
+}
+
+QgsSqlExpressionCompiler::OperandType QgsSqlExpressionCompiler::fieldType( const QgsField& field )
+{
+  switch ( field.type() )
+  {
+    case QVariant::Int:
+    case QVariant::UInt:
+    case QVariant::LongLong:
+    case QVariant::ULongLong:
+    case QVariant::Double:
+      return NumericOperand;
+    case QVariant::String:
+      return StringOperand;
+    default:
+      return InvalidOperand;
+  }
+}
+
+QgsSqlExpressionCompiler::Result QgsSqlExpressionCompiler::compileLike( QgsExpression::BinaryOperator op, const QString& left, const QString& pattern, QString& result )
+{
+  if ( op != QgsExpression::boLike && op != QgsExpression::boNotLike )
+  {
+    return Fail;
+  }
+  result = QString( "%1 %2 %3" ).arg( left, op == QgsExpression::boLike ? "LIKE" : "NOT LIKE", quotedValue( pattern ) );
+  return Complete;
+}
+
+bool QgsSqlExpressionCompiler::spatialPredicateRect( const QgsExpression::Node* node, QgsRectangle& rect )
+{
+  if ( node->nodeType() != QgsExpression::ntFunction )
+  {
+    return false;
+  }
+  const QgsExpression::NodeFunction* n = static_cast<const QgsExpression::NodeFunction*>( node );
+  //predicates which can only be true if the bounding boxes intersect
+  static const QStringList predicates = QStringList() << "bbox" << "intersects" << "contains" << "within"
+                                        << "crosses" << "touches" << "overlaps" << "equals";
+  if ( !predicates.contains( QgsExpression::Functions()[n->fnIndex()]->name() ) || !n->args() || n->args()->count() != 2 )
+  {
+    return false;
+  }
+  QList<QgsExpression::Node*> args = n->args()->list();
+  if ( args[0]->nodeType() != QgsExpression::ntFunction || args[1]->nodeType() != QgsExpression::ntFunction )
+  {
+    return false;
+  }
+  const QgsExpression::NodeFunction* geometryArg = static_cast<const QgsExpression::NodeFunction*>( args[0] );
+  const QgsExpression::NodeFunction* literalArg = static_cast<const QgsExpression::NodeFunction*>( args[1] );
+  if ( QgsExpression::Functions()[geometryArg->fnIndex()]->name() != "$geometry" ||
+       !literalArg->args() || literalArg->args()->count() != 1 || literalArg->args()->list()[0]->nodeType() != QgsExpression::ntLiteral )
+  {
+    return false;
+  }
+
+  QString literal = static_cast<const QgsExpression::NodeLiteral*>( literalArg->args()->list()[0] )->value().toString();
+  QString literalFunction = QgsExpression::Functions()[literalArg->fnIndex()]->name();
+  QScopedPointer<QgsGeometry> geometry;
+  if ( literalFunction == "geomFromGML" )
+  {
+    geometry.reset( QgsOgcUtils::geometryFromGML( literal ) );
+  }
+  else if ( literalFunction == "geomFromWKT" )
+  {
+    geometry.reset( QgsGeometry::fromWkt( literal ) );
+  }
+  if ( !geometry || geometry->isEmpty() )
+  {
+    return false;
+  }
+  rect = geometry->boundingBox();
+  return true;
+}
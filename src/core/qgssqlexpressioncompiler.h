@@ -0,0 +1,106 @@
+/***************************************************************************
+    qgssqlexpressioncompiler.h
+    ---------------------
+    begin                : October 2016
+    copyright            : (C) 2016 by Sandro Mani
+    email                : manisandro@gmail.com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QGSSQLEXPRESSIONCOMPILER_H
+#define QGSSQLEXPRESSIONCOMPILER_H
+
+#include "qgsexpression.h"
+#include "qgsfield.h"
+#include "qgsrectangle.h"
+
+/** \ingroup core
+ * Translates a QgsExpression into a SQL WHERE clause, so that feature iterators of
+ * database providers can let the database filter the features.
+ *
+ * Only a subset of the expressions is supported: comparisons of columns with literals,
+ * LIKE, IN, IS NULL and the boolean operators. Spatial predicates of the geometry with
+ * a literal geometry (as created for OGC filters) are turned into a filter rectangle,
+ * which the provider applies with its spatial index.
+ *
+ * Providers subclass the compiler to quote identifiers and values in their SQL dialect.
+ * @note added in 2.16
+ * @note not available in Python bindings
+ */
+class CORE_EXPORT QgsSqlExpressionCompiler
+{
+  public:
+    enum Result
+    {
+      None,     //!< No expression
+      Complete, //!< The SQL clause returns exactly the features matching the expression
+      Partial,  //!< The SQL clause returns a superset of the matching features, the expression has to be evaluated on them
+      Fail      //!< The expression could not be compiled, it has to be evaluated on all features
+    };
+
+    /** Constructor
+     * @param fields the fields of the provider, columns not in the fields are not compiled
+     */
+    explicit QgsSqlExpressionCompiler( const QgsFields& fields );
+    virtual ~QgsSqlExpressionCompiler();
+
+    /** Compiles an expression, the clause and the filter rectangle are available afterwards */
+    Result compile( const QgsExpression* exp );
+
+    /** The SQL WHERE clause of the compiled expression, may be empty if only a filter rectangle was compiled */
+    QString result() const { return mResult; }
+
+    /** The rectangle all matching features intersect, a null rectangle if unrestricted */
+    QgsRectangle filterRect() const { return mFilterRect; }
+
+    /** Whether feature iterators should compile filter expressions, reads the "/qgis/compileExpressions" setting */
+    static bool compileExpressions();
+
+  protected:
+    //! Kind of value an operand produces in the SQL
+    enum OperandType
+    {
+      NumericOperand,
+      StringOperand,
+      NullOperand,
+      InvalidOperand
+    };
+
+    virtual QString quotedIdentifier( const QString& identifier ) = 0;
+    virtual QString quotedValue( const QVariant& value ) = 0;
+
+    /** Returns the kind of value of a column, the default implementation decides by the type of the field */
+    virtual OperandType fieldType( const QgsField& field );
+
+    /** Compiles a LIKE type operator with a string column on the left and a literal pattern on the right.
+     * The default implementation supports LIKE and NOT LIKE, but not the case insensitive variants.
+     */
+    virtual Result compileLike( QgsExpression::BinaryOperator op, const QString& left, const QString& pattern, QString& result );
+
+    /** Compiles a node with a boolean value */
+    virtual Result compileNode( const QgsExpression::Node* node, QString& result );
+
+    /** Compiles a column or a literal */
+    OperandType compileOperand( const QgsExpression::Node* node, QString& result );
+
+    /** Checks whether a node is a spatial predicate of the geometry with a literal geometry,
+     * which implies that the bounding boxes of the geometries intersect.
+     * @param rect out: the bounding box of the literal geometry
+     */
+    static bool spatialPredicateRect( const QgsExpression::Node* node, QgsRectangle& rect );
+
+    QgsFields mFields;
+
+  private:
+    void compileConjunction( const QgsExpression::Node* node, QStringList& clauses, bool& complete );
+
+    QString mResult;
+    QgsRectangle mFilterRect;
+};
+
+#endif // QGSSQLEXPRESSIONCOMPILER_H
@@ -30,7 +30,7 @@ struct QgsVectorJoinInfo;
 class QgsVectorLayerFeatureIterator;
 
 /** Partial snapshot of vector layer's state (only the members necessary for access to features) */
-class QgsVectorLayerFeatureSource : public QgsAbstractFeatureSource
+class CORE_EXPORT QgsVectorLayerFeatureSource : public QgsAbstractFeatureSource
 {
   public:
     QgsVectorLayerFeatureSource( QgsVectorLayer* layer );
@@ -20,6 +20,7 @@
 
 #include "qgslogger.h"
 #include "qgsfeature.h"
+#include "qgskerneldensity.h"
 #include "qgsvectorlayer.h"
 #include "qgssymbollayerv2.h"
 #include "qgsogcutils.h"
@@ -31,10 +32,8 @@
 
 QgsHeatmapRenderer::QgsHeatmapRenderer( )
     : QgsFeatureRendererV2( "heatmapRenderer" )
-    , mCalculatedMaxValue( 0 )
     , mRadius( 10 )
     , mRadiusPixels( 0 )
-    , mRadiusSquared( 0 )
     , mRadiusUnit( QgsSymbolV2::MM )
     , mWeightAttrNum( -1 )
     , mGradientRamp( 0 )
@@ -54,12 +53,11 @@ QgsHeatmapRenderer::~QgsHeatmapRenderer()
 
 void QgsHeatmapRenderer::initializeValues( QgsRenderContext& context )
 {
-  mValues.resize( context.painter()->device()->width() * context.painter()->device()->height() / ( mRenderQuality * mRenderQuality ) );
-  mValues.fill( 0 );
-  mCalculatedMaxValue = 0;
+  mDensity.reset( new QgsKernelDensity( context.painter()->device()->width() / mRenderQuality,
+                                        context.painter()->device()->height() / mRenderQuality,
+                                        QgsKernelDensity::Quartic, QgsKernelDensity::Raw ) );
   mFeaturesRendered = 0;
   mRadiusPixels = qRound( mRadius * QgsSymbolLayerV2Utils::pixelSizeScaleFactor( context, mRadiusUnit, mRadiusMapUnitScale ) / mRenderQuality );
-  mRadiusSquared = mRadiusPixels * mRadiusPixels;
 }
 
 void QgsHeatmapRenderer::startRender( QgsRenderContext& context, const QgsFields& fields )
@@ -135,9 +133,6 @@ bool QgsHeatmapRenderer::renderFeature( QgsFeature& feature, QgsRenderContext& c
     }
   }
 
-  int width = context.painter()->device()->width() / mRenderQuality;
-  int height = context.painter()->device()->height() / mRenderQuality;
-
   //transform geometry if required
   QgsGeometry* geom;
   bool createdGeom = false;
@@ -161,36 +156,11 @@ bool QgsHeatmapRenderer::renderFeature( QgsFeature& feature, QgsRenderContext& c
   }
   geom = 0;
 
-  //loop through all points in multipoint
+  //the kernels are accumulated when rendering stops
   for ( QgsMultiPoint::const_iterator pointIt = multiPoint.constBegin(); pointIt != multiPoint.constEnd(); ++pointIt )
   {
     QgsPoint pixel = context.mapToPixel().transform( *pointIt );
-    int pointX = pixel.x() / mRenderQuality;
-    int pointY = pixel.y() / mRenderQuality;
-    for ( int x = qMax( pointX - mRadiusPixels, 0 ); x < qMin( pointX + mRadiusPixels, width ); ++x )
-    {
-      for ( int y = qMax( pointY - mRadiusPixels, 0 ); y < qMin( pointY + mRadiusPixels, height ); ++y )
-      {
-        int index = y * width + x;
-        if ( index >= mValues.count( ) )
-        {
-          continue;
-        }
-        double distanceSquared = pow( pointX - x, 2.0 ) + pow( pointY - y, 2.0 );
-        if ( distanceSquared > mRadiusSquared )
-        {
-          continue;
-        }
-
-        double score = weight * quarticKernel( sqrt( distanceSquared ), mRadiusPixels );
-        double value = mValues[ index ] + score;
-        if ( value > mCalculatedMaxValue )
-        {
-          mCalculatedMaxValue = value;
-        }
-        mValues[ index ] = value;
-      }
-    }
+    mDensity->addPoint( pixel.x() / mRenderQuality, pixel.y() / mRenderQuality, mRadiusPixels, weight );
   }
 
   mFeaturesRendered++;
@@ -205,36 +175,15 @@ bool QgsHeatmapRenderer::renderFeature( QgsFeature& feature, QgsRenderContext& c
 }
 
 
-double QgsHeatmapRenderer::uniformKernel( const double distance, const int bandwidth ) const
-{
-  Q_UNUSED( distance );
-  Q_UNUSED( bandwidth );
-  return 1.0;
-}
-
-double QgsHeatmapRenderer::quarticKernel( const double distance, const int bandwidth ) const
-{
-  return pow( 1. - pow( distance / ( double )bandwidth, 2 ), 2 );
-}
-
-double QgsHeatmapRenderer::triweightKernel( const double distance, const int bandwidth ) const
-{
-  return pow( 1. - pow( distance / ( double )bandwidth, 2 ), 3 );
-}
-
-double QgsHeatmapRenderer::epanechnikovKernel( const double distance, const int bandwidth ) const
-{
-  return ( 1. - pow( distance / ( double )bandwidth, 2 ) );
-}
-
-double QgsHeatmapRenderer::triangularKernel( const double distance, const int bandwidth ) const
-{
-  return ( 1. - ( distance / ( double )bandwidth ) );
-}
-
 void QgsHeatmapRenderer::stopRender( QgsRenderContext& context )
 {
-  renderImage( context );
+  // a canceled render does not need the density surface
+  if ( mDensity && !context.renderingStopped() )
+  {
+    mDensity->calculate();
+    renderImage( context );
+  }
+  mDensity.reset();
   mWeightExpression.reset();
 }
 
@@ -245,28 +194,33 @@ void QgsHeatmapRenderer::renderImage( QgsRenderContext& context )
     return;
   }
 
-  QImage image( context.painter()->device()->width() / mRenderQuality,
-                context.painter()->device()->height() / mRenderQuality,
-                QImage::Format_ARGB32 );
+  QImage image( mDensity->width(), mDensity->height(), QImage::Format_ARGB32 );
   image.fill( Qt::transparent );
 
-  double scaleMax = mExplicitMax > 0 ? mExplicitMax : mCalculatedMaxValue;
+  double scaleMax = mExplicitMax > 0 ? mExplicitMax : mDensity->maximumValue();
+
+  //look up the ramp colors in a table instead of evaluating the ramp for every pixel
+  const int nColors = 1024;
+  QVector<QRgb> colors( nColors + 1 );
+  for ( int i = 0; i <= nColors; ++i )
+  {
+    double rampValue = double( i ) / nColors;
+    colors[i] = mGradientRamp->color( mInvertRamp ? 1 - rampValue : rampValue ).rgba();
+  }
 
+  const float* values = mDensity->values().constData();
   int idx = 0;
   double pixVal = 0;
-  QColor pixColor;
   for ( int heightIndex = 0; heightIndex < image.height(); ++heightIndex )
   {
     QRgb* scanLine = ( QRgb* )image.scanLine( heightIndex );
     for ( int widthIndex = 0; widthIndex < image.width(); ++widthIndex )
     {
       //scale result to fit in the range [0, 1]
-      pixVal = mValues.at( idx ) > 0 ? qMin(( mValues.at( idx ) / scaleMax ), 1.0 ) : 0;
+      pixVal = values[idx] > 0 && scaleMax > 0 ? qMin(( values[idx] / scaleMax ), 1.0 ) : 0;
 
       //convert value to color from ramp
-      pixColor = mGradientRamp->color( mInvertRamp ? 1 - pixVal : pixVal );
-
-      scanLine[widthIndex] = pixColor.rgba();
+      scanLine[widthIndex] = colors[qRound( pixVal * nColors )];
       idx++;
     }
   }
@@ -23,6 +23,7 @@
 #include "qgsgeometry.h"
 #include <QScopedPointer>
 
+class QgsKernelDensity;
 class QgsVectorColorRampV2;
 
 /** \ingroup core
@@ -169,13 +170,11 @@ class CORE_EXPORT QgsHeatmapRenderer : public QgsFeatureRendererV2
     /** Private assignment operator. @see clone() */
     QgsHeatmapRenderer& operator=( const QgsHeatmapRenderer& );
 
-    QVector<double> mValues;
-
-    double mCalculatedMaxValue;
+    /** Collects the points during rendering and calculates the density surface in stopRender */
+    QScopedPointer<QgsKernelDensity> mDensity;
 
     double mRadius;
     int mRadiusPixels;
-    double mRadiusSquared;
     QgsSymbolV2::OutputUnit mRadiusUnit;
     QgsMapUnitScale mRadiusMapUnitScale;
 
@@ -191,12 +190,6 @@ class CORE_EXPORT QgsHeatmapRenderer : public QgsFeatureRendererV2
 
     int mFeaturesRendered;
 
-    double uniformKernel( const double distance, const int bandwidth ) const;
-    double quarticKernel( const double distance, const int bandwidth ) const;
-    double triweightKernel( const double distance, const int bandwidth ) const;
-    double epanechnikovKernel( const double distance, const int bandwidth ) const;
-    double triangularKernel( const double distance, const int bandwidth ) const;
-
     QgsMultiPoint convertToMultipoint( QgsGeometry *geom );
     void initializeValues( QgsRenderContext& context );
     void renderImage( QgsRenderContext &context );
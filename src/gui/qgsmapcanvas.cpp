@@ -196,6 +196,7 @@ QgsMapCanvas::QgsMapCanvas( QWidget * parent, const char *name )
     , mUseParallelRendering( false )
     , mDrawRenderingStats( false )
     , mCache( 0 )
+    , mTiledCaching( false )
     , mPreviewEffect( 0 )
     , mSnappingUtils( 0 )
 {
@@ -584,6 +585,7 @@ void QgsMapCanvas::setCachingEnabled( bool enabled )
   if ( enabled )
   {
     mCache = new QgsMapRendererCache;
+    mCache->setTiled( mTiledCaching );
   }
   else
   {
@@ -597,6 +599,22 @@ bool QgsMapCanvas::isCachingEnabled() const
   return mCache != 0;
 }
 
+void QgsMapCanvas::setTiledCachingEnabled( bool enabled )
+{
+  if ( enabled == mTiledCaching )
+    return;
+
+  if ( mJob && mJob->isActive() )
+  {
+    // wait for the current rendering to finish, before touching the cache
+    mJob->waitForFinished();
+  }
+
+  mTiledCaching = enabled;
+  if ( mCache )
+    mCache->setTiled( enabled );
+}
+
 void QgsMapCanvas::clearCache()
 {
   if ( mCache )
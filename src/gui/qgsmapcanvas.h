@@ -148,6 +148,14 @@ class GUI_EXPORT QgsMapCanvas : public QGraphicsView
     //! @note added in 2.4
     bool isCachingEnabled() const;
 
+    //! Set whether images of rendered layers are cached in tiles, so that panning only renders the newly exposed parts
+    //! @note added in 2.16
+    void setTiledCachingEnabled( bool enabled );
+
+    //! Check whether images of rendered layers are cached in tiles
+    //! @note added in 2.16
+    bool isTiledCachingEnabled() const { return mTiledCaching; }
+
     //! Make sure to remove any rendered images from cache (does nothing if cache is not enabled)
     //! @note added in 2.4
     void clearCache();
@@ -699,6 +707,9 @@ class GUI_EXPORT QgsMapCanvas : public QGraphicsView
     //! Optionally use cache with rendered map layers for the current map settings
     QgsMapRendererCache* mCache;
 
+    //! Whether the cache keeps the rendered map layers in tiles
+    bool mTiledCaching;
+
     QTimer *mResizeTimer;
     QTimer *mRefreshTimer;
 
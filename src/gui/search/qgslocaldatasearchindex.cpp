@@ -0,0 +1,184 @@
+/***************************************************************************
+ *  qgslocaldatasearchindex.cpp                                            *
+ *  -------------------                                                    *
+ *  begin                : Dec 10, 2015                                    *
+ *  copyright            : (C) 2015 by Sandro Mani / Sourcepole AG         *
+ *  email                : smani@sourcepole.ch                             *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgslocaldatasearchindex.h"
+#include "qgsgeometry.h"
+#include <QStringList>
+#include <algorithm>
+
+static bool shorterList( const QVector<int>* a, const QVector<int>* b )
+{
+  return a->size() < b->size();
+}
+
+void QgsLocalDataSearchIndex::addFeature( const QgsFeature& feature )
+{
+  Document document;
+  document.fid = feature.id();
+  document.removed = false;
+  if ( feature.constGeometry() )
+  {
+    document.bbox = feature.constGeometry()->boundingBox();
+  }
+  QStringList values;
+  foreach ( const QVariant& attribute, feature.attributes() )
+  {
+    if ( !attribute.isNull() )
+    {
+      values.append( attribute.toString().toLower() );
+    }
+  }
+  document.text = values.join( "\n" ).toUtf8();
+
+  QWriteLocker locker( &mLock );
+  QHash<QgsFeatureId, int>::const_iterator it = mDocumentIds.constFind( document.fid );
+  if ( it != mDocumentIds.constEnd() )
+  {
+    //the old entry stays in the trigram lists, matches are verified against the text anyway
+    mDocuments[it.value()].removed = true;
+    mDocuments[it.value()].text.clear();
+  }
+  appendDocument( document );
+}
+
+void QgsLocalDataSearchIndex::appendDocument( const Document& document )
+{
+  int documentIdx = mDocuments.size();
+  mDocuments.append( document );
+  mDocumentIds.insert( document.fid, documentIdx );
+  //documents are only appended, so the lists stay sorted
+  foreach ( quint32 trigram, trigrams( document.text ) )
+  {
+    mTrigrams[trigram].append( documentIdx );
+  }
+}
+
+void QgsLocalDataSearchIndex::removeFeature( QgsFeatureId fid )
+{
+  QWriteLocker locker( &mLock );
+  QHash<QgsFeatureId, int>::iterator it = mDocumentIds.find( fid );
+  if ( it != mDocumentIds.end() )
+  {
+    mDocuments[it.value()].removed = true;
+    mDocuments[it.value()].text.clear();
+    mDocumentIds.erase( it );
+  }
+}
+
+bool QgsLocalDataSearchIndex::needsCompaction() const
+{
+  QReadLocker locker( &mLock );
+  return mDocuments.size() > 1000 && mDocumentIds.size() < mDocuments.size() / 2;
+}
+
+QgsLocalDataSearchIndex* QgsLocalDataSearchIndex::compacted() const
+{
+  QgsLocalDataSearchIndex* index = new QgsLocalDataSearchIndex();
+  QReadLocker locker( &mLock );
+  index->mDocuments.reserve( mDocumentIds.size() );
+  foreach ( const Document& document, mDocuments )
+  {
+    if ( !document.removed )
+    {
+      index->appendDocument( document );
+    }
+  }
+  return index;
+}
+
+QList<QgsFeatureId> QgsLocalDataSearchIndex::search( const QString& text, const QgsRectangle& filterRect, int& position, int limit ) const
+{
+  QList<QgsFeatureId> result;
+  QByteArray searchText = text.toLower().toUtf8();
+  QReadLocker locker( &mLock );
+
+  QVector<quint32> searchTrigrams = trigrams( searchText );
+  if ( searchTrigrams.isEmpty() )
+  {
+    //too short for the trigrams, scan the documents
+    for ( ; position < mDocuments.size() && result.size() < limit; ++position )
+    {
+      if ( matches( position, searchText, filterRect ) )
+      {
+        result.append( mDocuments[position].fid );
+      }
+    }
+    return result;
+  }
+
+  //candidates are in all lists of the trigrams of the text, start with the shortest list
+  QList< const QVector<int>* > lists;
+  foreach ( quint32 trigram, searchTrigrams )
+  {
+    QHash<quint32, QVector<int> >::const_iterator it = mTrigrams.constFind( trigram );
+    if ( it == mTrigrams.constEnd() )
+    {
+      position = mDocuments.size();
+      return result;
+    }
+    lists.append( &it.value() );
+  }
+  std::sort( lists.begin(), lists.end(), shorterList );
+
+  const QVector<int>& shortest = *lists.first();
+  const int* candidate = std::lower_bound( shortest.constBegin(), shortest.constEnd(), position );
+  for ( ; candidate != shortest.constEnd() && result.size() < limit; ++candidate )
+  {
+    position = *candidate + 1;
+    bool inAll = true;
+    for ( int i = 1; i < lists.size() && inAll; ++i )
+    {
+      inAll = std::binary_search( lists[i]->constBegin(), lists[i]->constEnd(), *candidate );
+    }
+    if ( inAll && matches( *candidate, searchText, filterRect ) )
+    {
+      result.append( mDocuments[*candidate].fid );
+    }
+  }
+  if ( candidate == shortest.constEnd() )
+  {
+    position = mDocuments.size();
+  }
+  return result;
+}
+
+QVector<quint32> QgsLocalDataSearchIndex::trigrams( const QByteArray& text )
+{
+  QVector<quint32> result;
+  const unsigned char* data = reinterpret_cast<const unsigned char*>( text.constData() );
+  for ( int i = 0, n = text.size() - 2; i < n; ++i )
+  {
+    result.append(( quint32( data[i] ) << 16 ) | ( quint32( data[i + 1] ) << 8 ) | data[i + 2] );
+  }
+  std::sort( result.begin(), result.end() );
+  result.erase( std::unique( result.begin(), result.end() ), result.end() );
+  return result;
+}
+
+bool QgsLocalDataSearchIndex::matches( int document, const QByteArray& text, const QgsRectangle& filterRect ) const
+{
+  const Document& doc = mDocuments[document];
+  if ( doc.removed )
+  {
+    return false;
+  }
+  if ( !filterRect.isEmpty() && !doc.bbox.intersects( filterRect ) )
+  {
+    return false;
+  }
+  return doc.text.contains( text );
+}
@@ -0,0 +1,77 @@
+/***************************************************************************
+ *  qgslocaldatasearchindex.h                                              *
+ *  -------------------                                                    *
+ *  begin                : Dec 10, 2015                                    *
+ *  copyright            : (C) 2015 by Sandro Mani / Sourcepole AG         *
+ *  email                : smani@sourcepole.ch                             *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSLOCALDATASEARCHINDEX_H
+#define QGSLOCALDATASEARCHINDEX_H
+
+#include "qgsfeature.h"
+#include "qgsrectangle.h"
+#include <QHash>
+#include <QReadWriteLock>
+#include <QVector>
+
+/**
+ * Trigram index over the attribute values of the features of a layer, answering case insensitive
+ * substring searches. Features are added and removed from the GUI thread while searches run in
+ * the search threads, all methods are thread safe.
+ */
+class GUI_EXPORT QgsLocalDataSearchIndex
+{
+  public:
+    /** Adds the attribute values and bounding box of a feature, replacing the entry of the feature if it is already indexed */
+    void addFeature( const QgsFeature& feature );
+    /** Removes a feature from the index */
+    void removeFeature( QgsFeatureId fid );
+
+    /**
+     * Returns features containing the text in any attribute value
+     * @param text the text to search for
+     * @param filterRect if not empty, only features whose bounding box intersects the rectangle are returned
+     * @param position in: where to continue the search, 0 for the first call. out: where to continue the next call
+     * @param limit maximum number of returned features
+     * @return the features, an empty list if there are no more matches
+     */
+    QList<QgsFeatureId> search( const QString& text, const QgsRectangle& filterRect, int& position, int limit ) const;
+
+    /** Returns whether most documents are removed or replaced ones which only take up space */
+    bool needsCompaction() const;
+    /** Returns a copy of the index without the removed documents, the positions of searches are not valid in the copy */
+    QgsLocalDataSearchIndex* compacted() const;
+
+  private:
+    struct Document
+    {
+      QgsFeatureId fid;
+      /** Lower case attribute values in UTF-8, separated by newlines */
+      QByteArray text;
+      QgsRectangle bbox;
+      bool removed;
+    };
+
+    QVector<Document> mDocuments;
+    QHash<QgsFeatureId, int> mDocumentIds;
+    /** Sorted indices of the documents containing a trigram */
+    QHash<quint32, QVector<int> > mTrigrams;
+    mutable QReadWriteLock mLock;
+
+    static QVector<quint32> trigrams( const QByteArray& text );
+    /** Appends a document, without locking */
+    void appendDocument( const Document& document );
+    bool matches( int document, const QByteArray& text, const QgsRectangle& filterRect ) const;
+};
+
+#endif // QGSLOCALDATASEARCHINDEX_H
@@ -16,6 +16,7 @@
  ***************************************************************************/
 
 #include "qgslocaldatasearchprovider.h"
+#include "qgslocaldatasearchindex.h"
 #include "qgscrscache.h"
 #include "qgsmaplayerregistry.h"
 #include "qgsmaplayer.h"
@@ -25,28 +26,62 @@
 #include "qgslegendinterface.h"
 #include "qgsfeaturerequest.h"
 #include "qgsmapcanvas.h"
+#include "qgsdatasourceuri.h"
+#include "qgsvectordataprovider.h"
 #include "qgsvectorlayer.h"
+#include "qgsvectorlayerfeatureiterator.h"
 #include "geometry/qgsgeometry.h"
+#include <QFileInfo>
 #include <QThread>
 #include <QMutexLocker>
+#include <QRegExp>
+#include <QTimer>
+#include <QtConcurrentRun>
 
 
+const int QgsLocalDataSearchProvider::sMaxIncrementalUpdates = 10000;
+const long QgsLocalDataSearchProvider::sMaxIndexedFeatures = 1000000;
+
 QgsLocalDataSearchProvider::QgsLocalDataSearchProvider( QgsMapCanvas* mapCanvas )
     : QgsSearchProvider( mapCanvas )
 {
+  connect( QgsMapLayerRegistry::instance(), SIGNAL( layersAdded( QList<QgsMapLayer*> ) ), this, SLOT( layersAdded( QList<QgsMapLayer*> ) ) );
+  connect( QgsMapLayerRegistry::instance(), SIGNAL( layersWillBeRemoved( QStringList ) ), this, SLOT( layersWillBeRemoved( QStringList ) ) );
+  layersAdded( QgsMapLayerRegistry::instance()->mapLayers().values() );
+}
+
+QgsLocalDataSearchProvider::~QgsLocalDataSearchProvider()
+{
+  foreach ( const LayerIndex& layerIndex, mLayerIndices )
+  {
+    if ( layerIndex.watcher )
+    {
+      layerIndex.watcher->waitForFinished();
+      delete layerIndex.watcher->result();
+    }
+  }
 }
 
 void QgsLocalDataSearchProvider::startSearch( const QString& searchtext, const SearchRegion& searchRegion )
 {
   QList<QgsMapLayer*> visibleLayers;
+  QgsLocalDataSearchIndexMap indices;
   foreach ( QgsMapLayer* layer, QgsMapLayerRegistry::instance()->mapLayers() )
   {
     if ( layer->type() == QgsMapLayer::VectorLayer && mMapCanvas->layers().contains( layer ) )
+    {
       visibleLayers.append( layer );
+      // Layers whose index is not built yet are searched with an expression
+      QSharedPointer<QgsLocalDataSearchIndex> index = mLayerIndices.value( layer->id() ).index;
+      if ( index )
+      {
+        indices.insert( static_cast<QgsVectorLayer*>( layer ), index );
+      }
+    }
   }
 
   QThread* crawlerThread = new QThread( this );
-  mCrawler = new QgsLocalDataSearchCrawler( searchtext, searchRegion, visibleLayers );
+  mCrawler = new QgsLocalDataSearchCrawler( searchtext, searchRegion, visibleLayers, indices );
   mCrawler->moveToThread( crawlerThread );
   connect( crawlerThread, SIGNAL( started() ), mCrawler, SLOT( run() ) );
   connect( crawlerThread, SIGNAL( finished() ), crawlerThread, SLOT( deleteLater() ) );
@@ -63,6 +98,188 @@ void QgsLocalDataSearchProvider::cancelSearch()
     mCrawler->abort();
 }
 
+void QgsLocalDataSearchProvider::layersAdded( const QList<QgsMapLayer*>& layers )
+{
+  foreach ( QgsMapLayer* layer, layers )
+  {
+    QgsVectorLayer* vlayer = qobject_cast<QgsVectorLayer*>( layer );
+    if ( !vlayer || !vlayer->dataProvider() )
+    {
+      continue;
+    }
+    connect( vlayer, SIGNAL( featureAdded( QgsFeatureId ) ), this, SLOT( featureAdded( QgsFeatureId ) ) );
+    connect( vlayer, SIGNAL( featureDeleted( QgsFeatureId ) ), this, SLOT( featureDeleted( QgsFeatureId ) ) );
+    connect( vlayer, SIGNAL( attributeValueChanged( QgsFeatureId, int, QVariant ) ), this, SLOT( attributeValueChanged( QgsFeatureId, int, QVariant ) ) );
+    connect( vlayer, SIGNAL( geometryChanged( QgsFeatureId, QgsGeometry ) ), this, SLOT( geometryChanged( QgsFeatureId, QgsGeometry ) ) );
+    // Committing or rolling back changes feature ids, changed fields or a reloaded provider change all documents
+    connect( vlayer, SIGNAL( editingStopped() ), this, SLOT( rebuildIndex() ) );
+    connect( vlayer, SIGNAL( updatedFields() ), this, SLOT( rebuildIndex() ) );
+    connect( vlayer, SIGNAL( dataChanged() ), this, SLOT( rebuildIndex() ) );
+    if ( isIndexable( vlayer ) )
+    {
+      buildIndex( vlayer );
+    }
+  }
+}
+
+bool QgsLocalDataSearchProvider::isIndexable( QgsVectorLayer* layer )
+{
+  // Building the index reads all features, remote and large layers are searched with an expression instead
+  long featureCount = layer->dataProvider()->featureCount();
+  if ( featureCount < 0 || featureCount > sMaxIndexedFeatures )
+  {
+    return false;
+  }
+  QString providerKey = layer->dataProvider()->name();
+  if ( providerKey == "memory" )
+  {
+    return true;
+  }
+  else if ( providerKey == "ogr" )
+  {
+    return QFileInfo( layer->dataProvider()->dataSourceUri().split( "|" ).first() ).isFile();
+  }
+  else if ( providerKey == "spatialite" )
+  {
+    return QFileInfo( QgsDataSourceURI( layer->dataProvider()->dataSourceUri() ).database() ).isFile();
+  }
+  return false;
+}
+
+void QgsLocalDataSearchProvider::layersWillBeRemoved( const QStringList& layerIds )
+{
+  // Running builds are discarded when they finish
+  foreach ( const QString& layerId, layerIds )
+  {
+    mLayerIndices.remove( layerId );
+  }
+}
+
+void QgsLocalDataSearchProvider::buildIndex( QgsVectorLayer* layer )
+{
+  LayerIndex& layerIndex = mLayerIndices[layer->id()];
+  if ( layerIndex.watcher )
+  {
+    layerIndex.rebuildPending = true;
+    return;
+  }
+  // The changes up to now are part of the new index
+  layerIndex.changedFeatures.clear();
+  layerIndex.rebuildPending = false;
+  layerIndex.watcher = new IndexWatcher( this );
+  layerIndex.watcher->setProperty( "layerId", layer->id() );
+  connect( layerIndex.watcher, SIGNAL( finished() ), this, SLOT( indexBuilt() ) );
+  // The source of the layer includes joined and virtual fields as well as the edit buffer
+  layerIndex.watcher->setFuture( QtConcurrent::run( indexFeatures, static_cast<QgsAbstractFeatureSource*>( new QgsVectorLayerFeatureSource( layer ) ) ) );
+}
+
+QgsLocalDataSearchIndex* QgsLocalDataSearchProvider::indexFeatures( QgsAbstractFeatureSource* source )
+{
+  QgsLocalDataSearchIndex* index = new QgsLocalDataSearchIndex();
+  QgsFeatureIterator it = source->getFeatures( QgsFeatureRequest() );
+  QgsFeature feature;
+  while ( it.nextFeature( feature ) )
+  {
+    index->addFeature( feature );
+  }
+  it.close();
+  delete source;
+  return index;
+}
+
+void QgsLocalDataSearchProvider::indexBuilt()
+{
+  IndexWatcher* watcher = static_cast<IndexWatcher*>( sender() );
+  QString layerId = watcher->property( "layerId" ).toString();
+  QgsVectorLayer* layer = qobject_cast<QgsVectorLayer*>( QgsMapLayerRegistry::instance()->mapLayer( layerId ) );
+  QMap<QString, LayerIndex>::iterator it = mLayerIndices.find( layerId );
+  if ( !layer || it == mLayerIndices.end() || it->watcher != watcher )
+  {
+    delete watcher->result();
+    watcher->deleteLater();
+    return;
+  }
+  // Searches still running keep the previous index
+  it->index = QSharedPointer<QgsLocalDataSearchIndex>( watcher->result() );
+  it->watcher = 0;
+  watcher->deleteLater();
+
+  // Apply the changes of the layer during the build
+  if ( it->rebuildPending )
+  {
+    buildIndex( layer );
+  }
+  else if ( !it->changedFeatures.isEmpty() )
+  {
+    QTimer::singleShot( 0, this, SLOT( updateChangedFeatures() ) );
+  }
+}
+
+void QgsLocalDataSearchProvider::rebuildIndex()
+{
+  QgsVectorLayer* layer = qobject_cast<QgsVectorLayer*>( sender() );
+  if ( layer && mLayerIndices.contains( layer->id() ) )
+  {
+    buildIndex( layer );
+  }
+}
+
+void QgsLocalDataSearchProvider::featureChanged( QgsFeatureId fid )
+{
+  QgsVectorLayer* layer = qobject_cast<QgsVectorLayer*>( sender() );
+  if ( !layer || !mLayerIndices.contains( layer->id() ) )
+  {
+    return;
+  }
+  LayerIndex& layerIndex = mLayerIndices[layer->id()];
+  if ( layerIndex.changedFeatures.isEmpty() )
+  {
+    // Collect the changes of bulk edits and update them at once
+    QTimer::singleShot( 0, this, SLOT( updateChangedFeatures() ) );
+  }
+  layerIndex.changedFeatures.insert( fid );
+}
+
+void QgsLocalDataSearchProvider::updateChangedFeatures()
+{
+  for ( QMap<QString, LayerIndex>::iterator it = mLayerIndices.begin(); it != mLayerIndices.end(); ++it )
+  {
+    QgsVectorLayer* layer = qobject_cast<QgsVectorLayer*>( QgsMapLayerRegistry::instance()->mapLayer( it.key() ) );
+    if ( !layer || !it->index || it->watcher )
+    {
+      continue;
+    }
+    if ( it->changedFeatures.size() > sMaxIncrementalUpdates )
+    {
+      buildIndex( layer );
+      continue;
+    }
+    if ( it->changedFeatures.isEmpty() )
+    {
+      continue;
+    }
+
+    QgsFeatureIds remaining = it->changedFeatures;
+    QgsFeatureIterator fit = layer->getFeatures( QgsFeatureRequest().setFilterFids( it->changedFeatures ) );
+    QgsFeature feature;
+    while ( fit.nextFeature( feature ) )
+    {
+      it->index->addFeature( feature );
+      remaining.remove( feature.id() );
+    }
+    // Features which were not found have been deleted
+    foreach ( QgsFeatureId fid, remaining )
+    {
+      it->index->removeFeature( fid );
+    }
+    it->changedFeatures.clear();
+    if ( it->index->needsCompaction() )
+    {
+      // Searches still running keep the previous index
+      it->index = QSharedPointer<QgsLocalDataSearchIndex>( it->index->compacted() );
+    }
+  }
+}
 
 const int QgsLocalDataSearchCrawler::sResultCountLimit = 50;
 
@@ -72,27 +289,18 @@ void QgsLocalDataSearchCrawler::run()
 
   QString escapedSearchText = mSearchText;
   escapedSearchText.replace( "'", "\\'" );
+  // The index matches the text literally, texts with regular expression syntax are searched with the expression
+  bool literalText = QRegExp::escape( mSearchText ) == mSearchText;
   foreach ( QgsMapLayer* layer, mLayers )
   {
-    QMutexLocker locker( &mAbortMutex );
-    if ( mAborted )
+    if ( aborted() )
     {
       break;
     }
-    locker.unlock();
 
     QgsVectorLayer* vlayer = static_cast<QgsVectorLayer*>( layer );
 
-    const QgsFields& fields = vlayer->pendingFields();
-    QStringList conditions;
-    for ( int idx = 0, nFields = fields.count(); idx < nFields; ++idx )
-    {
-      conditions.append( QString( "regexp_matchi( \"%1\" ,'%2')" ).arg( fields[idx].name(), escapedSearchText ) );
-    }
-    QString exprText = conditions.join( " OR " );
-
-    QgsFeatureRequest req;
-    QgsFeature feature;
+    QScopedPointer<QgsGeometry> filterGeom;
     if ( !mSearchRegion.polygon.isEmpty() )
     {
       QgsLineStringV2* exterior = new QgsLineStringV2();
@@ -103,21 +311,44 @@ void QgsLocalDataSearchCrawler::run()
       }
       QgsPolygonV2* poly = new QgsPolygonV2();
       poly->setExteriorRing( exterior );
-      QgsGeometry filterGeom( poly );
+      filterGeom.reset( new QgsGeometry( poly ) );
+    }
 
-      req.setFilterRect( filterGeom.boundingBox() );
+    QSharedPointer<QgsLocalDataSearchIndex> index = mIndices.value( vlayer );
+    if ( index && literalText )
+    {
+      resultCount = searchIndex( vlayer, index.data(), filterGeom.data(), resultCount );
+      if ( resultCount >= sResultCountLimit )
+      {
+        QgsDebugMsg( "Stopping search due to result count limit hit" );
+        break;
+      }
+      continue;
+    }
+
+    const QgsFields& fields = vlayer->pendingFields();
+    QStringList conditions;
+    for ( int idx = 0, nFields = fields.count(); idx < nFields; ++idx )
+    {
+      conditions.append( QString( "regexp_matchi( \"%1\" ,'%2')" ).arg( fields[idx].name(), escapedSearchText ) );
+    }
+    QString exprText = conditions.join( " OR " );
+
+    QgsFeatureRequest req;
+    QgsFeature feature;
+    if ( filterGeom )
+    {
+      req.setFilterRect( filterGeom->boundingBox() );
       QgsExpression expr( exprText );
       expr.prepare( vlayer->pendingFields() );
       QgsFeatureIterator it = vlayer->getFeatures( req );
       while ( it.nextFeature( feature ) && resultCount < sResultCountLimit )
       {
-        locker.relock();
-        if ( mAborted )
+        if ( aborted() )
         {
           break;
         }
-        locker.unlock();
-        if ( expr.evaluate( feature ).toBool() && filterGeom.contains( feature.geometry() ) )
+        if ( expr.evaluate( feature ).toBool() && filterGeom->contains( feature.geometry() ) )
         {
           buildResult( feature, vlayer );
           ++resultCount;
@@ -130,12 +361,10 @@ void QgsLocalDataSearchCrawler::run()
       QgsFeatureIterator it = vlayer->getFeatures( req );
       while ( it.nextFeature( feature ) && resultCount < sResultCountLimit )
       {
-        locker.relock();
-        if ( mAborted )
+        if ( aborted() )
         {
           break;
         }
-        locker.unlock();
         buildResult( feature, vlayer );
         ++resultCount;
       }
@@ -149,6 +378,33 @@ void QgsLocalDataSearchCrawler::run()
   emit searchFinished();
 }
 
+int QgsLocalDataSearchCrawler::searchIndex( QgsVectorLayer* layer, const QgsLocalDataSearchIndex* index, const QgsGeometry* filterGeom, int resultCount )
+{
+  QgsRectangle filterRect = filterGeom ? filterGeom->boundingBox() : QgsRectangle();
+  int position = 0;
+  while ( resultCount < sResultCountLimit && !aborted() )
+  {
+    // Only the candidates are fetched from the layer, to build the results and test them against the search region
+    QList<QgsFeatureId> fids = index->search( mSearchText, filterRect, position, sResultCountLimit - resultCount );
+    if ( fids.isEmpty() )
+    {
+      break;
+    }
+    QgsFeatureIterator it = layer->getFeatures( QgsFeatureRequest().setFilterFids( fids.toSet() ) );
+    QgsFeature feature;
+    while ( it.nextFeature( feature ) && resultCount < sResultCountLimit )
+    {
+      if ( !feature.geometry() || ( filterGeom && !filterGeom->contains( feature.geometry() ) ) )
+      {
+        continue;
+      }
+      buildResult( feature, layer );
+      ++resultCount;
+    }
+  }
+  return resultCount;
+}
+
 void QgsLocalDataSearchCrawler::buildResult( const QgsFeature &feature, QgsVectorLayer* layer )
 {
   // Get the string which matched the search term
@@ -185,6 +441,12 @@ void QgsLocalDataSearchCrawler::buildResult( const QgsFeature &feature, QgsVecto
   emit searchResultFound( result );
 }
 
+bool QgsLocalDataSearchCrawler::aborted()
+{
+  QMutexLocker locker( &mAbortMutex );
+  return mAborted;
+}
+
 void QgsLocalDataSearchCrawler::abort()
 {
   mAbortMutex.lock();
@@ -20,24 +20,70 @@
 #define QGSLOCALDATASEARCHPROVIDER_HPP
 
 #include "qgssearchprovider.h"
+#include "qgsfeature.h"
+#include <QFutureWatcher>
 #include <QMutex>
 #include <QPointer>
+#include <QSet>
+#include <QSharedPointer>
 
-class QgsFeature;
+class QgsAbstractFeatureSource;
 class QgsMapLayer;
 class QgsVectorLayer;
 class QgsLocalDataSearchCrawler;
+class QgsLocalDataSearchIndex;
+
+typedef QMap< QgsVectorLayer*, QSharedPointer<QgsLocalDataSearchIndex> > QgsLocalDataSearchIndexMap;
 
 class GUI_EXPORT QgsLocalDataSearchProvider : public QgsSearchProvider
 {
     Q_OBJECT
   public:
     QgsLocalDataSearchProvider( QgsMapCanvas *mapCanvas );
+    ~QgsLocalDataSearchProvider();
     void startSearch( const QString& searchtext, const SearchRegion& searchRegion ) override;
     void cancelSearch() override;
 
   private:
+    typedef QFutureWatcher< QgsLocalDataSearchIndex* > IndexWatcher;
+
+    struct LayerIndex
+    {
+      LayerIndex() : watcher( 0 ), rebuildPending( false ) {}
+      /** The index, null until it is built the first time */
+      QSharedPointer<QgsLocalDataSearchIndex> index;
+      /** The running build, if any */
+      IndexWatcher* watcher;
+      /** Features changed since the last update of the index */
+      QSet<QgsFeatureId> changedFeatures;
+      /** Whether the layer changed during the running build */
+      bool rebuildPending;
+    };
+
     QPointer<QgsLocalDataSearchCrawler> mCrawler;
+    QMap<QString, LayerIndex> mLayerIndices;
+
+    /** Above this number of changed features, the index is rebuilt instead of updated */
+    static const int sMaxIncrementalUpdates;
+    /** Layers with more features are not indexed */
+    static const long sMaxIndexedFeatures;
+
+    /** Whether the layer is local and small enough to build an index of all its features */
+    static bool isIndexable( QgsVectorLayer* layer );
+    void buildIndex( QgsVectorLayer* layer );
+    void featureChanged( QgsFeatureId fid );
+    static QgsLocalDataSearchIndex* indexFeatures( QgsAbstractFeatureSource* source );
+
+  private slots:
+    void layersAdded( const QList<QgsMapLayer*>& layers );
+    void layersWillBeRemoved( const QStringList& layerIds );
+    void indexBuilt();
+    void rebuildIndex();
+    void updateChangedFeatures();
+    void featureAdded( QgsFeatureId fid ) { featureChanged( fid ); }
+    void featureDeleted( QgsFeatureId fid ) { featureChanged( fid ); }
+    void attributeValueChanged( QgsFeatureId fid, int /*idx*/, const QVariant& /*value*/ ) { featureChanged( fid ); }
+    void geometryChanged( QgsFeatureId fid, const QgsGeometry& /*geom*/ ) { featureChanged( fid ); }
 };
 
 
@@ -47,8 +93,8 @@ class GUI_EXPORT QgsLocalDataSearchCrawler : public QObject
   public:
     QgsLocalDataSearchCrawler( const QString& searchText,
                                   const QgsSearchProvider::SearchRegion& searchRegion,
-                                  QList<QgsMapLayer*> layers, QObject* parent = 0 )
-        : QObject( parent ), mSearchText( searchText ), mSearchRegion( searchRegion ), mLayers( layers ), mAborted( false ) {}
+                                  QList<QgsMapLayer*> layers, const QgsLocalDataSearchIndexMap& indices = QgsLocalDataSearchIndexMap(), QObject* parent = 0 )
+        : QObject( parent ), mSearchText( searchText ), mSearchRegion( searchRegion ), mLayers( layers ), mIndices( indices ), mAborted( false ) {}
 
     void abort();
 
@@ -65,10 +111,14 @@ class GUI_EXPORT QgsLocalDataSearchCrawler : public QObject
     QString mSearchText;
     QgsSearchProvider::SearchRegion mSearchRegion;
     QList<QgsMapLayer*> mLayers;
+    QgsLocalDataSearchIndexMap mIndices;
     QMutex mAbortMutex;
     bool mAborted;
 
+    bool aborted();
     void buildResult( const QgsFeature& feature, QgsVectorLayer *layer );
+    /** Searches the layer with its text index, returns the new result count */
+    int searchIndex( QgsVectorLayer* layer, const QgsLocalDataSearchIndex* index, const QgsGeometry* filterGeom, int resultCount );
 };
 
 #endif // QGSLOCALDATASEARCHPROVIDER_HPP
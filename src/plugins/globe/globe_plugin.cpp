@@ -181,6 +181,25 @@ class QueryCoordinatesHandler : public osgGA::GUIEventHandler
     GlobePlugin* mGlobe;
 };
 
+// An event handler that keeps the render order of the tiles up to date while the camera moves
+class ViewCenterHandler : public osgGA::GUIEventHandler
+{
+  public:
+    ViewCenterHandler( GlobePlugin* globe ) :  mGlobe( globe ) { }
+
+    bool handle( const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdapter& /*aa*/ )
+    {
+      if ( ea.getEventType() == osgGA::GUIEventAdapter::FRAME )
+      {
+        mGlobe->updateTileViewCenter();
+      }
+      return false;
+    }
+
+  private:
+    GlobePlugin* mGlobe;
+};
+
 class KeyboardControlHandler : public osgGA::GUIEventHandler
 {
   public:
@@ -344,6 +363,7 @@ void GlobePlugin::run()
   mOsgViewer->setSceneData( mRootNode );
 
   mOsgViewer->addEventHandler( new QueryCoordinatesHandler( this ) );
+  mOsgViewer->addEventHandler( new ViewCenterHandler( this ) );
   mOsgViewer->addEventHandler( new KeyboardControlHandler( manip ) );
   mOsgViewer->addEventHandler( new osgViewer::StatsHandler() );
   mOsgViewer->addEventHandler( new osgViewer::WindowSizeHandler() );
@@ -747,11 +767,27 @@ void GlobePlugin::refreshQGISMapLayer( const QgsRectangle& dirtyRect )
   if ( mTileSource )
   {
     mOsgViewer->getDatabasePager()->clear();
+    updateTileViewCenter();
     mTileSource->refresh( dirtyRect );
     mOsgViewer->requestRedraw();
   }
 }
 
+void GlobePlugin::updateTileViewCenter()
+{
+  // Tiles close to the focal point of the camera are rendered first
+  osgEarth::Util::EarthManipulator* manip = mOsgViewer ? dynamic_cast<osgEarth::Util::EarthManipulator*>( mOsgViewer->getCameraManipulator() ) : 0;
+  if ( mTileSource && manip )
+  {
+#if OSGEARTH_VERSION_LESS_THAN(2, 7, 0)
+    osg::Vec3d focalPoint = manip->getViewpoint().getFocalPoint();
+#else
+    osg::Vec3d focalPoint = manip->getViewpoint().focalPoint().get().vec3d();
+#endif
+    mTileSource->setViewCenter( QgsPoint( focalPoint.x(), focalPoint.y() ) );
+  }
+}
+
 void GlobePlugin::updateTileStats( int queued, int tot )
 {
   if ( mStatsLabel )
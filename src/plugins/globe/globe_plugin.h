@@ -87,6 +87,8 @@ class GLOBE_EXPORT GlobePlugin : public QObject, public QgisPlugin
 
     //! emits signal with current mouse coordinates
     void showCurrentCoordinates( const osgEarth::GeoPoint &geoPoint );
+    //! tells the tile source where the camera looks at, so that close tiles are rendered first
+    void updateTileViewCenter();
 
   public slots:
     void run();
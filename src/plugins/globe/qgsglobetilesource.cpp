@@ -17,6 +17,7 @@
 
 #include <osgEarth/Registry>
 #include <osgEarth/ImageUtils>
+#include <osg/Math>
 
 #include "qgscrscache.h"
 #include "qgsglobetilesource.h"
@@ -26,6 +27,10 @@
 #include "qgsmaprenderercustompainterjob.h"
 #include "qgsmaprendererparalleljob.h"
 
+#include <QThread>
+#include <qmath.h>
+#include <algorithm>
+
 QgsGlobeTileStatistics* QgsGlobeTileStatistics::s_instance = 0;
 
 QgsGlobeTileStatistics::QgsGlobeTileStatistics() : mTileCount( 0 ), mQueueTileCount( 0 )
@@ -131,7 +136,7 @@ void QgsGlobeTileImage::update( osg::NodeVisitor * )
 ///////////////////////////////////////////////////////////////////////////////
 
 QgsGlobeTileUpdateManager::QgsGlobeTileUpdateManager( QObject* parent )
-    : QObject( parent ), mCurrentTile( 0 ), mRenderer( 0 )
+    : QObject( parent ), mQueueSerial( 0 ), mMaxRenderJobs( qMax( 1, QThread::idealThreadCount() ) )
 {
   connect( this, SIGNAL( startRendering() ), this, SLOT( start() ) );
   connect( this, SIGNAL( cancelRendering() ), this, SLOT( cancel() ) );
@@ -142,85 +147,199 @@ QgsGlobeTileUpdateManager::~QgsGlobeTileUpdateManager()
 #ifdef GLOBE_SHOW_TILE_STATS
   QgsGlobeTileStatistics::instance()->updateQueueTileCount( 0 );
 #endif
+  mQueueMutex.lock();
   mTileQueue.clear();
-  mCurrentTile = 0;
-  if ( mRenderer )
+  mQueuedTiles.clear();
+  QList<QgsMapRendererParallelJob*> jobs = mRenderJobs.keys();
+  mRenderJobs.clear();
+  mQueueMutex.unlock();
+  // The jobs must not report back to the destroyed manager
+  foreach ( QgsMapRendererParallelJob* job, jobs )
+  {
+    disconnect( job, SIGNAL( finished() ), this, SLOT( renderingFinished() ) );
+    job->cancel();
+    job->waitForFinished();
+    delete job;
+  }
+}
+
+void QgsGlobeTileUpdateManager::updateViewCenter( const QgsPoint& center )
+{
+  mQueueMutex.lock();
+  // Called for every frame while the camera moves
+  if ( center != mViewCenter )
   {
-    mRenderer->cancel();
+    mViewCenter = center;
+    rebuildQueue();
   }
+  mQueueMutex.unlock();
 }
 
 void QgsGlobeTileUpdateManager::addTile( QgsGlobeTileImage *tile )
 {
-  if ( !mTileQueue.contains( tile ) )
+  mQueueMutex.lock();
+  if ( !mQueuedTiles.contains( tile ) )
   {
-    mTileQueue.append( tile );
+    QueuedTile queued = { tile, tile->lod(), tileDistance( tile ), ++mQueueSerial };
+    mQueuedTiles.insert( tile, queued.serial );
+    mTileQueue.append( queued );
+    std::push_heap( mTileQueue.begin(), mTileQueue.end(), queueLessThan );
 #ifdef GLOBE_SHOW_TILE_STATS
-    QgsGlobeTileStatistics::instance()->updateQueueTileCount( mTileQueue.size() );
+    QgsGlobeTileStatistics::instance()->updateQueueTileCount( mQueuedTiles.size() );
 #endif
-    qSort( mTileQueue.begin(), mTileQueue.end(), QgsGlobeTileImage::lodSort );
   }
+  mQueueMutex.unlock();
   emit startRendering();
 }
 
 void QgsGlobeTileUpdateManager::removeTile( QgsGlobeTileImage *tile )
 {
-  if ( mCurrentTile == tile )
+  bool rendering = false;
+  mQueueMutex.lock();
+  // Queue entries of removed tiles are dropped when they reach the top of the heap
+  if ( mQueuedTiles.remove( tile ) > 0 )
   {
-    mCurrentTile = 0;
-    if ( mRenderer )
-      emit cancelRendering();
-  }
-  else if ( mTileQueue.contains( tile ) )
-  {
-    mTileQueue.removeAll( tile );
+    if ( mTileQueue.size() > 2 * mQueuedTiles.size() + 64 )
+    {
+      rebuildQueue();
+    }
 #ifdef GLOBE_SHOW_TILE_STATS
-    QgsGlobeTileStatistics::instance()->updateQueueTileCount( mTileQueue.size() );
+    QgsGlobeTileStatistics::instance()->updateQueueTileCount( mQueuedTiles.size() );
 #endif
   }
+  for ( QHash<QgsMapRendererParallelJob*, QgsGlobeTileImage*>::iterator it = mRenderJobs.begin(); it != mRenderJobs.end(); ++it )
+  {
+    if ( it.value() == tile )
+    {
+      it.value() = 0;
+      rendering = true;
+    }
+  }
+  mQueueMutex.unlock();
+  if ( rendering )
+  {
+    emit cancelRendering();
+  }
 }
 
 void QgsGlobeTileUpdateManager::waitForFinished() const
 {
-  if ( mRenderer )
+  mQueueMutex.lock();
+  QList<QgsMapRendererParallelJob*> jobs = mRenderJobs.keys();
+  mQueueMutex.unlock();
+  // Finished jobs are deleted later, in the thread of the manager which is also the calling thread
+  foreach ( QgsMapRendererParallelJob* job, jobs )
   {
-    mRenderer->waitForFinished();
+    job->waitForFinished();
   }
 }
 
 void QgsGlobeTileUpdateManager::start()
 {
-  if ( mRenderer == 0 && !mTileQueue.isEmpty() )
+  QList<QgsMapRendererParallelJob*> jobs;
+  mQueueMutex.lock();
+  while ( mRenderJobs.size() < mMaxRenderJobs && !mQueuedTiles.isEmpty() )
   {
-    mCurrentTile = mTileQueue.takeFirst();
+    std::pop_heap( mTileQueue.begin(), mTileQueue.end(), queueLessThan );
+    QueuedTile queued = mTileQueue.last();
+    mTileQueue.remove( mTileQueue.size() - 1 );
+    if ( mQueuedTiles.value( queued.tile, 0 ) != queued.serial )
+    {
+      continue;
+    }
+    mQueuedTiles.remove( queued.tile );
+    QgsMapRendererParallelJob* job = new QgsMapRendererParallelJob( queued.tile->createSettings( queued.tile->dpi(), mLayerSet ) );
+    connect( job, SIGNAL( finished() ), this, SLOT( renderingFinished() ) );
+    mRenderJobs.insert( job, queued.tile );
+    jobs.append( job );
+  }
 #ifdef GLOBE_SHOW_TILE_STATS
-    QgsGlobeTileStatistics::instance()->updateQueueTileCount( mTileQueue.size() );
+  QgsGlobeTileStatistics::instance()->updateQueueTileCount( mQueuedTiles.size() );
 #endif
-    mRenderer = new QgsMapRendererParallelJob( mCurrentTile->createSettings( mCurrentTile->dpi(), mLayerSet ) );
-    connect( mRenderer, SIGNAL( finished() ), this, SLOT( renderingFinished() ) );
-    mRenderer->start();
+  mQueueMutex.unlock();
+  // Starting a job may spin an event loop (i.e. for network providers), so the queue is not locked meanwhile
+  foreach ( QgsMapRendererParallelJob* job, jobs )
+  {
+    job->start();
   }
 }
 
 void QgsGlobeTileUpdateManager::cancel()
 {
-  if ( mRenderer )
-    mRenderer->cancel();
+  QList<QgsMapRendererParallelJob*> jobs;
+  mQueueMutex.lock();
+  for ( QHash<QgsMapRendererParallelJob*, QgsGlobeTileImage*>::const_iterator it = mRenderJobs.constBegin(); it != mRenderJobs.constEnd(); ++it )
+  {
+    if ( it.value() == 0 )
+    {
+      jobs.append( it.key() );
+    }
+  }
+  mQueueMutex.unlock();
+  foreach ( QgsMapRendererParallelJob* job, jobs )
+  {
+    job->cancel();
+  }
 }
 
 void QgsGlobeTileUpdateManager::renderingFinished()
 {
-  if ( mCurrentTile )
+  QgsMapRendererParallelJob* job = qobject_cast<QgsMapRendererParallelJob*>( QObject::sender() );
+  if ( !job )
   {
-    QImage image = mRenderer->renderedImage();
-    mCurrentTile->setUpdatedImage( image );
-    mCurrentTile = 0;
+    return;
   }
-  mRenderer->deleteLater();
-  mRenderer = 0;
+  mQueueMutex.lock();
+  // The tile cannot be destroyed meanwhile, since removeTile waits for the lock
+  QgsGlobeTileImage* tile = mRenderJobs.take( job );
+  if ( tile )
+  {
+    tile->setUpdatedImage( job->renderedImage() );
+  }
+  mQueueMutex.unlock();
+  job->deleteLater();
   start();
 }
 
+bool QgsGlobeTileUpdateManager::queueLessThan( const QueuedTile& lhs, const QueuedTile& rhs )
+{
+  // The top of the heap is the finest tile closest to the view center
+  if ( lhs.lod != rhs.lod )
+  {
+    return lhs.lod < rhs.lod;
+  }
+  return lhs.distance > rhs.distance;
+}
+
+double QgsGlobeTileUpdateManager::tileDistance( QgsGlobeTileImage* tile ) const
+{
+  QgsPoint center = tile->extent().center();
+  double dx = qAbs( center.x() - mViewCenter.x() );
+  if ( dx > 180. )
+  {
+    dx = 360. - dx;
+  }
+  dx *= qCos( 0.5 * ( center.y() + mViewCenter.y() ) * osg::PI / 180. );
+  double dy = center.y() - mViewCenter.y();
+  return dx * dx + dy * dy;
+}
+
+void QgsGlobeTileUpdateManager::rebuildQueue()
+{
+  QVector<QueuedTile> queue;
+  queue.reserve( mQueuedTiles.size() );
+  foreach ( QueuedTile queued, mTileQueue )
+  {
+    if ( mQueuedTiles.value( queued.tile, 0 ) == queued.serial )
+    {
+      queued.distance = tileDistance( queued.tile );
+      queue.append( queued );
+    }
+  }
+  std::make_heap( queue.begin(), queue.end(), queueLessThan );
+  mTileQueue = queue;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 QgsGlobeTileSource::QgsGlobeTileSource( QgsMapCanvas* canvas, const osgEarth::TileSourceOptions& options )
@@ -21,10 +21,13 @@
 #include <osgEarth/TileSource>
 #include <osgEarth/Version>
 #include <osg/ImageStream>
+#include <QHash>
 #include <QImage>
 #include <QStringList>
 #include <QLabel>
 #include <QMutex>
+#include <QVector>
+#include "qgspoint.h"
 #include "qgsrectangle.h"
 
 //#define GLOBE_SHOW_TILE_STATS
@@ -65,12 +68,11 @@ class QgsGlobeTileImage : public osg::Image
     QgsMapSettings createSettings( int dpi, const QStringList &layerSet ) const;
     void setUpdatedImage( const QImage& image ) { mUpdatedImage = image; }
     int dpi() const { return mDpi; }
+    int lod() const { return mLod; }
     const QgsRectangle& extent() { return mTileExtent; }
 
     void update( osg::NodeVisitor * );
 
-    static bool lodSort( const QgsGlobeTileImage* lhs, const QgsGlobeTileImage* rhs ) { return lhs->mLod > rhs->mLod; }
-
   private:
     osg::ref_ptr<QgsGlobeTileSource> mTileSource;
     QgsRectangle mTileExtent;
@@ -88,6 +90,8 @@ class QgsGlobeTileUpdateManager : public QObject
     QgsGlobeTileUpdateManager( QObject* parent = 0 );
     ~QgsGlobeTileUpdateManager();
     void updateLayerSet( const QStringList& layerSet ) { mLayerSet = layerSet; }
+    /** Sets the WGS84 position the camera looks at, queued tiles close to it are rendered first */
+    void updateViewCenter( const QgsPoint& center );
     void addTile( QgsGlobeTileImage* tile );
     void removeTile( QgsGlobeTileImage* tile );
     void waitForFinished() const;
@@ -97,10 +101,29 @@ class QgsGlobeTileUpdateManager : public QObject
     void cancelRendering();
 
   private:
+    struct QueuedTile
+    {
+      QgsGlobeTileImage* tile;
+      int lod;
+      double distance;
+      quint64 serial;
+    };
+
     QStringList mLayerSet;
-    QList<QgsGlobeTileImage*> mTileQueue;
-    QgsGlobeTileImage* mCurrentTile;
-    QgsMapRendererParallelJob* mRenderer;
+    QgsPoint mViewCenter;
+    mutable QMutex mQueueMutex;
+    // Binary heap of the queued tiles, ordered by LOD (finest first) and distance to the view center.
+    // Entries of removed tiles are skipped lazily, mQueuedTiles holds the serial of the valid entry of each tile.
+    QVector<QueuedTile> mTileQueue;
+    QHash<QgsGlobeTileImage*, quint64> mQueuedTiles;
+    quint64 mQueueSerial;
+    // Running jobs and their tile, which is 0 if the tile was removed in the meantime
+    QHash<QgsMapRendererParallelJob*, QgsGlobeTileImage*> mRenderJobs;
+    int mMaxRenderJobs;
+
+    static bool queueLessThan( const QueuedTile& lhs, const QueuedTile& rhs );
+    double tileDistance( QgsGlobeTileImage* tile ) const;
+    void rebuildQueue();
 
   private slots:
     void start();
@@ -131,6 +154,10 @@ class QgsGlobeTileSource : public osgEarth::TileSource
     {
       mTileUpdateManager.waitForFinished();
     }
+    void setViewCenter( const QgsPoint& center )
+    {
+      mTileUpdateManager.updateViewCenter( center );
+    }
 
   private:
     friend class QgsGlobeTileImage;
@@ -44,16 +44,6 @@
 
 #define NO_DATA -9999
 
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
-#endif
-
-#if defined(GDAL_VERSION_NUM) && GDAL_VERSION_NUM >= 1800
-#define TO8F(x) (x).toUtf8().constData()
-#else
-#define TO8F(x) QFile::encodeName( x ).constData()
-#endif
-
 static const QString sName = QObject::tr( "Heatmap" );
 static const QString sDescription = QObject::tr( "Creates a Heatmap raster for the input point vector" );
 static const QString sCategory = QObject::tr( "Raster" );
@@ -142,7 +132,6 @@ void Heatmap::run()
   // Getting the rasterdataset in place
   GDALAllRegister();
 
-  GDALDataset *emptyDataset;
   GDALDriver *myDriver;
 
   myDriver = GetGDALDriverManager()->GetDriverByName( d.outputFormat().toUtf8() );
@@ -153,40 +142,19 @@ void Heatmap::run()
   }
 
   double geoTransform[6] = { myBBox.xMinimum(), cellsize, 0, myBBox.yMinimum(), 0, cellsize };
-  emptyDataset = myDriver->Create( d.outputFilename().toUtf8(), columns, rows, 1, GDT_Float32, NULL );
-  emptyDataset->SetGeoTransform( geoTransform );
-  // Set the projection on the raster destination to match the input layer
-  emptyDataset->SetProjection( inputLayer->crs().toWkt().toLocal8Bit().data() );
-
-  GDALRasterBand *poBand;
-  poBand = emptyDataset->GetRasterBand( 1 );
-  poBand->SetNoDataValue( NO_DATA );
-
-  float* line = ( float * ) CPLMalloc( sizeof( float ) * columns );
-  for ( int i = 0; i < columns ; i++ )
-  {
-    line[i] = NO_DATA;
-  }
-  // Write the empty raster
-  for ( int i = 0; i < rows ; i++ )
-  {
-    CPLErr err = poBand->RasterIO( GF_Write, 0, i, columns, 1, line, columns, 1, GDT_Float32, int( 0 ), int( 0 ) );
-    Q_UNUSED( err );
-  }
-
-  CPLFree( line );
-  //close the dataset
-  GDALClose(( GDALDatasetH ) emptyDataset );
-
-  // open the raster in GA_Update mode
-  GDALDataset *heatmapDS;
-  heatmapDS = ( GDALDataset * ) GDALOpen( TO8F( d.outputFilename() ), GA_Update );
+  GDALDataset* heatmapDS = myDriver->Create( d.outputFilename().toUtf8(), columns, rows, 1, GDT_Float32, NULL );
   if ( !heatmapDS )
   {
-    mQGisIface->messageBar()->pushMessage( tr( "Raster update error" ), tr( "Could not open the created raster for updating. The heatmap was not generated." ), QgsMessageBar::WARNING );
+    mQGisIface->messageBar()->pushMessage( tr( "Raster update error" ), tr( "Could not create the output raster. The heatmap was not generated." ), QgsMessageBar::WARNING );
     return;
   }
+  heatmapDS->SetGeoTransform( geoTransform );
+  // Set the projection on the raster destination to match the input layer
+  heatmapDS->SetProjection( inputLayer->crs().toWkt().toLocal8Bit().data() );
+
+  GDALRasterBand *poBand;
   poBand = heatmapDS->GetRasterBand( 1 );
+  poBand->SetNoDataValue( NO_DATA );
 
   QgsAttributeList myAttrList;
   int rField = 0;
@@ -220,6 +188,9 @@ void Heatmap::run()
     myAttrList.append( wField );
   }
 
+  // The kernels of all points are collected first and then accumulated tile by tile in parallel
+  QgsKernelDensity density( columns, rows, ( QgsKernelDensity::KernelShape ) kernelShape, ( QgsKernelDensity::OutputValues ) valueType, mDecay );
+
   // This might have attributes or mightnot have attibutes at all
   // based on the variableRadius() and weighted()
   QgsFeatureIterator fit = inputLayer->getFeatures( QgsFeatureRequest().setSubsetOfAttributes( myAttrList ) );
@@ -235,8 +206,11 @@ void Heatmap::run()
   while ( fit.nextFeature( myFeature ) )
   {
     counter++;
-    p.setValue( counter );
-    QApplication::processEvents();
+    if ( counter % 1000 == 0 )
+    {
+      p.setValue( counter );
+      QApplication::processEvents();
+    }
     if ( p.wasCanceled() )
     {
       mQGisIface->messageBar()->pushMessage( tr( "Heatmap generation aborted" ), tr( "QGIS will now load the partially-computed raster" ), QgsMessageBar::INFO, mQGisIface->messageTimeout() );
@@ -253,14 +227,7 @@ void Heatmap::run()
     QgsMultiPoint multiPoints;
     if ( !isMultiPoint )
     {
-      QgsPoint myPoint = featureGeometry->asPoint();
-      // avoiding any empty points or out of extent points
-      if (( myPoint.x() < myBBox.xMinimum() ) || ( myPoint.y() < myBBox.yMinimum() )
-          || ( myPoint.x() > myBBox.xMaximum() ) || ( myPoint.y() > myBBox.yMaximum() ) )
-      {
-        continue;
-      }
-      multiPoints << myPoint;
+      multiPoints << featureGeometry->asPoint();
     }
     else
     {
@@ -274,8 +241,6 @@ void Heatmap::run()
       myBuffer = bufferSize( radius, cellsize );
     }
 
-    int blockSize = 2 * myBuffer + 1; //Block SIDE would be more appropriate
-
     double weight = 1.0;
     if ( d.weighted() )
     {
@@ -293,59 +258,26 @@ void Heatmap::run()
       }
 
       // calculate the pixel position
-      unsigned int xPosition, yPosition;
-      xPosition = ((( *pointIt ).x() - myBBox.xMinimum() ) / cellsize ) - myBuffer;
-      yPosition = ((( *pointIt ).y() - myBBox.yMinimum() ) / cellsize ) - myBuffer;
+      int xPosition = (( *pointIt ).x() - myBBox.xMinimum() ) / cellsize;
+      int yPosition = (( *pointIt ).y() - myBBox.yMinimum() ) / cellsize;
+      density.addPoint( xPosition, yPosition, myBuffer, weight );
+    }
+  }
 
-      // get the data
-      float *dataBuffer = ( float * ) CPLMalloc( sizeof( float ) * blockSize * blockSize );
-      CPLErr err = poBand->RasterIO( GF_Read, xPosition, yPosition, blockSize, blockSize,
-                                     dataBuffer, blockSize, blockSize, GDT_Float32, int( 0 ), int( 0 ) );
-      Q_UNUSED( err );
+  p.setLabelText( tr( "Calculating density" ) );
+  p.setValue( totalFeatures );
+  QApplication::processEvents();
 
-      for ( int xp = 0; xp <= myBuffer; xp++ )
-      {
-        for ( int yp = 0; yp <= myBuffer; yp++ )
-        {
-          double distance = sqrt( pow( xp, 2.0 ) + pow( yp, 2.0 ) );
-
-          // is pixel outside search bandwidth of feature?
-          if ( distance > myBuffer )
-          {
-            continue;
-          }
-
-          double pixelValue = weight * calculateKernelValue( distance, myBuffer, kernelShape, valueType );
-
-          // clearing anamolies along the axes
-          if ( xp == 0 && yp == 0 )
-          {
-            pixelValue /= 4;
-          }
-          else if ( xp == 0 || yp == 0 )
-          {
-            pixelValue /= 2;
-          }
-
-          int pos[4];
-          pos[0] = ( myBuffer + xp ) * blockSize + ( myBuffer + yp );
-          pos[1] = ( myBuffer + xp ) * blockSize + ( myBuffer - yp );
-          pos[2] = ( myBuffer - xp ) * blockSize + ( myBuffer + yp );
-          pos[3] = ( myBuffer - xp ) * blockSize + ( myBuffer - yp );
-          for ( int p = 0; p < 4; p++ )
-          {
-            if ( dataBuffer[ pos[p] ] == NO_DATA )
-            {
-              dataBuffer[ pos[p] ] = 0;
-            }
-            dataBuffer[ pos[p] ] += pixelValue;
-          }
-        }
-      }
-      err = poBand->RasterIO( GF_Write, xPosition, yPosition, blockSize, blockSize,
-                              dataBuffer, blockSize, blockSize, GDT_Float32, int( 0 ), int( 0 ) );
-      Q_UNUSED( err );
-      CPLFree( dataBuffer );
+  // The raster is calculated and written in strips, pixels without contribution of any point are written as no data
+  const int stripRows = 256;
+  for ( int row = 0; row < rows; row += stripRows )
+  {
+    int stripHeight = qMin( stripRows, rows - row );
+    QVector<float> values = density.calculateRows( row, stripHeight, NO_DATA );
+    if ( poBand->RasterIO( GF_Write, 0, row, columns, stripHeight, values.data(), columns, stripHeight, GDT_Float32, 0, 0 ) != CE_None )
+    {
+      mQGisIface->messageBar()->pushMessage( tr( "Raster update error" ), tr( "Could not write to the output raster. The heatmap is incomplete." ), QgsMessageBar::WARNING );
+      break;
     }
   }
 
@@ -391,133 +323,6 @@ int Heatmap::bufferSize( double radius, double cellsize )
   return buffer;
 }
 
-double Heatmap::calculateKernelValue( const double distance, const int bandwidth, const KernelShape shape, const OutputValues outputType )
-{
-  switch ( shape )
-  {
-    case Heatmap::Triangular:
-      return triangularKernel( distance, bandwidth, outputType );
-
-    case Heatmap::Uniform:
-      return uniformKernel( distance, bandwidth, outputType );
-
-    case Heatmap::Quartic:
-      return quarticKernel( distance, bandwidth, outputType );
-
-    case Heatmap::Triweight:
-      return triweightKernel( distance, bandwidth, outputType );
-
-    case Heatmap::Epanechnikov:
-      return epanechnikovKernel( distance, bandwidth, outputType );
-  }
-  return 0;
-
-}
-
-/* The kernel functions below are taken from "Kernel Smoothing" by Wand and Jones (1995), p. 175
- *
- * Each kernel is multiplied by a normalizing constant "k", which normalizes the kernel area
- * to 1 for a given bandwidth size.
- *
- * k is calculated by polar double integration of the kernel function
- * between a radius of 0 to the specified bandwidth and equating the area to 1. */
-
-double Heatmap::uniformKernel( const double distance, const int bandwidth, const OutputValues outputType ) const
-{
-  Q_UNUSED( distance );
-  switch ( outputType )
-  {
-    case Heatmap::Scaled:
-    {
-      // Normalizing constant
-      double k = 2. / ( M_PI * ( double )bandwidth );
-
-      // Derived from Wand and Jones (1995), p. 175
-      return k * ( 0.5 / ( double )bandwidth );
-    }
-    default:
-      return 1.0;
-  }
-}
-
-double Heatmap::quarticKernel( const double distance, const int bandwidth, const OutputValues outputType ) const
-{
-  switch ( outputType )
-  {
-    case Heatmap::Scaled:
-    {
-      // Normalizing constant
-      double k = 116. / ( 5. * M_PI * pow(( double )bandwidth, 2 ) );
-
-      // Derived from Wand and Jones (1995), p. 175
-      return k * ( 15. / 16. ) * pow( 1. - pow( distance / ( double )bandwidth, 2 ), 2 );
-    }
-    default:
-      return pow( 1. - pow( distance / ( double )bandwidth, 2 ), 2 );
-  }
-}
-
-double Heatmap::triweightKernel( const double distance, const int bandwidth, const OutputValues outputType ) const
-{
-  switch ( outputType )
-  {
-    case Heatmap::Scaled:
-    {
-      // Normalizing constant
-      double k = 128. / ( 35. * M_PI * pow(( double )bandwidth, 2 ) );
-
-      // Derived from Wand and Jones (1995), p. 175
-      return k * ( 35. / 32. ) * pow( 1. - pow( distance / ( double )bandwidth, 2 ), 3 );
-    }
-    default:
-      return pow( 1. - pow( distance / ( double )bandwidth, 2 ), 3 );
-  }
-}
-
-double Heatmap::epanechnikovKernel( const double distance, const int bandwidth, const OutputValues outputType ) const
-{
-  switch ( outputType )
-  {
-    case Heatmap::Scaled:
-    {
-      // Normalizing constant
-      double k = 8. / ( 3. * M_PI * pow(( double )bandwidth, 2 ) );
-
-      // Derived from Wand and Jones (1995), p. 175
-      return k * ( 3. / 4. ) * ( 1. - pow( distance / ( double )bandwidth, 2 ) );
-    }
-    default:
-      return ( 1. - pow( distance / ( double )bandwidth, 2 ) );
-  }
-}
-
-double Heatmap::triangularKernel( const double distance, const int bandwidth, const OutputValues outputType ) const
-{
-  switch ( outputType )
-  {
-    case Heatmap::Scaled:
-    {
-      // Normalizing constant. In this case it's calculated a little different
-      // due to the inclusion of the non-standard "decay" parameter
-
-      if ( mDecay >= 0 )
-      {
-        double k = 3. / (( 1. + 2. * mDecay ) * M_PI * pow(( double )bandwidth, 2 ) );
-
-        // Derived from Wand and Jones (1995), p. 175 (with addition of decay parameter)
-        return k * ( 1. - ( 1. - mDecay ) * ( distance / ( double )bandwidth ) );
-      }
-      else
-      {
-        // Non-standard or mathematically valid negative decay ("coolmap")
-        return ( 1. - ( 1. - mDecay ) * ( distance / ( double )bandwidth ) );
-      }
-    }
-    default:
-      return ( 1. - ( 1. - mDecay ) * ( distance / ( double )bandwidth ) );
-  }
-}
-
 // Unload the plugin by cleaning up the GUI
 void Heatmap::unload()
 {
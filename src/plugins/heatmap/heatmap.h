@@ -42,6 +42,7 @@
 #include "../qgisplugin.h"
 #include "qgsvectorlayer.h"
 #include "qgscoordinatereferencesystem.h"
+#include "qgskerneldensity.h"
 
 //forward declarations
 class QAction;
@@ -73,18 +74,18 @@ class Heatmap: public QObject, public QgisPlugin
     // Kernel shape type
     enum KernelShape
     {
-      Quartic,
-      Triangular,
-      Uniform,
-      Triweight,
-      Epanechnikov
+      Quartic = QgsKernelDensity::Quartic,
+      Triangular = QgsKernelDensity::Triangular,
+      Uniform = QgsKernelDensity::Uniform,
+      Triweight = QgsKernelDensity::Triweight,
+      Epanechnikov = QgsKernelDensity::Epanechnikov
     };
 
     // Output values type
     enum OutputValues
     {
-      Raw,
-      Scaled
+      Raw = QgsKernelDensity::Raw,
+      Scaled = QgsKernelDensity::Scaled
     };
 
     QMap<QString, QVariant> mSessionSettings;
@@ -106,18 +107,6 @@ class Heatmap: public QObject, public QgisPlugin
     double mapUnitsOf( double meters, QgsCoordinateReferenceSystem layerCrs );
     //! Worker to calculate buffer size in pixels
     int bufferSize( double radius, double cellsize );
-    //! Calculate the value given to a point width a given distance for a specified kernel shape
-    double calculateKernelValue( const double distance, const int bandwidth, const KernelShape shape, const OutputValues outputType );
-    //! Uniform kernel function
-    double uniformKernel( const double distance, const int bandwidth, const OutputValues outputType ) const;
-    //! Quartic kernel function
-    double quarticKernel( const double distance, const int bandwidth, const OutputValues outputType ) const;
-    //! Triweight kernel function
-    double triweightKernel( const double distance, const int bandwidth, const OutputValues outputType ) const;
-    //! Epanechnikov kernel function
-    double epanechnikovKernel( const double distance, const int bandwidth, const OutputValues outputType ) const;
-    //! Triangular kernel function
-    double triangularKernel( const double distance, const int bandwidth, const OutputValues outputType ) const;
 
     // MANDATORY PLUGIN PROPERTY DECLARATIONS  .....
 
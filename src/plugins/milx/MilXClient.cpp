@@ -33,15 +33,17 @@
 #include <QNetworkConfigurationManager>
 #include <QNetworkSession>
 #include <QImage>
+#include <QMutexLocker>
 #include <QProcess>
 #include <QSettings>
 #include <QTcpSocket>
 #include <QThread>
 #include <QTimer>
+#include <QVector>
 #include <QWidget>
 
 MilXClientWorker::MilXClientWorker( bool sync )
-    : mSync( sync ), mProcess( 0 ), mNetworkSession( 0 ), mTcpSocket( 0 )
+    : mSync( sync ), mProcess( 0 ), mNetworkSession( 0 ), mTcpSocket( 0 ), mInBlockingRequest( false )
 {
 }
 
@@ -59,6 +61,8 @@ void MilXClientWorker::cleanup()
   }
   delete mNetworkSession;
   mNetworkSession = 0;
+  mReplyBuffer.clear();
+  failPostedRequests();
 }
 
 bool MilXClientWorker::initialize()
@@ -158,6 +162,7 @@ bool MilXClientWorker::initialize()
   timeoutTimer.setSingleShot( true );
   connect( mTcpSocket, SIGNAL( disconnected() ), this, SLOT( cleanup() ) );
   connect( mTcpSocket, SIGNAL( error( QAbstractSocket::SocketError ) ), this, SLOT( handleSocketError() ) );
+  connect( mTcpSocket, SIGNAL( readyRead() ), this, SLOT( readReplies() ) );
   {
     QEventLoop evLoop;
     connect( mTcpSocket, SIGNAL( error( QAbstractSocket::SocketError ) ), &evLoop, SLOT( quit() ) );
@@ -215,6 +220,12 @@ bool MilXClientWorker::processRequest( const QByteArray& request, QByteArray& re
     return false;
   }
 
+  // The replies to posted requests precede the reply to this request
+  if ( !waitForPostedRequests() )
+  {
+    return false;
+  }
+
   int requiredSize = 0;
   response.clear();
 
@@ -223,6 +234,7 @@ bool MilXClientWorker::processRequest( const QByteArray& request, QByteArray& re
   mTcpSocket->write( request );
   mTcpSocket->flush();
 
+  mInBlockingRequest = true;
   do
   {
     if ( mSync || forceSync )
@@ -239,8 +251,9 @@ bool MilXClientWorker::processRequest( const QByteArray& request, QByteArray& re
       }
     }
 
-    if ( !mLastError.isEmpty() || !mTcpSocket->isValid() )
+    if ( !mLastError.isEmpty() || !mTcpSocket || !mTcpSocket->isValid() )
     {
+      mInBlockingRequest = false;
       return false;
     }
     response += mTcpSocket->readAll();
@@ -252,8 +265,86 @@ bool MilXClientWorker::processRequest( const QByteArray& request, QByteArray& re
   }
   while ( response.size() < requiredSize );
   Q_ASSERT( mTcpSocket->bytesAvailable() == 0 );
+  mInBlockingRequest = false;
 
-  QDataStream ostream( &response, QIODevice::ReadOnly );
+  // Send the requests which were posted while waiting for the reply
+  QList< QPair<PostedRequest, QByteArray> > deferredRequests = mDeferredRequests;
+  mDeferredRequests.clear();
+  typedef QPair<PostedRequest, QByteArray> DeferredRequest_t;
+  foreach ( const DeferredRequest_t& deferred, deferredRequests )
+  {
+    postRequest( deferred.first.requestId, deferred.second, deferred.first.expectedReply );
+  }
+
+  return checkReply( response, expectedReply );
+}
+
+void MilXClientWorker::postRequest( int requestId, const QByteArray& request, quint8 expectedReply )
+{
+  PostedRequest posted = { requestId, expectedReply };
+  if ( mInBlockingRequest )
+  {
+    mDeferredRequests.append( qMakePair( posted, request ) );
+    return;
+  }
+  if ( !mTcpSocket && !initialize() )
+  {
+    mLastError = tr( "Connection failed" );
+    emit requestFinished( requestId, false, mLastError.toUtf8() );
+    return;
+  }
+
+  mPostedRequests.append( posted );
+  qint32 len = request.size();
+  mTcpSocket->write( reinterpret_cast<char*>( &len ), sizeof( quint32 ) );
+  mTcpSocket->write( request );
+  mTcpSocket->flush();
+}
+
+bool MilXClientWorker::waitForPostedRequests()
+{
+  while ( !mPostedRequests.isEmpty() )
+  {
+    if ( !mTcpSocket || !mTcpSocket->waitForReadyRead( 5000 ) )
+    {
+      if ( mLastError.isEmpty() )
+      {
+        mLastError = tr( "Connection failed" );
+      }
+      failPostedRequests();
+      return false;
+    }
+    readReplies();
+  }
+  return true;
+}
+
+void MilXClientWorker::readReplies()
+{
+  // Replies to blocking requests are read by processRequest
+  if ( mPostedRequests.isEmpty() || !mTcpSocket )
+  {
+    return;
+  }
+  mReplyBuffer += mTcpSocket->readAll();
+  while ( !mPostedRequests.isEmpty() && mReplyBuffer.size() >= int( sizeof( qint32 ) ) )
+  {
+    qint32 size = *reinterpret_cast<const qint32*>( mReplyBuffer.constData() );
+    if ( mReplyBuffer.size() < int( sizeof( qint32 ) ) + size )
+    {
+      break;
+    }
+    QByteArray response = mReplyBuffer.mid( sizeof( qint32 ), size );
+    mReplyBuffer.remove( 0, sizeof( qint32 ) + size );
+    PostedRequest posted = mPostedRequests.takeFirst();
+    bool success = checkReply( response, posted.expectedReply );
+    emit requestFinished( posted.requestId, success, success ? response : mLastError.toUtf8() );
+  }
+}
+
+bool MilXClientWorker::checkReply( const QByteArray& response, quint8 expectedReply )
+{
+  QDataStream ostream( response );
   MilXServerReply replycmd = 0; ostream >> replycmd;
   if ( replycmd == MILX_REPLY_ERROR )
   {
@@ -268,6 +359,16 @@ bool MilXClientWorker::processRequest( const QByteArray& request, QByteArray& re
   return true;
 }
 
+void MilXClientWorker::failPostedRequests()
+{
+  QList<PostedRequest> postedRequests = mPostedRequests;
+  mPostedRequests.clear();
+  foreach ( const PostedRequest& posted, postedRequests )
+  {
+    emit requestFinished( posted.requestId, false, mLastError.toUtf8() );
+  }
+}
+
 void MilXClientWorker::handleSocketError()
 {
   if ( !mTcpSocket )
@@ -306,9 +407,12 @@ MilXClient* MilXClient::instance()
 }
 
 MilXClient::MilXClient()
-    : mAsyncWorker( false ), mSyncWorker( true )
+    : mAsyncWorker( false ), mSyncWorker( true ), mLastRequestId( 0 )
 {
-  ;
+  // Cost is in kB of graphics
+  mSymbolCache.setMaxCost( 64 * 1024 );
+  // Queued, so that a request which fails while it is posted is reported after the caller got its id
+  connect( &mAsyncWorker, SIGNAL( requestFinished( int, bool, QByteArray ) ), this, SLOT( handleAsyncReply( int, bool, QByteArray ) ), Qt::QueuedConnection );
   mSyncWorker.moveToThread( this );
   start();
 }
@@ -518,6 +622,66 @@ bool MilXClient::moveAttributePoint( const QRect &visibleExtent, int dpi, const
   return true;
 }
 
+int MilXClient::movePointAsync( QObject* owner, const QRect &visibleExtent, int dpi, const NPointSymbol& symbol, int index, const QPoint& newPos )
+{
+  QByteArray request;
+  QDataStream istream( &request, QIODevice::WriteOnly );
+  istream << MILX_REQUEST_MOVE_POINT << visibleExtent << dpi << symbol.xml << symbol.points << symbol.controlPoints << symbol.attributes << symbol.finalized << symbol.colored << index << newPos;
+  return instance()->postSymbolEdit( owner, request, MILX_REPLY_MOVE_POINT );
+}
+
+int MilXClient::moveAttributePointAsync( QObject* owner, const QRect &visibleExtent, int dpi, const NPointSymbol& symbol, int attr, const QPoint& newPos )
+{
+  QByteArray request;
+  QDataStream istream( &request, QIODevice::WriteOnly );
+  istream << MILX_REQUEST_MOVE_ATTRIBUTE_POINT << visibleExtent << dpi << symbol.xml << symbol.points << symbol.controlPoints << symbol.attributes << symbol.finalized << symbol.colored << attr << newPos;
+  return instance()->postSymbolEdit( owner, request, MILX_REPLY_MOVE_ATTRIBUTE_POINT );
+}
+
+int MilXClient::postSymbolEdit( QObject* owner, const QByteArray& request, quint8 expectedReply )
+{
+  int requestId = ++mLastRequestId;
+  connect( owner, SIGNAL( destroyed( QObject* ) ), this, SLOT( cancelSymbolEdits( QObject* ) ), Qt::UniqueConnection );
+  mInFlightEdits.insert( requestId, owner );
+  mAsyncWorker.postRequest( requestId, request, expectedReply );
+  return requestId;
+}
+
+void MilXClient::handleAsyncReply( int requestId, bool success, const QByteArray& response )
+{
+  QObject* owner = mInFlightEdits.take( requestId );
+  if ( !owner )
+  {
+    // Canceled
+    return;
+  }
+  if ( !success )
+  {
+    emit symbolEditFailed( owner, requestId, QString::fromUtf8( response ) );
+    return;
+  }
+
+  QDataStream ostream( response );
+  MilXServerReply replycmd = 0; ostream >> replycmd;
+  NPointSymbolGraphic result;
+  QByteArray svgxml; ostream >> svgxml;
+  result.graphic = renderSvg( svgxml );
+  ostream >> result.offset;
+  ostream >> result.adjustedPoints;
+  ostream >> result.controlPoints;
+  ostream >> result.attributes;
+  ostream >> result.attributePoints;
+  emit symbolEdited( owner, requestId, result );
+}
+
+void MilXClient::cancelSymbolEdits( QObject* owner )
+{
+  foreach ( int requestId, mInFlightEdits.keys( owner ) )
+  {
+    mInFlightEdits.remove( requestId );
+  }
+}
+
 bool MilXClient::canDeletePoint( const NPointSymbol& symbol, int index, bool& canDelete )
 {
   QByteArray request;
@@ -651,43 +815,111 @@ bool MilXClient::updateSymbol( const QRect& visibleExtent, int dpi, const NPoint
 
 bool MilXClient::updateSymbols( const QRect& visibleExtent, int dpi, double scaleFactor, const QList<NPointSymbol>& symbols, QList<NPointSymbolGraphic>& result )
 {
+  MilXClient* client = instance();
   int nSymbols = symbols.length();
-  QByteArray request;
-  QDataStream istream( &request, QIODevice::WriteOnly );
-  istream << MILX_REQUEST_UPDATE_SYMBOLS;
-  istream << visibleExtent;
-  istream << dpi;
-  istream << scaleFactor;
-  istream << nSymbols;
-  foreach ( const NPointSymbol& symbol, symbols )
-  {
-    istream << symbol.xml << symbol.points << symbol.controlPoints << symbol.attributes << symbol.finalized << symbol.colored;
-  }
-  QByteArray response;
-  if ( !instance()->processRequest( request, response, MILX_REPLY_UPDATE_SYMBOLS ) )
+  QVector<NPointSymbolGraphic> graphics( nSymbols );
+  QList<int> missing;
+  QList<QByteArray> missingKeys;
   {
-    return false;
+    QMutexLocker locker( &client->mSymbolCacheMutex );
+    for ( int i = 0; i < nSymbols; ++i )
+    {
+      QByteArray key = symbolCacheKey( dpi, scaleFactor, symbols[i] );
+      const CachedSymbolGraphic* cached = client->mSymbolCache.object( key );
+      if ( cached )
+      {
+        // The cached graphic can be reused if it was not clipped, or if it was clipped to an extent which covers the current one
+        QPoint origin = symbols[i].points.isEmpty() ? QPoint() : symbols[i].points.front();
+        QRect graphicRect( cached->graphic.offset, cached->graphic.graphic.size() );
+        if ( cached->extent.contains( visibleExtent.translated( -origin ) ) ||
+             ( !cached->graphic.graphic.isNull() && cached->extent.contains( graphicRect.adjusted( -1, -1, 1, 1 ) ) ) )
+        {
+          graphics[i] = cached->graphic;
+          continue;
+        }
+      }
+      missing.append( i );
+      missingKeys.append( key );
+    }
   }
 
-  QDataStream ostream( &response, QIODevice::ReadOnly );
-  MilXServerReply replycmd = 0; ostream >> replycmd;
-  int nOutSymbols;
-  ostream >> nOutSymbols;
-  if ( nOutSymbols != nSymbols )
+  if ( !missing.isEmpty() )
   {
-    return false;
+    // Render the changed symbols for an extent with a margin, so that the graphics remain valid while panning
+    int marginX = visibleExtent.width() / 2;
+    int marginY = visibleExtent.height() / 2;
+    QRect requestExtent = visibleExtent.adjusted( -marginX, -marginY, marginX, marginY );
+
+    int nRequested = missing.length();
+    QByteArray request;
+    QDataStream istream( &request, QIODevice::WriteOnly );
+    istream << MILX_REQUEST_UPDATE_SYMBOLS;
+    istream << requestExtent;
+    istream << dpi;
+    istream << scaleFactor;
+    istream << nRequested;
+    foreach ( int i, missing )
+    {
+      const NPointSymbol& symbol = symbols[i];
+      istream << symbol.xml << symbol.points << symbol.controlPoints << symbol.attributes << symbol.finalized << symbol.colored;
+    }
+    QByteArray response;
+    if ( !client->processRequest( request, response, MILX_REPLY_UPDATE_SYMBOLS ) )
+    {
+      return false;
+    }
+
+    QDataStream ostream( &response, QIODevice::ReadOnly );
+    MilXServerReply replycmd = 0; ostream >> replycmd;
+    int nOutSymbols;
+    ostream >> nOutSymbols;
+    if ( nOutSymbols != nRequested )
+    {
+      return false;
+    }
+    for ( int j = 0; j < nOutSymbols; ++j )
+    {
+      int i = missing[j];
+      NPointSymbolGraphic& symbolGraphic = graphics[i];
+      QByteArray svgxml; ostream >> svgxml;
+      symbolGraphic.graphic = renderSvg( svgxml );
+      ostream >> symbolGraphic.offset;
+
+      CachedSymbolGraphic* cached = new CachedSymbolGraphic;
+      cached->graphic = symbolGraphic;
+      cached->extent = requestExtent.translated( symbols[i].points.isEmpty() ? QPoint() : -symbols[i].points.front() );
+      QMutexLocker locker( &client->mSymbolCacheMutex );
+      client->mSymbolCache.insert( missingKeys[j], cached, 1 + symbolGraphic.graphic.byteCount() / 1024 );
+    }
   }
-  for ( int i = 0; i < nOutSymbols; ++i )
+
+  foreach ( const NPointSymbolGraphic& symbolGraphic, graphics )
   {
-    NPointSymbolGraphic symbolGraphic;
-    QByteArray svgxml; ostream >> svgxml;
-    symbolGraphic.graphic = renderSvg( svgxml );
-    ostream >> symbolGraphic.offset;
     result.append( symbolGraphic );
   }
   return true;
 }
 
+void MilXClient::clearSymbolCache()
+{
+  QMutexLocker locker( &instance()->mSymbolCacheMutex );
+  instance()->mSymbolCache.clear();
+}
+
+QByteArray MilXClient::symbolCacheKey( int dpi, double scaleFactor, const NPointSymbol& symbol )
+{
+  // Points are stored relative to the first point, so that the key does not change when the map is panned
+  QList<QPoint> points;
+  foreach ( const QPoint& point, symbol.points )
+  {
+    points.append( point - symbol.points.front() );
+  }
+  QByteArray key;
+  QDataStream stream( &key, QIODevice::WriteOnly );
+  stream << dpi << scaleFactor << symbol.xml << points << symbol.controlPoints << symbol.attributes << symbol.finalized << symbol.colored;
+  return key;
+}
+
 bool MilXClient::upgradeMilXFile( const QString& inputXml, QString& outputXml, bool& valid, QString& messages )
 {
   QByteArray request;
@@ -815,6 +1047,9 @@ bool MilXClient::getCurrentLibraryVersionTag( QString& versionTag )
 
 bool MilXClient::setSymbolOptions( int symbolSize, int lineWidth , int workMode )
 {
+  // The options change the appearance of all symbols
+  clearSymbolCache();
+
   QByteArray request;
   QDataStream istream( &request, QIODevice::WriteOnly );
   istream << MILX_REQUEST_SET_SYMBOL_OPTIONS << symbolSize << lineWidth << workMode;
@@ -19,7 +19,10 @@
 #define MILXCLIENT_HPP
 
 #include <qglobal.h>
+#include <QCache>
+#include <QHash>
 #include <QMap>
+#include <QMutex>
 #include <QObject>
 #include <QPair>
 #include <QPoint>
@@ -44,16 +47,40 @@ public slots:
   bool processRequest(const QByteArray& request, QByteArray& response, quint8 expectedReply, bool forceSync = false);
   void cleanup();
 
+public:
+  /** Sends a request without waiting for the reply, so that several requests can be in flight.
+   *  The server replies in request order, the replies are reported through requestFinished.
+   *  The response of a failed request is the UTF-8 encoded error message. */
+  void postRequest(int requestId, const QByteArray& request, quint8 expectedReply);
+  /** Blocks until the replies to all posted requests have been received */
+  bool waitForPostedRequests();
+
+signals:
+  void requestFinished(int requestId, bool success, const QByteArray& response);
+
 private:
+  struct PostedRequest {
+    int requestId;
+    quint8 expectedReply;
+  };
+
   bool mSync;
   QProcess* mProcess;
   QNetworkSession* mNetworkSession;
   QTcpSocket* mTcpSocket;
   QString mLastError;
   QString mLibraryVersionTag;
+  QList<PostedRequest> mPostedRequests;
+  QList< QPair<PostedRequest, QByteArray> > mDeferredRequests;
+  QByteArray mReplyBuffer;
+  bool mInBlockingRequest;
+
+  bool checkReply(const QByteArray& response, quint8 expectedReply);
+  void failPostedRequests();
 
 private slots:
   void handleSocketError();
+  void readReplies();
 };
 
 
@@ -118,13 +145,19 @@ public:
   static bool insertPoint(const QRect &visibleExtent, int dpi, const NPointSymbol& symbol, const QPoint& newPoint, NPointSymbolGraphic& result);
   static bool movePoint(const QRect &visibleExtent, int dpi, const NPointSymbol& symbol, int index, const QPoint& newPos, NPointSymbolGraphic& result);
   static bool moveAttributePoint(const QRect &visibleExtent, int dpi, const NPointSymbol& symbol, int attr, const QPoint& newPos, NPointSymbolGraphic& result);
+  /** Non-blocking variants of movePoint and moveAttributePoint for interactive edits, to be called from the GUI thread.
+   *  The resulting graphic is delivered through symbolEdited, a failure through symbolEditFailed. Return the request id. */
+  static int movePointAsync(QObject* owner, const QRect &visibleExtent, int dpi, const NPointSymbol& symbol, int index, const QPoint& newPos);
+  static int moveAttributePointAsync(QObject* owner, const QRect &visibleExtent, int dpi, const NPointSymbol& symbol, int attr, const QPoint& newPos);
   static bool canDeletePoint(const NPointSymbol& symbol, int index, bool& canDelete);
   static bool deletePoint(const QRect &visibleExtent, int dpi, const NPointSymbol& symbol, int index, NPointSymbolGraphic& result);
   static bool editSymbol(const QRect &visibleExtent, int dpi, const NPointSymbol& symbol, QString& newSymbolXml, QString& newSymbolMilitaryName, NPointSymbolGraphic& result, WId parentWid);
   static bool createSymbol(QString& symbolId, SymbolDesc& result, WId parentWid);
 
   static bool updateSymbol(const QRect& visibleExtent, int dpi, const NPointSymbol& symbol, NPointSymbolGraphic& result, bool returnPoints);
+  /** Graphics of unchanged symbols are taken from a cache, only the remaining symbols are sent to the server in one request */
   static bool updateSymbols(const QRect& visibleExtent, int dpi, double scaleFactor, const QList<NPointSymbol>& symbols, QList<NPointSymbolGraphic>& result);
+  static void clearSymbolCache();
 
   static bool hitTest(const NPointSymbol& symbol, const QPoint& clickPos, bool& hitTestResult);
   static bool pickSymbol(const QList<NPointSymbol>& symbols, const QPoint& clickPos, int& selectedSymbol, QRect &boundingBox);
@@ -136,25 +169,44 @@ public:
   static bool validateSymbolXml(const QString& symbolXml, const QString &mssVersion, QString &adjustedSymbolXml, bool& valid, QString& messages);
 
   static void quit(){ delete instance(); }
+  static MilXClient* instance();
 
 signals:
   void requestCompleted();
+  void symbolEdited(QObject* owner, int requestId, const MilXClient::NPointSymbolGraphic& result);
+  void symbolEditFailed(QObject* owner, int requestId, const QString& error);
 
 private:
+  struct CachedSymbolGraphic {
+    NPointSymbolGraphic graphic;
+    // Visible extent the graphic was rendered for, relative to the first symbol point
+    QRect extent;
+  };
+
   static MilXClient* sInstance;
   MilXClientWorker mAsyncWorker;
   MilXClientWorker mSyncWorker;
   int mSymbolSize;
   int mLineWidth;
   int mWorkMode;
+  QCache<QByteArray, CachedSymbolGraphic> mSymbolCache;
+  QMutex mSymbolCacheMutex;
+  int mLastRequestId;
+  // Request id -> owner of the edits in flight
+  QHash<int, QObject*> mInFlightEdits;
 
   MilXClient();
   ~MilXClient();
-  static MilXClient* instance();
   static QImage renderSvg(const QByteArray& xml);
+  static QByteArray symbolCacheKey(int dpi, double scaleFactor, const NPointSymbol& symbol);
 
   bool processRequest(const QByteArray& request, QByteArray& response, quint8 expectedReply, bool async = false);
   bool setSymbolOptions(int symbolSize, int lineWidth, int workMode );
+  int postSymbolEdit(QObject* owner, const QByteArray& request, quint8 expectedReply);
+
+private slots:
+  void handleAsyncReply(int requestId, bool success, const QByteArray& response);
+  void cancelSymbolEdits(QObject* owner);
 };
 
 #endif // MILXCLIENT_HPP
@@ -22,6 +22,7 @@
 #include "MilXClient.hpp"
 #include "qgsmapcanvas.h"
 #include "qgscoordinatetransform.h"
+#include "qgsmessagelog.h"
 
 #include <QApplication>
 #include <QDesktopWidget>
@@ -32,15 +33,21 @@
 REGISTER_QGS_ANNOTATION_ITEM( QgsMilXAnnotationItem )
 
 QgsMilXAnnotationItem::QgsMilXAnnotationItem( QgsMapCanvas* canvas )
-    : QgsAnnotationItem( canvas ), mFinalized( false )
+    : QgsAnnotationItem( canvas ), mFinalized( false ), mEditRequestId( 0 )
 {
+  mEditMove.valid = false;
+  mQueuedMove.valid = false;
   mOffsetFromReferencePoint = QPoint( 0, 0 );
   connect( canvas, SIGNAL( extentsChanged() ), this, SLOT( updateSymbol() ) );
+  connect( MilXClient::instance(), SIGNAL( symbolEdited( QObject*, int, MilXClient::NPointSymbolGraphic ) ), this, SLOT( symbolEdited( QObject*, int, MilXClient::NPointSymbolGraphic ) ) );
+  connect( MilXClient::instance(), SIGNAL( symbolEditFailed( QObject*, int, QString ) ), this, SLOT( symbolEditFailed( QObject*, int, QString ) ) );
 }
 
 QgsMilXAnnotationItem::QgsMilXAnnotationItem( QgsMapCanvas* canvas, QgsMilXAnnotationItem* source )
-    : QgsAnnotationItem( canvas, source )
+    : QgsAnnotationItem( canvas, source ), mEditRequestId( 0 )
 {
+  mEditMove.valid = false;
+  mQueuedMove.valid = false;
   setSymbolXml( source->mSymbolXml, source->mSymbolMilitaryName );
   mAdditionalPoints = source->mAdditionalPoints;
   mRenderOffset = source->mRenderOffset;
@@ -50,10 +57,15 @@ QgsMilXAnnotationItem::QgsMilXAnnotationItem( QgsMapCanvas* canvas, QgsMilXAnnot
   mFinalized = source->mFinalized;
   updateSymbol( false );
   connect( canvas, SIGNAL( extentsChanged() ), this, SLOT( updateSymbol() ) );
+  connect( MilXClient::instance(), SIGNAL( symbolEdited( QObject*, int, MilXClient::NPointSymbolGraphic ) ), this, SLOT( symbolEdited( QObject*, int, MilXClient::NPointSymbolGraphic ) ) );
+  connect( MilXClient::instance(), SIGNAL( symbolEditFailed( QObject*, int, QString ) ), this, SLOT( symbolEditFailed( QObject*, int, QString ) ) );
 }
 
 void QgsMilXAnnotationItem::fromMilxItem( QgsMilXItem* item )
 {
+  // The item replaces the current state, pending interactive moves are obsolete
+  mEditRequestId = 0;
+  mQueuedMove.valid = false;
   const QgsCoordinateReferenceSystem& canvasCrs = mMapCanvas->mapSettings().destinationCrs();
   const QgsCoordinateTransform* crst = QgsCoordinateTransformCache::instance()->transform( "EPSG:4326", canvasCrs.authid() );
   setMapPosition( crst->transform( item->points().front() ), canvasCrs );
@@ -69,9 +81,10 @@ void QgsMilXAnnotationItem::fromMilxItem( QgsMilXItem* item )
   updateSymbol( true );
 }
 
-QgsMilXItem* QgsMilXAnnotationItem::toMilxItem() const
+QgsMilXItem* QgsMilXAnnotationItem::toMilxItem()
 {
   Q_ASSERT( mFinalized );
+  finishMoves();
   const QgsCoordinateTransform* crst = QgsCoordinateTransformCache::instance()->transform( mGeoPosCrs.authid(), "EPSG:4326" );
   QList<QgsPoint> points;
   points.append( crst->transform( mGeoPos ) );
@@ -193,11 +206,11 @@ void QgsMilXAnnotationItem::handleMoveAction( int moveAction, const QPointF &new
     int idx = moveAction - NumMouseMoveActions;
     if ( idx < 1 + mAdditionalPoints.size() )
     {
-      movePoint( idx, newPos.toPoint() );
+      movePoint( idx, newPos.toPoint(), true );
     }
     else if ( idx < 1 + mAdditionalPoints.size() + mAttributes.size() )
     {
-      moveAttributePoint( mAttributes[idx - 1 - mAdditionalPoints.size()].first, newPos.toPoint() );
+      moveAttributePoint( mAttributes[idx - 1 - mAdditionalPoints.size()].first, newPos.toPoint(), true );
     }
   }
   else
@@ -247,6 +260,7 @@ Qt::CursorShape QgsMilXAnnotationItem::cursorShapeForAction( int moveAction ) co
 
 void QgsMilXAnnotationItem::_showItemEditor()
 {
+  finishMoves();
   QString symbolId;
   QString symbolMilitaryName;
   MilXClient::NPointSymbol symbol( mSymbolXml, screenPoints(), mControlPoints, screenAttributes(), mFinalized, true );
@@ -261,6 +275,7 @@ void QgsMilXAnnotationItem::_showItemEditor()
 
 void QgsMilXAnnotationItem::setMapPosition( const QgsPoint &pos, const QgsCoordinateReferenceSystem &crs )
 {
+  finishMoves();
   if ( mGeoPosCrs.isValid() )
   {
     const QgsCoordinateTransform* t = QgsCoordinateTransformCache::instance()->transform( mGeoPosCrs.authid(), crs.authid() );
@@ -293,6 +308,7 @@ void QgsMilXAnnotationItem::setMapPosition( const QgsPoint &pos, const QgsCoordi
 
 void QgsMilXAnnotationItem::appendPoint( const QPoint& newPoint )
 {
+  finishMoves();
   MilXClient::NPointSymbol symbol( mSymbolXml, screenPoints(), mControlPoints, screenAttributes(), mFinalized, true );
   MilXClient::NPointSymbolGraphic result;
   int dpi = QApplication::desktop()->logicalDpiX();
@@ -302,32 +318,103 @@ void QgsMilXAnnotationItem::appendPoint( const QPoint& newPoint )
   }
 }
 
-void QgsMilXAnnotationItem::movePoint( int index, const QPoint& newPos )
+void QgsMilXAnnotationItem::movePoint( int index, const QPoint& newPos, bool interactive )
 {
+  PointMove move = { true, false, index, toMapCoordinates( newPos ) };
+  if ( !interactive )
+  {
+    finishMoves();
+    applyMove( move );
+  }
+  else if ( mEditRequestId != 0 )
+  {
+    mQueuedMove = move;
+  }
+  else
+  {
+    postMove( move );
+  }
+}
+
+void QgsMilXAnnotationItem::moveAttributePoint( int attr, const QPoint& newPos, bool interactive )
+{
+  PointMove move = { true, true, attr, toMapCoordinates( newPos ) };
+  if ( !interactive )
+  {
+    finishMoves();
+    applyMove( move );
+  }
+  else if ( mEditRequestId != 0 )
+  {
+    mQueuedMove = move;
+  }
+  else
+  {
+    postMove( move );
+  }
+}
+
+void QgsMilXAnnotationItem::postMove( const PointMove& move )
+{
+  // The symbol is built from the current state, which includes the results of all previous moves
   MilXClient::NPointSymbol symbol( mSymbolXml, screenPoints(), mControlPoints, screenAttributes(), mFinalized, true );
-  MilXClient::NPointSymbolGraphic result;
   int dpi = QApplication::desktop()->logicalDpiX();
-  if ( MilXClient::movePoint( mMapCanvas->sceneRect().toRect(), dpi, symbol, index, newPos, result ) )
+  QPoint screenPos = toCanvasCoordinates( move.mapPos ).toPoint();
+  mEditMove = move;
+  mEditExtent = mMapCanvas->mapSettings().visibleExtent();
+  if ( move.attribute )
   {
-    setGraphic( result, true );
+    mEditRequestId = MilXClient::moveAttributePointAsync( this, mMapCanvas->sceneRect().toRect(), dpi, symbol, move.index, screenPos );
+  }
+  else
+  {
+    mEditRequestId = MilXClient::movePointAsync( this, mMapCanvas->sceneRect().toRect(), dpi, symbol, move.index, screenPos );
   }
 }
 
-void QgsMilXAnnotationItem::moveAttributePoint( int attr, const QPoint& newPos )
+void QgsMilXAnnotationItem::applyMove( const PointMove& move )
 {
   MilXClient::NPointSymbol symbol( mSymbolXml, screenPoints(), mControlPoints, screenAttributes(), mFinalized, true );
-  MilXClient::NPointSymbolGraphic result;
   int dpi = QApplication::desktop()->logicalDpiX();
-  if ( MilXClient::moveAttributePoint( mMapCanvas->sceneRect().toRect(), dpi, symbol, attr, newPos, result ) )
+  QPoint screenPos = toCanvasCoordinates( move.mapPos ).toPoint();
+  MilXClient::NPointSymbolGraphic result;
+  bool success;
+  if ( move.attribute )
+  {
+    success = MilXClient::moveAttributePoint( mMapCanvas->sceneRect().toRect(), dpi, symbol, move.index, screenPos, result );
+  }
+  else
+  {
+    success = MilXClient::movePoint( mMapCanvas->sceneRect().toRect(), dpi, symbol, move.index, screenPos, result );
+  }
+  if ( success )
   {
     setGraphic( result, true );
   }
+  else
+  {
+    QgsMessageLog::logMessage( tr( "Failed to move the point of symbol %1" ).arg( mSymbolMilitaryName ), "MilX" );
+  }
+}
+
+void QgsMilXAnnotationItem::finishMoves()
+{
+  if ( mEditRequestId == 0 && !mQueuedMove.valid )
+  {
+    return;
+  }
+  // The reply to the move in flight is ignored, the latest move is applied to the current state instead
+  PointMove move = mQueuedMove.valid ? mQueuedMove : mEditMove;
+  mEditRequestId = 0;
+  mQueuedMove.valid = false;
+  applyMove( move );
 }
 
 void QgsMilXAnnotationItem::setAttribute( int attridx, double value )
 {
   if ( attridx >= 0 && attridx < mAttributes.size() )
   {
+    finishMoves();
     mAttributes[attridx].second = value;
     updateSymbol( true );
   }
@@ -452,12 +539,14 @@ void QgsMilXAnnotationItem::setGraphic( MilXClient::NPointSymbolGraphic &result,
 
 void QgsMilXAnnotationItem::finalize()
 {
+  finishMoves();
   mFinalized = true;
   updateSymbol( true );
 }
 
 void QgsMilXAnnotationItem::showContextMenu( const QPoint &screenPos )
 {
+  finishMoves();
   QPoint canvasPos = mMapCanvas->mapFromGlobal( screenPos );
   QMenu menu;
   menu.addAction( mSymbolMilitaryName )->setEnabled( false );
@@ -605,3 +694,42 @@ void QgsMilXAnnotationItem::updateSymbol( bool updatePoints )
     setGraphic( result, updatePoints );
   }
 }
+
+void QgsMilXAnnotationItem::symbolEdited( QObject* owner, int requestId, const MilXClient::NPointSymbolGraphic& result )
+{
+  if ( owner != this || requestId != mEditRequestId )
+  {
+    return;
+  }
+  mEditRequestId = 0;
+  if ( mMapCanvas->mapSettings().visibleExtent() == mEditExtent )
+  {
+    MilXClient::NPointSymbolGraphic graphic = result;
+    setGraphic( graphic, true );
+  }
+  else if ( !mQueuedMove.valid )
+  {
+    // The reply is in the screen coordinates of the old extent, move again from the current state
+    mQueuedMove = mEditMove;
+  }
+  if ( mQueuedMove.valid )
+  {
+    PointMove move = mQueuedMove;
+    mQueuedMove.valid = false;
+    postMove( move );
+  }
+}
+
+void QgsMilXAnnotationItem::symbolEditFailed( QObject* owner, int requestId, const QString& error )
+{
+  if ( owner != this || requestId != mEditRequestId )
+  {
+    return;
+  }
+  QgsMessageLog::logMessage( tr( "Failed to move the point of symbol %1: %2" ).arg( mSymbolMilitaryName ).arg( error ), "MilX" );
+  // Do not lose the latest move, apply it synchronously
+  PointMove move = mQueuedMove.valid ? mQueuedMove : mEditMove;
+  mEditRequestId = 0;
+  mQueuedMove.valid = false;
+  applyMove( move );
+}
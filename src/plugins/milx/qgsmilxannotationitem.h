@@ -19,6 +19,7 @@
 #define QGSMILXANNOTATIONITEM_H
 
 #include "qgsannotationitem.h"
+#include "qgsrectangle.h"
 #include "MilXClient.hpp"
 
 class QgsCoordinateTransform;
@@ -35,15 +36,17 @@ class QgsMilXAnnotationItem : public QgsAnnotationItem
     QgsMilXAnnotationItem* clone( QgsMapCanvas *canvas ) override { return new QgsMilXAnnotationItem( canvas, this ); }
 
     void fromMilxItem( QgsMilXItem* item );
-    QgsMilXItem* toMilxItem() const;
+    QgsMilXItem* toMilxItem();
 
     void setSymbolXml( const QString& symbolXml, const QString &symbolMilitaryName );
     void setMapPosition( const QgsPoint &pos, const QgsCoordinateReferenceSystem &crs = QgsCoordinateReferenceSystem() ) override;
     const QgsPoint& point( int idx ) const { return idx == 0 ? mMapPosition : mAdditionalPoints[idx - 1]; }
     int pointCount() const { return 1 + mAdditionalPoints.size(); }
     void appendPoint( const QPoint &newPoint );
-    void movePoint( int index, const QPoint &newPos );
-    void moveAttributePoint( int attr, const QPoint& newPos );
+    /** If interactive is true, the symbol is updated asynchronously once the server has processed the move.
+     *  While a move is in flight, only the latest further move is kept and sent once the reply arrives. */
+    void movePoint( int index, const QPoint &newPos, bool interactive = false );
+    void moveAttributePoint( int attr, const QPoint& newPos, bool interactive = false );
     void setAttribute( int attridx, double value );
     QList<QPoint> screenPoints() const;
     const QList< QPair<int, double> >& attributes() const { return mAttributes; }
@@ -72,6 +75,10 @@ class QgsMilXAnnotationItem : public QgsAnnotationItem
   public slots:
     void updateSymbol( bool updatePoints = false );
 
+  private slots:
+    void symbolEdited( QObject* owner, int requestId, const MilXClient::NPointSymbolGraphic& result );
+    void symbolEditFailed( QObject* owner, int requestId, const QString& error );
+
   signals:
     void copy();
     void cut();
@@ -80,6 +87,15 @@ class QgsMilXAnnotationItem : public QgsAnnotationItem
     QgsMilXAnnotationItem( QgsMapCanvas* canvas, QgsMilXAnnotationItem* source );
 
   private:
+    // Interactive move of a point, the position is in canvas map coordinates so that it survives extent changes
+    struct PointMove
+    {
+      bool valid;
+      bool attribute;
+      int index;
+      QgsPoint mapPos;
+    };
+
     QString mSymbolXml;
     QString mSymbolMilitaryName;
     QPixmap mGraphic;
@@ -89,9 +105,19 @@ class QgsMilXAnnotationItem : public QgsAnnotationItem
     QList< QPair<int, double> > mAttributes;
     QList< QPair<int, QgsPoint> > mAttributePoints;
     bool mFinalized;
+    // Request id of the interactive move in flight (0 if none), the visible extent it was posted for, and the move
+    int mEditRequestId;
+    QgsRectangle mEditExtent;
+    PointMove mEditMove;
+    // Latest move waiting for the reply to the move in flight
+    PointMove mQueuedMove;
 
     void _showItemEditor() override;
     double metersToPixels() const;
+    void postMove( const PointMove& move );
+    void applyMove( const PointMove& move );
+    //! Applies the latest pending interactive move synchronously
+    void finishMoves();
 
     bool createBillboard() const override { return !isMultiPoint(); }
     QImage billboardImage() const override { return mGraphic.toImage(); }
@@ -253,6 +253,7 @@ class QgsMilXLayer::Renderer : public QgsMapLayerRenderer
     bool render() override
     {
       const QList<QgsMilXItem*>& items = mLayer->mItems;
+      QList<int> itemIndices;
       QList<QPoint> itemOrigins;
       QList<MilXClient::NPointSymbol> symbols;
       QStringList flags = mRendererContext.customRenderFlags().split( ";" );
@@ -268,6 +269,7 @@ class QgsMilXLayer::Renderer : public QgsMapLayerRenderer
         if ( points.isEmpty() )
           continue;
         QList< QPair<int, double> > screenAttribs = items[i]->screenAttributes( mRendererContext.mapToPixel(), mRendererContext.coordinateTransform() );
+        itemIndices.append( i );
         itemOrigins.append( points.front() );
         symbols.append( MilXClient::NPointSymbol( items[i]->mssString(), points, items[i]->controlPoints(), screenAttribs, true, !mLayer->mIsApproved ) );
       }
@@ -286,11 +288,12 @@ class QgsMilXLayer::Renderer : public QgsMapLayerRenderer
       mRendererContext.painter()->setOpacity(( 100. - mLayer->mTransparency ) / 100. );
       for ( int i = 0, n = result.size(); i < n; ++i )
       {
-        QPoint renderPos = itemOrigins[i] + result[i].offset + items[i]->userOffset();
-        if ( !items[i]->isMultiPoint() )
+        const QgsMilXItem* item = items[itemIndices[i]];
+        QPoint renderPos = itemOrigins[i] + result[i].offset + item->userOffset();
+        if ( !item->isMultiPoint() )
         {
           // Draw line from visual reference point to actual refrence point
-          mRendererContext.painter()->drawLine( itemOrigins[i], itemOrigins[i] + items[i]->userOffset() );
+          mRendererContext.painter()->drawLine( itemOrigins[i], itemOrigins[i] + item->userOffset() );
         }
         mRendererContext.painter()->drawImage( renderPos, result[i].graphic );
       }
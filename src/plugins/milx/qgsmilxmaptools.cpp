@@ -249,7 +249,7 @@ void QgsMilXCreateTool::canvasMoveEvent( QMouseEvent * e )
 {
   if ( mItem != 0 && e->buttons() == Qt::NoButton )
   {
-    mItem->movePoint( mItem->absolutePointIdx( mNPressedPoints ), e->pos() );
+    mItem->movePoint( mItem->absolutePointIdx( mNPressedPoints ), e->pos(), true );
     if ( mInputWidget )
     {
       int pointidx = mItem->absolutePointIdx( mNPressedPoints );
@@ -0,0 +1,670 @@
+/***************************************************************************
+    graphcache.cpp - Cache of the routing graphs of the roadgraph plugin
+                             -------------------
+    begin                : December 2015
+    copyright            : (C) 2015 by Sandro Mani
+    email                : manisandro@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "graphcache.h"
+
+#include <qgsapplication.h>
+#include <qgsarcproperter.h>
+#include <qgscompactgraph.h>
+#include <qgscoordinatereferencesystem.h>
+#include <qgsdistancearea.h>
+#include <qgsfeaturerequest.h>
+#include <qgsgeometry.h>
+#include <qgsgraph.h>
+#include <qgsgraphanalyzer.h>
+#include <qgsgraphbuilder.h>
+#include <qgsgraphdirector.h>
+#include <qgslogger.h>
+#include <qgsmaplayerregistry.h>
+#include <qgsspatialindex.h>
+#include <qgsvectorlayer.h>
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#include <limits>
+
+static const quint32 sSnapshotMagic = 0x52474743; // RGGC
+static const quint32 sSnapshotVersion = 3;
+// Maximum number of arcs kept in memory
+static const int sMaxCachedArcs = 4 * 1024 * 1024;
+// Maximum total size of the snapshots on disk
+static const qint64 sMaxSnapshotBytes = Q_INT64_C( 1024 ) * 1024 * 1024;
+
+/** Records the feature of each arc, so that the parts of split arcs can be costed by the properters */
+class RgFeatureIdProperter : public QgsArcProperter
+{
+  public:
+    QVariant property( double distance, const QgsFeature& f ) const override
+    {
+      Q_UNUSED( distance );
+      return double( f.id() );
+    }
+};
+
+static QVector< QVariant > toProperties( const QVector<double>& costs )
+{
+  QVector< QVariant > properties( costs.size() );
+  for ( int k = 0, n = costs.size(); k < n; ++k )
+  {
+    properties[k] = costs[k];
+  }
+  return properties;
+}
+
+RgCachedGraph::RgCachedGraph( const QgsGraph* graph )
+    : graph( new QgsCompactGraph( graph ) )
+    , index( 0 )
+{
+  criterionCount = qMax( 0, this->graph->criterionCount() - 1 );
+}
+
+RgCachedGraph::~RgCachedGraph()
+{
+  delete graph;
+  delete index;
+}
+
+int RgTiedGraph::vertexCount() const
+{
+  return mGraph->graph->vertexCount();
+}
+
+QgsGraph* RgTiedGraph::shortestPath( int fromPoint, int toPoint, int criterionNum ) const
+{
+  const TiedPoint& from = mPoints[fromPoint];
+  const TiedPoint& to = mPoints[toPoint];
+  if ( !from.tied || !to.tied )
+  {
+    return 0;
+  }
+  if ( from.point == to.point )
+  {
+    // Both points are tied to the same place
+    QgsGraph* path = new QgsGraph();
+    path->addVertex( from.point );
+    return path;
+  }
+  const QgsCompactGraph* graph = mGraph->graph;
+  // The feature ids follow the costs, other invalid criteria cost nothing
+  int criterion = criterionNum >= 0 && criterionNum < mGraph->criterionCount ? criterionNum : -1;
+
+  // Search from the vertices the start point leads to, with the costs of the parts to them
+  QVector<int> startVertices;
+  QVector<double> startCosts;
+  foreach ( const Part& part, from.exits )
+  {
+    startVertices.append( part.vertex );
+    startCosts.append( part.costs.value( criterion ) );
+  }
+  QVector<int> targetVertices;
+  foreach ( const Part& part, to.entries )
+  {
+    targetVertices.append( part.vertex );
+  }
+  QVector<int> tree;
+  QVector<double> costs;
+  QgsGraphAnalyzer::dijkstra( graph, startVertices, startCosts, criterion, &tree, &costs, targetVertices );
+
+  double bestCost = std::numeric_limits<double>::infinity();
+  int entry = -1;
+  for ( int j = 0, n = to.entries.size(); j < n; ++j )
+  {
+    double cost = costs[to.entries[j].vertex] + to.entries[j].costs.value( criterion );
+    if ( cost < bestCost )
+    {
+      bestCost = cost;
+      entry = j;
+    }
+  }
+  // Both points may lie on the same arc
+  const QVector<double>* direct = 0;
+  QPair<int, int> key = qMakePair( fromPoint, toPoint );
+  for ( QMultiHash< QPair<int, int>, QVector<double> >::const_iterator it = mDirectParts.constFind( key ); it != mDirectParts.constEnd() && it.key() == key; ++it )
+  {
+    if ( it.value().value( criterion ) <= bestCost )
+    {
+      bestCost = it.value().value( criterion );
+      direct = &it.value();
+    }
+  }
+  if ( entry == -1 && !direct )
+  {
+    return 0;
+  }
+
+  QgsGraph* path = new QgsGraph();
+  int prev = path->addVertex( from.point );
+  if ( direct )
+  {
+    path->addArc( prev, path->addVertex( to.point ), toProperties( *direct ) );
+    return path;
+  }
+
+  // Trace the arcs back from the entry vertex to the start vertex it is reached from
+  QList<int> arcs;
+  int vertex = to.entries[entry].vertex;
+  while ( tree[vertex] != -1 )
+  {
+    int arc = graph->compactArcIdx( tree[vertex] );
+    arcs.prepend( arc );
+    vertex = graph->arcOutVertex( arc );
+  }
+  int exit = -1;
+  for ( int j = 0, n = from.exits.size(); j < n; ++j )
+  {
+    if ( from.exits[j].vertex == vertex && ( exit == -1 || from.exits[j].costs.value( criterion ) < from.exits[exit].costs.value( criterion ) ) )
+    {
+      exit = j;
+    }
+  }
+
+  if ( graph->vertexPoint( vertex ) != from.point )
+  {
+    int next = path->addVertex( graph->vertexPoint( vertex ) );
+    path->addArc( prev, next, toProperties( from.exits[exit].costs ) );
+    prev = next;
+  }
+  foreach ( int arc, arcs )
+  {
+    QVector<double> arcCosts( mGraph->criterionCount );
+    for ( int k = 0; k < mGraph->criterionCount; ++k )
+    {
+      arcCosts[k] = graph->arcCosts( k )[arc];
+    }
+    int next = path->addVertex( graph->vertexPoint( graph->arcInVertex( arc ) ) );
+    path->addArc( prev, next, toProperties( arcCosts ) );
+    prev = next;
+  }
+  if ( graph->vertexPoint( to.entries[entry].vertex ) != to.point )
+  {
+    path->addArc( prev, path->addVertex( to.point ), toProperties( to.entries[entry].costs ) );
+  }
+  return path;
+}
+
+RgGraphCache::RgGraphCache( QObject* parent )
+    : QObject( parent )
+    , mFeatureIdProperter( new RgFeatureIdProperter() )
+{
+  mGraphs.setMaxCost( sMaxCachedArcs );
+  connect( QgsMapLayerRegistry::instance(), SIGNAL( layersWillBeRemoved( QStringList ) ), this, SLOT( layersRemoved( QStringList ) ) );
+}
+
+RgGraphCache::~RgGraphCache()
+{
+  delete mFeatureIdProperter;
+}
+
+RgTiedGraph* RgGraphCache::makeGraph( QgsVectorLayer* layer, QgsGraphDirector* director, const QString& settingsKey,
+                                      const QgsCoordinateReferenceSystem& crs, bool otfEnabled, double topologyTolerance,
+                                      const QVector< QgsPoint >& additionalPoints, QVector< QgsPoint >& tiedPoints )
+{
+  if ( !mLayerRevisions.contains( layer->id() ) )
+  {
+    mLayerRevisions.insert( layer->id(), 0 );
+    connect( layer, SIGNAL( layerModified() ), this, SLOT( layerChanged() ), Qt::UniqueConnection );
+    connect( layer, SIGNAL( dataChanged() ), this, SLOT( layerChanged() ), Qt::UniqueConnection );
+  }
+
+  QString graphKey = QString( "%1|%2|%3|%4" ).arg( settingsKey ).arg( crs.toProj4() ).arg( otfEnabled ).arg( topologyTolerance, 0, 'g', 17 );
+  QString memoryKey = QString( "%1|%2|%3" ).arg( layer->id() ).arg( mLayerRevisions[layer->id()] ).arg( graphKey );
+
+  Entry* entry = mGraphs.object( memoryKey );
+  QSharedPointer<RgCachedGraph> graph;
+  if ( entry )
+  {
+    graph = entry->graph;
+  }
+  else
+  {
+    QString diskKey = snapshotKey( layer, graphKey );
+    QString diskStamp = diskKey.isEmpty() ? QString() : snapshotStamp( layer );
+    QgsGraph* built = diskKey.isEmpty() ? 0 : loadSnapshot( diskKey, diskStamp );
+    if ( !built )
+    {
+      QgsGraphBuilder builder( crs, otfEnabled, topologyTolerance );
+      QVector< QgsPoint > noTiedPoints;
+      director->addProperter( mFeatureIdProperter );
+      director->makeGraph( &builder, QVector< QgsPoint >(), noTiedPoints );
+      built = builder.graph();
+      if ( !diskKey.isEmpty() )
+      {
+        saveSnapshot( diskKey, diskStamp, built );
+      }
+    }
+    graph = QSharedPointer<RgCachedGraph>( new RgCachedGraph( built ) );
+    delete built;
+    // Graphs too large to be kept are used once
+    int cost = qMax( 1, graph->graph->arcCount() );
+    if ( cost <= mGraphs.maxCost() )
+    {
+      mGraphs.insert( memoryKey, new Entry( graph ), cost );
+    }
+  }
+  return tiePoints( graph, layer, director, crs, otfEnabled, topologyTolerance, additionalPoints, tiedPoints );
+}
+
+void RgGraphCache::clear()
+{
+  mGraphs.clear();
+}
+
+void RgGraphCache::layerChanged()
+{
+  QgsMapLayer* layer = qobject_cast<QgsMapLayer*>( QObject::sender() );
+  if ( layer )
+  {
+    // Graphs of older revisions are never looked up again
+    ++mLayerRevisions[layer->id()];
+    QString prefix = layer->id() + "|";
+    foreach ( const QString& key, mGraphs.keys() )
+    {
+      if ( key.startsWith( prefix ) )
+      {
+        mGraphs.remove( key );
+      }
+    }
+  }
+}
+
+void RgGraphCache::layersRemoved( const QStringList& layerIds )
+{
+  foreach ( const QString& layerId, layerIds )
+  {
+    mLayerRevisions.remove( layerId );
+    QString prefix = layerId + "|";
+    foreach ( const QString& key, mGraphs.keys() )
+    {
+      if ( key.startsWith( prefix ) )
+      {
+        mGraphs.remove( key );
+      }
+    }
+  }
+}
+
+QString RgGraphCache::snapshotKey( QgsVectorLayer* layer, const QString& graphKey )
+{
+  // Only unmodified file based layers can be identified across sessions
+  if ( layer->isModified() )
+  {
+    return QString();
+  }
+  QFileInfo fileInfo( layer->source().section( '|', 0, 0 ) );
+  if ( !fileInfo.isFile() )
+  {
+    return QString();
+  }
+  return QString( "%1|%2|%3|%4" )
+         .arg( fileInfo.canonicalFilePath() )
+         .arg( layer->source() )
+         .arg( layer->subsetString() )
+         .arg( graphKey );
+}
+
+QString RgGraphCache::snapshotStamp( QgsVectorLayer* layer )
+{
+  // The data of a layer can be spread over several files, e.g. the .shp, .shx, .dbf and .prj of a shapefile
+  QFileInfo fileInfo( layer->source().section( '|', 0, 0 ) );
+  QStringList stamps;
+  foreach ( const QFileInfo& file, fileInfo.dir().entryInfoList( QStringList() << fileInfo.completeBaseName() + ".*", QDir::Files, QDir::Name ) )
+  {
+    stamps.append( QString( "%1:%2:%3" ).arg( file.fileName() ).arg( file.lastModified().toMSecsSinceEpoch() ).arg( file.size() ) );
+  }
+  return stamps.join( "|" );
+}
+
+QString RgGraphCache::snapshotDir()
+{
+  return QgsApplication::qgisSettingsDirPath() + "roadgraph/";
+}
+
+QString RgGraphCache::snapshotPath( const QString& key, const QString& stamp )
+{
+  // Snapshots of older versions of the same data share the prefix
+  QString keyHash = QCryptographicHash::hash( key.toUtf8(), QCryptographicHash::Md5 ).toHex();
+  QString stampHash = QCryptographicHash::hash( stamp.toUtf8(), QCryptographicHash::Md5 ).toHex();
+  return snapshotDir() + keyHash + "-" + stampHash + ".graph";
+}
+
+void RgGraphCache::pruneSnapshots( const QString& currentPath )
+{
+  QDir dir( snapshotDir() );
+  QFileInfo current( currentPath );
+  QString prefix = current.fileName().section( '-', 0, 0 ) + "-";
+
+  // Snapshots of older versions of the data are never loaded again, the oldest others go above the size limit
+  qint64 totalSize = 0;
+  foreach ( const QFileInfo& file, dir.entryInfoList( QStringList() << "*.graph", QDir::Files, QDir::Time ) )
+  {
+    totalSize += file.size();
+    if ( file.fileName() == current.fileName() )
+    {
+      continue;
+    }
+    if ( file.fileName().startsWith( prefix ) || totalSize > sMaxSnapshotBytes )
+    {
+      QgsDebugMsg( QString( "Removing graph snapshot %1" ).arg( file.fileName() ) );
+      QFile::remove( file.absoluteFilePath() );
+      totalSize -= file.size();
+    }
+  }
+}
+
+QgsGraph* RgGraphCache::loadSnapshot( const QString& key, const QString& stamp )
+{
+  QFile file( snapshotPath( key, stamp ) );
+  if ( !file.open( QIODevice::ReadOnly ) )
+  {
+    return 0;
+  }
+  uchar* data = file.map( 0, file.size() );
+  if ( !data )
+  {
+    return 0;
+  }
+  QByteArray bytes = QByteArray::fromRawData( reinterpret_cast<const char*>( data ), file.size() );
+  QDataStream stream( bytes );
+  stream.setVersion( QDataStream::Qt_4_6 );
+
+  quint32 magic, version;
+  QString fileKey, fileStamp;
+  stream >> magic >> version >> fileKey >> fileStamp;
+  if ( magic != sSnapshotMagic || version != sSnapshotVersion || fileKey != key || fileStamp != stamp )
+  {
+    file.unmap( data );
+    return 0;
+  }
+
+  QgsGraph* graph = new QgsGraph();
+  qint32 nVertices, nArcs, nProperties;
+  stream >> nVertices;
+  for ( int i = 0; i < nVertices && stream.status() == QDataStream::Ok; ++i )
+  {
+    double x, y;
+    stream >> x >> y;
+    graph->addVertex( QgsPoint( x, y ) );
+  }
+  stream >> nArcs >> nProperties;
+  if ( nProperties < 0 )
+  {
+    stream.setStatus( QDataStream::ReadCorruptData );
+    nProperties = 0;
+  }
+  QVector< QVariant > properties( nProperties );
+  for ( int i = 0; i < nArcs && stream.status() == QDataStream::Ok; ++i )
+  {
+    qint32 outVertex, inVertex;
+    stream >> outVertex >> inVertex;
+    for ( int j = 0; j < nProperties; ++j )
+    {
+      double value;
+      stream >> value;
+      properties[j] = value;
+    }
+    if ( outVertex < 0 || outVertex >= nVertices || inVertex < 0 || inVertex >= nVertices )
+    {
+      stream.setStatus( QDataStream::ReadCorruptData );
+      break;
+    }
+    graph->addArc( outVertex, inVertex, properties );
+  }
+  file.unmap( data );
+
+  if ( stream.status() != QDataStream::Ok )
+  {
+    QgsDebugMsg( QString( "Corrupt graph snapshot %1" ).arg( file.fileName() ) );
+    delete graph;
+    return 0;
+  }
+  return graph;
+}
+
+void RgGraphCache::saveSnapshot( const QString& key, const QString& stamp, const QgsGraph* graph )
+{
+  QString path = snapshotPath( key, stamp );
+  QDir().mkpath( QFileInfo( path ).absolutePath() );
+
+  // Write to a temporary file, so that a concurrent load never sees a partial snapshot
+  QFile file( path + ".tmp" );
+  if ( !file.open( QIODevice::WriteOnly ) )
+  {
+    QgsDebugMsg( QString( "Cannot write graph snapshot %1" ).arg( file.fileName() ) );
+    return;
+  }
+  QDataStream stream( &file );
+  stream.setVersion( QDataStream::Qt_4_6 );
+  stream << sSnapshotMagic << sSnapshotVersion << key << stamp;
+
+  stream << qint32( graph->vertexCount() );
+  for ( int i = 0, n = graph->vertexCount(); i < n; ++i )
+  {
+    const QgsPoint& pt = graph->vertex( i ).point();
+    stream << pt.x() << pt.y();
+  }
+  int nProperties = graph->arcCount() > 0 ? graph->arc( 0 ).properties().size() : 0;
+  stream << qint32( graph->arcCount() ) << qint32( nProperties );
+  for ( int i = 0, n = graph->arcCount(); i < n; ++i )
+  {
+    const QgsGraphArc& arc = graph->arc( i );
+    stream << qint32( arc.outVertex() ) << qint32( arc.inVertex() );
+    const QVector< QVariant >& properties = arc.properties();
+    for ( int j = 0; j < nProperties; ++j )
+    {
+      stream << ( j < properties.size() ? properties[j].toDouble() : 0. );
+    }
+  }
+  file.close();
+
+  QFile::remove( path );
+  if ( stream.status() != QDataStream::Ok || !file.rename( path ) )
+  {
+    file.remove();
+    return;
+  }
+  pruneSnapshots( path );
+}
+
+static QgsFeature arcFeature( QgsVectorLayer* layer, const RgCachedGraph* graph, int arc, QHash< QgsFeatureId, QgsFeature >& features )
+{
+  QgsFeatureId fid = QgsFeatureId( graph->graph->arcCosts( graph->criterionCount )[arc] );
+  QHash< QgsFeatureId, QgsFeature >::const_iterator it = features.constFind( fid );
+  if ( it != features.constEnd() )
+  {
+    return it.value();
+  }
+  QgsFeature feature;
+  layer->getFeatures( QgsFeatureRequest( fid ).setFlags( QgsFeatureRequest::NoGeometry ) ).nextFeature( feature );
+  features.insert( fid, feature );
+  return feature;
+}
+
+static QVector<double> partCosts( const QList<QgsArcProperter*>& properters, int criterionCount, double distance, const QgsFeature& feature )
+{
+  QVector<double> costs( criterionCount, 0. );
+  for ( int k = 0, n = qMin( criterionCount, properters.size() ); k < n; ++k )
+  {
+    costs[k] = properters[k]->property( distance, feature ).toDouble();
+  }
+  return costs;
+}
+
+RgTiedGraph* RgGraphCache::tiePoints( const QSharedPointer<RgCachedGraph>& cached, QgsVectorLayer* layer, const QgsGraphDirector* director,
+                                      const QgsCoordinateReferenceSystem& crs, bool otfEnabled, double topologyTolerance,
+                                      const QVector< QgsPoint >& additionalPoints, QVector< QgsPoint >& tiedPoints )
+{
+  RgTiedGraph* tied = new RgTiedGraph();
+  tied->mGraph = cached;
+  tied->mPoints.resize( additionalPoints.size() );
+  tiedPoints = QVector< QgsPoint >( additionalPoints.size(), QgsPoint( 0.0, 0.0 ) );
+  const QgsCompactGraph* graph = cached->graph;
+  if ( additionalPoints.isEmpty() || graph->arcCount() == 0 )
+  {
+    return tied;
+  }
+
+  if ( !cached->index )
+  {
+    cached->index = new QgsSpatialIndex();
+    for ( int i = 0, n = graph->arcCount(); i < n; ++i )
+    {
+      QgsFeature feature( i );
+      feature.setGeometry( QgsGeometry::fromPolyline( QgsPolyline() << graph->vertexPoint( graph->arcOutVertex( i ) ) << graph->vertexPoint( graph->arcInVertex( i ) ) ) );
+      cached->index->insertFeature( feature );
+    }
+  }
+
+  // The parts of split arcs are measured and costed like the arcs built by the director
+  QgsGraphBuilder builder( crs, otfEnabled, topologyTolerance );
+  const QgsDistanceArea* da = builder.distanceArea();
+  const QList<QgsArcProperter*>& properters = director->properters();
+  int criterionCount = cached->criterionCount;
+  QHash< QgsFeatureId, QgsFeature > features;
+
+  double sqrTolerance = topologyTolerance * topologyTolerance;
+  for ( int i = 0; i < additionalPoints.size(); ++i )
+  {
+    const QgsPoint& pt = additionalPoints[i];
+    QList<QgsFeatureId> nearest = cached->index->nearestNeighbor( pt, 1 );
+    if ( nearest.isEmpty() )
+    {
+      continue;
+    }
+
+    // The nearest bounding box gives an upper bound of the distance to the nearest arc
+    int bestArc = -1;
+    double bestDist = std::numeric_limits<double>::infinity();
+    QgsPoint bestPoint;
+    for ( int pass = 0; pass < 2; ++pass )
+    {
+      QList<QgsFeatureId> candidates = nearest;
+      if ( pass == 1 )
+      {
+        double r = sqrt( bestDist );
+        candidates = cached->index->intersects( QgsRectangle( pt.x() - r, pt.y() - r, pt.x() + r, pt.y() + r ) );
+      }
+      foreach ( QgsFeatureId id, candidates )
+      {
+        const QgsPoint& p1 = graph->vertexPoint( graph->arcOutVertex( id ) );
+        const QgsPoint& p2 = graph->vertexPoint( graph->arcInVertex( id ) );
+        QgsPoint closest = p1;
+        double dist = p1 == p2 ? pt.sqrDist( p1 ) : pt.sqrDistToSegment( p1.x(), p1.y(), p2.x(), p2.y(), closest );
+        if ( dist < bestDist || ( dist == bestDist && id < bestArc ) )
+        {
+          bestDist = dist;
+          bestArc = ( int ) id;
+          bestPoint = closest;
+        }
+      }
+    }
+
+    int v1 = graph->arcOutVertex( bestArc ), v2 = graph->arcInVertex( bestArc );
+    const QgsPoint& p1 = graph->vertexPoint( v1 );
+    const QgsPoint& p2 = graph->vertexPoint( v2 );
+    RgTiedGraph::TiedPoint& point = tied->mPoints[i];
+
+    // Points on the end of an arc or within the tolerance of it are tied to the end vertex
+    int vertex = -1;
+    if ( bestPoint.sqrDist( p1 ) <= sqrTolerance )
+    {
+      vertex = v1;
+    }
+    else if ( bestPoint.sqrDist( p2 ) <= sqrTolerance )
+    {
+      vertex = v2;
+    }
+    if ( vertex != -1 )
+    {
+      RgTiedGraph::Part part;
+      part.vertex = vertex;
+      part.costs.fill( 0., criterionCount );
+      point.tied = true;
+      point.point = graph->vertexPoint( vertex );
+      point.exits.append( part );
+      point.entries.append( part );
+      tiedPoints[i] = point.point;
+      continue;
+    }
+
+    // Points within the tolerance of a point tied before share its parts
+    for ( int j = 0; j < i && !point.tied; ++j )
+    {
+      if ( tied->mPoints[j].tied && tied->mPoints[j].point.sqrDist( bestPoint ) <= sqrTolerance )
+      {
+        point = tied->mPoints[j];
+      }
+    }
+    if ( !point.tied )
+    {
+      point.tied = true;
+      point.point = bestPoint;
+
+      // Split the arcs between the end vertices in both directions
+      double sqrLength = p1.sqrDist( p2 );
+      foreach ( int start, QList<int>() << v1 << v2 )
+      {
+        int end = start == v1 ? v2 : v1;
+        for ( int arc = graph->outArcBegin( start ), n = graph->outArcEnd( start ); arc < n; ++arc )
+        {
+          if ( graph->arcInVertex( arc ) != end )
+          {
+            continue;
+          }
+          const QgsPoint& startPoint = graph->vertexPoint( start );
+          QgsFeature feature = arcFeature( layer, cached.data(), arc, features );
+          RgTiedGraph::Part entry;
+          entry.vertex = start;
+          entry.costs = partCosts( properters, criterionCount, da->measureLine( startPoint, bestPoint ), feature );
+          RgTiedGraph::Part exit;
+          exit.vertex = end;
+          exit.costs = partCosts( properters, criterionCount, da->measureLine( bestPoint, graph->vertexPoint( end ) ), feature );
+          point.entries.append( entry );
+          point.exits.append( exit );
+          point.arcs.append( qMakePair( arc, sqrt( startPoint.sqrDist( bestPoint ) / sqrLength ) ) );
+        }
+      }
+    }
+    tiedPoints[i] = point.point;
+  }
+
+  // Points tied to the same arc are also connected by the part of the arc between them
+  for ( int i = 0, n = tied->mPoints.size(); i < n; ++i )
+  {
+    for ( int j = 0; j < n; ++j )
+    {
+      const RgTiedGraph::TiedPoint& from = tied->mPoints[i];
+      const RgTiedGraph::TiedPoint& to = tied->mPoints[j];
+      for ( int k = 0; k < from.arcs.size(); ++k )
+      {
+        for ( int l = 0; l < to.arcs.size(); ++l )
+        {
+          if ( from.arcs[k].first == to.arcs[l].first && from.arcs[k].second < to.arcs[l].second )
+          {
+            QgsFeature feature = arcFeature( layer, cached.data(), from.arcs[k].first, features );
+            tied->mDirectParts.insert( qMakePair( i, j ), partCosts( properters, criterionCount, da->measureLine( from.point, to.point ), feature ) );
+          }
+        }
+      }
+    }
+  }
+  return tied;
+}
@@ -0,0 +1,161 @@
+/***************************************************************************
+    graphcache.h - Cache of the routing graphs of the roadgraph plugin
+                             -------------------
+    begin                : December 2015
+    copyright            : (C) 2015 by Sandro Mani
+    email                : manisandro@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef ROADGRAPH_GRAPHCACHE_H
+#define ROADGRAPH_GRAPHCACHE_H
+
+#include <QCache>
+#include <QHash>
+#include <QObject>
+#include <QSharedPointer>
+#include <QVector>
+
+#include <qgspoint.h>
+
+class QgsArcProperter;
+class QgsCompactGraph;
+class QgsCoordinateReferenceSystem;
+class QgsGraph;
+class QgsGraphDirector;
+class QgsSpatialIndex;
+class QgsVectorLayer;
+
+/** A graph kept by the cache, shared with the graphs which have points tied to it */
+struct RgCachedGraph
+{
+  RgCachedGraph( const QgsGraph* graph );
+  ~RgCachedGraph();
+  QgsCompactGraph* graph;
+  /** Number of arc properties computed by the properters of the director, the feature id of the arcs follows them */
+  int criterionCount;
+  /** Bounding boxes of the arcs by compact arc index, built when points are tied to the graph the first time */
+  QgsSpatialIndex* index;
+};
+
+/**
+ * \class RgTiedGraph
+ * \brief Points tied to a cached graph. The graph is shared with the cache, the tied points are connected to the
+ * end vertices of the arcs they split by the parts of these arcs.
+ */
+class RgTiedGraph
+{
+  public:
+    /** Number of vertices of the graph, without the tied points */
+    int vertexCount() const;
+
+    /**
+     * Returns the shortest path between two tied points, as a graph of the path whose first vertex is the start point
+     * and whose arcs have the costs of all criteria as properties.
+     * @return the path, owned by the caller, or 0 if the points are not tied or the end point is not reachable
+     */
+    QgsGraph* shortestPath( int fromPoint, int toPoint, int criterionNum ) const;
+
+  private:
+    /** A part of a split arc between a tied point and a vertex of the graph */
+    struct Part
+    {
+      int vertex;
+      QVector<double> costs;
+    };
+    struct TiedPoint
+    {
+      TiedPoint() : tied( false ) {}
+      bool tied;
+      QgsPoint point;
+      /** Parts from the point to the vertices */
+      QList<Part> exits;
+      /** Parts from the vertices to the point */
+      QList<Part> entries;
+      /** The arcs the point splits, with the fraction of the arc before it */
+      QList< QPair<int, double> > arcs;
+    };
+
+    QSharedPointer<RgCachedGraph> mGraph;
+    QVector<TiedPoint> mPoints;
+    /** Costs of the parts of an arc between two points tied to it, by ( fromPoint, toPoint ) */
+    QMultiHash< QPair<int, int>, QVector<double> > mDirectParts;
+
+    friend class RgGraphCache;
+};
+
+/**
+ * \class RgGraphCache
+ * \brief Keeps the graphs built by the directors, so that repeated routing requests do not rebuild them.
+ *
+ * Graphs are cached in memory per layer, layer revision, director settings, destination CRS and topology
+ * tolerance. Graphs of unmodified file based layers are additionally stored as binary snapshots in the
+ * settings directory, which are memory mapped when loaded again. Snapshots are invalidated by changes of
+ * any file of the layer (e.g. the .dbf of a shapefile).
+ */
+class RgGraphCache : public QObject
+{
+    Q_OBJECT
+  public:
+    RgGraphCache( QObject* parent = 0 );
+    ~RgGraphCache();
+
+    /**
+     * Returns the graph of the layer with the additional points tied to the nearest arcs.
+     * @param layer the layer the director reads
+     * @param director the director, builds the graph if it is not cached and computes the properties of the split arcs.
+     * A properter recording the feature of each arc is added to it when the graph is built.
+     * @param settingsKey string identifying all director settings
+     * @param crs destination CRS
+     * @param otfEnabled whether the layer is transformed to the destination CRS
+     * @param topologyTolerance vertices closer than the tolerance are merged
+     * @param additionalPoints points to tie to the graph
+     * @param tiedPoints the tied points, ( 0, 0 ) if a point could not be tied
+     * @return the graph, owned by the caller
+     */
+    RgTiedGraph* makeGraph( QgsVectorLayer* layer, QgsGraphDirector* director, const QString& settingsKey,
+                            const QgsCoordinateReferenceSystem& crs, bool otfEnabled, double topologyTolerance,
+                            const QVector< QgsPoint >& additionalPoints, QVector< QgsPoint >& tiedPoints );
+
+    /** Removes all graphs from the memory cache */
+    void clear();
+
+  private slots:
+    void layerChanged();
+    void layersRemoved( const QStringList& layerIds );
+
+  private:
+    struct Entry
+    {
+      Entry( const QSharedPointer<RgCachedGraph>& g ) : graph( g ) {}
+      QSharedPointer<RgCachedGraph> graph;
+    };
+
+    QCache< QString, Entry > mGraphs;
+    QHash< QString, int > mLayerRevisions;
+    QgsArcProperter* mFeatureIdProperter;
+
+    /** Identifies the graph of a file based layer, empty if the layer cannot be identified across sessions */
+    static QString snapshotKey( QgsVectorLayer* layer, const QString& graphKey );
+    /** Modification times and sizes of all files of the layer */
+    static QString snapshotStamp( QgsVectorLayer* layer );
+    static QString snapshotDir();
+    static QString snapshotPath( const QString& key, const QString& stamp );
+    /** Removes the snapshots of older versions of the data and the oldest snapshots above the size limit */
+    static void pruneSnapshots( const QString& currentPath );
+    static QgsGraph* loadSnapshot( const QString& key, const QString& stamp );
+    static void saveSnapshot( const QString& key, const QString& stamp, const QgsGraph* graph );
+    static RgTiedGraph* tiePoints( const QSharedPointer<RgCachedGraph>& graph, QgsVectorLayer* layer, const QgsGraphDirector* director,
+                                   const QgsCoordinateReferenceSystem& crs, bool otfEnabled, double topologyTolerance,
+                                   const QVector< QgsPoint >& additionalPoints, QVector< QgsPoint >& tiedPoints );
+};
+
+#endif // ROADGRAPH_GRAPHCACHE_H
@@ -34,6 +34,7 @@
 
 // Road grap plugin includes
 #include "roadgraphplugin.h"
+#include "graphcache.h"
 #include "shortestpathwidget.h"
 #include "settingsdlg.h"
 #include "speedproperter.h"
@@ -50,6 +51,7 @@
 #include <QLocale>
 #include <QToolBar>
 #include <QPushButton>
+#include <QStringList>
 #include <QDockWidget>
 #include <QVBoxLayout>
 #include <QDebug>
@@ -81,6 +83,7 @@ RoadGraphPlugin::RoadGraphPlugin( QgisInterface * theQgisInterface )
     , mQShortestPathDock( 0 )
 {
   mSettings = new RgLineVectorLayerSettings();
+  mGraphCache = new RgGraphCache( this );
   mTimeUnitName = "h";
   mDistanceUnitName = "km";
   mTopologyToleranceFactor = 0.0;
@@ -197,19 +200,22 @@ QgisInterface* RoadGraphPlugin::iface()
   return mQGisIface;
 }
 
-const QgsGraphDirector* RoadGraphPlugin::director() const
+QgsVectorLayer* RoadGraphPlugin::graphLayer() const
 {
-  QString layerId;
-  QgsVectorLayer *layer = NULL;
   QMap< QString, QgsMapLayer* > mapLayers = QgsMapLayerRegistry::instance()->mapLayers();
   QMap< QString, QgsMapLayer* >::const_iterator it;
   for ( it = mapLayers.begin(); it != mapLayers.end(); ++it )
   {
     if ( it.value()->name() != mSettings->mLayer )
       continue;
-    layer = dynamic_cast< QgsVectorLayer* >( it.value() );
-    break;
+    return dynamic_cast< QgsVectorLayer* >( it.value() );
   }
+  return NULL;
+}
+
+QgsGraphDirector* RoadGraphPlugin::director() const
+{
+  QgsVectorLayer *layer = graphLayer();
   if ( layer == NULL )
     return NULL;
   if ( layer->wkbType() == QGis::WKBLineString
@@ -236,6 +242,24 @@ const QgsGraphDirector* RoadGraphPlugin::director() const
   return NULL;
 }
 
+QString RoadGraphPlugin::directorSettingsKey() const
+{
+  return ( QStringList()
+           << mSettings->mDirection
+           << mSettings->mFirstPointToLastPointDirectionVal
+           << mSettings->mLastPointToFirstPointDirectionVal
+           << mSettings->mBothDirectionVal
+           << QString::number( mSettings->mDefaultDirection )
+           << mSettings->mSpeed
+           << QString::number( mSettings->mDefaultSpeed, 'g', 17 )
+           << QString::number( SpeedUnit::byName( mSettings->mSpeedUnitName ).multipler(), 'g', 17 ) ).join( "|" );
+}
+
+RgGraphCache* RoadGraphPlugin::graphCache() const
+{
+  return mGraphCache;
+}
+
 QString RoadGraphPlugin::timeUnitName()
 {
   return mTimeUnitName;
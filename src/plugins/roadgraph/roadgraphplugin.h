@@ -31,6 +31,8 @@ class QDockWidget;
 
 //forward declarations RoadGraph plugins classes
 class QgsGraphDirector;
+class QgsVectorLayer;
+class RgGraphCache;
 class RgShortestPathWidget;
 class RgLineVectorLayerSettings;
 
@@ -59,7 +61,22 @@ class RoadGraphPlugin: public QObject, public QgisPlugin
     /**
      * return pointer to graph director
      */
-    const QgsGraphDirector* director() const;
+    QgsGraphDirector* director() const;
+
+    /**
+     * return the layer the graph is built from
+     */
+    QgsVectorLayer* graphLayer() const;
+
+    /**
+     * return string identifying the settings of the director
+     */
+    QString directorSettingsKey() const;
+
+    /**
+     * return the cache of the built graphs
+     */
+    RgGraphCache* graphCache() const;
 
     /**
      * get time unit name
@@ -138,6 +155,11 @@ class RoadGraphPlugin: public QObject, public QgisPlugin
      */
     RgLineVectorLayerSettings *mSettings;
 
+    /**
+     * built graphs
+     */
+    RgGraphCache *mGraphCache;
+
     /**
      *  time unit for results presentation
      */
@@ -47,6 +47,7 @@
 
 // roadgraph plugin includes
 #include "roadgraphplugin.h"
+#include "graphcache.h"
 #include "shortestpathwidget.h"
 #include "exportdlg.h"
 #include "units.h"
@@ -240,12 +241,9 @@ QgsGraph* RgShortestPathWidget::getPath( QgsPoint& p1, QgsPoint& p2 )
     return NULL;
   }
 
-  QgsGraphBuilder builder(
-    mPlugin->iface()->mapCanvas()->mapSettings().destinationCrs(),
-    mPlugin->iface()->mapCanvas()->mapSettings().hasCrsTransformEnabled(),
-    mPlugin->topologyToleranceFactor() );
+  RgTiedGraph *graph = NULL;
   {
-    const QgsGraphDirector *director = mPlugin->director();
+    QgsGraphDirector *director = mPlugin->director();
     if ( director == NULL )
     {
       QMessageBox::critical( this, tr( "Plugin isn't configured" ), tr( "Plugin isn't configured!" ) );
@@ -259,7 +257,12 @@ QgsGraph* RgShortestPathWidget::getPath( QgsPoint& p1, QgsPoint& p2 )
 
     points.push_back( mFrontPoint );
     points.push_back( mBackPoint );
-    director->makeGraph( &builder, points, tiedPoint );
+    // The graph is only built by the director if it is not cached yet
+    graph = mPlugin->graphCache()->makeGraph(
+              mPlugin->graphLayer(), director, mPlugin->directorSettingsKey(),
+              mPlugin->iface()->mapCanvas()->mapSettings().destinationCrs(),
+              mPlugin->iface()->mapCanvas()->mapSettings().hasCrsTransformEnabled(),
+              mPlugin->topologyToleranceFactor(), points, tiedPoint );
 
     p1 = tiedPoint[ 0 ];
     p2 = tiedPoint[ 1 ];
@@ -270,26 +273,12 @@ QgsGraph* RgShortestPathWidget::getPath( QgsPoint& p1, QgsPoint& p2 )
   if ( p1 == QgsPoint( 0.0, 0.0 ) )
   {
     QMessageBox::critical( this, tr( "Tie point failed" ), tr( "Start point doesn't tie to the road!" ) );
+    delete graph;
     return NULL;
   }
   if ( p2 == QgsPoint( 0.0, 0.0 ) )
   {
     QMessageBox::critical( this, tr( "Tie point failed" ), tr( "Stop point doesn't tie to the road!" ) );
-    return NULL;
-  }
-
-  QgsGraph *graph = builder.graph();
-
-  int startVertexIdx = graph->findVertex( p1 );
-  if ( startVertexIdx < 0 )
-  {
-    mPlugin->iface()->messageBar()->pushMessage(
-      tr( "Cannot calculate path" ),
-      tr( "Could not find start vertex. Please check your input data." ),
-      QgsMessageBar::WARNING,
-      mPlugin->iface()->messageTimeout()
-    );
-
     delete graph;
     return NULL;
   }
@@ -312,12 +301,12 @@ QgsGraph* RgShortestPathWidget::getPath( QgsPoint& p1, QgsPoint& p2 )
   }
 
 
-  QgsGraph* shortestpathTree = QgsGraphAnalyzer::shortestTree( graph, startVertexIdx, criterionNum );
+  // Only the path to the stop point is searched, on the graph shared with the cache
+  QgsGraph* shortestpathTree = graph->shortestPath( 0, 1, criterionNum );
   delete graph;
 
-  if ( shortestpathTree->findVertex( p2 ) == -1 )
+  if ( shortestpathTree == NULL )
   {
-    delete shortestpathTree;
     QMessageBox::critical( this, tr( "Path not found" ), tr( "Path not found" ) );
     return NULL;
   }
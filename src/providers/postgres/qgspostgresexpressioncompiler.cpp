@@ -0,0 +1,53 @@
+/***************************************************************************
+    qgspostgresexpressioncompiler.cpp
+    ---------------------
+    begin                : October 2016
+    copyright            : (C) 2016 by Sandro Mani
+    email                : manisandro@gmail.com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgspostgresexpressioncompiler.h"
+#include "qgspostgresconn.h"
+
+QgsPostgresExpressionCompiler::QgsPostgresExpressionCompiler( const QgsFields& fields )
+    : QgsSqlExpressionCompiler( fields )
+{
+}
+
+QString QgsPostgresExpressionCompiler::quotedIdentifier( const QString& identifier )
+{
+  return QgsPostgresConn::quotedIdentifier( identifier );
+}
+
+QString QgsPostgresExpressionCompiler::quotedValue( const QVariant& value )
+{
+  return QgsPostgresConn::quotedValue( value );
+}
+
+QgsSqlExpressionCompiler::OperandType QgsPostgresExpressionCompiler::fieldType( const QgsField& field )
+{
+  // many types (uuid, hstore, dates, ...) are read as strings, but cannot be compared with any string
+  if ( field.type() == QVariant::String && field.typeName() != "text" && field.typeName() != "varchar" )
+  {
+    return InvalidOperand;
+  }
+  // numeric compares decimal values and float4 single precision values, not the doubles of the expression
+  if ( field.typeName() == "numeric" || field.typeName() == "float4" )
+  {
+    return InvalidOperand;
+  }
+  return QgsSqlExpressionCompiler::fieldType( field );
+}
+
+QgsSqlExpressionCompiler::Result QgsPostgresExpressionCompiler::compileLike( QgsExpression::BinaryOperator op, const QString& left, const QString& pattern, QString& result )
+{
+  result = QString( "%1 %2 %3" ).arg( left, QgsExpression::BinaryOperatorText[op], quotedValue( pattern ) );
+  return Complete;
+}
@@ -15,6 +15,7 @@
 #include "qgspostgresfeatureiterator.h"
 #include "qgspostgresprovider.h"
 #include "qgspostgresconnpool.h"
+#include "qgspostgresexpressioncompiler.h"
 #include "qgspostgrestransaction.h"
 #include "qgsgeometry.h"
 
@@ -32,6 +33,7 @@ QgsPostgresFeatureIterator::QgsPostgresFeatureIterator( QgsPostgresFeatureSource
     , mFeatureQueueSize( sFeatureQueueSize )
     , mFetched( 0 )
     , mFetchGeometry( false )
+    , mExpressionCompiled( false )
 {
   if ( !source->mTransactionConnection )
   {
@@ -57,7 +59,7 @@ QgsPostgresFeatureIterator::QgsPostgresFeatureIterator( QgsPostgresFeatureSource
 
   if ( request.filterType() == QgsFeatureRequest::FilterRect && !mSource->mGeometryColumn.isNull() )
   {
-    whereClause = whereClauseRect();
+    whereClause = whereClauseRect( mRequest.filterRect() );
   }
   else if ( request.filterType() == QgsFeatureRequest::FilterFid )
   {
@@ -67,6 +69,24 @@ QgsPostgresFeatureIterator::QgsPostgresFeatureIterator( QgsPostgresFeatureSource
   {
     whereClause = QgsPostgresUtils::whereClause( mRequest.filterFids(), mSource->mFields, mConn, mSource->mPrimaryKeyType, mSource->mPrimaryKeyAttrs, mSource->mShared );
   }
+  else if ( request.filterType() == QgsFeatureRequest::FilterExpression && QgsSqlExpressionCompiler::compileExpressions() )
+  {
+    // let the database filter the features with the parts of the expression it understands
+    QgsPostgresExpressionCompiler compiler( mSource->mFields );
+    QgsSqlExpressionCompiler::Result result = compiler.compile( mRequest.filterExpression() );
+    if ( result == QgsSqlExpressionCompiler::Complete || result == QgsSqlExpressionCompiler::Partial )
+    {
+      whereClause = compiler.result();
+      if ( !compiler.filterRect().isNull() && !mSource->mGeometryColumn.isNull() )
+      {
+        if ( !whereClause.isEmpty() )
+          whereClause += " AND ";
+
+        whereClause += "(" + whereClauseRect( compiler.filterRect() ) + ")";
+      }
+      mExpressionCompiled = result == QgsSqlExpressionCompiler::Complete;
+    }
+  }
 
   if ( !mSource->mSqlWhereClause.isEmpty() )
   {
@@ -93,6 +113,15 @@ QgsPostgresFeatureIterator::~QgsPostgresFeatureIterator()
 }
 
 
+bool QgsPostgresFeatureIterator::nextFeatureFilterExpression( QgsFeature& f )
+{
+  if ( mExpressionCompiled )
+    return fetchFeature( f );
+  else
+    return QgsAbstractFeatureIterator::nextFeatureFilterExpression( f );
+}
+
+
 bool QgsPostgresFeatureIterator::fetchFeature( QgsFeature& feature )
 {
   feature.setValid( false );
@@ -235,9 +264,8 @@ bool QgsPostgresFeatureIterator::close()
 
 ///////////////
 
-QString QgsPostgresFeatureIterator::whereClauseRect()
+QString QgsPostgresFeatureIterator::whereClauseRect( QgsRectangle rect )
 {
-  QgsRectangle rect = mRequest.filterRect();
   if ( mSource->mSpatialColType == sctGeography )
   {
     rect = QgsRectangle( -180.0, -90.0, 180.0, 90.0 ).intersect( &rect );
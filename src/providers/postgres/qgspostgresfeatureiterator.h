@@ -84,13 +84,16 @@ class QgsPostgresFeatureIterator : public QgsAbstractFeatureIteratorFromSource<Q
     //! fetch next feature, return true on success
     virtual bool fetchFeature( QgsFeature& feature ) override;
 
+    //! skips the client side evaluation if the database evaluates the whole expression
+    virtual bool nextFeatureFilterExpression( QgsFeature& f ) override;
+
     //! Setup the simplification of geometries to fetch using the specified simplify method
     virtual bool prepareSimplification( const QgsSimplifyMethod& simplifyMethod ) override;
 
     QgsPostgresConn* mConn;
 
 
-    QString whereClauseRect();
+    QString whereClauseRect( QgsRectangle rect );
     bool getFeature( QgsPostgresResult &queryResult, int row, QgsFeature &feature );
     void getFeatureAttribute( int idx, QgsPostgresResult& queryResult, int row, int& col, QgsFeature& feature );
     bool declareCursor( const QString& whereClause );
@@ -114,6 +117,9 @@ class QgsPostgresFeatureIterator : public QgsAbstractFeatureIteratorFromSource<Q
 
     bool mIsTransactionConnection;
 
+    //! Set to true, if the database evaluates the whole filter expression
+    bool mExpressionCompiled;
+
     static const int sFeatureQueueSize;
 
   private:
@@ -0,0 +1,97 @@
+/***************************************************************************
+    qgsspatialiteexpressioncompiler.cpp
+    ---------------------
+    begin                : October 2016
+    copyright            : (C) 2016 by Sandro Mani
+    email                : manisandro@gmail.com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsspatialiteexpressioncompiler.h"
+
+QgsSpatiaLiteExpressionCompiler::QgsSpatiaLiteExpressionCompiler( const QgsFields& fields )
+    : QgsSqlExpressionCompiler( fields )
+{
+}
+
+QString QgsSpatiaLiteExpressionCompiler::quotedIdentifier( const QString& identifier )
+{
+  // same quoting as QgsSpatiaLiteProvider, the compiler does not depend on the provider
+  QString id( identifier );
+  id.replace( "\"", "\"\"" );
+  return id.prepend( "\"" ).append( "\"" );
+}
+
+QString QgsSpatiaLiteExpressionCompiler::quotedValue( const QVariant& value )
+{
+  if ( value.isNull() )
+    return "NULL";
+
+  switch ( value.type() )
+  {
+    case QVariant::Int:
+    case QVariant::LongLong:
+    case QVariant::Double:
+      return value.toString();
+
+    default:
+    {
+      QString v = value.toString();
+      v.replace( "'", "''" );
+      return v.prepend( "'" ).append( "'" );
+    }
+  }
+}
+
+QgsSqlExpressionCompiler::OperandType QgsSpatiaLiteExpressionCompiler::fieldType( const QgsField& field )
+{
+  // only columns with text affinity compare like strings, blobs and untyped columns are read as strings too
+  if ( field.type() == QVariant::String )
+  {
+    QString typeName = field.typeName().toUpper();
+    if ( !typeName.contains( "CHAR" ) && !typeName.contains( "CLOB" ) && !typeName.contains( "TEXT" ) )
+    {
+      return InvalidOperand;
+    }
+  }
+  return QgsSqlExpressionCompiler::fieldType( field );
+}
+
+QgsSqlExpressionCompiler::Result QgsSpatiaLiteExpressionCompiler::compileLike( QgsExpression::BinaryOperator op, const QString& left, const QString& pattern, QString& result )
+{
+  // the LIKE of SQLite ignores the case of ASCII characters
+  bool ascii = true;
+  for ( int i = 0; i < pattern.length() && ascii; ++i )
+  {
+    ascii = pattern[i].unicode() < 128;
+  }
+
+  switch ( op )
+  {
+    case QgsExpression::boLike:
+      // the case sensitive check is done by the client
+      result = QString( "%1 LIKE %2" ).arg( left, quotedValue( pattern ) );
+      return Partial;
+
+    case QgsExpression::boILike:
+      if ( !ascii )
+        return Fail;
+      result = QString( "%1 LIKE %2" ).arg( left, quotedValue( pattern ) );
+      return Complete;
+
+    case QgsExpression::boNotILike:
+      if ( !ascii )
+        return Fail;
+      result = QString( "%1 NOT LIKE %2" ).arg( left, quotedValue( pattern ) );
+      return Complete;
+
+    default:
+      return Fail;
+  }
+}
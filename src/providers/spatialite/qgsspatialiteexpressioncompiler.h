@@ -0,0 +1,33 @@
+/***************************************************************************
+    qgsspatialiteexpressioncompiler.h
+    ---------------------
+    begin                : October 2016
+    copyright            : (C) 2016 by Sandro Mani
+    email                : manisandro@gmail.com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QGSSPATIALITEEXPRESSIONCOMPILER_H
+#define QGSSPATIALITEEXPRESSIONCOMPILER_H
+
+#include "qgssqlexpressioncompiler.h"
+
+/** Compiles feature request expressions to SQLite WHERE clauses */
+class QgsSpatiaLiteExpressionCompiler : public QgsSqlExpressionCompiler
+{
+  public:
+    explicit QgsSpatiaLiteExpressionCompiler( const QgsFields& fields );
+
+  protected:
+    virtual QString quotedIdentifier( const QString& identifier ) override;
+    virtual QString quotedValue( const QVariant& value ) override;
+    virtual OperandType fieldType( const QgsField& field ) override;
+    virtual Result compileLike( QgsExpression::BinaryOperator op, const QString& left, const QString& pattern, QString& result ) override;
+};
+
+#endif // QGSSPATIALITEEXPRESSIONCOMPILER_H
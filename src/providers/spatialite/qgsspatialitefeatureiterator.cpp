@@ -16,6 +16,7 @@
 
 #include "qgsspatialiteconnection.h"
 #include "qgsspatialiteconnpool.h"
+#include "qgsspatialiteexpressioncompiler.h"
 #include "qgsspatialiteprovider.h"
 
 #include "qgslogger.h"
@@ -26,6 +27,7 @@
 QgsSpatiaLiteFeatureIterator::QgsSpatiaLiteFeatureIterator( QgsSpatiaLiteFeatureSource* source, bool ownSource, const QgsFeatureRequest& request )
     : QgsAbstractFeatureIteratorFromSource<QgsSpatiaLiteFeatureSource>( source, ownSource, request )
     , sqliteStatement( NULL )
+    , mExpressionCompiled( false )
 {
 
   mHandle = QgsSpatiaLiteConnPool::instance()->acquireConnection( mSource->mSqlitePath );
@@ -36,7 +38,7 @@ QgsSpatiaLiteFeatureIterator::QgsSpatiaLiteFeatureIterator( QgsSpatiaLiteFeature
   if ( request.filterType() == QgsFeatureRequest::FilterRect && !mSource->mGeometryColumn.isNull() )
   {
     // some kind of MBR spatial filtering is required
-    whereClause += whereClauseRect();
+    whereClause += whereClauseRect( mRequest.filterRect() );
   }
 
   if ( request.filterType() == QgsFeatureRequest::FilterFid )
@@ -49,6 +51,25 @@ QgsSpatiaLiteFeatureIterator::QgsSpatiaLiteFeatureIterator( QgsSpatiaLiteFeature
     whereClause += whereClauseFids();
   }
 
+  if ( request.filterType() == QgsFeatureRequest::FilterExpression && QgsSqlExpressionCompiler::compileExpressions() )
+  {
+    // let SQLite filter the features with the parts of the expression it understands
+    QgsSpatiaLiteExpressionCompiler compiler( mSource->mFields );
+    QgsSqlExpressionCompiler::Result result = compiler.compile( mRequest.filterExpression() );
+    if ( result == QgsSqlExpressionCompiler::Complete || result == QgsSqlExpressionCompiler::Partial )
+    {
+      whereClause += compiler.result();
+      if ( !compiler.filterRect().isNull() && !mSource->mGeometryColumn.isNull() )
+      {
+        if ( !whereClause.isEmpty() )
+          whereClause += " AND ";
+
+        whereClause += "(" + whereClauseRect( compiler.filterRect() ) + ")";
+      }
+      mExpressionCompiled = result == QgsSqlExpressionCompiler::Complete;
+    }
+  }
+
   if ( !mSource->mSubsetString.isEmpty() )
   {
     if ( !whereClause.isEmpty() )
@@ -74,6 +95,15 @@ QgsSpatiaLiteFeatureIterator::~QgsSpatiaLiteFeatureIterator()
 }
 
 
+bool QgsSpatiaLiteFeatureIterator::nextFeatureFilterExpression( QgsFeature& f )
+{
+  if ( mExpressionCompiled )
+    return fetchFeature( f );
+  else
+    return QgsAbstractFeatureIterator::nextFeatureFilterExpression( f );
+}
+
+
 bool QgsSpatiaLiteFeatureIterator::fetchFeature( QgsFeature& feature )
 {
   if ( mClosed )
@@ -211,9 +241,8 @@ QString QgsSpatiaLiteFeatureIterator::whereClauseFids()
   return whereClauses.isEmpty() ? "" : whereClauses.join( " OR " ).prepend( "(" ).append( ")" );
 }
 
-QString QgsSpatiaLiteFeatureIterator::whereClauseRect()
+QString QgsSpatiaLiteFeatureIterator::whereClauseRect( const QgsRectangle& rect )
 {
-  QgsRectangle rect = mRequest.filterRect();
   QString whereClause;
 
   if ( mRequest.flags() & QgsFeatureRequest::ExactIntersect )
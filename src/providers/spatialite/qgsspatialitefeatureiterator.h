@@ -69,7 +69,10 @@ class QgsSpatiaLiteFeatureIterator : public QgsAbstractFeatureIteratorFromSource
     //! fetch next feature, return true on success
     virtual bool fetchFeature( QgsFeature& feature ) override;
 
-    QString whereClauseRect();
+    //! skips the client side evaluation if SQLite evaluates the whole expression
+    virtual bool nextFeatureFilterExpression( QgsFeature& f ) override;
+
+    QString whereClauseRect( const QgsRectangle& rect );
     QString whereClauseFid();
     QString whereClauseFids();
     QString mbr( const QgsRectangle& rect );
@@ -93,6 +96,9 @@ class QgsSpatiaLiteFeatureIterator : public QgsAbstractFeatureIteratorFromSource
 
     //! Set to true, if geometry is in the requested columns
     bool mFetchGeometry;
+
+    //! Set to true, if SQLite evaluates the whole filter expression
+    bool mExpressionCompiled;
 };
 
 #endif // QGSSPATIALITEFEATUREITERATOR_H
@@ -17,28 +17,111 @@
 
 #include "qgsnetworkaccessmanager.h"
 #include "qgsapplication.h"
+#include "qgslogger.h"
 #include <QAbstractNetworkCache>
-#include <QImage>
+#include <QCoreApplication>
+#include <QNetworkReply>
+#include <QSettings>
+#include <QThread>
+#include <QtConcurrentRun>
 
-QCache<QUrl, QImage> QgsTileCache::sTileCache( 256 );
-QMutex QgsTileCache::sTileCacheMutex;
+#include <limits>
 
+QgsTileCache::Shard QgsTileCache::sShards[QgsTileCache::sShardCount];
+QAtomicInt QgsTileCache::sShardsInitialized;
+QMutex QgsTileCache::sInitMutex;
+QAtomicInt QgsTileCache::sHits;
+QAtomicInt QgsTileCache::sMisses;
+QAtomicInt QgsTileCache::sEvictions;
+QAtomicInt QgsTileCache::sStoreCompressed;
 
-void QgsTileCache::insertTile( const QUrl &url, const QImage &image )
+
+void QgsTileCache::initShards()
+{
+  QSettings s;
+  qint64 maxCost = s.value( "/Qgis/tileCacheSize", 64 ).toLongLong() * 1024 * 1024;
+  for ( int i = 0; i < sShardCount; ++i )
+  {
+    QMutexLocker locker( &sShards[i].mutex );
+    sShards[i].cache.setMaxCost( shardCost( maxCost ) );
+  }
+  setStoreCompressed( s.value( "/Qgis/tileCacheCompressed", false ).toBool() );
+}
+
+int QgsTileCache::shardCost( qint64 maxCost )
+{
+  return qBound( qint64( 0 ), maxCost / sShardCount, qint64( std::numeric_limits<int>::max() ) );
+}
+
+QgsTileCache::Shard* QgsTileCache::shards()
+{
+  // initialized explicitly, the initialization of function statics is not thread safe with all compilers
+  if ( !sShardsInitialized.testAndSetAcquire( 1, 1 ) )
+  {
+    QMutexLocker locker( &sInitMutex );
+    if ( !sShardsInitialized.testAndSetAcquire( 1, 1 ) )
+    {
+      initShards();
+      sShardsInitialized.fetchAndStoreRelease( 1 );
+    }
+  }
+  return sShards;
+}
+
+QgsTileCache::Shard& QgsTileCache::shard( const QUrl &url )
+{
+  return shards()[qHash( url ) % sShardCount];
+}
+
+void QgsTileCache::insertIntoShard( Shard &shard, const QUrl &url, Tile *tile, int cost )
+{
+  QMutexLocker locker( &shard.mutex );
+  int count = shard.cache.count() + ( shard.cache.contains( url ) ? 0 : 1 );
+  if ( shard.cache.insert( url, tile, cost ) )
+  {
+    sEvictions.fetchAndAddRelaxed( count - shard.cache.count() );
+  }
+}
+
+void QgsTileCache::insertTile( const QUrl &url, const QImage &image, const QByteArray &encodedData )
 {
-  QMutexLocker locker( &sTileCacheMutex );
-  sTileCache.insert( url, new QImage( image ) );
+  Tile *tile = new Tile;
+  int cost;
+  if ( storeCompressed() && !encodedData.isEmpty() )
+  {
+    tile->data = encodedData;
+    cost = encodedData.size();
+  }
+  else if ( !image.isNull() )
+  {
+    tile->image = image;
+    cost = image.byteCount();
+  }
+  else
+  {
+    delete tile;
+    return;
+  }
+  insertIntoShard( shard( url ), url, tile, qMax( cost, 1 ) );
 }
 
 bool QgsTileCache::tile( const QUrl &url, QImage &image )
 {
-  QMutexLocker locker( &sTileCacheMutex );
-  if ( QImage *i = sTileCache.object( url ) )
+  Shard &s = shard( url );
+  s.mutex.lock();
+  if ( Tile *t = s.cache.object( url ) )
   {
-    image = *i;
+    // the image data is implicitly shared, decode outside of the lock
+    Tile cached = *t;
+    s.mutex.unlock();
+    sHits.ref();
+    image = cached.image.isNull() ? QImage::fromData( cached.data ) : cached.image;
     return true;
   }
-  else if ( QgsNetworkAccessManager::instance()->cache()->metaData( url ).isValid() )
+  s.mutex.unlock();
+  sMisses.ref();
+
+  if ( QgsNetworkAccessManager::instance()->cache()->metaData( url ).isValid() )
   {
     if ( QIODevice *data = QgsNetworkAccessManager::instance()->cache()->data( url ) )
     {
@@ -47,11 +130,178 @@ bool QgsTileCache::tile( const QUrl &url, QImage &image )
 
       image = QImage::fromData( imageData );
 
-      // cache it as well (mutex is already locked)
-      sTileCache.insert( url, new QImage( image ) );
+      // cache it as well
+      insertTile( url, image, imageData );
 
       return true;
     }
   }
   return false;
 }
+
+bool QgsTileCache::contains( const QUrl &url )
+{
+  Shard &s = shard( url );
+  QMutexLocker locker( &s.mutex );
+  return s.cache.contains( url );
+}
+
+void QgsTileCache::prefetchTiles( const QString &source, const QList<QNetworkRequest> &requests, int tileCost )
+{
+  // tiles which do not fit in a shard are never cached
+  qint64 maxTiles = 0;
+  if ( tileCost > 0 && tileCost <= maxCost() / sShardCount )
+    maxTiles = maxCost() / 4 / tileCost;
+
+  QList<QNetworkRequest> missing;
+  Q_FOREACH ( const QNetworkRequest& request, requests )
+  {
+    if ( missing.size() >= maxTiles )
+      break;
+    if ( !contains( request.url() ) )
+      missing << request;
+  }
+  QgsTilePrefetcher::instance()->prefetch( source, missing );
+}
+
+qint64 QgsTileCache::totalCost()
+{
+  qint64 cost = 0;
+  Shard *s = shards();
+  for ( int i = 0; i < sShardCount; ++i )
+  {
+    QMutexLocker locker( &s[i].mutex );
+    cost += s[i].cache.totalCost();
+  }
+  return cost;
+}
+
+qint64 QgsTileCache::maxCost()
+{
+  Shard *s = shards();
+  QMutexLocker locker( &s[0].mutex );
+  return qint64( s[0].cache.maxCost() ) * sShardCount;
+}
+
+void QgsTileCache::setMaxCost( qint64 maxCost )
+{
+  Shard *s = shards();
+  for ( int i = 0; i < sShardCount; ++i )
+  {
+    QMutexLocker locker( &s[i].mutex );
+    int count = s[i].cache.count();
+    s[i].cache.setMaxCost( shardCost( maxCost ) );
+    sEvictions.fetchAndAddRelaxed( count - s[i].cache.count() );
+  }
+}
+
+bool QgsTileCache::storeCompressed()
+{
+  return sStoreCompressed;
+}
+
+void QgsTileCache::setStoreCompressed( bool compressed )
+{
+  sStoreCompressed = compressed ? 1 : 0;
+}
+
+void QgsTileCache::resetStatistics()
+{
+  sHits = 0;
+  sMisses = 0;
+  sEvictions = 0;
+}
+
+
+static void decodePrefetchedTile( const QUrl &url, const QByteArray &data )
+{
+  QImage image = QImage::fromData( data );
+  if ( !image.isNull() )
+    QgsTileCache::insertTile( url, image, data );
+}
+
+QgsTilePrefetcher* QgsTilePrefetcher::sInstance = nullptr;
+QMutex QgsTilePrefetcher::sInstanceMutex;
+
+QgsTilePrefetcher* QgsTilePrefetcher::instance()
+{
+  // called from the render threads
+  QMutexLocker locker( &sInstanceMutex );
+  if ( !sInstance )
+    sInstance = new QgsTilePrefetcher();
+  return sInstance;
+}
+
+QgsTilePrefetcher::QgsTilePrefetcher()
+{
+  // the downloads need an event loop, which the render threads do not run after rendering
+  moveToThread( QCoreApplication::instance()->thread() );
+}
+
+void QgsTilePrefetcher::prefetch( const QString &source, const QList<QNetworkRequest> &requests )
+{
+  QMutexLocker locker( &mQueueMutex );
+  // tiles around a previous view are not interesting anymore
+  if ( requests.isEmpty() )
+    mQueues.remove( source );
+  else
+    mQueues[source] = requests;
+  locker.unlock();
+  QMetaObject::invokeMethod( this, "processQueue", Qt::QueuedConnection );
+}
+
+void QgsTilePrefetcher::processQueue()
+{
+  while ( mReplies.size() < sMaxReplies )
+  {
+    QMutexLocker locker( &mQueueMutex );
+    if ( mQueues.isEmpty() )
+      return;
+    QMap<QString, QList<QNetworkRequest> >::iterator it = mQueues.upperBound( mLastSource );
+    if ( it == mQueues.end() )
+      it = mQueues.begin();
+    mLastSource = it.key();
+    QNetworkRequest request = it->takeFirst();
+    if ( it->isEmpty() )
+      mQueues.erase( it );
+    locker.unlock();
+
+    if ( QgsTileCache::contains( request.url() ) )
+      continue;
+
+    QNetworkReply *reply = QgsNetworkAccessManager::instance()->get( request );
+    connect( reply, SIGNAL( finished() ), this, SLOT( replyFinished() ) );
+    mReplies << reply;
+  }
+}
+
+void QgsTilePrefetcher::replyFinished()
+{
+  QNetworkReply *reply = qobject_cast<QNetworkReply*>( sender() );
+  mReplies.removeOne( reply );
+  reply->deleteLater();
+
+  QVariant status = reply->attribute( QNetworkRequest::HttpStatusCodeAttribute );
+  QString contentType = reply->header( QNetworkRequest::ContentTypeHeader ).toString();
+  if ( reply->error() == QNetworkReply::NoError && ( status.isNull() || status.toInt() == 200 ) &&
+       ( contentType.startsWith( "image/", Qt::CaseInsensitive ) || contentType.compare( "application/octet-stream", Qt::CaseInsensitive ) == 0 ) )
+  {
+    QByteArray data = reply->readAll();
+    if ( QgsTileCache::storeCompressed() )
+    {
+      // decoded when the tile is drawn
+      QgsTileCache::insertTile( reply->request().url(), QImage(), data );
+    }
+    else
+    {
+      // do not block the main thread with decoding
+      QtConcurrent::run( decodePrefetchedTile, reply->request().url(), data );
+    }
+  }
+  else
+  {
+    QgsDebugMsg( QString( "Tile prefetch failed [%1]" ).arg( reply->url().toString() ) );
+  }
+
+  processQueue();
+}
@@ -17,17 +17,26 @@
 #define QGSTILECACHE_H
 
 
+#include <QAtomicInt>
 #include <QCache>
+#include <QImage>
+#include <QMap>
 #include <QMutex>
+#include <QNetworkRequest>
+#include <QObject>
 
-class QImage;
+class QNetworkReply;
 class QUrl;
 
 /** A simple tile cache implementation. Tiles are cached according to their URL.
- * There is a small in-memory cache and a secondary caching in the local disk.
+ * There is an in-memory cache and a secondary caching in the local disk.
  * The in-memory cache is there to save CPU time otherwise wasted to read and
  * uncompress data saved on the disk.
  *
+ * The in-memory cache is bounded by the size of the cached tiles in bytes and split
+ * into shards with their own locks, so that render threads do not wait for each other.
+ * Tiles can optionally be stored compressed, they are then decoded when accessed.
+ *
  * The class is thread safe (its methods can be called from any thread).
  */
 class QgsTileCache
@@ -35,22 +44,111 @@ class QgsTileCache
   public:
 
     //! Add a tile image with given URL to the cache
-    static void insertTile( const QUrl &url, const QImage &image );
+    //! If compressed storage is enabled and the encoded image data is given, the encoded data is stored
+    static void insertTile( const QUrl &url, const QImage &image, const QByteArray &encodedData = QByteArray() );
 
     //! Try to access a tile and load it into "image" argument
     //! @returns true if the tile exists in the cache
     static bool tile( const QUrl &url, QImage &image );
 
-    //! how many tiles are stored in the in-memory cache
-    static int totalCost() { return sTileCache.totalCost(); }
-    //! how many tiles can be stored in the in-memory cache
-    static int maxCost() { return sTileCache.maxCost(); }
+    //! Whether a tile is in the in-memory cache
+    static bool contains( const QUrl &url );
+
+    //! Loads tiles in the background into the in-memory cache, from the disk cache or the network.
+    //! Replaces the requests of previous calls with the same source which have not been started yet.
+    //! The requests are given by priority. Only as many tiles of the given decoded size in bytes are prefetched
+    //! as fit in a quarter of the in-memory cache, so that they do not evict the tiles of the view.
+    static void prefetchTiles( const QString &source, const QList<QNetworkRequest> &requests, int tileCost );
+
+    //! size of the tiles stored in the in-memory cache in bytes
+    static qint64 totalCost();
+    //! size of the tiles which can be stored in the in-memory cache in bytes
+    static qint64 maxCost();
+    //! set the size of the tiles which can be stored in the in-memory cache in bytes
+    static void setMaxCost( qint64 maxCost );
+
+    //! whether tiles are stored with their encoded data instead of the decoded image
+    static bool storeCompressed();
+    //! set whether tiles are stored with their encoded data, applies to tiles inserted afterwards
+    static void setStoreCompressed( bool compressed );
+
+    //! number of tiles found in the in-memory cache
+    static int hits() { return sHits; }
+    //! number of tiles not found in the in-memory cache
+    static int misses() { return sMisses; }
+    //! number of tiles removed from the in-memory cache to make room for others
+    static int evictions() { return sEvictions; }
+    //! reset the hit, miss and eviction counters
+    static void resetStatistics();
+
+  private:
+    //! cached tile, either the decoded image or the encoded image data
+    struct Tile
+    {
+      QImage image;
+      QByteArray data;
+    };
+
+    //! part of the in-memory cache with its own lock
+    struct Shard
+    {
+      QCache<QUrl, Tile> cache;
+      //! mutex to protect the cache of the shard
+      QMutex mutex;
+    };
+
+    static const int sShardCount = 16;
+
+    //! the shards, initialized from the settings on first use
+    static Shard* shards();
+    static void initShards();
+    static int shardCost( qint64 maxCost );
+    static Shard& shard( const QUrl &url );
+    static void insertIntoShard( Shard &shard, const QUrl &url, Tile *tile, int cost );
+
+    static Shard sShards[sShardCount];
+    static QAtomicInt sShardsInitialized;
+    static QMutex sInitMutex;
+
+    static QAtomicInt sHits;
+    static QAtomicInt sMisses;
+    static QAtomicInt sEvictions;
+    static QAtomicInt sStoreCompressed;
+};
+
+
+/** Downloads the tiles requested by QgsTileCache::prefetchTiles() in the main thread
+ * and inserts them into the tile cache.
+ */
+class QgsTilePrefetcher : public QObject
+{
+    Q_OBJECT
+
+  public:
+    static QgsTilePrefetcher* instance();
+
+    //! Queue the requests, replacing the queued requests of the source which have not been started yet
+    void prefetch( const QString &source, const QList<QNetworkRequest> &requests );
+
+  private slots:
+    void processQueue();
+    void replyFinished();
 
   private:
-    //! in-memory cache
-    static QCache<QUrl, QImage> sTileCache;
-    //! mutex to protect the in-memory cache
-    static QMutex sTileCacheMutex;
+    QgsTilePrefetcher();
+
+    static QgsTilePrefetcher* sInstance;
+    static QMutex sInstanceMutex;
+
+    static const int sMaxReplies = 4;
+
+    //! mutex to protect the queues, which are filled from the render threads
+    QMutex mQueueMutex;
+    //! queued requests per source, the sources take turns
+    QMap<QString, QList<QNetworkRequest> > mQueues;
+    QString mLastSource;
+    //! running replies, only accessed in the main thread
+    QList<QNetworkReply*> mReplies;
 };
 
 #endif // QGSTILECACHE_H
@@ -885,11 +885,107 @@ QImage *QgsWmsProvider::draw( QgsRectangle const &viewExtent, int pixelWidth, in
       QgsWmsTiledImageDownloadHandler handler( dataSourceUri(), mSettings.authorization(), mTileReqNo, requestsFinal, image, viewExtent, mSettings.mSmoothPixmapTransform, feedback );
       handler.downloadBlocking();
     }
+
+    // the tiles of WMS layers without tile matrix sets depend on the view resolution
+    if ( mSettings.mTiled && !( feedback && ( feedback->isPreviewOnly() || feedback->isCanceled() ) ) )
+    {
+      prefetchTiles( tileMode, tm, viewExtent );
+    }
   }
 
   return image;
 }
 
+void QgsWmsProvider::prefetchTiles( QgsTileMode tileMode, const QgsWmtsTileMatrix* tm, const QgsRectangle& viewExtent )
+{
+  QSettings s;
+  if ( !s.value( "/Qgis/tileCachePrefetch", false ).toBool() )
+    return;
+
+  // tiles of one tile ring around the view, for panning
+  TilePositions tiles;
+  int c0, r0, c1, r1;
+  tm->viewExtentIntersection( viewExtent, tileMatrixLimits( tm ), c0, r0, c1, r1 );
+  double twMap = tm->tileWidth * tm->tres;
+  double thMap = tm->tileHeight * tm->tres;
+  QgsRectangle ringExtent( viewExtent.xMinimum() - twMap, viewExtent.yMinimum() - thMap, viewExtent.xMaximum() + twMap, viewExtent.yMaximum() + thMap );
+  int rc0, rr0, rc1, rr1;
+  tm->viewExtentIntersection( ringExtent, tileMatrixLimits( tm ), rc0, rr0, rc1, rr1 );
+  for ( int row = rr0; row <= rr1; row++ )
+  {
+    for ( int col = rc0; col <= rc1; col++ )
+    {
+      if ( row < r0 || row > r1 || col < c0 || col > c1 )
+        tiles << TilePosition( row, col );
+    }
+  }
+
+  TileRequests requests;
+  switch ( tileMode )
+  {
+    case WMSC:
+      createTileRequestsWMSC( tm, tiles, requests );
+      break;
+
+    case WMTS:
+      createTileRequestsWMTS( tm, tiles, requests );
+      break;
+  }
+
+  // tiles of the view in the next higher resolution, for zooming in
+  const QgsWmtsTileMatrix* tmNext = mTileMatrixSet ? mTileMatrixSet->findOtherResolution( tm->tres, -1 ) : nullptr;
+  if ( tmNext )
+  {
+    TilePositions nextTiles;
+    tmNext->viewExtentIntersection( viewExtent, tileMatrixLimits( tmNext ), c0, r0, c1, r1 );
+    for ( int row = r0; row <= r1; row++ )
+    {
+      for ( int col = c0; col <= c1; col++ )
+      {
+        nextTiles << TilePosition( row, col );
+      }
+    }
+
+    TileRequests nextRequests;
+    switch ( tileMode )
+    {
+      case WMSC:
+        createTileRequestsWMSC( tmNext, nextTiles, nextRequests );
+        break;
+
+      case WMTS:
+        createTileRequestsWMTS( tmNext, nextTiles, nextRequests );
+        break;
+    }
+    requests << nextRequests;
+  }
+
+  QList<QNetworkRequest> networkRequests;
+  Q_FOREACH ( const TileRequest& r, requests )
+  {
+    QNetworkRequest request( r.url );
+    mSettings.authorization().setAuthorization( request );
+    request.setAttribute( QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::PreferCache );
+    request.setAttribute( QNetworkRequest::CacheSaveControlAttribute, true );
+    networkRequests << request;
+  }
+  // the tiles of the ring come first and are dropped last if the cache is too small
+  QgsTileCache::prefetchTiles( dataSourceUri(), networkRequests, tm->tileWidth * tm->tileHeight * 4 );
+}
+
+const QgsWmtsTileMatrixLimits* QgsWmsProvider::tileMatrixLimits( const QgsWmtsTileMatrix* tm ) const
+{
+  if ( !mTileLayer || !mTileMatrixSet )
+    return nullptr;
+
+  QHash<QString, QgsWmtsTileMatrixSetLink>::const_iterator setLink = mTileLayer->setLinks.constFind( mTileMatrixSet->identifier );
+  if ( setLink == mTileLayer->setLinks.constEnd() )
+    return nullptr;
+
+  QHash<QString, QgsWmtsTileMatrixLimits>::const_iterator limits = setLink->limits.constFind( tm->identifier );
+  return limits != setLink->limits.constEnd() ? &limits.value() : nullptr;
+}
+
 void QgsWmsProvider::readBlock( int bandNo, QgsRectangle  const & viewExtent, int pixelWidth, int pixelHeight, void *block, QgsRasterBlockFeedback *feedback )
 {
   Q_UNUSED( bandNo );
@@ -3746,7 +3842,8 @@ void QgsWmsTiledImageDownloadHandler::tileReplyFinished()
 
       QgsDebugMsg( QString( "tile reply: length %1" ).arg( reply->bytesAvailable() ) );
 
-      QImage myLocalImage = QImage::fromData( reply->readAll() );
+      QByteArray myLocalImageData = reply->readAll();
+      QImage myLocalImage = QImage::fromData( myLocalImageData );
 
       if ( !myLocalImage.isNull() )
       {
@@ -3763,7 +3860,7 @@ void QgsWmsTiledImageDownloadHandler::tileReplyFinished()
                     .arg( r.right() ).arg( r.top() )
                     .arg( r.width() ).arg( r.height() ) );
 #endif
-        QgsTileCache::insertTile( reply->url(), myLocalImage );
+        QgsTileCache::insertTile( reply->url(), myLocalImage, myLocalImageData );
 
         if ( mFeedback )
         {
@@ -412,6 +412,12 @@ class QgsWmsProvider : public QgsRasterDataProvider
     //! Get tiles from a different resolution to cover the missing areas
     void fetchOtherResTiles( QgsTileMode tileMode, const QgsRectangle& viewExtent, int imageWidth, QList<QRectF>& missing, double tres, int resOffset, QList<TileImage> &otherResTiles );
 
+    //! Load the tiles around the view and the tiles of the next higher resolution into the tile cache in the background
+    void prefetchTiles( QgsTileMode tileMode, const QgsWmtsTileMatrix* tm, const QgsRectangle& viewExtent );
+
+    //! Returns the limits of a tile matrix of the tile layer, nullptr if there are none
+    const QgsWmtsTileMatrixLimits* tileMatrixLimits( const QgsWmtsTileMatrix* tm ) const;
+
     /**
      * Try to get best extent for the layer in given CRS. Returns true on success, false otherwise (layer not found, invalid CRS, transform failed)
      */
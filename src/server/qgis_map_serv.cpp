@@ -38,7 +38,11 @@
 #include "qgsmaplayerregistry.h"
 #include "qgsserverlogger.h"
 #include "qgseditorwidgetregistry.h"
+#include "qgsmetatilecache.h"
 #include "qgsmslayercache.h"
+#include "qgsserverrequestcontext.h"
+
+class QgsServerInterfaceImpl;
 
 #ifdef HAVE_SERVER_PYTHON_PLUGINS
 #include "qgsserverplugins.h"
@@ -52,6 +56,7 @@
 #include <QSettings>
 #include <QDateTime>
 #include <QScopedPointer>
+#include <QThread>
 
 #include <fcgi_stdio.h>
 
@@ -124,45 +129,19 @@ void dummyMessageHandler( QtMsgType type, const char *msg )
 void printRequestInfos()
 {
   QgsMessageLog::logMessage( "********************new request***************", "Server", QgsMessageLog::INFO );
-  if ( getenv( "REMOTE_ADDR" ) != NULL )
-  {
-    QgsMessageLog::logMessage( "remote ip: " + QString( getenv( "REMOTE_ADDR" ) ), "Server", QgsMessageLog::INFO );
-  }
-  if ( getenv( "REMOTE_HOST" ) != NULL )
-  {
-    QgsMessageLog::logMessage( "remote ip: " + QString( getenv( "REMOTE_HOST" ) ), "Server", QgsMessageLog::INFO );
-  }
-  if ( getenv( "REMOTE_USER" ) != NULL )
-  {
-    QgsMessageLog::logMessage( "remote user: " + QString( getenv( "REMOTE_USER" ) ), "Server", QgsMessageLog::INFO );
-  }
-  if ( getenv( "REMOTE_IDENT" ) != NULL )
-  {
-    QgsMessageLog::logMessage( "REMOTE_IDENT: " + QString( getenv( "REMOTE_IDENT" ) ), "Server", QgsMessageLog::INFO );
-  }
-  if ( getenv( "CONTENT_TYPE" ) != NULL )
-  {
-    QgsMessageLog::logMessage( "CONTENT_TYPE: " + QString( getenv( "CONTENT_TYPE" ) ), "Server", QgsMessageLog::INFO );
-  }
-  if ( getenv( "AUTH_TYPE" ) != NULL )
-  {
-    QgsMessageLog::logMessage( "AUTH_TYPE: " + QString( getenv( "AUTH_TYPE" ) ), "Server", QgsMessageLog::INFO );
-  }
-  if ( getenv( "HTTP_USER_AGENT" ) != NULL )
-  {
-    QgsMessageLog::logMessage( "HTTP_USER_AGENT: " + QString( getenv( "HTTP_USER_AGENT" ) ), "Server", QgsMessageLog::INFO );
-  }
-  if ( getenv( "HTTP_PROXY" ) != NULL )
+  QStringList variables;
+  variables << "REMOTE_ADDR" << "REMOTE_HOST" << "REMOTE_USER" << "REMOTE_IDENT" << "CONTENT_TYPE" << "AUTH_TYPE"
+  << "HTTP_USER_AGENT" << "HTTP_PROXY" << "HTTPS_PROXY" << "NO_PROXY";
+  QStringList labels;
+  labels << "remote ip: " << "remote ip: " << "remote user: " << "REMOTE_IDENT: " << "CONTENT_TYPE: " << "AUTH_TYPE: "
+  << "HTTP_USER_AGENT: " << "HTTP_PROXY: " << "HTTPS_PROXY: " << "NO_PROXY: ";
+  for ( int i = 0; i < variables.size(); ++i )
   {
-    QgsMessageLog::logMessage( "HTTP_PROXY: " + QString( getenv( "HTTP_PROXY" ) ), "Server", QgsMessageLog::INFO );
-  }
-  if ( getenv( "HTTPS_PROXY" ) != NULL )
-  {
-    QgsMessageLog::logMessage( "HTTPS_PROXY: " + QString( getenv( "HTTPS_PROXY" ) ), "Server", QgsMessageLog::INFO );
-  }
-  if ( getenv( "NO_PROXY" ) != NULL )
-  {
-    QgsMessageLog::logMessage( "NO_PROXY: " + QString( getenv( "NO_PROXY" ) ), "Server", QgsMessageLog::INFO );
+    QString value = QgsServerRequestContext::getEnv( variables[i] );
+    if ( !value.isNull() )
+    {
+      QgsMessageLog::logMessage( labels[i] + value, "Server", QgsMessageLog::INFO );
+    }
   }
 }
 
@@ -234,10 +213,10 @@ void setupNetworkAccessManager()
 QgsRequestHandler* createRequestHandler()
 {
   QgsRequestHandler* requestHandler = 0;
-  char* requestMethod = getenv( "REQUEST_METHOD" );
-  if ( requestMethod != NULL )
+  QString requestMethod = QgsServerRequestContext::getEnv( "REQUEST_METHOD" );
+  if ( !requestMethod.isNull() )
   {
-    if ( strcmp( requestMethod, "POST" ) == 0 )
+    if ( requestMethod == "POST" )
     {
       //requestHandler = new QgsSOAPRequestHandler();
       requestHandler = new QgsPostRequestHandler();
@@ -257,7 +236,7 @@ QgsRequestHandler* createRequestHandler()
 QString configPath( const QString& defaultConfigPath, const QMap<QString, QString>& parameters )
 {
   QString cfPath( defaultConfigPath );
-  QString projectFile = getenv( "QGIS_PROJECT_FILE" );
+  QString projectFile = QgsServerRequestContext::getEnv( "QGIS_PROJECT_FILE" );
   if ( !projectFile.isEmpty() )
   {
     cfPath = projectFile;
@@ -312,6 +291,188 @@ void setEnvVars( QHash< QString, QString >& envVars )
   }
 }
 
+/**Processes the current request of the calling thread
+  @param serverIface interface of the python plugins, 0 if the plugin filters are not used in the thread*/
+void processRequest( const QString& defaultConfigFilePath, QgsMapRenderer* theMapRenderer, QgsCapabilitiesCache* capabilitiesCache, QgsServerInterfaceImpl* serverIface )
+{
+  int logLevel = QgsServerLogger::instance()->logLevel();
+  QTime time; //used for measuring request time if loglevel < 1
+
+  QgsMapLayerRegistry::instance()->removeAllMapLayers();
+  QCoreApplication::processEvents();
+
+  if ( logLevel < 1 )
+  {
+    time.start();
+    printRequestInfos();
+  }
+
+  //Request handler
+  QScopedPointer<QgsRequestHandler> theRequestHandler( createRequestHandler() );
+
+  try
+  {
+    // TODO: split parse input into plain parse and processing from specific services
+    theRequestHandler->parseInput();
+  }
+  catch ( QgsMapServiceException& e )
+  {
+    QgsMessageLog::logMessage( "Parse input exception: " + e.message(), "Server", QgsMessageLog::CRITICAL );
+    theRequestHandler->setServiceException( e );
+  }
+
+#ifdef HAVE_SERVER_PYTHON_PLUGINS
+  QgsServerFiltersMap pluginFilters;
+  if ( serverIface )
+  {
+    // Set the request handler into the interface for plugins to manipulate it
+    serverIface->setRequestHandler( theRequestHandler.data() );
+    // Store plugin filters for faster access
+    pluginFilters = serverIface->filters();
+  }
+  // Iterate filters and call their requestReady() method
+  QgsServerFiltersMap::const_iterator filtersIterator;
+  for ( filtersIterator = pluginFilters.constBegin(); filtersIterator != pluginFilters.constEnd(); ++filtersIterator )
+  {
+    filtersIterator.value()->requestReady();
+  }
+
+  //Pass the filters to the requestHandler, this is needed for the following reasons:
+  // 1. allow core services to access plugin filters and implement thir own plugin hooks
+  // 2. allow requestHandler to call sendResponse plugin hook
+
+  //TODO: implement this in the requestHandler ctor (far easier if we will get rid of
+  //      HAVE_SERVER_PYTHON_PLUGINS
+  theRequestHandler->setPluginFilters( pluginFilters );
+#else
+  Q_UNUSED( serverIface );
+#endif
+
+  // Copy the parameters map
+  QMap<QString, QString> parameterMap( theRequestHandler->parameterMap() );
+
+  printRequestParameters( parameterMap, logLevel );
+  QMap<QString, QString>::const_iterator paramIt;
+  //Config file path
+  QString configFilePath = configPath( defaultConfigFilePath, parameterMap );
+  //Service parameter
+  QString serviceString = theRequestHandler->parameter( "SERVICE" );
+
+  if ( serviceString.isEmpty() )
+  {
+    // SERVICE not mandatory for WMS 1.3.0 GetMap & GetFeatureInfo
+    QString requestString = theRequestHandler->parameter( "REQUEST" );
+    if ( requestString == "GetMap" || requestString == "GetFeatureInfo" )
+    {
+      serviceString = "WMS";
+    }
+  }
+
+  // Enter core services main switch
+  if ( !theRequestHandler->exceptionRaised() )
+  {
+    if ( serviceString == "WCS" )
+    {
+      QgsWCSProjectParser* p = QgsConfigCache::instance()->wcsConfiguration( configFilePath );
+      if ( !p )
+      {
+        theRequestHandler->setServiceException( QgsMapServiceException( "Project file error", "Error reading the project file" ) );
+      }
+      else
+      {
+        QgsWCSServer wcsServer( configFilePath, parameterMap, p, theRequestHandler.data() );
+        wcsServer.executeRequest();
+      }
+    }
+    else if ( serviceString == "WFS" )
+    {
+      QgsWFSProjectParser* p = QgsConfigCache::instance()->wfsConfiguration( configFilePath );
+      if ( !p )
+      {
+        theRequestHandler->setServiceException( QgsMapServiceException( "Project file error", "Error reading the project file" ) );
+      }
+      else
+      {
+        QgsWFSServer wfsServer( configFilePath, parameterMap, p, theRequestHandler.data() );
+        wfsServer.executeRequest();
+      }
+    }
+    else if ( serviceString == "WMS" )
+    {
+      QgsWMSConfigParser* p = QgsConfigCache::instance()->wmsConfiguration( configFilePath, parameterMap );
+      if ( !p )
+      {
+        theRequestHandler->setServiceException( QgsMapServiceException( "WMS configuration error", "There was an error reading the project file or the SLD configuration" ) );
+      }
+      else
+      {
+        QgsWMSServer wmsServer( configFilePath, parameterMap, p, theRequestHandler.data(), theMapRenderer, capabilitiesCache );
+        wmsServer.executeRequest();
+      }
+    }
+    else
+    {
+      theRequestHandler->setServiceException( QgsMapServiceException( "Service configuration error", "Service unknown or unsupported" ) );
+    } // end switch
+  } // end if not exception raised
+
+#ifdef HAVE_SERVER_PYTHON_PLUGINS
+  // Iterate filters and call their responseComplete() method
+  for ( filtersIterator = pluginFilters.constBegin(); filtersIterator != pluginFilters.constEnd(); ++filtersIterator )
+  {
+    filtersIterator.value()->responseComplete();
+  }
+#endif
+
+  //possibility for client to suggest a download filename
+  QString outputFileName = theRequestHandler->parameter( "FILE_NAME" );
+  if ( !outputFileName.isEmpty() )
+  {
+    theRequestHandler->setDefaultHeaders();
+    theRequestHandler->setHeader( "Content-Disposition", "attachment; filename=\"" + outputFileName + "\"" );
+  }
+
+  theRequestHandler->sendResponse();
+
+  if ( logLevel < 1 )
+  {
+    QgsMessageLog::logMessage( "Request finished in " + QString::number( time.elapsed() ) + " ms", "Server", QgsMessageLog::INFO );
+  }
+
+  //the layers of the request can be used by other threads afterwards
+  QgsMapLayerRegistry::instance()->removeAllMapLayers();
+  QgsMSLayerCache::instance()->releaseLayers();
+}
+
+/**Accepts and processes FastCGI requests in a separate thread*/
+class QgsServerRequestThread: public QThread
+{
+  public:
+    QgsServerRequestThread( const QString& defaultConfigFilePath )
+        : mDefaultConfigFilePath( defaultConfigFilePath )
+    {}
+
+  protected:
+    void run() override
+    {
+      QgsServerRequestContext::initThreadRequest();
+
+      //renderer and capabilities cache are not shared between the threads
+      QgsCapabilitiesCache capabilitiesCache;
+      QgsMapRenderer theMapRenderer;
+      theMapRenderer.setLabelingEngine( new QgsPalLabeling() );
+
+      while ( QgsServerRequestContext::acceptThreadRequest() >= 0 )
+      {
+        processRequest( mDefaultConfigFilePath, &theMapRenderer, &capabilitiesCache, 0 );
+        QgsServerRequestContext::finishThreadRequest();
+      }
+    }
+
+  private:
+    QString mDefaultConfigFilePath;
+};
+
 int main( int argc, char * argv[] )
 {
 #ifndef _MSC_VER
@@ -390,13 +551,19 @@ int main( int argc, char * argv[] )
   QgsFontUtils::loadStandardTestFonts( QStringList() << "Roman" << "Bold" );
 #endif
 
-  int logLevel = QgsServerLogger::instance()->logLevel();
-  QTime time; //used for measuring request time if loglevel < 1
+  //create the logger in the main thread, it receives the log messages of all threads
+  QgsServerLogger::instance();
 
   //init layer cache here (the environment variable MAX_CACHE_LAYERS is not accessible anymore in the fcgi-loop)
   QgsMSLayerCache* cache = QgsMSLayerCache::instance();
   Q_UNUSED( cache );
 
+  //same for the meta tile cache
+  QgsMetaTileCache::instance();
+
+  //and the renderer used for GetMap
+  QgsWMSServer::setUseLegacyRenderer( QString( getenv( "QGIS_SERVER_LEGACY_RENDERER" ) ).toInt() != 0 );
+
 #ifdef HAVE_SERVER_PYTHON_PLUGINS
   // Create the interface
   QgsServerInterfaceImpl serverIface( &capabilitiesCache );
@@ -419,143 +586,51 @@ int main( int argc, char * argv[] )
   QHash< QString, QString > environmentVars;
   saveEnvVars( environmentVars );
 
-  while ( fcgi_accept() >= 0 )
-  {
-    //restore environment variables
-    setEnvVars( environmentVars );
-
-    QgsMapLayerRegistry::instance()->removeAllMapLayers();
-    qgsapp.processEvents();
-
-    if ( logLevel < 1 )
-    {
-      time.start();
-      printRequestInfos();
-    }
-
-    //Request handler
-    QScopedPointer<QgsRequestHandler> theRequestHandler( createRequestHandler() );
-
-    try
-    {
-      // TODO: split parse input into plain parse and processing from specific services
-      theRequestHandler->parseInput();
-    }
-    catch ( QgsMapServiceException& e )
-    {
-      QgsMessageLog::logMessage( "Parse input exception: " + e.message(), "Server", QgsMessageLog::CRITICAL );
-      theRequestHandler->setServiceException( e );
-    }
-
+  //requests are processed in parallel threads if configured. The python plugin filters expect the requests one after the other
+  int nThreads = QString( getenv( "QGIS_SERVER_THREADS" ) ).toInt();
 #ifdef HAVE_SERVER_PYTHON_PLUGINS
-    // Set the request handler into the interface for plugins to manipulate it
-    serverIface.setRequestHandler( theRequestHandler.data() );
-    // Iterate filters and call their requestReady() method
-    QgsServerFiltersMap::const_iterator filtersIterator;
-    for ( filtersIterator = pluginFilters.constBegin(); filtersIterator != pluginFilters.constEnd(); ++filtersIterator )
+  if ( nThreads > 1 && !pluginFilters.isEmpty() )
+  {
+    QgsMessageLog::logMessage( "Server python plugin filters loaded, requests are not processed in parallel", "Server", QgsMessageLog::WARNING );
+    nThreads = 1;
+  }
+#endif
+  if ( nThreads > 1 && !FCGX_IsCGI() )
+  {
+    QgsMessageLog::logMessage( QString( "Processing requests in %1 threads" ).arg( nThreads ), "Server", QgsMessageLog::INFO );
+    QgsMapLayerRegistry::setThreadLocalInstances( true );
+    FCGX_Init();
+    QList<QgsServerRequestThread*> threads;
+    for ( int i = 0; i < nThreads; ++i )
     {
-      filtersIterator.value()->requestReady();
+      QgsServerRequestThread* thread = new QgsServerRequestThread( defaultConfigFilePath );
+      threads << thread;
+      thread->start();
     }
 
-    //Pass the filters to the requestHandler, this is needed for the following reasons:
-    // 1. allow core services to access plugin filters and implement thir own plugin hooks
-    // 2. allow requestHandler to call sendResponse plugin hook
-
-    //TODO: implement this in the requestHandler ctor (far easier if we will get rid of
-    //      HAVE_SERVER_PYTHON_PLUGINS
-    theRequestHandler->setPluginFilters( pluginFilters );
-#endif
-
-    // Copy the parameters map
-    QMap<QString, QString> parameterMap( theRequestHandler->parameterMap() );
-
-    printRequestParameters( parameterMap, logLevel );
-    QMap<QString, QString>::const_iterator paramIt;
-    //Config file path
-    QString configFilePath = configPath( defaultConfigFilePath, parameterMap );
-    //Service parameter
-    QString serviceString = theRequestHandler->parameter( "SERVICE" );
-
-    if ( serviceString.isEmpty() )
+    //the main thread processes the events of the shared objects, e.g. the log messages and the layer cache.
+    //The threads only stop if accepting requests fails
+    foreach ( QgsServerRequestThread* thread, threads )
     {
-      // SERVICE not mandatory for WMS 1.3.0 GetMap & GetFeatureInfo
-      QString requestString = theRequestHandler->parameter( "REQUEST" );
-      if ( requestString == "GetMap" || requestString == "GetFeatureInfo" )
+      while ( !thread->wait( 100 ) )
       {
-        serviceString = "WMS";
+        qgsapp.processEvents();
       }
+      delete thread;
     }
+    return 0;
+  }
 
-    // Enter core services main switch
-    if ( !theRequestHandler->exceptionRaised() )
-    {
-      if ( serviceString == "WCS" )
-      {
-        QgsWCSProjectParser* p = QgsConfigCache::instance()->wcsConfiguration( configFilePath );
-        if ( !p )
-        {
-          theRequestHandler->setServiceException( QgsMapServiceException( "Project file error", "Error reading the project file" ) );
-        }
-        else
-        {
-          QgsWCSServer wcsServer( configFilePath, parameterMap, p, theRequestHandler.data() );
-          wcsServer.executeRequest();
-        }
-      }
-      else if ( serviceString == "WFS" )
-      {
-        QgsWFSProjectParser* p = QgsConfigCache::instance()->wfsConfiguration( configFilePath );
-        if ( !p )
-        {
-          theRequestHandler->setServiceException( QgsMapServiceException( "Project file error", "Error reading the project file" ) );
-        }
-        else
-        {
-          QgsWFSServer wfsServer( configFilePath, parameterMap, p, theRequestHandler.data() );
-          wfsServer.executeRequest();
-        }
-      }
-      else if ( serviceString == "WMS" )
-      {
-        QgsWMSConfigParser* p = QgsConfigCache::instance()->wmsConfiguration( configFilePath, parameterMap );
-        if ( !p )
-        {
-          theRequestHandler->setServiceException( QgsMapServiceException( "WMS configuration error", "There was an error reading the project file or the SLD configuration" ) );
-        }
-        else
-        {
-          QgsWMSServer wmsServer( configFilePath, parameterMap, p, theRequestHandler.data(), theMapRenderer.data(), &capabilitiesCache );
-          wmsServer.executeRequest();
-        }
-      }
-      else
-      {
-        theRequestHandler->setServiceException( QgsMapServiceException( "Service configuration error", "Service unknown or unsupported" ) );
-      } // end switch
-    } // end if not exception raised
+  while ( fcgi_accept() >= 0 )
+  {
+    //restore environment variables
+    setEnvVars( environmentVars );
 
 #ifdef HAVE_SERVER_PYTHON_PLUGINS
-    // Iterate filters and call their responseComplete() method
-    for ( filtersIterator = pluginFilters.constBegin(); filtersIterator != pluginFilters.constEnd(); ++filtersIterator )
-    {
-      filtersIterator.value()->responseComplete();
-    }
+    processRequest( defaultConfigFilePath, theMapRenderer.data(), &capabilitiesCache, &serverIface );
+#else
+    processRequest( defaultConfigFilePath, theMapRenderer.data(), &capabilitiesCache, 0 );
 #endif
-
-    //possibility for client to suggest a download filename
-    QString outputFileName = theRequestHandler->parameter( "FILE_NAME" );
-    if ( !outputFileName.isEmpty() )
-    {
-      theRequestHandler->setDefaultHeaders();
-      theRequestHandler->setHeader( "Content-Disposition", "attachment; filename=\"" + outputFileName + "\"" );
-    }
-
-    theRequestHandler->sendResponse();
-
-    if ( logLevel < 1 )
-    {
-      QgsMessageLog::logMessage( "Request finished in " + QString::number( time.elapsed() ) + " ms", "Server", QgsMessageLog::INFO );
-    }
   }
   return 0;
 }
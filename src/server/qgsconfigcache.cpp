@@ -17,6 +17,7 @@
 
 #include "qgsconfigcache.h"
 #include "qgsmessagelog.h"
+#include "qgsmetatilecache.h"
 #include "qgsmslayercache.h"
 #include "qgswcsprojectparser.h"
 #include "qgswfsprojectparser.h"
@@ -24,15 +25,17 @@
 #include "qgssldconfigparser.h"
 
 #include <QFile>
+#include <QThreadStorage>
 
 QgsConfigCache* QgsConfigCache::instance()
 {
-  static QgsConfigCache *instance = 0;
+  //the parsed documents cannot be shared between the request threads
+  static QThreadStorage<QgsConfigCache*> instances;
 
-  if ( !instance )
-    instance = new QgsConfigCache();
+  if ( !instances.hasLocalData() )
+    instances.setLocalData( new QgsConfigCache() );
 
-  return instance;
+  return instances.localData();
 }
 
 QgsConfigCache::QgsConfigCache()
@@ -174,4 +177,6 @@ void QgsConfigCache::removeChangedEntry( const QString& path )
   mXmlDocumentCache.remove( path );
 
   mFileSystemWatcher.removePath( path );
+
+  QgsMetaTileCache::instance()->removeProjectTiles( path );
 }
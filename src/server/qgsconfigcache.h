@@ -34,6 +34,7 @@ class QgsConfigCache: public QObject
 {
     Q_OBJECT
   public:
+    /**Returns the cache of the calling thread*/
     static QgsConfigCache* instance();
     ~QgsConfigCache();
 
@@ -14,6 +14,7 @@
  ***************************************************************************/
 #include "qgsgetrequesthandler.h"
 #include "qgslogger.h"
+#include "qgsserverrequestcontext.h"
 #include "qgsremotedatasourcebuilder.h"
 #include <QStringList>
 #include <QUrl>
@@ -28,10 +29,10 @@ void QgsGetRequestHandler::parseInput()
 {
   QString queryString;
 
-  const char* qs = getenv( "QUERY_STRING" );
-  if ( qs )
+  QString qs = QgsServerRequestContext::getEnv( "QUERY_STRING" );
+  if ( !qs.isNull() )
   {
-    queryString = QString( qs );
+    queryString = qs;
     QgsDebugMsg( "query string is: " + queryString );
   }
   else
@@ -22,6 +22,7 @@
 #include "qgshttptransaction.h"
 #include "qgslogger.h"
 #include "qgsmapserviceexception.h"
+#include "qgsserverrequestcontext.h"
 #include <QBuffer>
 #include <QByteArray>
 #include <QDomDocument>
@@ -30,7 +31,6 @@
 #include <QTextStream>
 #include <QStringList>
 #include <QUrl>
-#include <fcgi_stdio.h>
 
 QgsHttpRequestHandler::QgsHttpRequestHandler()
     : QgsRequestHandler()
@@ -128,25 +128,27 @@ void QgsHttpRequestHandler::sendHeaders()
     setDefaultHeaders();
   }
 
+  QByteArray headers;
   QMap<QString, QString>::const_iterator it;
   for ( it = mHeaders.constBegin(); it != mHeaders.constEnd(); ++it )
   {
-    printf( it.key().toLocal8Bit() );
-    printf( ": " );
-    printf( it.value().toLocal8Bit() );
-    printf( "\n" );
+    headers.append( it.key().toLocal8Bit() );
+    headers.append( ": " );
+    headers.append( it.value().toLocal8Bit() );
+    headers.append( "\n" );
   }
 
-  printf( "\n" );
+  headers.append( "\n" );
+  QgsServerRequestContext::write( headers.constData(), headers.size() );
   mHeaders.clear();
   mHeadersSent = TRUE;
 }
 
 void QgsHttpRequestHandler::sendBody() const
 {
-  size_t result = fwrite(( void* )mBody.data(), mBody.size(), 1, FCGI_stdout );
+  int result = QgsServerRequestContext::write( mBody.constData(), mBody.size() );
 #ifdef QGISDEBUG
-  QgsDebugMsg( QString( "Sent %1 blocks of %2 bytes" ).arg( result ).arg( mBody.size() ) );
+  QgsDebugMsg( QString( "Sent %1 of %2 bytes" ).arg( result ).arg( mBody.size() ) );
 #else
   Q_UNUSED( result );
 #endif
@@ -610,27 +612,22 @@ void QgsHttpRequestHandler::requestStringToParameterMap( const QString& request,
 
 QString QgsHttpRequestHandler::readPostBody() const
 {
-  char* lengthString = NULL;
   int length = 0;
   char* input = NULL;
   QString inputString;
   QString lengthQString;
 
-  lengthString = getenv( "CONTENT_LENGTH" );
-  if ( lengthString != NULL )
+  lengthQString = QgsServerRequestContext::getEnv( "CONTENT_LENGTH" );
+  if ( !lengthQString.isNull() )
   {
     bool conversionSuccess = false;
-    lengthQString = QString( lengthString );
     length = lengthQString.toInt( &conversionSuccess );
     QgsDebugMsg( "length is: " + lengthQString );
     if ( conversionSuccess )
     {
       input = ( char* )malloc( length + 1 );
       memset( input, 0, length + 1 );
-      for ( int i = 0; i < length; ++i )
-      {
-        input[i] = getchar();
-      }
+      QgsServerRequestContext::read( input, length );
       //fgets(input, length+1, stdin);
       if ( input != NULL )
       {
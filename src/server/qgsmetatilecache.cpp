@@ -0,0 +1,284 @@
+/***************************************************************************
+                              qgsmetatilecache.cpp
+                              --------------------
+  begin                : October 2016
+  copyright            : (C) 2016 by Sandro Mani
+  email                : smani at sourcepole dot ch
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsmetatilecache.h"
+#include "qgsmessagelog.h"
+#include "qgslogger.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+#include <QTemporaryFile>
+
+#include <cmath>
+#include <cstdlib>
+
+//the disk cache is pruned after this number of written meta tiles
+static const int sPruneInterval = 100;
+
+static bool newerFile( const QFileInfo& a, const QFileInfo& b )
+{
+  return a.lastModified() > b.lastModified();
+}
+
+static int intFromEnvironment( const char* name, int defaultValue )
+{
+  bool conversionOk = false;
+  int value = QString( getenv( name ) ).toInt( &conversionOk );
+  return conversionOk ? value : defaultValue;
+}
+
+QgsMetaTileCache* QgsMetaTileCache::instance()
+{
+  static QgsMetaTileCache mInstance;
+  return &mInstance;
+}
+
+QgsMetaTileCache::QgsMetaTileCache()
+{
+  mMetaTileSize = qMax( 0, intFromEnvironment( "QGIS_SERVER_METATILE_SIZE", 0 ) );
+  mTiles.setMaxCost( intFromEnvironment( "QGIS_SERVER_METATILE_CACHE_SIZE", 64 ) * 1024 );
+  mMaxDiskCacheSize = qint64( qMax( 0, intFromEnvironment( "QGIS_SERVER_METATILE_CACHE_DISK_SIZE", 1024 ) ) ) * 1024 * 1024;
+  mExpiry = qMax( 0, intFromEnvironment( "QGIS_SERVER_METATILE_CACHE_EXPIRY", 0 ) );
+
+  mDirectory = getenv( "QGIS_SERVER_METATILE_CACHE_DIR" );
+  if ( mMetaTileSize > 0 && !mDirectory.isEmpty() && !QDir().mkpath( mDirectory ) )
+  {
+    QgsMessageLog::logMessage( "Cannot create meta tile cache directory " + mDirectory + ", tiles are only cached in memory", "Server", QgsMessageLog::WARNING );
+    mDirectory.clear();
+  }
+}
+
+bool QgsMetaTileCache::tile( const QString& project, const QString& metaTileKey, int column, int row, QImage& image )
+{
+  QString key = tileKey( metaTileKey, column, row );
+  bool diskSearched = mDirectory.isEmpty();
+  QMutexLocker locker( &mMutex );
+  while ( true )
+  {
+    if ( QImage* cachedTile = mTiles.object( key ) )
+    {
+      image = *cachedTile;
+      mHits.ref();
+      return true;
+    }
+    if ( mRenderingMetaTiles.contains( metaTileKey ) )
+    {
+      //rendering the meta tile again would not be faster
+      mMetaTileRendered.wait( &mMutex );
+      continue;
+    }
+    if ( diskSearched )
+    {
+      break;
+    }
+
+    locker.unlock();
+    QImage diskTile;
+    QFileInfo diskTileInfo( tileFilePath( project, key ) );
+    if ( diskTileInfo.exists() && ( mExpiry == 0 || diskTileInfo.lastModified().secsTo( QDateTime::currentDateTime() ) < mExpiry ) )
+    {
+      diskTile.load( diskTileInfo.filePath() );
+    }
+    locker.relock();
+    diskSearched = true;
+    if ( !diskTile.isNull() )
+    {
+      mTiles.insert( key, new QImage( diskTile ), qMax( 1, diskTile.byteCount() / 1024 ) );
+    }
+  }
+
+  mRenderingMetaTiles.insert( metaTileKey );
+  mMisses.ref();
+  return false;
+}
+
+void QgsMetaTileCache::insertMetaTile( const QString& project, const QString& metaTileKey, const QImage& metaTile, int tileWidth, int tileHeight )
+{
+  QList< QPair<QString, QImage> > tiles;
+  for ( int row = 0; row < metaTile.height() / tileHeight; ++row )
+  {
+    for ( int column = 0; column < metaTile.width() / tileWidth; ++column )
+    {
+      tiles.append( qMakePair( tileKey( metaTileKey, column, row ), metaTile.copy( column * tileWidth, row * tileHeight, tileWidth, tileHeight ) ) );
+    }
+  }
+
+  //write the tiles to unique temporary files, so that other processes never read incomplete files
+  if ( !mDirectory.isEmpty() && QDir().mkpath( projectDirectory( project ) ) )
+  {
+    QList< QPair<QString, QImage> >::const_iterator tileIt = tiles.constBegin();
+    for ( ; tileIt != tiles.constEnd(); ++tileIt )
+    {
+      QString filePath = tileFilePath( project, tileIt->first );
+      QTemporaryFile tempFile( projectDirectory( project ) + "/XXXXXX.tmp" );
+      if ( !tempFile.open() || !tileIt->second.save( &tempFile, "PNG" ) )
+      {
+        QgsDebugMsg( "could not write tile " + filePath );
+        continue;
+      }
+      tempFile.close();
+      QFile::remove( filePath );
+      if ( tempFile.rename( filePath ) )
+      {
+        tempFile.setAutoRemove( false );
+      }
+    }
+
+    if ( mInsertsSincePrune.fetchAndAddOrdered( 1 ) + 1 >= sPruneInterval )
+    {
+      mInsertsSincePrune.fetchAndStoreOrdered( 0 );
+      pruneDiskCache();
+    }
+  }
+
+  QMutexLocker locker( &mMutex );
+  QList< QPair<QString, QImage> >::const_iterator tileIt = tiles.constBegin();
+  for ( ; tileIt != tiles.constEnd(); ++tileIt )
+  {
+    mTiles.insert( tileIt->first, new QImage( tileIt->second ), qMax( 1, tileIt->second.byteCount() / 1024 ) );
+  }
+  mRenderingMetaTiles.remove( metaTileKey );
+  mMetaTileRendered.wakeAll();
+}
+
+void QgsMetaTileCache::cancelMetaTile( const QString& metaTileKey )
+{
+  QMutexLocker locker( &mMutex );
+  mRenderingMetaTiles.remove( metaTileKey );
+  mMetaTileRendered.wakeAll();
+}
+
+void QgsMetaTileCache::removeProjectTiles( const QString& project )
+{
+  QMutexLocker locker( &mMutex );
+  QString prefix = project + "\n";
+  foreach ( const QString& key, mTiles.keys() )
+  {
+    if ( key.startsWith( prefix ) )
+    {
+      mTiles.remove( key );
+    }
+  }
+  locker.unlock();
+
+  if ( !mDirectory.isEmpty() )
+  {
+    QDir dir( projectDirectory( project ) );
+    foreach ( const QString& file, dir.entryList( QDir::Files ) )
+    {
+      dir.remove( file );
+    }
+    QDir( mDirectory ).rmdir( dir.dirName() );
+  }
+}
+
+void QgsMetaTileCache::pruneDiskCache()
+{
+  if ( !mPruneMutex.tryLock() )
+  {
+    return;
+  }
+
+  //tiles of all projects, the newest first
+  QFileInfoList files;
+  QDir dir( mDirectory );
+  foreach ( const QString& projectDir, dir.entryList( QDir::Dirs | QDir::NoDotAndDotDot ) )
+  {
+    files += QDir( dir.filePath( projectDir ) ).entryInfoList( QStringList() << "*.png" << "*.tmp", QDir::Files );
+  }
+  qSort( files.begin(), files.end(), newerFile );
+
+  QDateTime now = QDateTime::currentDateTime();
+  qint64 totalSize = 0;
+  foreach ( const QFileInfo& file, files )
+  {
+    int age = file.lastModified().secsTo( now );
+    //temporary files older than an hour are left over from crashed processes
+    bool expired = file.suffix() == "tmp" ? age > 3600 : mExpiry > 0 && age >= mExpiry;
+    if ( file.suffix() != "tmp" )
+    {
+      totalSize += file.size();
+    }
+    if ( expired || totalSize > mMaxDiskCacheSize )
+    {
+      QFile::remove( file.filePath() );
+    }
+  }
+  mPruneMutex.unlock();
+}
+
+QgsMetaTileCache::TileGrid QgsMetaTileCache::tileGrid( double xMin, double yMin, double tileWidth, double tileHeight, int metaTileSize )
+{
+  TileGrid grid;
+  //position of the tile in the grid of tiles with the size of the requested tile. The grid may be shifted against the origin
+  qint64 column = floor( xMin / tileWidth + 1E-6 );
+  qint64 row = floor( yMin / tileHeight + 1E-6 );
+  grid.phaseX = qRound(( xMin / tileWidth - column ) * 10000 );
+  grid.phaseY = qRound(( yMin / tileHeight - row ) * 10000 );
+  grid.metaColumn = floor( double( column ) / metaTileSize ) * metaTileSize;
+  grid.metaRow = floor( double( row ) / metaTileSize ) * metaTileSize;
+  //rows of the meta tile are counted from the top
+  grid.tileColumn = column - grid.metaColumn;
+  grid.tileRow = grid.metaRow + metaTileSize - 1 - row;
+  return grid;
+}
+
+QgsRectangle QgsMetaTileCache::metaTileExtent( const TileGrid& grid, double tileWidth, double tileHeight, int metaTileSize )
+{
+  double metaXMin = ( grid.metaColumn + grid.phaseX / 10000.0 ) * tileWidth;
+  double metaYMin = ( grid.metaRow + grid.phaseY / 10000.0 ) * tileHeight;
+  return QgsRectangle( metaXMin, metaYMin, metaXMin + metaTileSize * tileWidth, metaYMin + metaTileSize * tileHeight );
+}
+
+QString QgsMetaTileCache::metaTileKey( const QString& project, const QMap<QString, QString>& parameters, int width, int height,
+                                       double tileWidth, double tileHeight, const TileGrid& grid )
+{
+  //the key contains all parameters affecting the output except the extent of the tile
+  QStringList keyParts;
+  keyParts << project << QFileInfo( project ).lastModified().toString( Qt::ISODate );
+  QMap<QString, QString>::const_iterator paramIt = parameters.constBegin();
+  for ( ; paramIt != parameters.constEnd(); ++paramIt )
+  {
+    if ( paramIt.key() != "BBOX" && paramIt.key() != "WIDTH" && paramIt.key() != "HEIGHT" )
+    {
+      keyParts << paramIt.key() + "=" + paramIt.value();
+    }
+  }
+  keyParts << QString( "%1x%2" ).arg( width ).arg( height );
+  keyParts << QString( "%1,%2,%3,%4" ).arg( QString::number( tileWidth, 'g', 10 ) ).arg( QString::number( tileHeight, 'g', 10 ) ).arg( grid.phaseX ).arg( grid.phaseY );
+  keyParts << QString( "%1,%2" ).arg( grid.metaColumn ).arg( grid.metaRow );
+  return keyParts.join( "\n" );
+}
+
+QString QgsMetaTileCache::tileKey( const QString& metaTileKey, int column, int row )
+{
+  return metaTileKey + QString( "\n%1,%2" ).arg( column ).arg( row );
+}
+
+QString QgsMetaTileCache::projectDirectory( const QString& project ) const
+{
+  return mDirectory + "/" + QCryptographicHash::hash( project.toUtf8(), QCryptographicHash::Md5 ).toHex();
+}
+
+QString QgsMetaTileCache::tileFilePath( const QString& project, const QString& tileKey ) const
+{
+  return projectDirectory( project ) + "/" + QCryptographicHash::hash( tileKey.toUtf8(), QCryptographicHash::Md5 ).toHex() + ".png";
+}
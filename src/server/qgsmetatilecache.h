@@ -0,0 +1,138 @@
+/***************************************************************************
+                              qgsmetatilecache.h
+                              ------------------
+  begin                : October 2016
+  copyright            : (C) 2016 by Sandro Mani
+  email                : smani at sourcepole dot ch
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSMETATILECACHE_H
+#define QGSMETATILECACHE_H
+
+#include "qgsrectangle.h"
+
+#include <QAtomicInt>
+#include <QCache>
+#include <QImage>
+#include <QMap>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include <QWaitCondition>
+
+/**A cache for GetMap tiles. Tiles are rendered in blocks of n x n tiles (meta tiles) which are sliced
+and stored in memory and optionally on disk. Configured by the environment variables
+QGIS_SERVER_METATILE_SIZE (n, the cache is disabled if not set), QGIS_SERVER_METATILE_CACHE_SIZE
+(memory in MB, default 64), QGIS_SERVER_METATILE_CACHE_DIR (disk cache directory, no disk cache
+if not set), QGIS_SERVER_METATILE_CACHE_DISK_SIZE (disk cache size in MB, default 1024) and
+QGIS_SERVER_METATILE_CACHE_EXPIRY (seconds after which tiles on disk are rendered again, no expiry if
+not set). The cache is shared by the request threads*/
+class SERVER_EXPORT QgsMetaTileCache
+{
+  public:
+    /**Position of a requested tile in the grid of meta tiles*/
+    struct TileGrid
+    {
+      /**Column and row of the lower left tile of the meta tile in the grid of tiles*/
+      qint64 metaColumn;
+      qint64 metaRow;
+      /**Column and row of the tile in the meta tile, rows are counted from the top*/
+      int tileColumn;
+      int tileRow;
+      /**Shift of the grid against the origin, in 1/10000 of a tile*/
+      int phaseX;
+      int phaseY;
+    };
+
+    static QgsMetaTileCache* instance();
+
+    /**Returns the position of a tile in the grid of meta tiles. The grid of tiles has the size of the tile
+      and is aligned to the tile, so that requests of a tiled client share meta tiles.
+      @param xMin left of the tile
+      @param yMin bottom of the tile
+      @param tileWidth width of the tile in map units
+      @param tileHeight height of the tile in map units
+      @param metaTileSize number of tiles per side of the meta tiles*/
+    static TileGrid tileGrid( double xMin, double yMin, double tileWidth, double tileHeight, int metaTileSize );
+    /**Returns the extent of the meta tile containing a tile*/
+    static QgsRectangle metaTileExtent( const TileGrid& grid, double tileWidth, double tileHeight, int metaTileSize );
+    /**Returns the key of the meta tile containing a tile
+      @param project the project file
+      @param parameters the request parameters, BBOX, WIDTH and HEIGHT are ignored
+      @param width width of the tile in pixels
+      @param height height of the tile in pixels
+      @param tileWidth width of the tile in map units
+      @param tileHeight height of the tile in map units
+      @param grid position of the tile*/
+    static QString metaTileKey( const QString& project, const QMap<QString, QString>& parameters, int width, int height,
+                                double tileWidth, double tileHeight, const TileGrid& grid );
+
+    /**Number of tiles per side of the meta tiles, 0 if the cache is disabled*/
+    int metaTileSize() const { return mMetaTileSize; }
+
+    /**Searches a tile of a meta tile. If another thread renders the meta tile, waits until it is finished.
+      If the tile is not found, the calling thread has to render the meta tile and call insertMetaTile()
+      or cancelMetaTile() afterwards.
+      @param project the project file, used for invalidating the tiles
+      @param metaTileKey key of the meta tile, must start with the project file
+      @param column column of the tile in the meta tile
+      @param row row of the tile in the meta tile (from the top)
+      @param image out: the tile
+      @return true if the tile was found*/
+    bool tile( const QString& project, const QString& metaTileKey, int column, int row, QImage& image );
+    /**Slices a rendered meta tile and stores the tiles*/
+    void insertMetaTile( const QString& project, const QString& metaTileKey, const QImage& metaTile, int tileWidth, int tileHeight );
+    /**Called if the meta tile could not be rendered after tile() returned false*/
+    void cancelMetaTile( const QString& metaTileKey );
+
+    /**Removes the tiles of a project (e.g. if the project file has changed)*/
+    void removeProjectTiles( const QString& project );
+
+    /**Number of tiles found in the cache*/
+    int hits() const { return mHits; }
+    /**Number of tiles which had to be rendered*/
+    int misses() const { return mMisses; }
+
+  private:
+    QgsMetaTileCache();
+
+    static QString tileKey( const QString& metaTileKey, int column, int row );
+    QString projectDirectory( const QString& project ) const;
+    QString tileFilePath( const QString& project, const QString& tileKey ) const;
+    /**Removes expired tiles and the oldest tiles above the size limit from the disk cache*/
+    void pruneDiskCache();
+
+    int mMetaTileSize;
+    /**Directory for the disk cache, empty if tiles are only stored in memory*/
+    QString mDirectory;
+    /**Maximum size of the disk cache in bytes*/
+    qint64 mMaxDiskCacheSize;
+    /**Age in seconds after which tiles on disk are not used anymore, 0 for no expiry*/
+    int mExpiry;
+    /**Meta tiles written since the disk cache was pruned the last time*/
+    QAtomicInt mInsertsSincePrune;
+    /**Only one thread prunes the disk cache*/
+    QMutex mPruneMutex;
+
+    /**Tiles by project, meta tile and position, cost in KB*/
+    QCache<QString, QImage> mTiles;
+    /**Meta tiles being rendered*/
+    QSet<QString> mRenderingMetaTiles;
+    QWaitCondition mMetaTileRendered;
+    /**Protects the tiles and the meta tiles being rendered*/
+    QMutex mMutex;
+
+    QAtomicInt mHits;
+    QAtomicInt mMisses;
+};
+
+#endif // QGSMETATILECACHE_H
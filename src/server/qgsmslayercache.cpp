@@ -20,6 +20,7 @@
 #include "qgsvectorlayer.h"
 #include "qgslogger.h"
 #include <QFile>
+#include <QThread>
 
 QgsMSLayerCache* QgsMSLayerCache::instance()
 {
@@ -53,6 +54,7 @@ QgsMSLayerCache::~QgsMSLayerCache()
 void QgsMSLayerCache::insertLayer( const QString& url, const QString& layerName, QgsMapLayer* layer, const QString& configFile, const QList<QString>& tempFiles )
 {
   QgsMessageLog::logMessage( "Layer cache: insert Layer '" + layerName + "' configFile: " + configFile, "Server", QgsMessageLog::INFO );
+  QMutexLocker locker( &mMutex );
   updateEntries();
 
   QPair<QString, QString> urlLayerPair = qMakePair( url, layerName );
@@ -64,6 +66,7 @@ void QgsMSLayerCache::insertLayer( const QString& url, const QString& layerName,
   newEntry.lastUsedTime = time( NULL );
   newEntry.temporaryFiles = tempFiles;
   newEntry.configFile = configFile;
+  newEntry.user = QThread::currentThread();
 
   mEntries.insert( urlLayerPair, newEntry );
 
@@ -74,7 +77,7 @@ void QgsMSLayerCache::insertLayer( const QString& url, const QString& layerName,
     if ( configIt == mConfigFiles.end() )
     {
       mConfigFiles.insert( configFile, 1 );
-      mFileSystemWatcher.addPath( configFile );
+      watchConfigFile( configFile, true );
     }
     else
     {
@@ -89,32 +92,71 @@ void QgsMSLayerCache::insertLayer( const QString& url, const QString& layerName,
 QgsMapLayer* QgsMSLayerCache::searchLayer( const QString& url, const QString& layerName, const QString& configFile )
 {
   QPair<QString, QString> urlNamePair = qMakePair( url, layerName );
-  if ( !mEntries.contains( urlNamePair ) )
+  QThread* thread = QThread::currentThread();
+  QMutexLocker locker( &mMutex );
+  QMultiHash<QPair<QString, QString>, QgsMSLayerCacheEntry>::iterator layerIt = mEntries.find( urlNamePair );
+  for ( ; layerIt != mEntries.end() && layerIt.key() == urlNamePair; ++layerIt )
   {
-    QgsMessageLog::logMessage( "Layer '" + layerName + "' configFile: " + configFile + " not found in layer cache'", "Server", QgsMessageLog::INFO );
-    return 0;
+    //a layer cannot be used by several threads at the same time
+    if (( configFile.isEmpty() || layerIt->configFile == configFile ) && ( !layerIt->user || layerIt->user == thread ) )
+    {
+      layerIt->lastUsedTime = time( NULL );
+      layerIt->user = thread;
+      QgsMessageLog::logMessage( "Layer '" + layerName + "' configFile: " + configFile + " found in layer cache", "Server", QgsMessageLog::INFO );
+      return layerIt->layerPointer;
+    }
   }
-  else
+  QgsMessageLog::logMessage( "Layer '" + layerName + "' configFile: " + configFile + " not found in layer cache'", "Server", QgsMessageLog::INFO );
+  return 0;
+}
+
+void QgsMSLayerCache::releaseLayers()
+{
+  QThread* thread = QThread::currentThread();
+  QMutexLocker locker( &mMutex );
+  QMultiHash<QPair<QString, QString>, QgsMSLayerCacheEntry>::iterator entryIt = mEntries.begin();
+  for ( ; entryIt != mEntries.end(); ++entryIt )
   {
-    QList< QgsMSLayerCacheEntry > layers = mEntries.values( urlNamePair );
-    QList< QgsMSLayerCacheEntry >::iterator layerIt = layers.begin();
-    for ( ; layerIt != layers.end(); ++layerIt )
+    if ( entryIt->user == thread )
     {
-      if ( configFile.isEmpty() || layerIt->configFile == configFile )
-      {
-        layerIt->lastUsedTime = time( NULL );
-        QgsMessageLog::logMessage( "Layer '" + layerName + "' configFile: " + configFile + " found in layer cache", "Server", QgsMessageLog::INFO );
-        return layerIt->layerPointer;
-      }
+      entryIt->user = 0;
+    }
+  }
+
+  QList<QgsMSLayerCacheEntry>::iterator obsoleteIt = mObsoleteEntries.begin();
+  while ( obsoleteIt != mObsoleteEntries.end() )
+  {
+    if ( obsoleteIt->user == thread )
+    {
+      freeEntryRessources( *obsoleteIt );
+      obsoleteIt = mObsoleteEntries.erase( obsoleteIt );
+    }
+    else
+    {
+      ++obsoleteIt;
     }
-    QgsMessageLog::logMessage( "Layer '" + layerName + "' configFile: " + configFile + " not found in layer cache'", "Server", QgsMessageLog::INFO );
-    return 0;
   }
+
+  //entries in use are not removed when inserting layers
+  updateEntries();
+}
+
+int QgsMSLayerCache::projectsMaxLayers() const
+{
+  QMutexLocker locker( &mMutex );
+  return mProjectMaxLayers;
+}
+
+void QgsMSLayerCache::setProjectMaxLayers( int n )
+{
+  QMutexLocker locker( &mMutex );
+  mProjectMaxLayers = n;
 }
 
 void QgsMSLayerCache::removeProjectFileLayers( const QString& project )
 {
   QgsMessageLog::logMessage( "Removing cache entries for project file: " + project, "Server", QgsMessageLog::INFO );
+  QMutexLocker locker( &mMutex );
   QList< QPair< QString, QString > > removeEntries;
   QList< QgsMSLayerCacheEntry > removeEntriesValues;
 
@@ -125,7 +167,15 @@ void QgsMSLayerCache::removeProjectFileLayers( const QString& project )
     {
       removeEntries.push_back( entryIt.key() );
       removeEntriesValues.push_back( entryIt.value() );
-      freeEntryRessources( entryIt.value() );
+      if ( entryIt.value().user )
+      {
+        //freed when the request using it is finished
+        mObsoleteEntries.push_back( entryIt.value() );
+      }
+      else
+      {
+        freeEntryRessources( entryIt.value() );
+      }
     }
   }
 
@@ -149,35 +199,36 @@ void QgsMSLayerCache::updateEntries()
 
   for ( int i = 0; i < entriesToDelete; ++i )
   {
-    removeLeastUsedEntry();
+    if ( !removeLeastUsedEntry() )
+    {
+      break;
+    }
   }
 }
 
-void QgsMSLayerCache::removeLeastUsedEntry()
+bool QgsMSLayerCache::removeLeastUsedEntry()
 {
-  if ( mEntries.size() < 1 )
-  {
-    return;
-  }
-
   QHash<QPair<QString, QString>, QgsMSLayerCacheEntry>::iterator it = mEntries.begin();
-  QHash<QPair<QString, QString>, QgsMSLayerCacheEntry>::iterator lowest_it = it;
-  time_t lowest_time = it->lastUsedTime;
+  QHash<QPair<QString, QString>, QgsMSLayerCacheEntry>::iterator lowest_it = mEntries.end();
 
   for ( ; it != mEntries.end(); ++it )
   {
-    if ( it->lastUsedTime < lowest_time )
+    if ( !it->user && ( lowest_it == mEntries.end() || it->lastUsedTime < lowest_it->lastUsedTime ) )
     {
       lowest_it = it;
-      lowest_time = it->lastUsedTime;
     }
   }
+  if ( lowest_it == mEntries.end() )
+  {
+    return false;
+  }
 
   QgsMessageLog::logMessage( "Removing last accessed layer '" + lowest_it.value().layerPointer->name() + "' project file " + lowest_it.value().configFile + " from cache" , "Server", QgsMessageLog::INFO );
   freeEntryRessources( *lowest_it );
   mEntries.erase( lowest_it );
   //QgsMessageLog::logMessage( "*********QgsMSLayerCache::removeLeastUsedEntry. Cache contents after removing entry:", "Server", QgsMessageLog::INFO );
   //logCacheContents();
+  return true;
 }
 
 void QgsMSLayerCache::freeEntryRessources( QgsMSLayerCacheEntry& entry )
@@ -203,7 +254,7 @@ void QgsMSLayerCache::freeEntryRessources( QgsMSLayerCacheEntry& entry )
     if ( configFileCount < 2 )
     {
       mConfigFiles.remove( entry.configFile );
-      mFileSystemWatcher.removePath( entry.configFile );
+      watchConfigFile( entry.configFile, false );
     }
     else
     {
@@ -212,6 +263,22 @@ void QgsMSLayerCache::freeEntryRessources( QgsMSLayerCacheEntry& entry )
   }
 }
 
+void QgsMSLayerCache::watchConfigFile( const QString& configFile, bool watch )
+{
+  //called directly in the thread of the cache, queued from the request threads
+  QMetaObject::invokeMethod( this, watch ? "addWatchedPath" : "removeWatchedPath", Qt::AutoConnection, Q_ARG( QString, configFile ) );
+}
+
+void QgsMSLayerCache::addWatchedPath( const QString& path )
+{
+  mFileSystemWatcher.addPath( path );
+}
+
+void QgsMSLayerCache::removeWatchedPath( const QString& path )
+{
+  mFileSystemWatcher.removePath( path );
+}
+
 void QgsMSLayerCache::logCacheContents() const
 {
   QgsMessageLog::logMessage( "***********************Layer cache contents:***************" , "Server", QgsMessageLog::INFO );
@@ -234,10 +301,16 @@ void QgsMSLayerCache::logCacheContents() const
 
 void QgsMSLayerCache::removeAllEntries()
 {
+  QMutexLocker locker( &mMutex );
   QMultiHash<QPair<QString, QString>, QgsMSLayerCacheEntry>::iterator entryIt = mEntries.begin();
   for ( ; entryIt != mEntries.end(); ++entryIt )
   {
     freeEntryRessources( entryIt.value() );
   }
   mEntries.clear();
+  foreach ( QgsMSLayerCacheEntry entry, mObsoleteEntries )
+  {
+    freeEntryRessources( entry );
+  }
+  mObsoleteEntries.clear();
 }
@@ -21,11 +21,13 @@
 #include <time.h>
 #include <QFileSystemWatcher>
 #include <QMultiHash>
+#include <QMutex>
 #include <QObject>
 #include <QPair>
 #include <QString>
 
 class QgsMapLayer;
+class QThread;
 
 struct QgsMSLayerCacheEntry
 {
@@ -35,6 +37,7 @@ struct QgsMSLayerCacheEntry
   QgsMapLayer* layerPointer;
   QList<QString> temporaryFiles; //path to the temporary files written for the layer
   QString configFile; //path to the project file associated with the layer
+  QThread* user; //thread processing a request with the layer, 0 if the layer is not in use
 
   bool operator==( const QgsMSLayerCacheEntry& other ) const
   {
@@ -43,12 +46,14 @@ struct QgsMSLayerCacheEntry
              && url == other.url
              && layerPointer == other.layerPointer
              && temporaryFiles == other.temporaryFiles
-             && configFile == other.configFile );
+             && configFile == other.configFile
+             && user == other.user );
   }
 };
 
 /** A singleton class that caches layer objects for the
-QGIS mapserver*/
+QGIS mapserver. The cache is shared by the request threads: a layer returned by searchLayer() or
+inserted with insertLayer() is used by the calling thread until it calls releaseLayers()*/
 class QgsMSLayerCache: public QObject
 {
     Q_OBJECT
@@ -62,13 +67,15 @@ class QgsMSLayerCache: public QObject
     @param configFile path of the config file (to invalidate entries if file changes). Can be empty (e.g. layers from sld)
     @param tempFiles some layers have temporary files. The cash makes sure they are removed when removing the layer from the cash*/
     void insertLayer( const QString& url, const QString& layerName, QgsMapLayer* layer, const QString& configFile = QString(), const QList<QString>& tempFiles = QList<QString>() );
-    /** Searches for the layer with the given url.
+    /** Searches for the layer with the given url. Layers used by other threads are not returned.
      @return a pointer to the layer or 0 if no such layer*/
     QgsMapLayer* searchLayer( const QString& url, const QString& layerName, const QString& configFile = QString() );
+    /** Releases the layers used by the calling thread, to be called at the end of a request*/
+    void releaseLayers();
 
-    int projectsMaxLayers() const { return mProjectMaxLayers; }
+    int projectsMaxLayers() const;
 
-    void setProjectMaxLayers( int n ) { mProjectMaxLayers = n; }
+    void setProjectMaxLayers( int n );
 
     void removeAllEntries();
 
@@ -79,10 +86,13 @@ class QgsMSLayerCache: public QObject
      depending on their time stamps and the number of other
     layers*/
     void updateEntries();
-    /** Removes the cash entry with the lowest 'lastUsedTime'*/
-    void removeLeastUsedEntry();
+    /** Removes the unused cash entry with the lowest 'lastUsedTime'
+     @return false if all entries are in use*/
+    bool removeLeastUsedEntry();
     /** Frees memory and removes temporary files of an entry*/
     void freeEntryRessources( QgsMSLayerCacheEntry& entry );
+    /** Adds or removes a config file from the file system watcher, which is only accessed in the thread of the cache*/
+    void watchConfigFile( const QString& configFile, bool watch );
 
     //for debugging
     void logCacheContents() const;
@@ -93,6 +103,9 @@ class QgsMSLayerCache: public QObject
       layer names*/
     QMultiHash<QPair<QString, QString>, QgsMSLayerCacheEntry> mEntries;
 
+    /** Entries removed from the cache while in use, freed when their thread releases them*/
+    QList<QgsMSLayerCacheEntry> mObsoleteEntries;
+
     /** Config files used in the cache (with reference counter)*/
     QHash< QString, int > mConfigFiles;
 
@@ -105,10 +118,16 @@ class QgsMSLayerCache: public QObject
     /** Maximum number of layers in the cache, overrides DEFAULT_MAX_N_LAYERS if larger*/
     int mProjectMaxLayers;
 
+    /** Protects the entries, the config files and the maximum numbers of layers*/
+    mutable QMutex mMutex;
+
   private slots:
 
     /** Removes entries from a project (e.g. if a project file has changed)*/
     void removeProjectFileLayers( const QString& project );
+
+    void addWatchedPath( const QString& path );
+    void removeWatchedPath( const QString& path );
 };
 
 #endif
@@ -17,6 +17,7 @@
 #include <stdlib.h>
 #include "qgspostrequesthandler.h"
 #include "qgslogger.h"
+#include "qgsserverrequestcontext.h"
 #include <QDomDocument>
 
 QgsPostRequestHandler::QgsPostRequestHandler()
@@ -34,13 +35,13 @@ void QgsPostRequestHandler::parseInput()
   QgsDebugMsg( inputString );
 
   //Map parameter in QUERY_STRING?
-  const char* qs = getenv( "QUERY_STRING" );
+  QString qs = QgsServerRequestContext::getEnv( "QUERY_STRING" );
   QMap<QString, QString> getParameters;
   QString queryString;
   QString mapParameter;
-  if ( qs )
+  if ( !qs.isNull() )
   {
-    queryString = QString( qs );
+    queryString = qs;
     requestStringToParameterMap( queryString, getParameters );
     mapParameter = getParameters.value( "MAP" );
   }
@@ -55,10 +56,10 @@ void QgsPostRequestHandler::parseInput()
   else
   {
     QString queryString;
-    const char* qs = getenv( "QUERY_STRING" );
-    if ( qs )
+    QString qs = QgsServerRequestContext::getEnv( "QUERY_STRING" );
+    if ( !qs.isNull() )
     {
-      queryString = QString( qs );
+      queryString = qs;
       QgsDebugMsg( "query string is: " + queryString );
     }
     else
@@ -18,6 +18,7 @@
 
 
 #include "qgsserverinterfaceimpl.h"
+#include "qgsserverrequestcontext.h"
 
 
 QgsServerInterfaceImpl::QgsServerInterfaceImpl( QgsCapabilitiesCache* capCache ) :
@@ -29,7 +30,7 @@ QgsServerInterfaceImpl::QgsServerInterfaceImpl( QgsCapabilitiesCache* capCache )
 
 QString QgsServerInterfaceImpl::getEnv( const QString& name ) const
 {
-  return getenv( name.toLocal8Bit() );
+  return QgsServerRequestContext::getEnv( name );
 }
 
 
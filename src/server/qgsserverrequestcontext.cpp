@@ -0,0 +1,94 @@
+/***************************************************************************
+                              qgsserverrequestcontext.cpp
+                              ---------------------------
+  begin                : October 2016
+  copyright            : (C) 2016 by Sandro Mani
+  email                : smani at sourcepole dot ch
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsserverrequestcontext.h"
+
+#include <QMutex>
+#include <QThreadStorage>
+
+#include <fcgi_stdio.h>
+
+//requests of the threads accepting their own requests, deleted when the thread finishes
+static QThreadStorage<FCGX_Request*> sThreadRequests;
+
+void QgsServerRequestContext::initThreadRequest()
+{
+  FCGX_Request* request = new FCGX_Request;
+  FCGX_InitRequest( request, 0, 0 );
+  sThreadRequests.setLocalData( request );
+}
+
+int QgsServerRequestContext::acceptThreadRequest()
+{
+  if ( !sThreadRequests.hasLocalData() )
+  {
+    return -1;
+  }
+
+  //accepting on the same socket from several threads is not safe on all platforms
+  static QMutex sAcceptMutex;
+  QMutexLocker locker( &sAcceptMutex );
+  return FCGX_Accept_r( sThreadRequests.localData() );
+}
+
+void QgsServerRequestContext::finishThreadRequest()
+{
+  if ( sThreadRequests.hasLocalData() )
+  {
+    FCGX_Finish_r( sThreadRequests.localData() );
+  }
+}
+
+QString QgsServerRequestContext::getEnv( const QString& name )
+{
+  const char* value = 0;
+  if ( sThreadRequests.hasLocalData() )
+  {
+    value = FCGX_GetParam( name.toLocal8Bit().constData(), sThreadRequests.localData()->envp );
+  }
+  else
+  {
+    value = getenv( name.toLocal8Bit().constData() );
+  }
+  return value ? QString( value ) : QString();
+}
+
+int QgsServerRequestContext::write( const char* data, int size )
+{
+  if ( size < 1 )
+  {
+    return 0;
+  }
+  if ( sThreadRequests.hasLocalData() )
+  {
+    return FCGX_PutStr( data, size, sThreadRequests.localData()->out );
+  }
+  return fwrite(( void* )data, 1, size, FCGI_stdout );
+}
+
+int QgsServerRequestContext::read( char* data, int size )
+{
+  if ( size < 1 )
+  {
+    return 0;
+  }
+  if ( sThreadRequests.hasLocalData() )
+  {
+    return FCGX_GetStr( data, size, sThreadRequests.localData()->in );
+  }
+  return fread(( void* )data, 1, size, FCGI_stdin );
+}
@@ -0,0 +1,47 @@
+/***************************************************************************
+                              qgsserverrequestcontext.h
+                              -------------------------
+  begin                : October 2016
+  copyright            : (C) 2016 by Sandro Mani
+  email                : smani at sourcepole dot ch
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSSERVERREQUESTCONTEXT_H
+#define QGSSERVERREQUESTCONTEXT_H
+
+#include <QString>
+
+/**Access to the CGI variables and the input and output streams of the request processed by the calling thread.
+Threads which called initThreadRequest() accept their own FastCGI requests, the other threads use the process
+environment and the standard streams of FCGI_Accept()*/
+class QgsServerRequestContext
+{
+  public:
+    /**Creates the FastCGI request of the calling thread. FCGX_Init() must have been called before*/
+    static void initThreadRequest();
+    /**Accepts the next request with the request of the calling thread
+      @return a negative value in case of error*/
+    static int acceptThreadRequest();
+    /**Finishes the current request of the calling thread, flushing the output*/
+    static void finishThreadRequest();
+
+    /**Returns the value of a CGI variable, a null string if the variable is not set*/
+    static QString getEnv( const QString& name );
+    /**Writes data to the output stream
+      @return the number of bytes written*/
+    static int write( const char* data, int size );
+    /**Reads up to size bytes from the input stream
+      @return the number of bytes read*/
+    static int read( char* data, int size );
+};
+
+#endif // QGSSERVERREQUESTCONTEXT_H
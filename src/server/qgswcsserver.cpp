@@ -23,6 +23,7 @@
 #include "qgsrasterfilewriter.h"
 #include "qgslogger.h"
 #include "qgsmapserviceexception.h"
+#include "qgsserverrequestcontext.h"
 
 #include <QTemporaryFile>
 #include <QUrl>
@@ -414,11 +415,11 @@ QByteArray* QgsWCSServer::getCoverage()
 
 QString QgsWCSServer::serviceUrl() const
 {
-  QUrl mapUrl( getenv( "REQUEST_URI" ) );
-  mapUrl.setHost( getenv( "SERVER_NAME" ) );
+  QUrl mapUrl( QgsServerRequestContext::getEnv( "REQUEST_URI" ) );
+  mapUrl.setHost( QgsServerRequestContext::getEnv( "SERVER_NAME" ) );
 
   //Add non-default ports to url
-  QString portString = getenv( "SERVER_PORT" );
+  QString portString = QgsServerRequestContext::getEnv( "SERVER_PORT" );
   if ( !portString.isEmpty() )
   {
     bool portOk;
@@ -432,7 +433,7 @@ QString QgsWCSServer::serviceUrl() const
     }
   }
 
-  if ( QString( getenv( "HTTPS" ) ).compare( "on", Qt::CaseInsensitive ) == 0 )
+  if ( QgsServerRequestContext::getEnv( "HTTPS" ).compare( "on", Qt::CaseInsensitive ) == 0 )
   {
     mapUrl.setScheme( "https" );
   }
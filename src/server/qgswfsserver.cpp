@@ -33,6 +33,7 @@
 #include "qgsvectorlayer.h"
 #include "qgslogger.h"
 #include "qgsmapserviceexception.h"
+#include "qgsserverrequestcontext.h"
 #include "qgssymbolv2.h"
 #include "qgslegendmodel.h"
 #include "qgscomposerlegenditem.h"
@@ -65,6 +66,41 @@ static const QString GML_NAMESPACE = "http://www.opengis.net/gml";
 static const QString OGC_NAMESPACE = "http://www.opengis.net/ogc";
 static const QString QGS_NAMESPACE = "http://www.qgis.org/gml";
 
+/** Lets the data provider filter the features with the OGC filter expression,
+ * if the expression only uses fields of the provider. Returns false if the request has to stay unfiltered.
+ */
+static bool setProviderFilterExpression( QgsFeatureRequest& req, const QgsExpression& filter, const QgsFields& fields )
+{
+  QgsAttributeList filterAttributes;
+  foreach ( const QString& column, filter.referencedColumns() )
+  {
+    int idx = fields.indexFromName( column );
+    if ( idx < 0 || fields.fieldOrigin( idx ) != QgsFields::OriginProvider )
+    {
+      return false;
+    }
+    filterAttributes << idx;
+  }
+
+  req.setFilterExpression( filter.expression() );
+  if ( req.flags() & QgsFeatureRequest::SubsetOfAttributes )
+  {
+    // the attributes are needed where the provider cannot evaluate the expression
+    QgsAttributeList attributes = req.subsetOfAttributes();
+    foreach ( int idx, filterAttributes )
+    {
+      if ( !attributes.contains( idx ) )
+        attributes << idx;
+    }
+    req.setSubsetOfAttributes( attributes );
+  }
+  if ( filter.needsGeometry() )
+  {
+    req.setFlags( req.flags() & ~QgsFeatureRequest::NoGeometry );
+  }
+  return true;
+}
+
 QgsWFSServer::QgsWFSServer( const QString& configFilePath, QMap<QString, QString> &parameters, QgsWFSProjectParser* cp,
                             QgsRequestHandler* rh )
     : QgsOWSServer( configFilePath, parameters, rh )
@@ -598,6 +634,13 @@ int QgsWFSServer::getFeature( QgsRequestHandler& request, const QString& format
               {
                 throw QgsMapServiceException( "RequestNotWellFormed", filter->parserErrorString() );
               }
+              QgsFeatureRequest req;
+              req.setFlags( mWithGeom ? QgsFeatureRequest::NoFlags : QgsFeatureRequest::NoGeometry );
+              req.setSubsetOfAttributes( attrIndexes );
+              if ( setProviderFilterExpression( req, *filter, fields ) )
+              {
+                fit = layer->getFeatures( req );
+              }
               while ( fit.nextFeature( feature ) && ( maxFeatures == -1 || featureCounter < maxFeat ) )
               {
                 QVariant res = filter->evaluate( &feature, fields );
@@ -1018,6 +1061,11 @@ int QgsWFSServer::getFeature( QgsRequestHandler& request, const QString& format
               mWithGeom = false;
             }
             req.setSubsetOfAttributes( attrIndexes );
+            if ( !bboxOk )
+            {
+              // a request has a single filter, the BBOX parameter is kept as filter rectangle
+              setProviderFilterExpression( req, *filter, fields );
+            }
             QgsFeatureIterator fit = layer->getFeatures( req );
             while ( fit.nextFeature( feature ) && ( maxFeatures == -1 || featureCounter < maxFeat ) )
             {
@@ -1656,7 +1704,9 @@ QgsFeatureIds QgsWFSServer::getFeatureIdsFromFilter( QDomElement filterElem, Qgs
       }
       QgsFeature feature;
       const QgsFields& fields = provider->fields();
-      QgsFeatureIterator fit = layer->getFeatures();
+      QgsFeatureRequest req;
+      setProviderFilterExpression( req, *filter, layer->pendingFields() );
+      QgsFeatureIterator fit = layer->getFeatures( req );
       while ( fit.nextFeature( feature ) )
       {
         QVariant res = filter->evaluate( &feature, fields );
@@ -1858,11 +1908,11 @@ QDomElement QgsWFSServer::createFeatureGML3( QgsFeature* feat, QDomDocument& doc
 
 QString QgsWFSServer::serviceUrl() const
 {
-  QUrl mapUrl( getenv( "REQUEST_URI" ) );
-  mapUrl.setHost( getenv( "SERVER_NAME" ) );
+  QUrl mapUrl( QgsServerRequestContext::getEnv( "REQUEST_URI" ) );
+  mapUrl.setHost( QgsServerRequestContext::getEnv( "SERVER_NAME" ) );
 
   //Add non-default ports to url
-  QString portString = getenv( "SERVER_PORT" );
+  QString portString = QgsServerRequestContext::getEnv( "SERVER_PORT" );
   if ( !portString.isEmpty() )
   {
     bool portOk;
@@ -1876,7 +1926,7 @@ QString QgsWFSServer::serviceUrl() const
     }
   }
 
-  if ( QString( getenv( "HTTPS" ) ).compare( "on", Qt::CaseInsensitive ) == 0 )
+  if ( QgsServerRequestContext::getEnv( "HTTPS" ).compare( "on", Qt::CaseInsensitive ) == 0 )
   {
     mapUrl.setScheme( "https" );
   }
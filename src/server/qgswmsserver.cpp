@@ -28,7 +28,10 @@
 #include "qgsmaplayerlegend.h"
 #include "qgsmaplayerregistry.h"
 #include "qgsmaprenderer.h"
+#include "qgsmaprenderercustompainterjob.h"
+#include "qgsmaprendererparalleljob.h"
 #include "qgsmaptopixel.h"
+#include "qgsmetatilecache.h"
 #include "qgsproject.h"
 #include "qgsrasteridentifyresult.h"
 #include "qgsrasterlayer.h"
@@ -44,17 +47,25 @@
 #include "qgsrendererv2.h"
 #include "qgspaintenginehack.h"
 #include "qgsogcutils.h"
+#include "qgspallabeling.h"
 #include "qgsfeature.h"
 #include "qgseditorwidgetregistry.h"
 #include "qgsserverlogger.h"
+#include "qgsserverrequestcontext.h"
 #include "qgssymbollayerv2utils.h"
 
+#include <QCoreApplication>
 #include <QImage>
 #include <QPainter>
+#include <QThread>
 #include <QStringList>
 #include <QTemporaryFile>
 #include <QTextStream>
 #include <QDir>
+#include <QDateTime>
+#include <QFileInfo>
+
+#include <cmath>
 
 //for printing
 #include "qgscomposition.h"
@@ -64,6 +75,8 @@
 #include <QUrl>
 #include <QPaintEngine>
 
+bool QgsWMSServer::sUseLegacyRenderer = false;
+
 QgsWMSServer::QgsWMSServer( const QString& configFilePath, QMap<QString, QString> &parameters, QgsWMSConfigParser* cp,
                             QgsRequestHandler* rh, QgsMapRenderer* renderer, QgsCapabilitiesCache* capCache )
     : QgsOWSServer( configFilePath, parameters, rh )
@@ -458,7 +471,7 @@ QDomDocument QgsWMSServer::getCapabilities( QString version, bool fullProjectInf
   QDomElement postResourceElement = doc.createElement( "OnlineResource"/*wms:OnlineResource*/ );
   postResourceElement.setAttribute( "xmlns:xlink", "http://www.w3.org/1999/xlink" );
   postResourceElement.setAttribute( "xlink:type", "simple" );
-  postResourceElement.setAttribute( "xlink:href", "http://" + QString( getenv( "SERVER_NAME" ) ) + QString( getenv( "REQUEST_URI" ) ) );
+  postResourceElement.setAttribute( "xlink:href", "http://" + QgsServerRequestContext::getEnv( "SERVER_NAME" ) + QgsServerRequestContext::getEnv( "REQUEST_URI" ) );
   postElement.appendChild( postResourceElement );
   dcpTypeElement.appendChild( postElement );
 #endif
@@ -1514,6 +1527,129 @@ QImage* QgsWMSServer::printCompositionToImage( QgsComposition* c ) const
 #endif
 
 QImage* QgsWMSServer::getMap( HitTest* hitTest )
+{
+  if ( !hitTest )
+  {
+    QImage* cachedMap = getCachedMap();
+    if ( cachedMap )
+    {
+      return cachedMap;
+    }
+  }
+  return renderMap( hitTest );
+}
+
+QImage* QgsWMSServer::getCachedMap()
+{
+  QgsMetaTileCache* cache = QgsMetaTileCache::instance();
+  int metaTileSize = cache->metaTileSize();
+  //external data in the request may change without notice
+  if ( metaTileSize < 1 || mParameters.contains( "SLD" ) || mParameters.contains( "SLD_BODY" ) || mParameters.contains( "GML" ) )
+  {
+    return 0;
+  }
+
+  bool widthOk, heightOk, bboxOk;
+  int width = mParameters.value( "WIDTH" ).toInt( &widthOk );
+  int height = mParameters.value( "HEIGHT" ).toInt( &heightOk );
+  QgsRectangle bbox = _parseBBOX( mParameters.value( "BBOX" ), bboxOk );
+  if ( !widthOk || !heightOk || !bboxOk || width < 1 || height < 1 || width > 1024 || height > 1024 || bbox.isEmpty() )
+  {
+    return 0;
+  }
+  bool tiled = mParameters.value( "TILED" ).compare( "true", Qt::CaseInsensitive ) == 0;
+  bool squarePowerOfTwo = width == height && ( width & ( width - 1 ) ) == 0;
+
+  //the horizontal axis is the second one of the BBOX for WMS 1.3.0 with inverted axis
+  QString crs = mParameters.value( "CRS", mParameters.value( "SRS" ) );
+  bool axisInverted = mParameters.value( "VERSION", "1.3.0" ) != "1.1.1" && QgsCRSCache::instance()->crsByAuthId( crs ).axisInverted();
+  double xMin = axisInverted ? bbox.yMinimum() : bbox.xMinimum();
+  double yMin = axisInverted ? bbox.xMinimum() : bbox.yMinimum();
+  double tileWidth = axisInverted ? bbox.height() : bbox.width();
+  double tileHeight = axisInverted ? bbox.width() : bbox.height();
+
+  QgsMetaTileCache::TileGrid grid = QgsMetaTileCache::tileGrid( xMin, yMin, tileWidth, tileHeight, metaTileSize );
+  //only tiles of a tiled client are cached, other maps would hardly ever be requested again
+  if ( !tiled && ( !squarePowerOfTwo || grid.phaseX != 0 || grid.phaseY != 0 ) )
+  {
+    return 0;
+  }
+  QString metaTileKey = QgsMetaTileCache::metaTileKey( mConfigFilePath, mParameters, width, height, tileWidth, tileHeight, grid );
+
+  QImage tile;
+  if ( cache->tile( mConfigFilePath, metaTileKey, grid.tileColumn, grid.tileRow, tile ) )
+  {
+    QgsMessageLog::logMessage( QString( "Meta tile cache hit (%1 hits, %2 misses)" ).arg( cache->hits() ).arg( cache->misses() ), "Server", QgsMessageLog::INFO );
+    QImage* result = new QImage( tile );
+    drawDecorations( result );
+    return result;
+  }
+  QgsMessageLog::logMessage( QString( "Meta tile cache miss (%1 hits, %2 misses)" ).arg( cache->hits() ).arg( cache->misses() ), "Server", QgsMessageLog::INFO );
+
+  //render the meta tile in one pass, labels are placed consistently across the tiles.
+  //Overlays and watermark refer to the requested map, they are drawn on the tile and not cached
+  QgsRectangle metaExtent = QgsMetaTileCache::metaTileExtent( grid, tileWidth, tileHeight, metaTileSize );
+  QgsRectangle metaBBox = metaExtent;
+  if ( axisInverted )
+  {
+    metaBBox.invert();
+  }
+
+  QMap<QString, QString> tileParameters = mParameters;
+  mParameters.insert( "BBOX", QString( "%1,%2,%3,%4" ).arg( metaBBox.xMinimum(), 0, 'g', 17 ).arg( metaBBox.yMinimum(), 0, 'g', 17 )
+                      .arg( metaBBox.xMaximum(), 0, 'g', 17 ).arg( metaBBox.yMaximum(), 0, 'g', 17 ) );
+  mParameters.insert( "WIDTH", QString::number( metaTileSize * width ) );
+  mParameters.insert( "HEIGHT", QString::number( metaTileSize * height ) );
+
+  //other threads wait for the meta tile, it has to be canceled on any error
+  QImage* metaTile = 0;
+  try
+  {
+    if ( checkMaximumWidthHeight() )
+    {
+      metaTile = renderMap( 0, false );
+    }
+    if ( metaTile )
+    {
+      cache->insertMetaTile( mConfigFilePath, metaTileKey, *metaTile, width, height );
+    }
+  }
+  catch ( ... )
+  {
+    mParameters = tileParameters;
+    cache->cancelMetaTile( metaTileKey );
+    delete metaTile;
+    throw;
+  }
+  mParameters = tileParameters;
+
+  if ( !metaTile )
+  {
+    cache->cancelMetaTile( metaTileKey );
+    return 0;
+  }
+
+  QImage* result = new QImage( metaTile->copy( grid.tileColumn * width, grid.tileRow * height, width, height ) );
+  delete metaTile;
+  drawDecorations( result );
+  return result;
+}
+
+void QgsWMSServer::drawDecorations( QImage* img ) const
+{
+  QPainter painter( img );
+  painter.setRenderHint( QPainter::Antialiasing );
+  if ( mConfigParser )
+  {
+    //draw configuration format specific overlay items
+    mConfigParser->drawOverlays( &painter, img->dotsPerMeterX() / 1000.0 * 25.4, img->width(), img->height() );
+  }
+
+  //draw possible client configurable watermark on top
+  drawWatermark( img, &painter );
+}
+
+QImage* QgsWMSServer::renderMap( HitTest* hitTest, bool decorations )
 {
   if ( !checkMaximumWidthHeight() )
   {
@@ -1551,18 +1687,20 @@ QImage* QgsWMSServer::getMap( HitTest* hitTest )
   }
   else
   {
-    bool logRenderTime = QgsServerLogger::instance()->logLevel() < 1;
-    mMapRenderer->render( &thePainter, 0, logRenderTime );
+    drawMap( mMapRenderer, &thePainter, QgsServerLogger::instance()->logLevel() < 1 );
   }
 
-  if ( mConfigParser )
+  if ( decorations && mConfigParser )
   {
     //draw configuration format specific overlay items
     mConfigParser->drawOverlays( &thePainter, theImage->dotsPerMeterX() / 1000.0 * 25.4, theImage->width(), theImage->height() );
   }
 
   //draw possible client configurable watermark on top
-  drawWatermark( theImage, &thePainter );
+  if ( decorations )
+  {
+    drawWatermark( theImage, &thePainter );
+  }
 
   restoreOpacities( bkVectorRenderers, bkRasterRenderers, labelTransparencies, labelBufferTransparencies );
   restoreLayerFilters( originalLayerFilters );
@@ -1580,6 +1718,66 @@ QImage* QgsWMSServer::getMap( HitTest* hitTest )
   return theImage;
 }
 
+void QgsWMSServer::drawMap( QgsMapRenderer* renderer, QPainter* painter, bool logRenderTime )
+{
+  //the render context of the jobs always scales symbols from millimeters,
+  //symbols in pixel units (e.g. from SLD) are only rendered correctly by the legacy renderer
+  if ( sUseLegacyRenderer || renderer->outputUnits() != QgsMapRenderer::Millimeters )
+  {
+    renderer->render( painter, 0, logRenderTime );
+  }
+  else
+  {
+    renderWithJob( renderer, painter, logRenderTime );
+  }
+}
+
+void QgsWMSServer::renderWithJob( QgsMapRenderer* renderer, QPainter* painter, bool logRenderTime )
+{
+  QgsMapSettings mapSettings = renderer->mapSettings();
+  mapSettings.setFlag( QgsMapSettings::Antialiasing, true );
+  mapSettings.setFlag( QgsMapSettings::UseAdvancedEffects, true );
+  mapSettings.setFlag( QgsMapSettings::DrawLabeling, renderer->labelingEngine() != 0 );
+  //the background has already been painted into the image
+  mapSettings.setBackgroundColor( Qt::transparent );
+  mapSettings.setOutputImageFormat( QImage::Format_ARGB32_Premultiplied );
+
+  //the label engine settings are read from the project file, not from QgsProject
+  QgsPalLabeling* labelingEngine = dynamic_cast<QgsPalLabeling*>( renderer->labelingEngine() );
+
+  QgsMapRendererJob::Errors errors;
+  int renderingTime;
+  if ( QThread::currentThread() != QCoreApplication::instance()->thread() )
+  {
+    //the layer registry of a worker thread cannot be accessed from the thread pool,
+    //the requests are rendered in parallel by the worker threads anyway
+    QgsMapRendererCustomPainterJob job( mapSettings, painter );
+    job.setLabelingEngineSettings( labelingEngine );
+    job.renderSynchronously();
+    errors = job.errors();
+    renderingTime = job.renderingTime();
+  }
+  else
+  {
+    QgsMapRendererParallelJob job( mapSettings );
+    job.setLabelingEngineSettings( labelingEngine );
+    job.start();
+    job.waitForFinished();
+    painter->drawImage( 0, 0, job.renderedImage() );
+    errors = job.errors();
+    renderingTime = job.renderingTime();
+  }
+
+  foreach ( const QgsMapRendererJob::Error& error, errors )
+  {
+    QgsMessageLog::logMessage( QString( "Rendering of layer %1 failed: %2" ).arg( error.layerID, error.message ), "Server", QgsMessageLog::WARNING );
+  }
+  if ( logRenderTime )
+  {
+    QgsMessageLog::logMessage( "Map rendered in " + QString::number( renderingTime ) + " ms", "Rendering", QgsMessageLog::INFO );
+  }
+}
+
 int QgsWMSServer::getFeatureInfo( QDomDocument& result, QString version )
 {
   if ( !mMapRenderer || !mConfigParser )
@@ -2066,14 +2264,13 @@ int QgsWMSServer::configureMapRender( const QPaintDevice* paintDevice ) const
   //we don't reject the request if it is not there but disable reprojection on the fly
   if ( crs.isEmpty() )
   {
-    //disable on the fly projection
-    QgsProject::instance()->writeEntry( "SpatialRefSys", "/ProjectionsEnabled", 0 );
+    //disable on the fly projection. The setting of the renderer is used, the project is shared by the request threads
+    mMapRenderer->setProjectionsEnabled( false );
   }
   else
   {
     //enable on the fly projection
     QgsDebugMsg( "enable on the fly projection" );
-    QgsProject::instance()->writeEntry( "SpatialRefSys", "/ProjectionsEnabled", 1 );
 
     //destination SRS
     outputCRS = QgsCRSCache::instance()->crsByAuthId( crs );
@@ -2990,18 +3187,18 @@ bool QgsWMSServer::checkMaximumWidthHeight() const
 
 QString QgsWMSServer::serviceUrl() const
 {
-  QString requestUri = getenv( "REQUEST_URI" );
+  QString requestUri = QgsServerRequestContext::getEnv( "REQUEST_URI" );
   if ( requestUri.isEmpty() )
   {
     // in some cases (e.g. when running through python's CGIHTTPServer) the REQUEST_URI is not defined
-    requestUri = QString( getenv( "SCRIPT_NAME" ) ) + "?" + QString( getenv( "QUERY_STRING" ) );
+    requestUri = QgsServerRequestContext::getEnv( "SCRIPT_NAME" ) + "?" + QgsServerRequestContext::getEnv( "QUERY_STRING" );
   }
 
   QUrl mapUrl( requestUri );
-  mapUrl.setHost( getenv( "SERVER_NAME" ) );
+  mapUrl.setHost( QgsServerRequestContext::getEnv( "SERVER_NAME" ) );
 
   //Add non-default ports to url
-  QString portString = getenv( "SERVER_PORT" );
+  QString portString = QgsServerRequestContext::getEnv( "SERVER_PORT" );
   if ( !portString.isEmpty() )
   {
     bool portOk;
@@ -3015,7 +3212,7 @@ QString QgsWMSServer::serviceUrl() const
     }
   }
 
-  if ( QString( getenv( "HTTPS" ) ).compare( "on", Qt::CaseInsensitive ) == 0 )
+  if ( QgsServerRequestContext::getEnv( "HTTPS" ).compare( "on", Qt::CaseInsensitive ) == 0 )
   {
     mapUrl.setScheme( "https" );
   }
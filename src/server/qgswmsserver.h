@@ -56,7 +56,7 @@ class QStandardItem;
 a map<QString, QString>. This map is usually generated by a subclass of QgsWMSRequestHandler, which makes QgsWMSServer
 independent from any server side technology*/
 
-class QgsWMSServer: public QgsOWSServer
+class SERVER_EXPORT QgsWMSServer: public QgsOWSServer
 {
   public:
     /**Constructor. Does _NOT_ take ownership of
@@ -105,6 +105,13 @@ class QgsWMSServer: public QgsOWSServer
     /**Sets configuration parser for administration settings. Does not take ownership*/
     void setAdminConfigParser( QgsWMSConfigParser* parser ) { mConfigParser = parser; }
 
+    /**Sets whether GetMap requests are rendered with the legacy QgsMapRenderer instead of a map renderer job*/
+    static void setUseLegacyRenderer( bool legacy ) { sUseLegacyRenderer = legacy; }
+
+    /**Renders the layers and labels configured in the renderer. A map renderer job is used, unless the legacy
+      renderer is configured or the output units of the renderer are pixels, which the jobs do not support*/
+    static void drawMap( QgsMapRenderer* renderer, QPainter* painter, bool logRenderTime = false );
+
     /**Returns the schemaExtension for WMS 1.3.0 capabilities*/
     QDomDocument getSchemaExtension();
 
@@ -112,6 +119,25 @@ class QgsWMSServer: public QgsOWSServer
     /**Don't use the default constructor*/
     QgsWMSServer();
 
+    static bool sUseLegacyRenderer;
+
+    /**Renders the map, see getMap()
+      @param decorations false to omit the overlays and the watermark*/
+    QImage* renderMap( HitTest* hitTest, bool decorations = true );
+
+    /**Returns the requested map from the meta tile cache, renders the meta tile containing the map if
+      the map is not cached. Only requests of a tiled client are cached, i.e. square maps with a power of two
+      size on the grid of their own size, or requests with TILED=true.
+      @return 0 if the request is not suitable for the cache*/
+    QImage* getCachedMap();
+
+    /**Draws the overlays of the configuration and the watermark on a map*/
+    void drawDecorations( QImage* img ) const;
+
+    /**Renders the layers and labels configured in the renderer with a map renderer job.
+      The layers are rendered in parallel, unless the request is processed in a worker thread*/
+    static void renderWithJob( QgsMapRenderer* renderer, QPainter* painter, bool logRenderTime );
+
     /**Initializes WMS layers and configures mMapRendering.
       @param layersList out: list with WMS layer names
       @param stylesList out: list with WMS style names
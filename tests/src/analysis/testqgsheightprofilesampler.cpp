@@ -0,0 +1,274 @@
+/***************************************************************************
+     testqgsheightprofilesampler.cpp
+     -------------------------------
+    Date                 : October 2016
+    Copyright            : (C) 2016 by Sandro Mani
+    Email                : manisandro@gmail.com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest/QtTest>
+#include <QObject>
+#include <QDir>
+#include <QVector>
+#include <qmath.h>
+#include <algorithm>
+
+#include <gdal.h>
+
+#include "qgsapplication.h"
+#include "qgscoordinatereferencesystem.h"
+#include "qgscoordinatetransform.h"
+#include "qgsheightprofilesampler.h"
+#include "qgspoint.h"
+
+/** \ingroup UnitTests
+ * Tests of the interpolation, the block cache and the coordinate transform of the height profile sampler
+ */
+class TestQgsHeightProfileSampler : public QObject
+{
+    Q_OBJECT
+
+  private slots:
+    void initTestCase();// will be called before the first testfunction is executed.
+    void cleanupTestCase();// will be called after the last testfunction was executed.
+    void init() {} // will be called before each testfunction is executed.
+    void cleanup() {} // will be called after every testfunction.
+    void interpolation();
+    void outOfBounds();
+    void nodata();
+    void transform();
+    void sampleLine();
+    void modifiedFile();
+    void invalidFile();
+
+  private:
+    //! writes a DEM of the given size, whose values are demValue() plus offset
+    bool writeDem( int width, int height, double offset );
+    //! bilinear interpolation of demValue() at the given pixel position
+    static double interpolate( double col, double row );
+
+    QString mDemFile;
+    QgsCoordinateReferenceSystem mCrs;
+};
+
+// larger than one block of the cache, so that samples fall into several blocks
+static const int sDemWidth = 600;
+static const int sDemHeight = 500;
+static const double sDemNodata = -9999;
+static const double sGeoTransform[6] = { 600000, 10, 0, 200000, 0, -10 };
+
+static double demValue( int col, int row )
+{
+  if ( col == 100 && row == 101 )
+  {
+    return sDemNodata;
+  }
+  return 400 + 0.5 * col + 0.25 * row + 20 * qSin( col * 0.05 ) * qCos( row * 0.03 );
+}
+
+static QgsPoint geoPos( double col, double row )
+{
+  return QgsPoint( sGeoTransform[0] + col * sGeoTransform[1], sGeoTransform[3] + row * sGeoTransform[5] );
+}
+
+void TestQgsHeightProfileSampler::initTestCase()
+{
+  QgsApplication::init();
+  QgsApplication::initQgis();
+  GDALAllRegister();
+
+  mDemFile = QDir::tempPath() + "/testqgsheightprofilesampler_dem.tif";
+  mCrs.createFromOgcWmsCrs( "EPSG:21781" );
+  QVERIFY( writeDem( sDemWidth, sDemHeight, 0 ) );
+}
+
+void TestQgsHeightProfileSampler::cleanupTestCase()
+{
+  QFile::remove( mDemFile );
+  QgsApplication::exitQgis();
+}
+
+bool TestQgsHeightProfileSampler::writeDem( int width, int height, double offset )
+{
+  QVector<float> values( width * height );
+  for ( int row = 0; row < height; ++row )
+  {
+    for ( int col = 0; col < width; ++col )
+    {
+      double value = demValue( col, row );
+      values[row * width + col] = value == sDemNodata ? value : value + offset;
+    }
+  }
+  GDALDatasetH dataset = GDALCreate( GDALGetDriverByName( "GTiff" ), mDemFile.toUtf8().constData(), width, height, 1, GDT_Float32, 0 );
+  if ( !dataset )
+  {
+    return false;
+  }
+  double geoTransform[6];
+  std::copy( sGeoTransform, sGeoTransform + 6, geoTransform );
+  GDALSetGeoTransform( dataset, geoTransform );
+  GDALSetProjection( dataset, mCrs.toWkt().toUtf8().constData() );
+  GDALRasterBandH band = GDALGetRasterBand( dataset, 1 );
+  GDALSetRasterNoDataValue( band, sDemNodata );
+  CPLErr err = GDALRasterIO( band, GF_Write, 0, 0, width, height, values.data(), width, height, GDT_Float32, 0, 0 );
+  GDALClose( dataset );
+  return err == CE_None;
+}
+
+double TestQgsHeightProfileSampler::interpolate( double col, double row )
+{
+  // the values as stored in the DEM
+  int col0 = qFloor( col ), row0 = qFloor( row );
+  double v00 = float( demValue( col0, row0 ) ), v01 = float( demValue( col0 + 1, row0 ) );
+  double v10 = float( demValue( col0, row0 + 1 ) ), v11 = float( demValue( col0 + 1, row0 + 1 ) );
+  double lambdaC = col - col0, lambdaR = row - row0;
+  return ( v00 * ( 1. - lambdaC ) + v01 * lambdaC ) * ( 1. - lambdaR ) + ( v10 * ( 1. - lambdaC ) + v11 * lambdaC ) * lambdaR;
+}
+
+void TestQgsHeightProfileSampler::interpolation()
+{
+  QgsHeightProfileSampler sampler( mDemFile );
+  QVERIFY( sampler.isValid() );
+  QCOMPARE( sampler.verticalUnit(), QGis::Meters );
+
+  // positions within the blocks and across their borders, in an order which alternates between blocks
+  QVector<QPointF> pixels;
+  for ( int i = 0; i < 400; ++i )
+  {
+    pixels.append( QPointF( 3.3 + ( i * 37 ) % 590 + 0.01 * i, 2.7 + ( i * 53 ) % 490 + 0.005 * i ) );
+  }
+  pixels << QPointF( 255.5, 10.25 ) << QPointF( 256, 255.75 ) << QPointF( 511.9, 255.1 ) << QPointF( 0, 0 ) << QPointF( 598.5, 498.5 );
+  QVector<QgsPoint> points;
+  foreach ( const QPointF& pixel, pixels )
+  {
+    points.append( geoPos( pixel.x(), pixel.y() ) );
+  }
+
+  QVector<double> heights;
+  QVERIFY( sampler.sample( points, mCrs, heights ) );
+  QCOMPARE( heights.size(), points.size() );
+  for ( int i = 0; i < pixels.size(); ++i )
+  {
+    QVERIFY( qgsDoubleNear( heights[i], interpolate( pixels[i].x(), pixels[i].y() ), 1E-6 ) );
+  }
+
+  // sampling again is served from the cached blocks
+  QVector<double> cachedHeights;
+  QVERIFY( sampler.sample( points, mCrs, cachedHeights ) );
+  QVERIFY( cachedHeights == heights );
+}
+
+void TestQgsHeightProfileSampler::outOfBounds()
+{
+  QgsHeightProfileSampler sampler( mDemFile );
+
+  // the interpolation window of the samples is not entirely inside the DEM
+  QVector<QgsPoint> points = QVector<QgsPoint>()
+                             << geoPos( -0.5, 10 ) << geoPos( 10, -0.01 ) << geoPos( sDemWidth - 0.5, 10 )
+                             << geoPos( 10, sDemHeight - 1 ) << geoPos( -1000, -1000 ) << geoPos( 20.5, 30.5 );
+  QVector<double> heights;
+  QVERIFY( sampler.sample( points, mCrs, heights ) );
+  QCOMPARE( heights.size(), 6 );
+  for ( int i = 0; i < 5; ++i )
+  {
+    QCOMPARE( heights[i], 0. );
+  }
+  QVERIFY( qgsDoubleNear( heights[5], interpolate( 20.5, 30.5 ), 1E-6 ) );
+}
+
+void TestQgsHeightProfileSampler::nodata()
+{
+  QgsHeightProfileSampler sampler( mDemFile );
+
+  // nodata pixels are interpolated like the other pixels
+  QVector<QgsPoint> points = QVector<QgsPoint>() << geoPos( 100, 101 ) << geoPos( 99.5, 100.5 ) << geoPos( 100.25, 101.75 ) << geoPos( 101, 101 );
+  QVector<double> heights;
+  QVERIFY( sampler.sample( points, mCrs, heights ) );
+  QCOMPARE( heights[0], sDemNodata );
+  QVERIFY( qgsDoubleNear( heights[1], interpolate( 99.5, 100.5 ), 1E-6 ) );
+  QVERIFY( qgsDoubleNear( heights[2], interpolate( 100.25, 101.75 ), 1E-6 ) );
+  QVERIFY( heights[1] < 0 && heights[2] < 0 );
+  QVERIFY( qgsDoubleNear( heights[3], float( demValue( 101, 101 ) ), 1E-6 ) );
+}
+
+void TestQgsHeightProfileSampler::transform()
+{
+  QgsHeightProfileSampler sampler( mDemFile );
+
+  // all points are transformed at once, with the same result as one by one
+  QgsCoordinateReferenceSystem wgs84;
+  wgs84.createFromOgcWmsCrs( "EPSG:4326" );
+  QgsCoordinateTransform toWgs84( mCrs, wgs84 );
+  QgsCoordinateTransform fromWgs84( wgs84, mCrs );
+  QVector<QgsPoint> points;
+  QVector<QgsPoint> rasterPoints;
+  for ( int i = 0; i < 200; ++i )
+  {
+    QgsPoint p = toWgs84.transform( geoPos( 5.5 + i * 2.9, 7.25 + i * 2.3 ) );
+    points.append( p );
+    rasterPoints.append( fromWgs84.transform( p ) );
+  }
+
+  QVector<double> heights;
+  QVERIFY( sampler.sample( points, wgs84, heights ) );
+  QVector<double> expected;
+  QVERIFY( sampler.sample( rasterPoints, mCrs, expected ) );
+  QCOMPARE( heights.size(), 200 );
+  for ( int i = 0; i < 200; ++i )
+  {
+    QVERIFY( qgsDoubleNear( heights[i], expected[i], 1E-6 ) );
+    QVERIFY( qgsDoubleNear( heights[i], interpolate( 5.5 + i * 2.9, 7.25 + i * 2.3 ), 1E-3 ) );
+  }
+}
+
+void TestQgsHeightProfileSampler::sampleLine()
+{
+  QgsHeightProfileSampler sampler( mDemFile );
+
+  // two segments, 1000 and 500 map units long, sampled every 10 map units
+  QList<QgsPoint> points = QList<QgsPoint>() << geoPos( 10.5, 20.5 ) << geoPos( 110.5, 20.5 ) << geoPos( 110.5, 70.5 );
+  QVector<double> segmentLengths = QVector<double>() << 1000 << 500;
+  QVector<double> heights;
+  QVERIFY( sampler.sampleLine( points, segmentLengths, 150, mCrs, heights ) );
+  QCOMPARE( heights.size(), 150 );
+  QVERIFY( qgsDoubleNear( heights[0], interpolate( 10.5, 20.5 ), 1E-6 ) );
+  QVERIFY( qgsDoubleNear( heights[50], interpolate( 60.5, 20.5 ), 1E-6 ) );
+  QVERIFY( qgsDoubleNear( heights[120], interpolate( 110.5, 40.5 ), 1E-6 ) );
+}
+
+void TestQgsHeightProfileSampler::modifiedFile()
+{
+  QgsHeightProfileSampler sampler( mDemFile );
+  QVERIFY( sampler.isCurrent( mDemFile ) );
+  QVERIFY( !sampler.isCurrent( mDemFile + ".other" ) );
+  QVector<QgsPoint> points = QVector<QgsPoint>() << geoPos( 20.5, 30.5 );
+  QVector<double> heights;
+  QVERIFY( sampler.sample( points, mCrs, heights ) );
+  double height = heights[0];
+
+  // a sampler of the modified file reads the new values instead of the cached blocks
+  QVERIFY( writeDem( 300, 200, 100 ) );
+  QVERIFY( !sampler.isCurrent( mDemFile ) );
+  QgsHeightProfileSampler newSampler( mDemFile );
+  QVERIFY( newSampler.isCurrent( mDemFile ) );
+  QVERIFY( newSampler.sample( points, mCrs, heights ) );
+  QVERIFY( qgsDoubleNear( heights[0], height + 100, 1E-3 ) );
+}
+
+void TestQgsHeightProfileSampler::invalidFile()
+{
+  QgsHeightProfileSampler sampler( QDir::tempPath() + "/testqgsheightprofilesampler_nonexisting.tif" );
+  QVERIFY( !sampler.isValid() );
+  QVector<double> heights;
+  QVERIFY( !sampler.sample( QVector<QgsPoint>() << geoPos( 20.5, 30.5 ), mCrs, heights ) );
+  QCOMPARE( heights, QVector<double>() << 0. );
+}
+
+QTEST_MAIN( TestQgsHeightProfileSampler )
+#include "testqgsheightprofilesampler.moc"
@@ -0,0 +1,227 @@
+/***************************************************************************
+     testqgsidwinterpolator.cpp
+     --------------------------
+    Date                 : October 2016
+    Copyright            : (C) 2016 by Sandro Mani
+    Email                : manisandro@gmail.com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest/QtTest>
+#include <QObject>
+#include <QDir>
+#include <QFile>
+#include <QTextStream>
+#include <qmath.h>
+#include <algorithm>
+#include <vector>
+
+#include "qgsapplication.h"
+#include "qgsfeature.h"
+#include "qgsgeometry.h"
+#include "qgsgridfilewriter.h"
+#include "qgsidwinterpolator.h"
+#include "qgsrectangle.h"
+#include "qgsvectordataprovider.h"
+#include "qgsvectorlayer.h"
+
+/** \ingroup UnitTests
+ * Compares the concurrent grid writer and the local IDW interpolation with the serial global IDW interpolation
+ */
+class TestQgsIDWInterpolator : public QObject
+{
+    Q_OBJECT
+
+  public:
+    TestQgsIDWInterpolator();
+
+  private slots:
+    void initTestCase();// will be called before the first testfunction is executed.
+    void cleanupTestCase();// will be called after the last testfunction was executed.
+    void init() {} // will be called before each testfunction is executed.
+    void cleanup() {} // will be called after every testfunction.
+    void gridFileWriter();
+    void localEqualsGlobal_data();
+    void localEqualsGlobal();
+    void nearestNeighbours();
+
+  private:
+    QList<QgsInterpolator::LayerData> layerData() const;
+
+    QgsVectorLayer* mLayer;
+    QList<QgsPoint> mPoints;
+    QList<double> mValues;
+    QString mOutputFile;
+};
+
+// grid of 25 x 25 cells, a bit larger than the extent of the points
+static const int sGridColumns = 44;
+static const int sGridRows = 40;
+static const double sCellSize = 25;
+static const QgsRectangle sGridExtent( -50, 0, 1050, 1000 );
+
+TestQgsIDWInterpolator::TestQgsIDWInterpolator()
+    : mLayer( 0 )
+{
+}
+
+void TestQgsIDWInterpolator::initTestCase()
+{
+  QgsApplication::init();
+  QgsApplication::initQgis();
+
+  mOutputFile = QDir::tempPath() + "/testqgsidwinterpolator.asc";
+
+  // scattered points, one of them in the center of a grid cell
+  mLayer = new QgsVectorLayer( "Point?crs=EPSG:21781&field=value:double", "points", "memory" );
+  QVERIFY( mLayer->isValid() );
+  QgsFeatureList features;
+  for ( int i = 0; i < 300; ++i )
+  {
+    double x = i == 0 ? 512.5 : 1000 * qAbs( qSin( i * 12.9898 ) );
+    double y = i == 0 ? 487.5 : 1000 * qAbs( qSin( i * 78.233 ) );
+    double value = 100 + 20 * qSin( x * 0.011 ) + 15 * qCos( y * 0.007 );
+    QgsFeature f( mLayer->dataProvider()->fields(), i + 1 );
+    f.setGeometry( QgsGeometry::fromPoint( QgsPoint( x, y ) ) );
+    f.setAttribute( "value", value );
+    features.append( f );
+    mPoints.append( QgsPoint( x, y ) );
+    mValues.append( value );
+  }
+  QVERIFY( mLayer->dataProvider()->addFeatures( features ) );
+}
+
+void TestQgsIDWInterpolator::cleanupTestCase()
+{
+  QFile::remove( mOutputFile );
+  QFile::remove( QDir::tempPath() + "/testqgsidwinterpolator.prj" );
+  delete mLayer;
+  QgsApplication::exitQgis();
+}
+
+QList<QgsInterpolator::LayerData> TestQgsIDWInterpolator::layerData() const
+{
+  QgsInterpolator::LayerData layerData;
+  layerData.vectorLayer = mLayer;
+  layerData.zCoordInterpolation = false;
+  layerData.interpolationAttribute = 0;
+  layerData.mInputType = QgsInterpolator::POINTS;
+  return QList<QgsInterpolator::LayerData>() << layerData;
+}
+
+void TestQgsIDWInterpolator::gridFileWriter()
+{
+  QgsIDWInterpolator interpolator( layerData() );
+  QgsGridFileWriter writer( &interpolator, mOutputFile, sGridExtent, sGridColumns, sGridRows, sCellSize, sCellSize );
+  QCOMPARE( writer.writeFile(), 0 );
+
+  // the rows as written by the serial loop of the grid writer
+  QString expected;
+  QTextStream expectedStream( &expected );
+  expectedStream.setRealNumberPrecision( 8 );
+  QgsIDWInterpolator serialInterpolator( layerData() );
+  for ( int i = 0; i < sGridRows; ++i )
+  {
+    double y = sGridExtent.yMaximum() - sCellSize / 2.0 - i * sCellSize;
+    for ( int j = 0; j < sGridColumns; ++j )
+    {
+      double x = sGridExtent.xMinimum() + sCellSize / 2.0 + j * sCellSize;
+      double value = 0;
+      QCOMPARE( serialInterpolator.interpolatePoint( x, y, value ), 0 );
+      expectedStream << value << " ";
+    }
+    expectedStream << endl;
+  }
+
+  QFile file( mOutputFile );
+  QVERIFY( file.open( QFile::ReadOnly ) );
+  QString content = QString::fromLatin1( file.readAll() );
+  int dataStart = content.indexOf( '\n', content.indexOf( "NODATA_VALUE" ) ) + 1;
+  QVERIFY( dataStart > 0 );
+  QCOMPARE( content.mid( dataStart ), expected );
+}
+
+void TestQgsIDWInterpolator::localEqualsGlobal_data()
+{
+  QTest::addColumn<int>( "neighbourCount" );
+  QTest::addColumn<double>( "searchRadius" );
+
+  QTest::newRow( "all neighbours" ) << 300 << 0.;
+  QTest::newRow( "radius covering all points" ) << 0 << 2000.;
+  QTest::newRow( "all neighbours within radius" ) << 500 << 5000.;
+}
+
+void TestQgsIDWInterpolator::localEqualsGlobal()
+{
+  QFETCH( int, neighbourCount );
+  QFETCH( double, searchRadius );
+
+  QgsIDWInterpolator globalInterpolator( layerData() );
+  QgsIDWInterpolator localInterpolator( layerData() );
+  localInterpolator.setNeighbourCount( neighbourCount );
+  localInterpolator.setSearchRadius( searchRadius );
+
+  for ( int i = 0; i < sGridRows; ++i )
+  {
+    double y = sGridExtent.yMaximum() - sCellSize / 2.0 - i * sCellSize;
+    for ( int j = 0; j < sGridColumns; ++j )
+    {
+      double x = sGridExtent.xMinimum() + sCellSize / 2.0 + j * sCellSize;
+      double expected = 0, value = 0;
+      QCOMPARE( globalInterpolator.interpolatePoint( x, y, expected ), 0 );
+      QCOMPARE( localInterpolator.interpolatePoint( x, y, value ), 0 );
+      // the points are summed up in a different order
+      QVERIFY( qgsDoubleNear( value, expected, 1E-9 ) );
+    }
+  }
+  // a data point is returned as is
+  double value = 0;
+  QCOMPARE( localInterpolator.interpolatePoint( 512.5, 487.5, value ), 0 );
+  QCOMPARE( value, mValues[0] );
+}
+
+void TestQgsIDWInterpolator::nearestNeighbours()
+{
+  int neighbourCount = 12;
+  QgsIDWInterpolator localInterpolator( layerData() );
+  localInterpolator.setNeighbourCount( neighbourCount );
+
+  for ( int i = 0; i < sGridRows; ++i )
+  {
+    double y = sGridExtent.yMaximum() - sCellSize / 2.0 - i * sCellSize;
+    for ( int j = 0; j < sGridColumns; ++j )
+    {
+      double x = sGridExtent.xMinimum() + sCellSize / 2.0 + j * sCellSize;
+
+      // weighted mean of the nearest points, found by sorting all of them
+      std::vector< std::pair<double, double> > points;
+      for ( int k = 0; k < mPoints.size(); ++k )
+      {
+        points.push_back( std::make_pair( mPoints[k].sqrDist( x, y ), mValues[k] ) );
+      }
+      std::sort( points.begin(), points.end() );
+      if ( points.front().first == 0 )
+      {
+        continue;
+      }
+      double sumCounter = 0, sumDenominator = 0;
+      for ( int k = 0; k < neighbourCount; ++k )
+      {
+        sumCounter += points[k].second / points[k].first;
+        sumDenominator += 1 / points[k].first;
+      }
+
+      double value = 0;
+      QCOMPARE( localInterpolator.interpolatePoint( x, y, value ), 0 );
+      QVERIFY( qgsDoubleNear( value, sumCounter / sumDenominator, 1E-9 ) );
+    }
+  }
+}
+
+QTEST_MAIN( TestQgsIDWInterpolator )
+#include "testqgsidwinterpolator.moc"
@@ -0,0 +1,222 @@
+/***************************************************************************
+     testqgslineofsight.cpp
+     ----------------------
+    Date                 : October 2016
+    Copyright            : (C) 2016 by Sandro Mani
+    Email                : manisandro@gmail.com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest/QtTest>
+#include <QObject>
+#include <QPointF>
+#include <QVector>
+#include <qmath.h>
+
+#include "qgslineofsight.h"
+
+/** \ingroup UnitTests
+ * Compares the horizon sweep of the line of sight with the test of each target against all samples before it
+ */
+class TestQgsLineOfSight : public QObject
+{
+    Q_OBJECT
+
+  private slots:
+    void initTestCase() {}// will be called before the first testfunction is executed.
+    void cleanupTestCase() {}// will be called after the last testfunction was executed.
+    void init() {} // will be called before each testfunction is executed.
+    void cleanup() {} // will be called after every testfunction.
+    void sweepEqualsQuadratic_data();
+    void sweepEqualsQuadratic();
+    void obstructed();
+    void edgeOfRaster();
+    void degenerateProfiles();
+    void concurrentProfiles();
+};
+
+static const double sEarthRadius = 6370000;
+
+// The line of sight of the height profile dialog before the horizon sweep: each target is tested against the
+// line from the observer to it at every sample before it
+static QVector<bool> quadraticVisibility( const QVector<double>& distances, const QVector<double>& heights,
+    double observerHeight, double targetHeight, bool heightRelToTerr, double heightUnitsPerMeter )
+{
+  int nSamples = distances.size();
+  QVector<double> pX;
+  QVector<double> pY;
+  for ( int i = 0; i < nSamples; ++i )
+  {
+    pX.append( distances[i] );
+    double hCorr = 0.87 * pX.last() * pX.last() / ( 2 * sEarthRadius ) * heightUnitsPerMeter;
+    pY.append( heights[i] - hCorr );
+  }
+
+  QVector<bool> visible( nSamples );
+  double y = pY.front() + targetHeight - ( heightRelToTerr ? 0 : heights.front() );
+  visible[0] = y > pY.front();
+
+  QPointF p1( pX.front(), ( heightRelToTerr ? pY.front() : 0 ) + observerHeight );
+  for ( int i = 1; i < nSamples; ++i )
+  {
+    QPointF p2( pX[i], pY[i] + targetHeight );
+    if ( !heightRelToTerr )
+    {
+      p2.ry() -= heights[i];
+    }
+    visible[i] = true;
+    for ( int j = 1; j < i; ++j )
+    {
+      double Y = p1.y() + ( pX[j] - p1.x() ) / ( p2.x() - p1.x() ) * ( p2.y() - p1.y() );
+      if ( Y < pY[j] )
+      {
+        visible[i] = false;
+        break;
+      }
+    }
+  }
+  return visible;
+}
+
+// hills and valleys along a profile of the given length
+static void hillyProfile( int n, double step, QVector<double>& distances, QVector<double>& heights )
+{
+  distances.clear();
+  heights.clear();
+  for ( int i = 0; i < n; ++i )
+  {
+    distances.append( i * step );
+    heights.append( 450 + 60 * qSin( i * 0.013 ) + 25 * qSin( i * 0.071 ) + 4 * qSin( i * 1.37 ) );
+  }
+}
+
+void TestQgsLineOfSight::sweepEqualsQuadratic_data()
+{
+  QTest::addColumn<double>( "observerHeight" );
+  QTest::addColumn<double>( "targetHeight" );
+  QTest::addColumn<bool>( "heightRelToTerr" );
+  QTest::addColumn<double>( "heightUnitsPerMeter" );
+
+  QTest::newRow( "relative to terrain" ) << 2. << 1.5 << true << 1.;
+  QTest::newRow( "relative to terrain, feet" ) << 6.5 << 5. << true << 3.28084;
+  QTest::newRow( "above sea level" ) << 530. << 480. << false << 1.;
+  QTest::newRow( "above sea level, below the terrain" ) << 400. << 420. << false << 1.;
+}
+
+void TestQgsLineOfSight::sweepEqualsQuadratic()
+{
+  QFETCH( double, observerHeight );
+  QFETCH( double, targetHeight );
+  QFETCH( bool, heightRelToTerr );
+  QFETCH( double, heightUnitsPerMeter );
+
+  // long enough for the earth curvature to matter
+  QVector<double> distances, heights;
+  hillyProfile( 3000, 9.7, distances, heights );
+
+  QVector<bool> visible;
+  QgsLineOfSight::computeVisibility( distances, heights, observerHeight, targetHeight, heightRelToTerr, heightUnitsPerMeter, visible );
+  QVector<bool> expected = quadraticVisibility( distances, heights, observerHeight, targetHeight, heightRelToTerr, heightUnitsPerMeter );
+  QCOMPARE( visible.size(), expected.size() );
+  QVERIFY( visible == expected );
+}
+
+void TestQgsLineOfSight::obstructed()
+{
+  // flat terrain with a wall, which hides everything behind it
+  QVector<double> distances, heights;
+  for ( int i = 0; i < 100; ++i )
+  {
+    distances.append( i * 10 );
+    heights.append( i >= 40 && i <= 42 ? 600 : 500 );
+  }
+
+  QVector<bool> visible;
+  QgsLineOfSight::computeVisibility( distances, heights, 2, 0, true, 1, visible );
+  QVERIFY( visible == quadraticVisibility( distances, heights, 2, 0, true, 1 ) );
+  for ( int i = 1; i < 100; ++i )
+  {
+    QCOMPARE( visible[i], i <= 40 );
+  }
+  // the target on the observer position itself is only visible if it is above the terrain
+  QVERIFY( !visible[0] );
+
+  // a target higher than the wall is visible just behind it, but not further away
+  QgsLineOfSight::computeVisibility( distances, heights, 2, 150, true, 1, visible );
+  QVERIFY( visible == quadraticVisibility( distances, heights, 2, 150, true, 1 ) );
+  QVERIFY( visible[0] );
+  QVERIFY( visible[50] );
+  QVERIFY( !visible[99] );
+}
+
+void TestQgsLineOfSight::edgeOfRaster()
+{
+  // the profile leaves the raster, the samples outside of it have no height
+  QVector<double> distances, heights;
+  hillyProfile( 500, 9.7, distances, heights );
+  for ( int i = 400; i < 500; ++i )
+  {
+    heights[i] = 0;
+  }
+
+  QVector<bool> visible;
+  QgsLineOfSight::computeVisibility( distances, heights, 2, 1.5, true, 1, visible );
+  QVERIFY( visible == quadraticVisibility( distances, heights, 2, 1.5, true, 1 ) );
+  QVERIFY( visible.indexOf( true, 1 ) > 0 );
+  QCOMPARE( visible.indexOf( true, 400 ), -1 );
+
+  // targets at a fixed height above sea level remain visible beyond the edge
+  QgsLineOfSight::computeVisibility( distances, heights, 600, 700, false, 1, visible );
+  QVERIFY( visible == quadraticVisibility( distances, heights, 600, 700, false, 1 ) );
+  QVERIFY( visible[499] );
+
+  // and the profile may also start outside of the raster
+  for ( int i = 0; i < 50; ++i )
+  {
+    heights[i] = 0;
+  }
+  QgsLineOfSight::computeVisibility( distances, heights, 2, 1.5, true, 1, visible );
+  QVERIFY( visible == quadraticVisibility( distances, heights, 2, 1.5, true, 1 ) );
+}
+
+void TestQgsLineOfSight::degenerateProfiles()
+{
+  QVector<bool> visible( 3, true );
+  QgsLineOfSight::computeVisibility( QVector<double>(), QVector<double>(), 2, 0, true, 1, visible );
+  QVERIFY( visible.isEmpty() );
+
+  QgsLineOfSight::computeVisibility( QVector<double>() << 0, QVector<double>() << 500, 2, 1, true, 1, visible );
+  QCOMPARE( visible, QVector<bool>() << true );
+
+  // samples at the distance of the observer take the visibility of the previous sample
+  QVector<double> distances = QVector<double>() << 0 << 0 << 10 << 20;
+  QVector<double> heights = QVector<double>() << 500 << 700 << 490 << 480;
+  QgsLineOfSight::computeVisibility( distances, heights, 2, 0, true, 1, visible );
+  QCOMPARE( visible, QVector<bool>() << false << false << true << true );
+
+  // the shorter of distances and heights determines the number of samples
+  QgsLineOfSight::computeVisibility( distances, heights.mid( 0, 2 ), 2, 0, true, 1, visible );
+  QCOMPARE( visible.size(), 2 );
+}
+
+void TestQgsLineOfSight::concurrentProfiles()
+{
+  QVector<QgsLineOfSight::Profile> profiles( 8 );
+  for ( int k = 0; k < profiles.size(); ++k )
+  {
+    hillyProfile( 500 + 100 * k, 5 + k, profiles[k].distances, profiles[k].heights );
+  }
+  QgsLineOfSight::computeVisibility( profiles, 2, 1.5, true, 1 );
+  foreach ( const QgsLineOfSight::Profile& profile, profiles )
+  {
+    QVERIFY( profile.visible == quadraticVisibility( profile.distances, profile.heights, 2, 1.5, true, 1 ) );
+  }
+}
+
+QTEST_MAIN( TestQgsLineOfSight )
+#include "testqgslineofsight.moc"
@@ -0,0 +1,519 @@
+/***************************************************************************
+     testqgsnetworkanalysis.cpp
+     --------------------------
+    Date                 : October 2016
+    Copyright            : (C) 2016 by Sandro Mani
+    Email                : manisandro@gmail.com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest/QtTest>
+#include <QObject>
+#include <QVector>
+#include <limits>
+#include <qmath.h>
+
+#include "qgsapplication.h"
+#include "qgscompactgraph.h"
+#include "qgsdistancearcproperter.h"
+#include "qgsgeometry.h"
+#include "qgsgraph.h"
+#include "qgsgraphanalyzer.h"
+#include "qgsgraphbuilder.h"
+#include "qgslinevectorlayerdirector.h"
+#include "qgsvectordataprovider.h"
+#include "qgsvectorlayer.h"
+
+/** \ingroup UnitTests
+ * Compares the searches on the compact graph with the searches on the graph it was built from
+ */
+class TestQgsNetworkAnalysis : public QObject
+{
+    Q_OBJECT
+
+  public:
+    TestQgsNetworkAnalysis();
+
+  private slots:
+    void initTestCase();// will be called before the first testfunction is executed.
+    void cleanupTestCase();// will be called after the last testfunction was executed.
+    void init() {} // will be called before each testfunction is executed.
+    void cleanup() {} // will be called after every testfunction.
+    void compactGraph();
+    void dijkstra();
+    void dijkstraToTarget();
+    void dijkstraFromStartCosts();
+    void shortestTreeToTarget();
+    void costMatrix();
+    void isochrones();
+    void tiePoints();
+    void topologyTolerance();
+
+  private:
+    //! checks that the tree only contains arcs into their vertex along which the cost of the vertex is reached
+    void verifyTree( const QVector<int>& tree, const QVector<double>& costs, int startVertexIdx, int criterionNum );
+    //! builds the graph of a line layer with the given lines, tying the additional points to it
+    static QgsGraph* buildGraph( const QList<QgsPolyline>& lines, double topologyTolerance,
+                                 const QVector<QgsPoint>& additionalPoints, QVector<QgsPoint>& tiedPoints );
+
+    QgsGraph* mGraph;
+    QgsCompactGraph* mCompactGraph;
+    int mUnreachableVertex;
+};
+
+static const int sGridColumns = 12;
+static const int sGridRows = 9;
+
+TestQgsNetworkAnalysis::TestQgsNetworkAnalysis()
+    : mGraph( 0 )
+    , mCompactGraph( 0 )
+    , mUnreachableVertex( -1 )
+{
+}
+
+void TestQgsNetworkAnalysis::initTestCase()
+{
+  QgsApplication::init();
+  QgsApplication::initQgis();
+
+  // grid of streets, the horizontal ones are one-way, with a length and a travel time criterion
+  mGraph = new QgsGraph();
+  for ( int row = 0; row < sGridRows; ++row )
+  {
+    for ( int col = 0; col < sGridColumns; ++col )
+    {
+      mGraph->addVertex( QgsPoint( col * 100, row * 100 ) );
+    }
+  }
+  int n = 0;
+  for ( int row = 0; row < sGridRows; ++row )
+  {
+    for ( int col = 0; col < sGridColumns; ++col )
+    {
+      int v = row * sGridColumns + col;
+      if ( col + 1 < sGridColumns )
+      {
+        double length = 100 + 37 * qAbs( qSin( ++n * 1.3 ) );
+        double time = length / ( 5 + 20 * qAbs( qCos( n * 0.7 ) ) );
+        if ( row % 2 == 0 )
+        {
+          mGraph->addArc( v, v + 1, QVector<QVariant>() << length << time );
+        }
+        else
+        {
+          mGraph->addArc( v + 1, v, QVector<QVariant>() << length << time );
+        }
+      }
+      if ( row + 1 < sGridRows )
+      {
+        double length = 100 + 41 * qAbs( qSin( ++n * 2.1 ) );
+        double time = length / ( 5 + 20 * qAbs( qCos( n * 0.3 ) ) );
+        mGraph->addArc( v, v + sGridColumns, QVector<QVariant>() << length << time );
+        mGraph->addArc( v + sGridColumns, v, QVector<QVariant>() << length << time );
+      }
+    }
+  }
+  // a vertex which can only be left
+  mUnreachableVertex = mGraph->addVertex( QgsPoint( -100, -100 ) );
+  mGraph->addArc( mUnreachableVertex, 0, QVector<QVariant>() << 141.42 << 10. );
+
+  mCompactGraph = new QgsCompactGraph( mGraph );
+}
+
+void TestQgsNetworkAnalysis::cleanupTestCase()
+{
+  delete mCompactGraph;
+  delete mGraph;
+  QgsApplication::exitQgis();
+}
+
+void TestQgsNetworkAnalysis::verifyTree( const QVector<int>& tree, const QVector<double>& costs, int startVertexIdx, int criterionNum )
+{
+  QCOMPARE( tree.size(), mGraph->vertexCount() );
+  for ( int v = 0; v < mGraph->vertexCount(); ++v )
+  {
+    if ( tree[v] == -1 )
+    {
+      QVERIFY( v == startVertexIdx || costs[v] == std::numeric_limits<double>::infinity() );
+      continue;
+    }
+    const QgsGraphArc& arc = mGraph->arc( tree[v] );
+    QCOMPARE( arc.inVertex(), v );
+    QCOMPARE( costs[arc.outVertex()] + arc.property( criterionNum ).toDouble(), costs[v] );
+  }
+}
+
+void TestQgsNetworkAnalysis::compactGraph()
+{
+  QCOMPARE( mCompactGraph->vertexCount(), mGraph->vertexCount() );
+  QCOMPARE( mCompactGraph->arcCount(), mGraph->arcCount() );
+  QCOMPARE( mCompactGraph->criterionCount(), 2 );
+
+  for ( int v = 0; v < mGraph->vertexCount(); ++v )
+  {
+    QCOMPARE( mCompactGraph->vertexPoint( v ), mGraph->vertex( v ).point() );
+    const QgsGraphArcIdList outArcs = mGraph->vertex( v ).outArc();
+    QCOMPARE( mCompactGraph->outArcEnd( v ) - mCompactGraph->outArcBegin( v ), outArcs.size() );
+    int a = mCompactGraph->outArcBegin( v );
+    foreach ( int arcId, outArcs )
+    {
+      const QgsGraphArc& arc = mGraph->arc( arcId );
+      QCOMPARE( mCompactGraph->arcId( a ), arcId );
+      QCOMPARE( mCompactGraph->compactArcIdx( arcId ), a );
+      QCOMPARE( mCompactGraph->arcOutVertex( a ), v );
+      QCOMPARE( mCompactGraph->arcInVertex( a ), arc.inVertex() );
+      QCOMPARE( mCompactGraph->arcCosts( 0 )[a], arc.property( 0 ).toDouble() );
+      QCOMPARE( mCompactGraph->arcCosts( 1 )[a], arc.property( 1 ).toDouble() );
+      ++a;
+    }
+  }
+
+  // criteria beyond the arc properties cost nothing
+  for ( int a = 0; a < mCompactGraph->arcCount(); ++a )
+  {
+    QCOMPARE( mCompactGraph->arcCosts( 2 )[a], 0. );
+    QCOMPARE( mCompactGraph->arcCosts( -1 )[a], 0. );
+  }
+  QVector<double> costs;
+  QgsGraphAnalyzer::dijkstra( mCompactGraph, 0, 5, NULL, &costs );
+  QCOMPARE( costs[sGridColumns * sGridRows - 1], 0. );
+  QVERIFY( costs[mUnreachableVertex] == std::numeric_limits<double>::infinity() );
+
+  QCOMPARE( mCompactGraph->findVertex( QgsPoint( 300, 200 ) ), mGraph->findVertex( QgsPoint( 300, 200 ) ) );
+  QCOMPARE( mCompactGraph->findVertex( QgsPoint( 350, 200 ) ), -1 );
+}
+
+void TestQgsNetworkAnalysis::dijkstra()
+{
+  for ( int criterionNum = 0; criterionNum < 2; ++criterionNum )
+  {
+    foreach ( int startVertexIdx, QVector<int>() << 0 << 17 << sGridColumns * sGridRows - 1 )
+    {
+      QVector<int> expectedTree;
+      QVector<double> expectedCosts;
+      QgsGraphAnalyzer::dijkstra( mGraph, startVertexIdx, criterionNum, &expectedTree, &expectedCosts );
+
+      QVector<int> tree;
+      QVector<double> costs;
+      QgsGraphAnalyzer::dijkstra( mCompactGraph, startVertexIdx, criterionNum, &tree, &costs );
+
+      QCOMPARE( costs, expectedCosts );
+      QVERIFY( costs[mUnreachableVertex] == std::numeric_limits<double>::infinity() );
+      verifyTree( tree, costs, startVertexIdx, criterionNum );
+    }
+  }
+}
+
+void TestQgsNetworkAnalysis::dijkstraToTarget()
+{
+  int startVertexIdx = 14;
+  QVector<double> expectedCosts;
+  QgsGraphAnalyzer::dijkstra( mGraph, startVertexIdx, 1, NULL, &expectedCosts );
+
+  for ( int targetVertexIdx = 0; targetVertexIdx < mGraph->vertexCount(); ++targetVertexIdx )
+  {
+    QVector<int> tree;
+    QVector<double> costs;
+    QgsGraphAnalyzer::dijkstra( mCompactGraph, startVertexIdx, 1, &tree, &costs, targetVertexIdx );
+    QVERIFY( costs[targetVertexIdx] == expectedCosts[targetVertexIdx] );
+
+    // the path to the target is final and leads back to the start
+    int v = targetVertexIdx;
+    while ( tree[v] != -1 )
+    {
+      const QgsGraphArc& arc = mGraph->arc( tree[v] );
+      QCOMPARE( arc.inVertex(), v );
+      QCOMPARE( costs[arc.outVertex()] + arc.property( 1 ).toDouble(), costs[v] );
+      v = arc.outVertex();
+      QCOMPARE( costs[v], expectedCosts[v] );
+    }
+    QVERIFY( v == startVertexIdx || targetVertexIdx == mUnreachableVertex );
+  }
+}
+
+void TestQgsNetworkAnalysis::dijkstraFromStartCosts()
+{
+  // the search from several start vertices equals the search from an additional vertex with arcs of the start costs to them
+  QVector<int> startVertices = QVector<int>() << 5 << 40 << 41 << 5;
+  QVector<double> startCosts = QVector<double>() << 30 << 2.5 << 0 << 12;
+  QgsGraph graph( *mGraph );
+  int origin = graph.addVertex( QgsPoint( -200, -200 ) );
+  for ( int i = 0; i < startVertices.size(); ++i )
+  {
+    graph.addArc( origin, startVertices[i], QVector<QVariant>() << startCosts[i] << startCosts[i] );
+  }
+
+  for ( int criterionNum = 0; criterionNum < 2; ++criterionNum )
+  {
+    QVector<double> expectedCosts;
+    QgsGraphAnalyzer::dijkstra( &graph, origin, criterionNum, NULL, &expectedCosts );
+    expectedCosts.remove( origin );
+
+    QVector<int> tree;
+    QVector<double> costs;
+    QgsGraphAnalyzer::dijkstra( mCompactGraph, startVertices, startCosts, criterionNum, &tree, &costs );
+    QCOMPARE( costs, expectedCosts );
+    QVERIFY( costs[mUnreachableVertex] == std::numeric_limits<double>::infinity() );
+
+    // the tree leads back to the start vertex each vertex is reached from
+    for ( int v = 0; v < mGraph->vertexCount(); ++v )
+    {
+      if ( tree[v] == -1 )
+      {
+        QVERIFY( costs[v] == std::numeric_limits<double>::infinity() || startVertices.contains( v ) );
+        continue;
+      }
+      const QgsGraphArc& arc = mGraph->arc( tree[v] );
+      QCOMPARE( arc.inVertex(), v );
+      QCOMPARE( costs[arc.outVertex()] + arc.property( criterionNum ).toDouble(), costs[v] );
+    }
+    QCOMPARE( tree[41], -1 );
+    QVERIFY( costs[5] <= 12 );
+
+    // the costs of the paths to the targets are final when the search stops
+    QVector<int> targets = QVector<int>() << 100 << 7 << 100;
+    QVector<double> targetCosts;
+    QgsGraphAnalyzer::dijkstra( mCompactGraph, startVertices, startCosts, criterionNum, NULL, &targetCosts, targets );
+    foreach ( int target, targets )
+    {
+      QCOMPARE( targetCosts[target], costs[target] );
+    }
+  }
+}
+
+void TestQgsNetworkAnalysis::shortestTreeToTarget()
+{
+  int startVertexIdx = 5;
+  QVector<int> expectedTree;
+  QVector<double> expectedCosts;
+  QgsGraphAnalyzer::dijkstra( mGraph, startVertexIdx, 0, &expectedTree, &expectedCosts );
+
+  int targetVertexIdx = sGridColumns * sGridRows - 3;
+  QgsGraph* tree = QgsGraphAnalyzer::shortestTree( mCompactGraph, startVertexIdx, 0, targetVertexIdx );
+  int pathLength = 0;
+  for ( int v = targetVertexIdx; expectedTree[v] != -1; v = mGraph->arc( expectedTree[v] ).outVertex() )
+  {
+    ++pathLength;
+  }
+  QVERIFY( pathLength > 0 );
+  QCOMPARE( tree->arcCount(), pathLength );
+  QCOMPARE( tree->vertexCount(), pathLength + 1 );
+
+  // walk the path from the start, the arcs carry the costs of all criteria
+  int v = tree->findVertex( mGraph->vertex( startVertexIdx ).point() );
+  QVERIFY( v != -1 );
+  double length = 0;
+  for ( int i = 0; i < pathLength; ++i )
+  {
+    QCOMPARE( tree->vertex( v ).outArc().size(), 1 );
+    const QgsGraphArc& arc = tree->arc( tree->vertex( v ).outArc().first() );
+    QCOMPARE( arc.properties().size(), 2 );
+    length += arc.property( 0 ).toDouble();
+    v = arc.inVertex();
+  }
+  QCOMPARE( tree->vertex( v ).point(), mGraph->vertex( targetVertexIdx ).point() );
+  QVERIFY( qgsDoubleNear( length, expectedCosts[targetVertexIdx], 1E-9 ) );
+  delete tree;
+
+  // the tree to an unreachable target only holds the start
+  tree = QgsGraphAnalyzer::shortestTree( mCompactGraph, startVertexIdx, 0, mUnreachableVertex );
+  QCOMPARE( tree->vertexCount(), 1 );
+  QCOMPARE( tree->arcCount(), 0 );
+  delete tree;
+}
+
+void TestQgsNetworkAnalysis::costMatrix()
+{
+  // includes an origin which is a destination, an unreachable and a repeated destination
+  QVector<int> origins = QVector<int>() << 0 << 23 << 50 << mUnreachableVertex;
+  QVector<int> destinations = QVector<int>() << 50 << 7 << mUnreachableVertex << sGridColumns * sGridRows - 1 << 7;
+  QVector< QVector<double> > matrix = QgsGraphAnalyzer::costMatrix( mCompactGraph, origins, destinations, 1 );
+
+  QCOMPARE( matrix.size(), origins.size() );
+  for ( int i = 0; i < origins.size(); ++i )
+  {
+    QVector<double> expectedCosts;
+    QgsGraphAnalyzer::dijkstra( mGraph, origins[i], 1, NULL, &expectedCosts );
+    QCOMPARE( matrix[i].size(), destinations.size() );
+    for ( int j = 0; j < destinations.size(); ++j )
+    {
+      QVERIFY( matrix[i][j] == expectedCosts[destinations[j]] );
+    }
+  }
+  QVERIFY( matrix[2][0] == 0. );
+  QVERIFY( matrix[0][2] == std::numeric_limits<double>::infinity() );
+}
+
+void TestQgsNetworkAnalysis::isochrones()
+{
+  QVector<int> startVertices = QVector<int>() << 13 << 90;
+  QVector<double> thresholds = QVector<double>() << 30 << 12.5 << 60 << 0;
+  QVector< QVector<int> > result = QgsGraphAnalyzer::isochrones( mCompactGraph, startVertices, 1, thresholds );
+  QCOMPARE( result.size(), thresholds.size() );
+
+  // the cost of each vertex from the nearest start
+  QVector<double> costs( mGraph->vertexCount(), std::numeric_limits<double>::infinity() );
+  foreach ( int startVertexIdx, startVertices )
+  {
+    QVector<double> startCosts;
+    QgsGraphAnalyzer::dijkstra( mGraph, startVertexIdx, 1, NULL, &startCosts );
+    for ( int v = 0; v < costs.size(); ++v )
+    {
+      costs[v] = qMin( costs[v], startCosts[v] );
+    }
+  }
+
+  for ( int k = 0; k < thresholds.size(); ++k )
+  {
+    // the arcs which can be traversed completely within the threshold
+    QList<int> expected;
+    bool endVertexCheaper = false;
+    for ( int arcId = 0; arcId < mGraph->arcCount(); ++arcId )
+    {
+      const QgsGraphArc& arc = mGraph->arc( arcId );
+      double endCost = costs[arc.outVertex()] + arc.property( 1 ).toDouble();
+      if ( endCost <= thresholds[k] )
+      {
+        expected.append( arcId );
+      }
+      else if ( costs[arc.inVertex()] <= thresholds[k] )
+      {
+        endVertexCheaper = true;
+      }
+    }
+    QList<int> arcs = result[k].toList();
+    qSort( arcs );
+    QCOMPARE( arcs, expected );
+    // some arcs end at a vertex within the threshold, but are not traversable within it
+    QVERIFY( endVertexCheaper );
+  }
+  QVERIFY( result[3].isEmpty() );
+  QVERIFY( result[1].size() < result[0].size() && result[0].size() < result[2].size() );
+}
+
+QgsGraph* TestQgsNetworkAnalysis::buildGraph( const QList<QgsPolyline>& lines, double topologyTolerance,
+    const QVector<QgsPoint>& additionalPoints, QVector<QgsPoint>& tiedPoints )
+{
+  QgsVectorLayer layer( "LineString?crs=EPSG:3857", "lines", "memory" );
+  QgsFeatureList features;
+  foreach ( const QgsPolyline& line, lines )
+  {
+    QgsFeature f( layer.dataProvider()->fields() );
+    f.setGeometry( QgsGeometry::fromPolyline( line ) );
+    features.append( f );
+  }
+  layer.dataProvider()->addFeatures( features );
+
+  // both directions, the distance as the only criterion
+  QgsLineVectorLayerDirector director( &layer, -1, "", "", "", 3 );
+  director.addProperter( new QgsDistanceArcProperter() );
+  QgsGraphBuilder builder( layer.crs(), false, topologyTolerance );
+  director.makeGraph( &builder, additionalPoints, tiedPoints );
+  return builder.graph();
+}
+
+void TestQgsNetworkAnalysis::tiePoints()
+{
+  // streets of different lengths and directions, so that the tie point grid has many cells
+  QList<QgsPolyline> lines;
+  for ( int i = 0; i < 60; ++i )
+  {
+    QgsPoint start( 1000 + 2000 * qAbs( qSin( i * 12.9898 ) ), 1000 + 1500 * qAbs( qSin( i * 78.233 ) ) );
+    QgsPolyline line;
+    line << start << QgsPoint( start.x() + 300 * qCos( i * 0.9 ), start.y() + 200 * qSin( i * 0.9 ) )
+    << QgsPoint( start.x() + 50 * ( i % 7 ), start.y() - 400 + 13 * ( i % 5 ) );
+    lines.append( line );
+  }
+  // a single long street crossing the others
+  lines.append( QgsPolyline() << QgsPoint( 900, 900 ) << QgsPoint( 3300, 2800 ) );
+
+  // points in between the streets, and far outside of them
+  QVector<QgsPoint> additionalPoints;
+  for ( int i = 0; i < 150; ++i )
+  {
+    additionalPoints.append( QgsPoint( 800 + 2700 * qAbs( qSin( i * 3.7 + 0.3 ) ), 500 + 2300 * qAbs( qCos( i * 5.3 + 0.1 ) ) ) );
+  }
+  additionalPoints << QgsPoint( -5000, 1500 ) << QgsPoint( 2000, 20000 ) << QgsPoint( 10000, -10000 );
+
+  QVector<QgsPoint> tiedPoints;
+  QgsGraph* graph = buildGraph( lines, 0, additionalPoints, tiedPoints );
+  QVERIFY( graph );
+  QCOMPARE( tiedPoints.size(), additionalPoints.size() );
+
+  QList<QgsPoint> graphPoints;
+  for ( int v = 0; v < graph->vertexCount(); ++v )
+  {
+    graphPoints.append( graph->vertex( v ).point() );
+  }
+  for ( int i = 0; i < additionalPoints.size(); ++i )
+  {
+    // the nearest point on any segment, found by testing all of them
+    double minDist = std::numeric_limits<double>::infinity();
+    QgsPoint expected;
+    foreach ( const QgsPolyline& line, lines )
+    {
+      for ( int k = 0; k + 1 < line.size(); ++k )
+      {
+        QgsPoint closest;
+        double dist = additionalPoints[i].sqrDistToSegment( line[k].x(), line[k].y(), line[k + 1].x(), line[k + 1].y(), closest );
+        if ( dist < minDist )
+        {
+          minDist = dist;
+          expected = closest;
+        }
+      }
+    }
+    QCOMPARE( tiedPoints[i], expected );
+    // the segment is split at the tied point
+    QVERIFY( graphPoints.contains( tiedPoints[i] ) );
+  }
+  delete graph;
+}
+
+void TestQgsNetworkAnalysis::topologyTolerance()
+{
+  // the ends of the streets are within the tolerance of each other, on both sides of the axes
+  double tolerance = 0.5;
+  QList<QgsPolyline> lines;
+  lines << ( QgsPolyline() << QgsPoint( -10, 0 ) << QgsPoint( -0.4, -0.3 ) );
+  lines << ( QgsPolyline() << QgsPoint( 0, 0 ) << QgsPoint( 10, 0 ) );
+  lines << ( QgsPolyline() << QgsPoint( -0.2, 0 ) << QgsPoint( 0, -10 ) );
+  lines << ( QgsPolyline() << QgsPoint( 9.8, -0.3 ) << QgsPoint( 10, 10 ) );
+
+  QVector<QgsPoint> tiedPoints;
+  QgsGraph* graph = buildGraph( lines, tolerance, QVector<QgsPoint>(), tiedPoints );
+  QVERIFY( graph );
+  QCOMPARE( graph->vertexCount(), 5 );
+  QCOMPARE( graph->arcCount(), 8 );
+  // the merged vertex is the first one of the layer
+  QCOMPARE( graph->vertex( 1 ).point(), QgsPoint( -0.4, -0.3 ) );
+  QCOMPARE( graph->vertex( 1 ).outArc().size(), 3 );
+
+  // all streets are connected
+  QVector<double> costs;
+  QgsGraphAnalyzer::dijkstra( graph, 0, 0, NULL, &costs );
+  foreach ( double cost, costs )
+  {
+    QVERIFY( cost < std::numeric_limits<double>::infinity() );
+  }
+  delete graph;
+
+  // without tolerance, only equal vertices are merged, including -0.0 and +0.0
+  lines.clear();
+  lines << ( QgsPolyline() << QgsPoint( -10, 5 ) << QgsPoint( -0.0, 5 ) );
+  lines << ( QgsPolyline() << QgsPoint( 0.0, 5 ) << QgsPoint( 10, 5 ) );
+  lines << ( QgsPolyline() << QgsPoint( 0.0001, 5 ) << QgsPoint( 0, -10 ) );
+  graph = buildGraph( lines, 0, QVector<QgsPoint>(), tiedPoints );
+  QVERIFY( graph );
+  QCOMPARE( graph->vertexCount(), 5 );
+  QCOMPARE( graph->vertex( 1 ).outArc().size(), 2 );
+  delete graph;
+}
+
+QTEST_MAIN( TestQgsNetworkAnalysis )
+#include "testqgsnetworkanalysis.moc"
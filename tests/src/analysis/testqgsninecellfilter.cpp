@@ -0,0 +1,157 @@
+/***************************************************************************
+     testqgsninecellfilter.cpp
+     -------------------------
+    Date                 : October 2016
+    Copyright            : (C) 2016 by Sandro Mani
+    Email                : manisandro@gmail.com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest/QtTest>
+#include <QObject>
+#include <QDir>
+#include <QVector>
+#include <qmath.h>
+
+#include <gdal.h>
+
+#include "qgsapplication.h"
+#include "qgsaspectfilter.h"
+#include "qgshillshadefilter.h"
+#include "qgsslopefilter.h"
+
+/** \ingroup UnitTests
+ * Compares the row kernels of the derivative filters in tiled execution with the per cell scanline execution
+ */
+class TestQgsNineCellFilter : public QObject
+{
+    Q_OBJECT
+
+  private slots:
+    void initTestCase();// will be called before the first testfunction is executed.
+    void cleanupTestCase();// will be called after the last testfunction was executed.
+    void init() {} // will be called before each testfunction is executed.
+    void cleanup() {} // will be called after every testfunction.
+    void slope();
+    void aspect();
+    void hillshade();
+
+  private:
+    //! runs the filter and returns its output, or an empty vector on failure
+    QVector<float> run( QgsNineCellFilter& filter );
+
+    QString mInputFile;
+    QString mOutputFile;
+};
+
+static const int sDemWidth = 61;
+static const int sDemHeight = 47;
+static const float sDemNodata = -32768;
+
+void TestQgsNineCellFilter::initTestCase()
+{
+  QgsApplication::init();
+  QgsApplication::initQgis();
+  GDALAllRegister();
+
+  mInputFile = QDir::tempPath() + "/testqgsninecellfilter_dem.tif";
+  mOutputFile = QDir::tempPath() + "/testqgsninecellfilter_out.tif";
+
+  // smooth terrain with a flat area and some nodata cells, so that all branches of the derivatives are taken
+  QVector<float> heights( sDemWidth * sDemHeight );
+  for ( int row = 0; row < sDemHeight; ++row )
+  {
+    for ( int col = 0; col < sDemWidth; ++col )
+    {
+      float height = 500 + 40 * qSin( col * 0.21 ) * qCos( row * 0.17 ) + 3.5 * row;
+      if ( col > 40 && row > 30 )
+      {
+        height = 600;
+      }
+      if (( col * 7 + row * 13 ) % 53 == 0 || ( row == 20 && col > 10 && col < 14 ) )
+      {
+        height = sDemNodata;
+      }
+      heights[row * sDemWidth + col] = height;
+    }
+  }
+
+  GDALDriverH driver = GDALGetDriverByName( "GTiff" );
+  GDALDatasetH dataset = GDALCreate( driver, mInputFile.toUtf8().constData(), sDemWidth, sDemHeight, 1, GDT_Float32, 0 );
+  QVERIFY( dataset );
+  double geoTransform[6] = { 600000, 25, 0, 200000, 0, -20 };
+  GDALSetGeoTransform( dataset, geoTransform );
+  GDALRasterBandH band = GDALGetRasterBand( dataset, 1 );
+  GDALSetRasterNoDataValue( band, sDemNodata );
+  QCOMPARE( GDALRasterIO( band, GF_Write, 0, 0, sDemWidth, sDemHeight, heights.data(), sDemWidth, sDemHeight, GDT_Float32, 0, 0 ), CE_None );
+  GDALClose( dataset );
+}
+
+void TestQgsNineCellFilter::cleanupTestCase()
+{
+  QFile::remove( mInputFile );
+  QFile::remove( mOutputFile );
+  QgsApplication::exitQgis();
+}
+
+QVector<float> TestQgsNineCellFilter::run( QgsNineCellFilter& filter )
+{
+  filter.setZFactor( 1.5 );
+  if ( filter.processRaster( 0 ) != 0 )
+  {
+    return QVector<float>();
+  }
+  GDALDatasetH dataset = GDALOpen( mOutputFile.toUtf8().constData(), GA_ReadOnly );
+  if ( !dataset )
+  {
+    return QVector<float>();
+  }
+  QVector<float> values( sDemWidth * sDemHeight );
+  CPLErr err = GDALRasterIO( GDALGetRasterBand( dataset, 1 ), GF_Read, 0, 0, sDemWidth, sDemHeight, values.data(), sDemWidth, sDemHeight, GDT_Float32, 0, 0 );
+  GDALClose( dataset );
+  return err == CE_None ? values : QVector<float>();
+}
+
+void TestQgsNineCellFilter::slope()
+{
+  QgsSlopeFilter tiledFilter( mInputFile, mOutputFile, "GTiff" );
+  QVector<float> tiled = run( tiledFilter );
+  QgsSlopeFilter scanlineFilter( mInputFile, mOutputFile, "GTiff" );
+  scanlineFilter.setTiledExecution( false );
+  QVector<float> scanline = run( scanlineFilter );
+
+  QCOMPARE( tiled.size(), sDemWidth * sDemHeight );
+  QVERIFY( memcmp( tiled.constData(), scanline.constData(), tiled.size() * sizeof( float ) ) == 0 );
+}
+
+void TestQgsNineCellFilter::aspect()
+{
+  QgsAspectFilter tiledFilter( mInputFile, mOutputFile, "GTiff" );
+  QVector<float> tiled = run( tiledFilter );
+  QgsAspectFilter scanlineFilter( mInputFile, mOutputFile, "GTiff" );
+  scanlineFilter.setTiledExecution( false );
+  QVector<float> scanline = run( scanlineFilter );
+
+  QCOMPARE( tiled.size(), sDemWidth * sDemHeight );
+  QVERIFY( memcmp( tiled.constData(), scanline.constData(), tiled.size() * sizeof( float ) ) == 0 );
+}
+
+void TestQgsNineCellFilter::hillshade()
+{
+  QgsHillshadeFilter tiledFilter( mInputFile, mOutputFile, "GTiff", 315, 35 );
+  QVector<float> tiled = run( tiledFilter );
+  QgsHillshadeFilter scanlineFilter( mInputFile, mOutputFile, "GTiff", 315, 35 );
+  scanlineFilter.setTiledExecution( false );
+  QVector<float> scanline = run( scanlineFilter );
+
+  QCOMPARE( tiled.size(), sDemWidth * sDemHeight );
+  QVERIFY( memcmp( tiled.constData(), scanline.constData(), tiled.size() * sizeof( float ) ) == 0 );
+}
+
+QTEST_MAIN( TestQgsNineCellFilter )
+#include "testqgsninecellfilter.moc"
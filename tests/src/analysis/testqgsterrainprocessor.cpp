@@ -0,0 +1,167 @@
+/***************************************************************************
+     testqgsterrainprocessor.cpp
+     ---------------------------
+    Date                 : October 2016
+    Copyright            : (C) 2016 by Sandro Mani
+    Email                : manisandro@gmail.com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest/QtTest>
+#include <QObject>
+#include <QDir>
+#include <QVector>
+#include <qmath.h>
+
+#include <gdal.h>
+
+#include "qgsapplication.h"
+#include "qgsaspectfilter.h"
+#include "qgshillshadefilter.h"
+#include "qgsruggednessfilter.h"
+#include "qgsslopefilter.h"
+#include "qgsterrainprocessor.h"
+
+/** \ingroup UnitTests
+ * Compares the products of the single pass terrain processor with the outputs of the separate filters
+ */
+class TestQgsTerrainProcessor : public QObject
+{
+    Q_OBJECT
+
+  private slots:
+    void initTestCase();// will be called before the first testfunction is executed.
+    void cleanupTestCase();// will be called after the last testfunction was executed.
+    void init() {} // will be called before each testfunction is executed.
+    void cleanup() {} // will be called after every testfunction.
+    void productsEqualFilters();
+
+  private:
+    //! reads an output file, or returns an empty vector on failure
+    QVector<float> read( const QString& file ) const;
+    //! runs the filter and returns its output, or an empty vector on failure
+    QVector<float> run( QgsNineCellFilter& filter ) const;
+    QString outputFile( const QString& name ) const;
+
+    QString mInputFile;
+};
+
+static const int sDemWidth = 61;
+static const int sDemHeight = 47;
+static const float sDemNodata = -32768;
+static const double sZFactor = 1.5;
+
+void TestQgsTerrainProcessor::initTestCase()
+{
+  QgsApplication::init();
+  QgsApplication::initQgis();
+  GDALAllRegister();
+
+  mInputFile = QDir::tempPath() + "/testqgsterrainprocessor_dem.tif";
+
+  // smooth terrain with a flat area and some nodata cells, so that all branches of the derivatives are taken
+  QVector<float> heights( sDemWidth * sDemHeight );
+  for ( int row = 0; row < sDemHeight; ++row )
+  {
+    for ( int col = 0; col < sDemWidth; ++col )
+    {
+      float height = 500 + 40 * qSin( col * 0.21 ) * qCos( row * 0.17 ) + 3.5 * row;
+      if ( col > 40 && row > 30 )
+      {
+        height = 600;
+      }
+      if (( col * 7 + row * 13 ) % 53 == 0 || ( row == 20 && col > 10 && col < 14 ) )
+      {
+        height = sDemNodata;
+      }
+      heights[row * sDemWidth + col] = height;
+    }
+  }
+
+  GDALDriverH driver = GDALGetDriverByName( "GTiff" );
+  GDALDatasetH dataset = GDALCreate( driver, mInputFile.toUtf8().constData(), sDemWidth, sDemHeight, 1, GDT_Float32, 0 );
+  QVERIFY( dataset );
+  double geoTransform[6] = { 600000, 25, 0, 200000, 0, -20 };
+  GDALSetGeoTransform( dataset, geoTransform );
+  GDALRasterBandH band = GDALGetRasterBand( dataset, 1 );
+  GDALSetRasterNoDataValue( band, sDemNodata );
+  QCOMPARE( GDALRasterIO( band, GF_Write, 0, 0, sDemWidth, sDemHeight, heights.data(), sDemWidth, sDemHeight, GDT_Float32, 0, 0 ), CE_None );
+  GDALClose( dataset );
+}
+
+void TestQgsTerrainProcessor::cleanupTestCase()
+{
+  QFile::remove( mInputFile );
+  foreach ( const QString& name, QStringList() << "slope" << "aspect" << "hillshade" << "ruggedness" << "filter" )
+  {
+    QFile::remove( outputFile( name ) );
+  }
+  QgsApplication::exitQgis();
+}
+
+QString TestQgsTerrainProcessor::outputFile( const QString& name ) const
+{
+  return QDir::tempPath() + "/testqgsterrainprocessor_" + name + ".tif";
+}
+
+QVector<float> TestQgsTerrainProcessor::read( const QString& file ) const
+{
+  GDALDatasetH dataset = GDALOpen( file.toUtf8().constData(), GA_ReadOnly );
+  if ( !dataset )
+  {
+    return QVector<float>();
+  }
+  QVector<float> values( sDemWidth * sDemHeight );
+  CPLErr err = GDALRasterIO( GDALGetRasterBand( dataset, 1 ), GF_Read, 0, 0, sDemWidth, sDemHeight, values.data(), sDemWidth, sDemHeight, GDT_Float32, 0, 0 );
+  GDALClose( dataset );
+  return err == CE_None ? values : QVector<float>();
+}
+
+QVector<float> TestQgsTerrainProcessor::run( QgsNineCellFilter& filter ) const
+{
+  filter.setZFactor( sZFactor );
+  if ( filter.processRaster( 0 ) != 0 )
+  {
+    return QVector<float>();
+  }
+  return read( outputFile( "filter" ) );
+}
+
+void TestQgsTerrainProcessor::productsEqualFilters()
+{
+  QgsTerrainProcessor processor( mInputFile, "GTiff" );
+  processor.setZFactor( sZFactor );
+  processor.addProduct( QgsTerrainProcessor::Slope, outputFile( "slope" ) );
+  processor.addProduct( QgsTerrainProcessor::Aspect, outputFile( "aspect" ) );
+  processor.addProduct( QgsTerrainProcessor::Hillshade, outputFile( "hillshade" ), 315, 35 );
+  processor.addProduct( QgsTerrainProcessor::Ruggedness, outputFile( "ruggedness" ) );
+  QCOMPARE( processor.processRaster( 0 ), 0 );
+
+  QgsSlopeFilter slopeFilter( mInputFile, outputFile( "filter" ), "GTiff" );
+  QVector<float> slope = run( slopeFilter );
+  QgsAspectFilter aspectFilter( mInputFile, outputFile( "filter" ), "GTiff" );
+  QVector<float> aspect = run( aspectFilter );
+  QgsHillshadeFilter hillshadeFilter( mInputFile, outputFile( "filter" ), "GTiff", 315, 35 );
+  QVector<float> hillshade = run( hillshadeFilter );
+  QgsRuggednessFilter ruggednessFilter( mInputFile, outputFile( "filter" ), "GTiff" );
+  QVector<float> ruggedness = run( ruggednessFilter );
+
+  // cell for cell equal, including the nodata cells
+  QCOMPARE( slope.size(), sDemWidth * sDemHeight );
+  QVERIFY( slope.contains( -9999 ) );
+  QVERIFY( read( outputFile( "slope" ) ) == slope );
+  QCOMPARE( aspect.size(), sDemWidth * sDemHeight );
+  QVERIFY( read( outputFile( "aspect" ) ) == aspect );
+  QCOMPARE( hillshade.size(), sDemWidth * sDemHeight );
+  QVERIFY( read( outputFile( "hillshade" ) ) == hillshade );
+  QCOMPARE( ruggedness.size(), sDemWidth * sDemHeight );
+  QVERIFY( read( outputFile( "ruggedness" ) ) == ruggedness );
+}
+
+QTEST_MAIN( TestQgsTerrainProcessor )
+#include "testqgsterrainprocessor.moc"
@@ -0,0 +1,126 @@
+/***************************************************************************
+     testqgstininterpolator.cpp
+     --------------------------
+    Date                 : October 2016
+    Copyright            : (C) 2016 by Sandro Mani
+    Email                : manisandro@gmail.com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest/QtTest>
+#include <QObject>
+#include <qmath.h>
+
+#include "qgsapplication.h"
+#include "qgsfeature.h"
+#include "qgsgeometry.h"
+#include "qgstininterpolator.h"
+#include "qgsvectordataprovider.h"
+#include "qgsvectorlayer.h"
+#include "DualEdgeTriangulation.h"
+#include "LinTriangleInterpolator.h"
+
+/** \ingroup UnitTests
+ * Compares the linear TIN interpolation with the triangle interpolator of the triangulation
+ */
+class TestQgsTINInterpolator : public QObject
+{
+    Q_OBJECT
+
+  public:
+    TestQgsTINInterpolator();
+
+  private slots:
+    void initTestCase();// will be called before the first testfunction is executed.
+    void cleanupTestCase();// will be called after the last testfunction was executed.
+    void init() {} // will be called before each testfunction is executed.
+    void cleanup() {} // will be called after every testfunction.
+    void linearEqualsTriangleInterpolator();
+
+  private:
+    QgsVectorLayer* mLayer;
+    QList<Point3D> mPoints;
+};
+
+TestQgsTINInterpolator::TestQgsTINInterpolator()
+    : mLayer( 0 )
+{
+}
+
+void TestQgsTINInterpolator::initTestCase()
+{
+  QgsApplication::init();
+  QgsApplication::initQgis();
+
+  // scattered points with a smooth surface on top
+  mLayer = new QgsVectorLayer( "Point?field=z:double", "points", "memory" );
+  QVERIFY( mLayer->isValid() );
+  QgsFeatureList features;
+  for ( int i = 0; i < 400; ++i )
+  {
+    double x = 1000 + 997 * qAbs( qSin( i * 12.9898 ) );
+    double y = 2000 + 991 * qAbs( qSin( i * 78.233 ) );
+    double z = 400 + 50 * qSin( x * 0.01 ) * qCos( y * 0.013 );
+    QgsFeature f( mLayer->dataProvider()->fields(), i + 1 );
+    f.setGeometry( QgsGeometry::fromPoint( QgsPoint( x, y ) ) );
+    f.setAttribute( "z", z );
+    features.append( f );
+    mPoints.append( Point3D( x, y, z ) );
+  }
+  QVERIFY( mLayer->dataProvider()->addFeatures( features ) );
+}
+
+void TestQgsTINInterpolator::cleanupTestCase()
+{
+  delete mLayer;
+  QgsApplication::exitQgis();
+}
+
+void TestQgsTINInterpolator::linearEqualsTriangleInterpolator()
+{
+  QgsInterpolator::LayerData layerData;
+  layerData.vectorLayer = mLayer;
+  layerData.zCoordInterpolation = false;
+  layerData.interpolationAttribute = 0;
+  layerData.mInputType = QgsInterpolator::POINTS;
+  QgsTINInterpolator tinInterpolator( QList<QgsInterpolator::LayerData>() << layerData, QgsTINInterpolator::Linear );
+  QVERIFY( tinInterpolator.prepareConcurrentInterpolation() );
+
+  // the same triangulation, evaluated with the triangle search of the triangulation
+  DualEdgeTriangulation triangulation( 100000, 0 );
+  foreach ( const Point3D& p, mPoints )
+  {
+    triangulation.addPoint( new Point3D( p ) );
+  }
+  LinTriangleInterpolator triangleInterpolator( &triangulation );
+
+  // sample a grid extending beyond the convex hull
+  int nInside = 0;
+  for ( int row = 0; row < 60; ++row )
+  {
+    for ( int col = 0; col < 60; ++col )
+    {
+      double x = 950.3 + col * 18.31;
+      double y = 1950.7 + row * 18.17;
+      double result = 0;
+      int ret = tinInterpolator.interpolatePoint( x, y, result );
+      Point3D expected;
+      bool ok = triangleInterpolator.calcPoint( x, y, &expected );
+      QCOMPARE( ret == 0, ok );
+      if ( ok )
+      {
+        QVERIFY( qgsDoubleNear( result, expected.getZ(), 1E-9 ) );
+        ++nInside;
+      }
+    }
+  }
+  QVERIFY( nInside > 0 && nInside < 3600 );
+}
+
+QTEST_MAIN( TestQgsTINInterpolator )
+#include "testqgstininterpolator.moc"
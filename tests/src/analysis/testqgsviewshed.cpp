@@ -0,0 +1,433 @@
+/***************************************************************************
+     testqgsviewshed.cpp
+     -------------------
+    Date                 : October 2016
+    Copyright            : (C) 2016 by Sandro Mani
+    Email                : manisandro@gmail.com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest/QtTest>
+#include <QObject>
+#include <QDir>
+#include <QPolygon>
+#include <QVector>
+#include <qmath.h>
+
+#include <gdal.h>
+
+#include "qgsapplication.h"
+#include "qgscoordinatereferencesystem.h"
+#include "qgspoint.h"
+#include "qgsviewshed.h"
+
+/** \ingroup UnitTests
+ * Tests of the viewshed computation
+ */
+class TestQgsViewshed : public QObject
+{
+    Q_OBJECT
+
+  private slots:
+    void initTestCase();// will be called before the first testfunction is executed.
+    void cleanupTestCase();// will be called after the last testfunction was executed.
+    void init() {} // will be called before each testfunction is executed.
+    void cleanup(); // will be called after every testfunction.
+    void tiledEqualsInMemory_data();
+    void tiledEqualsInMemory();
+    void parallelEqualsSerial_data();
+    void parallelEqualsSerial();
+    void cumulativeEqualsSingleViewsheds_data();
+    void cumulativeEqualsSingleViewsheds();
+
+  private:
+    //! computes the viewshed of the observer in the middle of the DEM and returns the output, or an empty vector on failure
+    QVector<unsigned char> computeViewshed( int accuracyFactor, int& width, int& height, double radius = 4005, const QVector<QgsPoint>& filterRegion = QVector<QgsPoint>() );
+    //! computes the viewshed with the serial single ray sweep, or returns an empty vector on failure
+    QVector<unsigned char> computeSerialViewshed( int accuracyFactor, int& width, int& height, double radius, const QVector<QgsPoint>& filterRegion );
+    //! reads the output as UInt32 values, or returns an empty vector on failure
+    QVector<quint32> readOutput( int& width, int& height, double geoTransform[6] ) const;
+
+    QString mInputFile;
+    QString mOutputFile;
+    QgsCoordinateReferenceSystem mCrs;
+    qint64 mDefaultMaxInMemoryBytes;
+};
+
+static const int sDemWidth = 1201;
+static const int sDemHeight = 1001;
+static const float sDemNodata = -9999;
+// observer in the middle of the DEM
+static const double sObserverX = 606000;
+static const double sObserverY = 195000;
+
+Q_DECLARE_METATYPE( QVector<QgsPoint> )
+
+static inline double geoToPixelX( const double gtrans[6], double x, double y )
+{
+  return ( -gtrans[0] * gtrans[5] + gtrans[2] * gtrans[3] - gtrans[2] * y + gtrans[5] * x ) / ( gtrans[1] * gtrans[5] - gtrans[2] * gtrans[4] );
+}
+
+static inline double geoToPixelY( const double gtrans[6], double x, double y )
+{
+  return ( -gtrans[0] * gtrans[4] + gtrans[1] * gtrans[3] - gtrans[1] * y + gtrans[4] * x ) / ( gtrans[2] * gtrans[4] - gtrans[1] * gtrans[5] );
+}
+
+void TestQgsViewshed::initTestCase()
+{
+  QgsApplication::init();
+  QgsApplication::initQgis();
+  GDALAllRegister();
+  mDefaultMaxInMemoryBytes = QgsViewshed::maxInMemoryBytes();
+
+  mInputFile = QDir::tempPath() + "/testqgsviewshed_dem.tif";
+  mOutputFile = QDir::tempPath() + "/testqgsviewshed_out.tif";
+  mCrs.createFromOgcWmsCrs( "EPSG:21781" );
+
+  // hills and valleys, with some nodata cells
+  QVector<float> heights( sDemWidth * sDemHeight );
+  for ( int row = 0; row < sDemHeight; ++row )
+  {
+    for ( int col = 0; col < sDemWidth; ++col )
+    {
+      float height = 500 + 80 * qSin( col * 0.013 ) * qCos( row * 0.011 ) + 30 * qSin( col * 0.047 + row * 0.031 );
+      if (( col * 7 + row * 13 ) % 997 == 0 )
+      {
+        height = sDemNodata;
+      }
+      heights[row * sDemWidth + col] = height;
+    }
+  }
+
+  GDALDriverH driver = GDALGetDriverByName( "GTiff" );
+  GDALDatasetH dataset = GDALCreate( driver, mInputFile.toUtf8().constData(), sDemWidth, sDemHeight, 1, GDT_Float32, 0 );
+  QVERIFY( dataset );
+  double geoTransform[6] = { 600000, 10, 0, 200000, 0, -10 };
+  GDALSetGeoTransform( dataset, geoTransform );
+  GDALSetProjection( dataset, mCrs.toWkt().toUtf8().constData() );
+  GDALRasterBandH band = GDALGetRasterBand( dataset, 1 );
+  GDALSetRasterNoDataValue( band, sDemNodata );
+  QCOMPARE( GDALRasterIO( band, GF_Write, 0, 0, sDemWidth, sDemHeight, heights.data(), sDemWidth, sDemHeight, GDT_Float32, 0, 0 ), CE_None );
+  GDALClose( dataset );
+}
+
+void TestQgsViewshed::cleanupTestCase()
+{
+  QFile::remove( mInputFile );
+  QFile::remove( mOutputFile );
+  QgsApplication::exitQgis();
+}
+
+void TestQgsViewshed::cleanup()
+{
+  QgsViewshed::setMaxInMemoryBytes( mDefaultMaxInMemoryBytes );
+}
+
+QVector<unsigned char> TestQgsViewshed::computeViewshed( int accuracyFactor, int& width, int& height, double radius, const QVector<QgsPoint>& filterRegion )
+{
+  // the radius is not a multiple of the cell size, so that the window is not a multiple of the accuracy factor
+  if ( !QgsViewshed::computeViewshed( mInputFile, mOutputFile, "GTiff", QgsPoint( sObserverX, sObserverY ), mCrs, 2, 0, true, radius, QGis::Meters, filterRegion, true, accuracyFactor ) )
+  {
+    return QVector<unsigned char>();
+  }
+  GDALDatasetH dataset = GDALOpen( mOutputFile.toUtf8().constData(), GA_ReadOnly );
+  if ( !dataset )
+  {
+    return QVector<unsigned char>();
+  }
+  width = GDALGetRasterXSize( dataset );
+  height = GDALGetRasterYSize( dataset );
+  QVector<unsigned char> values( width * height );
+  CPLErr err = GDALRasterIO( GDALGetRasterBand( dataset, 1 ), GF_Read, 0, 0, width, height, values.data(), width, height, GDT_Byte, 0, 0 );
+  GDALClose( dataset );
+  return err == CE_None ? values : QVector<unsigned char>();
+}
+
+void TestQgsViewshed::tiledEqualsInMemory_data()
+{
+  QTest::addColumn<int>( "accuracyFactor" );
+
+  QTest::newRow( "full accuracy" ) << 1;
+  QTest::newRow( "reduced accuracy" ) << 3;
+}
+
+void TestQgsViewshed::tiledEqualsInMemory()
+{
+  QFETCH( int, accuracyFactor );
+
+  int width = 0, height = 0;
+  QVector<unsigned char> inMemory = computeViewshed( accuracyFactor, width, height );
+  QVERIFY( !inMemory.isEmpty() );
+  QVERIFY( inMemory.contains( 0 ) && inMemory.contains( 255 ) );
+
+  // any heightmap exceeds the limit, so that it is streamed in tiles
+  QgsViewshed::setMaxInMemoryBytes( 1 );
+  int tiledWidth = 0, tiledHeight = 0;
+  QVector<unsigned char> tiled = computeViewshed( accuracyFactor, tiledWidth, tiledHeight );
+  QCOMPARE( tiledWidth, width );
+  QCOMPARE( tiledHeight, height );
+  QVERIFY( tiled == inMemory );
+}
+
+QVector<unsigned char> TestQgsViewshed::computeSerialViewshed( int accuracyFactor, int& width, int& height, double radius, const QVector<QgsPoint>& filterRegion )
+{
+  // Straight port of the viewshed sweep before it was parallelized, for a north-up DEM in meters
+  GDALDatasetH dataset = GDALOpen( mInputFile.toUtf8().constData(), GA_ReadOnly );
+  if ( !dataset )
+  {
+    return QVector<unsigned char>();
+  }
+  GDALRasterBandH band = GDALGetRasterBand( dataset, 1 );
+  float noDataValue = GDALGetRasterNoDataValue( band, NULL );
+  double gtrans[6] = {};
+  GDALGetGeoTransform( dataset, gtrans );
+
+  int obs[2] = { qRound( geoToPixelX( gtrans, sObserverX, sObserverY ) ), qRound( geoToPixelY( gtrans, sObserverX, sObserverY ) ) };
+  int colStart = qMax( 0, qFloor( geoToPixelX( gtrans, sObserverX - radius, sObserverY + radius ) ) );
+  int colEnd = qMin( sDemWidth - 1, qCeil( geoToPixelX( gtrans, sObserverX + radius, sObserverY - radius ) ) );
+  int rowStart = qMax( 0, qFloor( geoToPixelY( gtrans, sObserverX - radius, sObserverY + radius ) ) );
+  int rowEnd = qMin( sDemHeight - 1, qCeil( geoToPixelY( gtrans, sObserverX + radius, sObserverY - radius ) ) );
+  int hmapWidth = colEnd - colStart + 1;
+  int hmapHeight = rowEnd - rowStart + 1;
+  QPolygon filterPoly;
+  foreach ( const QgsPoint& p, filterRegion )
+  {
+    filterPoly.append( QPoint( qRound( geoToPixelX( gtrans, p.x(), p.y() ) ), qRound( geoToPixelY( gtrans, p.x(), p.y() ) ) ) );
+  }
+
+  int scaledHmapWidth = hmapWidth / accuracyFactor;
+  int scaledHmapHeight = hmapHeight / accuracyFactor;
+  QVector<float> heightmap( scaledHmapWidth * scaledHmapHeight, noDataValue );
+  GDALRasterIOExtraArg rioargs;
+  INIT_RASTERIO_EXTRA_ARG( rioargs );
+  rioargs.eResampleAlg = GRIORA_Average;
+  CPLErr err = GDALRasterIOEx( band, GF_Read, colStart, rowStart, hmapWidth, hmapHeight, heightmap.data(), scaledHmapWidth, scaledHmapHeight, GDT_Float32, 0, 0, &rioargs );
+  GDALClose( dataset );
+  if ( err != CE_None )
+  {
+    return QVector<unsigned char>();
+  }
+
+  gtrans[1] *= accuracyFactor;
+  gtrans[2] *= accuracyFactor;
+  gtrans[4] *= accuracyFactor;
+  gtrans[5] *= accuracyFactor;
+  colStart /= accuracyFactor;
+  colEnd /= accuracyFactor;
+  rowStart /= accuracyFactor;
+  rowEnd /= accuracyFactor;
+  obs[0] /= accuracyFactor;
+  obs[1] /= accuracyFactor;
+  hmapWidth = scaledHmapWidth;
+  hmapHeight = scaledHmapHeight;
+  for ( int i = 0, n = filterPoly.size(); i < n; ++i )
+  {
+    filterPoly[i] = QPoint( filterPoly[i].x() / accuracyFactor, filterPoly[i].y() / accuracyFactor );
+  }
+
+  double earthRadius = 6370000;
+  double observerHeight = 2 + heightmap[( obs[1] - rowStart ) * hmapWidth + ( obs[0] - colStart )];
+  double targetHeight = 0;
+  int roi = .5 * qMin( hmapWidth, hmapHeight );
+  QVector<unsigned char> viewshed( hmapWidth * hmapHeight, 0 );
+  for ( int radiusNumber = 0; radiusNumber < 8 * roi; ++radiusNumber )
+  {
+    int target[2];
+    if ( radiusNumber <= roi )
+    {
+      target[0] = obs[0] + roi;
+      target[1] = obs[1] + radiusNumber;
+    }
+    else if ( radiusNumber <= 3 * roi )
+    {
+      target[0] = obs[0] + 2 * roi - radiusNumber;
+      target[1] = obs[1] + roi;
+    }
+    else if ( radiusNumber <= 5 * roi )
+    {
+      target[0] = obs[0] - roi;
+      target[1] = obs[1] + 4 * roi - radiusNumber;
+    }
+    else if ( radiusNumber <= 7 * roi )
+    {
+      target[0] = obs[0] + radiusNumber - 6 * roi;
+      target[1] = obs[1] - roi;
+    }
+    else
+    {
+      target[0] = obs[0] + roi;
+      target[1] = obs[1] + radiusNumber - 8 * roi;
+    }
+
+    int delta[2] = {target[0] - obs[0], target[1] - obs[1]};
+    int inciny = qAbs( delta[0] ) < qAbs( delta[1] );
+    double slope = ( double ) delta[1 - inciny] / ( double ) delta[inciny];
+    int step = delta[inciny] > 0 ? 1 : -1;
+    double horizon_slope = -99999;
+
+    for ( int i = step; true; i += step )
+    {
+      int p[2];
+      p[inciny] = obs[inciny] + i;
+      if ( i * slope > 0 )
+      {
+        p[1 - inciny] = obs[1 - inciny] + int( qCeil( i * slope - 0.5 ) );
+      }
+      else
+      {
+        p[1 - inciny] = obs[1 - inciny] + int( qFloor( i * slope + 0.5 ) );
+      }
+      if ( p[0] < colStart || p[0] > colEnd || p[1] < rowStart || p[1] > rowEnd )
+      {
+        break;
+      }
+      double dx = qAbs( p[0] - obs[0] ), dy = qAbs( p[1] - obs[1] );
+      if ( !( dx <= roi && dy <= roi && dx * dx + dy * dy <= double( roi ) * double( roi ) ) )
+      {
+        break;
+      }
+      if ( !filterPoly.isEmpty() && !filterPoly.containsPoint( QPoint( p[0], p[1] ), Qt::OddEvenFill ) )
+      {
+        continue;
+      }
+      int idx = ( p[1] - rowStart ) * hmapWidth + ( p[0] - colStart );
+      if ( idx >= heightmap.size() )
+      {
+        continue;
+      }
+      float pElev = heightmap[idx];
+      if ( pElev == noDataValue )
+      {
+        continue;
+      }
+
+      double pGeoX = gtrans[0] + p[0] * gtrans[1] + p[1] * gtrans[2];
+      double pGeoY = gtrans[3] + p[0] * gtrans[4] + p[1] * gtrans[5];
+      double geoDistSqr = ( sObserverX - pGeoX ) * ( sObserverX - pGeoX ) + ( sObserverY - pGeoY ) * ( sObserverY - pGeoY );
+      pElev -= 0.87 * geoDistSqr / ( 2 * earthRadius );
+
+      double s = double( pElev - observerHeight ) / double( qAbs( p[inciny] - obs[inciny] ) );
+      horizon_slope = qMax( horizon_slope, s );
+      double horizon_alt =  observerHeight + horizon_slope * qAbs( p[inciny] - obs[inciny] );
+      double tHeight = targetHeight + pElev;
+      viewshed[idx] = tHeight >= horizon_alt ? 255 : 0;
+    }
+  }
+  viewshed[( obs[1] - rowStart ) * hmapWidth + ( obs[0] - colStart )] = 255;
+
+  width = hmapWidth;
+  height = hmapHeight;
+  return viewshed;
+}
+
+void TestQgsViewshed::parallelEqualsSerial_data()
+{
+  QTest::addColumn<int>( "accuracyFactor" );
+  QTest::addColumn<double>( "radius" );
+  QTest::addColumn< QVector<QgsPoint> >( "filterRegion" );
+
+  QVector<QgsPoint> filterRegion = QVector<QgsPoint>()
+                                   << QgsPoint( 605300, 194600 ) << QgsPoint( 606800, 194200 )
+                                   << QgsPoint( 606500, 195900 ) << QgsPoint( 605600, 195400 );
+  QTest::newRow( "no filter" ) << 1 << 1005. << QVector<QgsPoint>();
+  QTest::newRow( "filter region" ) << 1 << 1005. << filterRegion;
+  // the window of 203 x 203 pixels is not a multiple of the accuracy factor
+  QTest::newRow( "reduced accuracy" ) << 2 << 1005. << QVector<QgsPoint>();
+  QTest::newRow( "reduced accuracy, filter region" ) << 3 << 1005. << filterRegion;
+}
+
+void TestQgsViewshed::parallelEqualsSerial()
+{
+  QFETCH( int, accuracyFactor );
+  QFETCH( double, radius );
+  QFETCH( QVector<QgsPoint>, filterRegion );
+
+  int width = 0, height = 0;
+  QVector<unsigned char> parallel = computeViewshed( accuracyFactor, width, height, radius, filterRegion );
+  QVERIFY( !parallel.isEmpty() );
+  QVERIFY( parallel.contains( 0 ) && parallel.contains( 255 ) );
+
+  int serialWidth = 0, serialHeight = 0;
+  QVector<unsigned char> serial = computeSerialViewshed( accuracyFactor, serialWidth, serialHeight, radius, filterRegion );
+  QCOMPARE( width, serialWidth );
+  QCOMPARE( height, serialHeight );
+  QVERIFY( memcmp( parallel.constData(), serial.constData(), parallel.size() ) == 0 );
+}
+
+QVector<quint32> TestQgsViewshed::readOutput( int& width, int& height, double geoTransform[6] ) const
+{
+  GDALDatasetH dataset = GDALOpen( mOutputFile.toUtf8().constData(), GA_ReadOnly );
+  if ( !dataset )
+  {
+    return QVector<quint32>();
+  }
+  width = GDALGetRasterXSize( dataset );
+  height = GDALGetRasterYSize( dataset );
+  GDALGetGeoTransform( dataset, geoTransform );
+  QVector<quint32> values( width * height );
+  CPLErr err = GDALRasterIO( GDALGetRasterBand( dataset, 1 ), GF_Read, 0, 0, width, height, values.data(), width, height, GDT_UInt32, 0, 0 );
+  GDALClose( dataset );
+  return err == CE_None ? values : QVector<quint32>();
+}
+
+void TestQgsViewshed::cumulativeEqualsSingleViewsheds_data()
+{
+  QTest::addColumn<int>( "mode" );
+
+  QTest::newRow( "count observers" ) << int( QgsViewshed::CountObservers );
+  QTest::newRow( "observer bitmask" ) << int( QgsViewshed::ObserverBitmask );
+}
+
+void TestQgsViewshed::cumulativeEqualsSingleViewsheds()
+{
+  QFETCH( int, mode );
+
+  // overlapping viewsheds
+  QList<QgsPoint> observers = QList<QgsPoint>() << QgsPoint( sObserverX, sObserverY )
+                              << QgsPoint( 605200, 194400 ) << QgsPoint( 606900, 195700 );
+  double radius = 1005;
+  QVERIFY( QgsViewshed::computeCumulativeViewshed( mInputFile, mOutputFile, "GTiff", observers, mCrs, 2, 0, true, radius, QGis::Meters, QgsViewshed::CumulativeMode( mode ) ) );
+  int width = 0, height = 0;
+  double geoTransform[6] = {};
+  QVector<quint32> cumulative = readOutput( width, height, geoTransform );
+  QVERIFY( !cumulative.isEmpty() );
+
+  // the sum (or union of the bits) of the viewsheds of the single observers, placed in the window of all observers
+  QVector<quint32> expected( width * height, 0 );
+  bool overlap = false;
+  for ( int i = 0; i < observers.size(); ++i )
+  {
+    QVERIFY( QgsViewshed::computeViewshed( mInputFile, mOutputFile, "GTiff", observers[i], mCrs, 2, 0, true, radius, QGis::Meters ) );
+    int singleWidth = 0, singleHeight = 0;
+    double singleGeoTransform[6] = {};
+    QVector<quint32> single = readOutput( singleWidth, singleHeight, singleGeoTransform );
+    QVERIFY( !single.isEmpty() );
+    QVERIFY( single.contains( 0 ) && single.contains( 255 ) );
+
+    int dx = qRound(( singleGeoTransform[0] - geoTransform[0] ) / geoTransform[1] );
+    int dy = qRound(( singleGeoTransform[3] - geoTransform[3] ) / geoTransform[5] );
+    QVERIFY( dx >= 0 && dy >= 0 && dx + singleWidth <= width && dy + singleHeight <= height );
+    for ( int y = 0; y < singleHeight; ++y )
+    {
+      for ( int x = 0; x < singleWidth; ++x )
+      {
+        if ( single[y * singleWidth + x] == 255 )
+        {
+          quint32& cell = expected[( y + dy ) * width + x + dx];
+          overlap = overlap || cell != 0;
+          cell = mode == QgsViewshed::CountObservers ? cell + 1 : cell | ( quint32( 1 ) << i );
+        }
+      }
+    }
+  }
+  QVERIFY( overlap );
+  QVERIFY( cumulative == expected );
+}
+
+QTEST_MAIN( TestQgsViewshed )
+#include "testqgsviewshed.moc"
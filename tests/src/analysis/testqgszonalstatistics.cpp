@@ -37,6 +37,7 @@ class TestQgsZonalStatistics : public QObject
     void cleanup() {}
 
     void testStatistics();
+    void testExtraStatistics();
 
   private:
     QgsVectorLayer* mVectorLayer;
@@ -131,5 +132,31 @@ void TestQgsZonalStatistics::testStatistics()
   QCOMPARE( f.attribute( "myqgis2_me" ).toDouble(), 0.833333333333333 );
 }
 
+void TestQgsZonalStatistics::testExtraStatistics()
+{
+  QgsZonalStatistics zs( mVectorLayer, mRasterPath, "x_", 1, QgsZonalStatistics::Min | QgsZonalStatistics::Max | QgsZonalStatistics::Histogram );
+  zs.setHistogramParameters( 2, 0.0, 1.0 );
+  QCOMPARE( zs.calculateStatistics( NULL ), 0 );
+
+  QgsFeature f;
+  QgsFeatureRequest request;
+  request.setFilterFid( 0 );
+  bool fetched = mVectorLayer->getFeatures( request ).nextFeature( f );
+  QVERIFY( fetched );
+  QCOMPARE( f.attribute( "x_min" ).toDouble(), 0.0 );
+  QCOMPARE( f.attribute( "x_max" ).toDouble(), 1.0 );
+  QCOMPARE( f.attribute( "x_hist" ).toString(), QString( "4,8" ) );
+
+  request.setFilterFid( 1 );
+  fetched = mVectorLayer->getFeatures( request ).nextFeature( f );
+  QVERIFY( fetched );
+  QCOMPARE( f.attribute( "x_hist" ).toString(), QString( "4,5" ) );
+
+  request.setFilterFid( 2 );
+  fetched = mVectorLayer->getFeatures( request ).nextFeature( f );
+  QVERIFY( fetched );
+  QCOMPARE( f.attribute( "x_hist" ).toString(), QString( "1,5" ) );
+}
+
 QTEST_MAIN( TestQgsZonalStatistics )
 #include "testqgszonalstatistics.moc"
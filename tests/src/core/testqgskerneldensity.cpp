@@ -0,0 +1,178 @@
+/***************************************************************************
+     testqgskerneldensity.cpp
+     ------------------------
+    Date                 : October 2016
+    Copyright            : (C) 2016 by Sandro Mani
+    Email                : manisandro@gmail.com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest/QtTest>
+#include <QObject>
+
+#include "qgskerneldensity.h"
+
+#include <cmath>
+
+/** \ingroup UnitTests
+ * Compares the tiled kernel density with a direct summation of the kernels
+ */
+class TestQgsKernelDensity : public QObject
+{
+    Q_OBJECT
+
+  private slots:
+    void initTestCase() {}// will be called before the first testfunction is executed.
+    void cleanupTestCase() {}// will be called after the last testfunction was executed.
+    void init() {} // will be called before each testfunction is executed.
+    void cleanup() {} // will be called after every testfunction.
+    void singlePoint();
+    void compareDirectSum_data();
+    void compareDirectSum();
+    void rows();
+    void zeroSum();
+
+  private:
+    struct TestPoint
+    {
+      int x, y, radius;
+      double weight;
+    };
+    //! points across several tiles, some of them outside the grid
+    static QList<TestPoint> testPoints();
+    static void addPoints( QgsKernelDensity& density, const QList<TestPoint>& points );
+};
+
+QList<TestQgsKernelDensity::TestPoint> TestQgsKernelDensity::testPoints()
+{
+  QList<TestPoint> points;
+  qsrand( 42 );
+  for ( int i = 0; i < 200; ++i )
+  {
+    TestPoint point = { qrand() % 700 - 50, qrand() % 600 - 50, 1 + qrand() % 40, 0.5 + ( qrand() % 100 ) / 50. };
+    points << point;
+  }
+  return points;
+}
+
+void TestQgsKernelDensity::addPoints( QgsKernelDensity& density, const QList<TestPoint>& points )
+{
+  foreach ( const TestPoint& point, points )
+  {
+    density.addPoint( point.x, point.y, point.radius, point.weight );
+  }
+}
+
+void TestQgsKernelDensity::singlePoint()
+{
+  QgsKernelDensity density( 50, 40 );
+  density.addPoint( 20, 10, 5 );
+  QCOMPARE( density.pointCount(), 1 );
+  density.calculate();
+
+  const QVector<float>& values = density.values();
+  QCOMPARE( values.size(), 50 * 40 );
+  QCOMPARE( values[10 * 50 + 20], 1.f );
+  QCOMPARE( density.maximumValue(), 1. );
+  QCOMPARE( values[10 * 50 + 22], float( density.kernelValue( 2, 5 ) ) );
+  QCOMPARE( values[10 * 50 + 26], 0.f );
+
+  // points whose kernel does not reach the grid are ignored
+  density.addPoint( -10, 10, 5 );
+  QCOMPARE( density.pointCount(), 1 );
+}
+
+void TestQgsKernelDensity::compareDirectSum_data()
+{
+  QTest::addColumn<int>( "shape" );
+  QTest::addColumn<int>( "outputValues" );
+
+  QTest::newRow( "quartic raw" ) << int( QgsKernelDensity::Quartic ) << int( QgsKernelDensity::Raw );
+  QTest::newRow( "quartic scaled" ) << int( QgsKernelDensity::Quartic ) << int( QgsKernelDensity::Scaled );
+  QTest::newRow( "triangular" ) << int( QgsKernelDensity::Triangular ) << int( QgsKernelDensity::Raw );
+  QTest::newRow( "uniform" ) << int( QgsKernelDensity::Uniform ) << int( QgsKernelDensity::Raw );
+  QTest::newRow( "epanechnikov scaled" ) << int( QgsKernelDensity::Epanechnikov ) << int( QgsKernelDensity::Scaled );
+}
+
+void TestQgsKernelDensity::compareDirectSum()
+{
+  QFETCH( int, shape );
+  QFETCH( int, outputValues );
+
+  const int width = 600, height = 500;
+  QgsKernelDensity density( width, height, ( QgsKernelDensity::KernelShape ) shape, ( QgsKernelDensity::OutputValues ) outputValues, 0.5 );
+  QList<TestPoint> points = testPoints();
+  addPoints( density, points );
+  density.calculate();
+
+  QVector<double> expected( width * height, 0. );
+  foreach ( const TestPoint& point, points )
+  {
+    for ( int y = qMax( 0, point.y - point.radius ); y <= qMin( height - 1, point.y + point.radius ); ++y )
+    {
+      for ( int x = qMax( 0, point.x - point.radius ); x <= qMin( width - 1, point.x + point.radius ); ++x )
+      {
+        double distance = sqrt( double(( x - point.x ) * ( x - point.x ) + ( y - point.y ) * ( y - point.y ) ) );
+        if ( distance <= point.radius )
+          expected[y * width + x] += float( point.weight ) * density.kernelValue( distance, point.radius );
+      }
+    }
+  }
+
+  const QVector<float>& values = density.values();
+  double maximum = 0;
+  for ( int i = 0; i < width * height; ++i )
+  {
+    QVERIFY( qAbs( values[i] - expected[i] ) <= 1e-5 * qMax( 1., qAbs( expected[i] ) ) );
+    maximum = qMax( maximum, expected[i] );
+  }
+  QVERIFY( qAbs( density.maximumValue() - maximum ) <= 1e-5 * maximum );
+}
+
+void TestQgsKernelDensity::rows()
+{
+  const int width = 600, height = 500;
+  QgsKernelDensity density( width, height );
+  addPoints( density, testPoints() );
+  density.calculate();
+  QVector<float> values = density.values();
+
+  // strips which do not match the tiles give the same values, pixels outside of all kernels are no data
+  const float noData = -9999;
+  double maximum = 0;
+  for ( int row = 0; row < height; row += 97 )
+  {
+    int rowCount = qMin( 97, height - row );
+    double rowsMaximum = 0;
+    QVector<float> rowValues = density.calculateRows( row, rowCount, noData, &rowsMaximum );
+    QCOMPARE( rowValues.size(), rowCount * width );
+    for ( int i = 0; i < rowValues.size(); ++i )
+    {
+      float value = values[row * width + i];
+      QVERIFY( rowValues[i] == value || ( rowValues[i] == noData && value == 0 ) );
+    }
+    maximum = qMax( maximum, rowsMaximum );
+  }
+  QCOMPARE( maximum, density.maximumValue() );
+}
+
+void TestQgsKernelDensity::zeroSum()
+{
+  // the kernels cancel out, but the pixels are within the radius
+  QgsKernelDensity density( 30, 30 );
+  density.addPoint( 10, 10, 4, 1 );
+  density.addPoint( 10, 10, 4, -1 );
+  QVector<float> values = density.calculateRows( 0, 30, -9999 );
+  QCOMPARE( values[10 * 30 + 10], 0.f );
+  QCOMPARE( values[10 * 30 + 14], 0.f );
+  QCOMPARE( values[10 * 30 + 15], -9999.f );
+  QCOMPARE( values[0], -9999.f );
+}
+
+QTEST_MAIN( TestQgsKernelDensity )
+#include "testqgskerneldensity.moc"
@@ -0,0 +1,248 @@
+/***************************************************************************
+     testqgsmaprenderercache.cpp
+     ---------------------------
+    Date                 : October 2016
+    Copyright            : (C) 2016 by Sandro Mani
+    Email                : manisandro@gmail.com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest/QtTest>
+#include <QObject>
+#include <QDir>
+#include <QFile>
+#include <QImage>
+#include <QPainter>
+#include <gdal.h>
+
+#include "qgsapplication.h"
+#include "qgscoordinatereferencesystem.h"
+#include "qgsfeature.h"
+#include "qgsgeometry.h"
+#include "qgsmaplayerregistry.h"
+#include "qgsmaprenderercache.h"
+#include "qgsmaprenderercustompainterjob.h"
+#include "qgsmapsettings.h"
+#include "qgsrasterlayer.h"
+#include "qgssinglesymbolrendererv2.h"
+#include "qgssymbolv2.h"
+#include "qgsvectordataprovider.h"
+#include "qgsvectorlayer.h"
+
+/** \ingroup UnitTests
+ * Tests of the tiled mode of the map renderer cache
+ */
+class TestQgsMapRendererCache : public QObject
+{
+    Q_OBJECT
+
+  private slots:
+    void initTestCase();// will be called before the first testfunction is executed.
+    void cleanupTestCase();// will be called after the last testfunction was executed.
+    void init() {} // will be called before each testfunction is executed.
+    void cleanup() {} // will be called after every testfunction.
+    void missingRegionAfterPan();
+    void missingRegionAfterSubPixelPan();
+    void removeDistantTiles();
+    void tiledPanRender();
+
+  private:
+    //! map settings of a 256x256 pixel view panned by the given number of pixels
+    QgsMapSettings settings( int dx, int dy ) const;
+    QImage render( const QgsMapSettings& settings, QgsMapRendererCache* cache ) const;
+
+    QgsVectorLayer* mLayer;
+    QgsRasterLayer* mRasterLayer;
+    QString mRasterFile;
+};
+
+void TestQgsMapRendererCache::initTestCase()
+{
+  QgsApplication::init();
+  QgsApplication::initQgis();
+
+  // coordinates are multiples of the pixel size, so that panned renders are exactly comparable
+  mLayer = new QgsVectorLayer( "Point?crs=epsg:4326", "points", "memory" );
+  QgsFeatureList features;
+  for ( int i = 0; i < 20; ++i )
+  {
+    for ( int j = 0; j < 20; ++j )
+    {
+      QgsFeature feature;
+      feature.setGeometry( QgsGeometry::fromPoint( QgsPoint( -4 + 2.25 * i, -4 + 2.125 * j ) ) );
+      features << feature;
+    }
+  }
+  mLayer->dataProvider()->addFeatures( features );
+
+  QgsStringMap props;
+  props["name"] = "circle";
+  props["color"] = "255,0,0";
+  props["size"] = "3";
+  mLayer->setRendererV2( new QgsSingleSymbolRendererV2( QgsMarkerSymbolV2::createSimple( props ) ) );
+
+  // a raster below the points, whose cells are the size of the output pixels
+  mRasterFile = QDir::tempPath() + "/testqgsmaprenderercache.tif";
+  GDALAllRegister();
+  GDALDatasetH dataset = GDALCreate( GDALGetDriverByName( "GTiff" ), mRasterFile.toLocal8Bit().data(), 400, 400, 1, GDT_Byte, 0 );
+  QVERIFY( dataset );
+  double geoTransform[6] = { -8, 0.125, 0, 40, 0, -0.125 };
+  GDALSetGeoTransform( dataset, geoTransform );
+  GDALSetProjection( dataset, QgsCoordinateReferenceSystem( "EPSG:4326" ).toWkt().toLocal8Bit().data() );
+  QVector<unsigned char> data( 400 * 400 );
+  for ( int row = 0; row < 400; ++row )
+  {
+    for ( int col = 0; col < 400; ++col )
+    {
+      data[row * 400 + col] = ( row * 7 + col * 13 ) % 256;
+    }
+  }
+  QCOMPARE( GDALRasterIO( GDALGetRasterBand( dataset, 1 ), GF_Write, 0, 0, 400, 400, data.data(), 400, 400, GDT_Byte, 0, 0 ), CE_None );
+  GDALClose( dataset );
+  mRasterLayer = new QgsRasterLayer( mRasterFile, "raster", "gdal" );
+  QVERIFY( mRasterLayer->isValid() );
+
+  QgsMapLayerRegistry::instance()->addMapLayers( QList<QgsMapLayer*>() << mLayer << mRasterLayer );
+}
+
+void TestQgsMapRendererCache::cleanupTestCase()
+{
+  QgsMapLayerRegistry::instance()->removeAllMapLayers();
+  QFile::remove( mRasterFile );
+  QgsApplication::exitQgis();
+}
+
+QgsMapSettings TestQgsMapRendererCache::settings( int dx, int dy ) const
+{
+  // 0.125 map units per pixel, in units whose scale does not depend on the position of the view
+  QgsMapSettings ms;
+  ms.setMapUnits( QGis::Meters );
+  ms.setOutputSize( QSize( 256, 256 ) );
+  ms.setExtent( QgsRectangle( 0.125 * dx, -0.125 * dy, 32 + 0.125 * dx, 32 - 0.125 * dy ) );
+  ms.setLayers( QStringList() << mLayer->id() << mRasterLayer->id() );
+  ms.setFlag( QgsMapSettings::Antialiasing, true );
+  return ms;
+}
+
+QImage TestQgsMapRendererCache::render( const QgsMapSettings& settings, QgsMapRendererCache* cache ) const
+{
+  QImage image( settings.outputSize(), settings.outputImageFormat() );
+  image.fill( 0 );
+  QPainter painter( &image );
+  QgsMapRendererCustomPainterJob job( settings, &painter );
+  job.setCache( cache );
+  job.start();
+  job.waitForFinished();
+  painter.end();
+  return image;
+}
+
+void TestQgsMapRendererCache::missingRegionAfterPan()
+{
+  QgsMapRendererCache cache;
+  cache.setTiled( true );
+  QImage image( 256, 256, QImage::Format_ARGB32_Premultiplied );
+  image.fill( 0 );
+
+  QVERIFY( !cache.init( settings( 0, 0 ) ) );
+  QCOMPARE( cache.missingRegion( "layer" ), QRegion( 0, 0, 256, 256 ) );
+  cache.setCacheImage( "layer", image );
+  QVERIFY( cache.missingRegion( "layer" ).isEmpty() );
+  QVERIFY( cache.init( settings( 0, 0 ) ) );
+
+  // moving the view right and down uncovers strips at the right and at the bottom
+  QVERIFY( !cache.init( settings( 10, 5 ) ) );
+  QCOMPARE( cache.missingRegion( "layer" ), QRegion( 246, 0, 10, 256 ) | QRegion( 0, 251, 256, 5 ) );
+  QVERIFY( cache.cacheImage( "layer" ).isNull() );
+
+  cache.setCacheImage( "layer", image );
+  QVERIFY( cache.missingRegion( "layer" ).isEmpty() );
+
+  // moving back, everything is still cached
+  QVERIFY( !cache.init( settings( 0, 0 ) ) );
+  QVERIFY( cache.missingRegion( "layer" ).isEmpty() );
+  QCOMPARE( cache.cacheImage( "layer" ).size(), QSize( 256, 256 ) );
+}
+
+void TestQgsMapRendererCache::missingRegionAfterSubPixelPan()
+{
+  QgsMapRendererCache cache;
+  cache.setTiled( true );
+  QImage image( 256, 256, QImage::Format_ARGB32_Premultiplied );
+  image.fill( 0 );
+
+  QgsMapSettings ms = settings( 0, 0 );
+  cache.init( ms );
+  cache.setCacheImage( "layer", image );
+
+  // the tiles would have to be resampled, so they are dropped
+  ms.setExtent( QgsRectangle( 0.05, 0, 32.05, 32 ) );
+  QVERIFY( !cache.init( ms ) );
+  QCOMPARE( cache.missingRegion( "layer" ), QRegion( 0, 0, 256, 256 ) );
+}
+
+void TestQgsMapRendererCache::removeDistantTiles()
+{
+  QgsMapRendererCache cache;
+  cache.setTiled( true );
+  QImage image( 256, 256, QImage::Format_ARGB32_Premultiplied );
+  image.fill( 0 );
+
+  cache.init( settings( 0, 0 ) );
+  cache.setCacheImage( "layer", image );
+
+  // tiles within one view size are kept
+  cache.init( settings( 256, 0 ) );
+  cache.init( settings( 0, 0 ) );
+  QVERIFY( cache.missingRegion( "layer" ).isEmpty() );
+
+  // tiles further away are removed
+  cache.init( settings( 768, 0 ) );
+  QCOMPARE( cache.missingRegion( "layer" ), QRegion( 0, 0, 256, 256 ) );
+  cache.init( settings( 0, 0 ) );
+  QCOMPARE( cache.missingRegion( "layer" ), QRegion( 0, 0, 256, 256 ) );
+}
+
+void TestQgsMapRendererCache::tiledPanRender()
+{
+  QgsMapRendererCache cache;
+  cache.setTiled( true );
+
+  QImage first = render( settings( 0, 0 ), &cache );
+  QImage empty( first.size(), first.format() );
+  empty.fill( 0 );
+  QVERIFY( first != empty );
+
+  // only the uncovered strips are rendered, the rest comes from the tiles.
+  // The full render goes through a cache without tiles, so that the layer is composed the same way.
+  QgsMapSettings panned = settings( 37, -21 );
+  QVERIFY( !cache.init( panned ) );
+  QVERIFY( !cache.missingRegion( mLayer->id() ).isEmpty() );
+  QVERIFY( !cache.missingRegion( mRasterLayer->id() ).isEmpty() );
+  QImage tiled = render( panned, &cache );
+  QgsMapRendererCache fullCache;
+  QImage full = render( panned, &fullCache );
+  QVERIFY( tiled != empty );
+  QVERIFY( tiled == full );
+  QVERIFY( cache.missingRegion( mLayer->id() ).isEmpty() );
+  QVERIFY( cache.missingRegion( mRasterLayer->id() ).isEmpty() );
+
+  // the tiles of the first view were kept rather than cleared for a full render of the layers
+  QVERIFY( !cache.init( settings( 0, 0 ) ) );
+  QVERIFY( cache.missingRegion( mLayer->id() ).isEmpty() );
+  QVERIFY( cache.missingRegion( mRasterLayer->id() ).isEmpty() );
+
+  // and once more, with the layer cached in tiles of two renders
+  panned = settings( 80, 45 );
+  tiled = render( panned, &cache );
+  full = render( panned, &fullCache );
+  QVERIFY( tiled == full );
+}
+
+QTEST_MAIN( TestQgsMapRendererCache )
+#include "testqgsmaprenderercache.moc"
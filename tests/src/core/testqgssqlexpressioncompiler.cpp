@@ -0,0 +1,220 @@
+/***************************************************************************
+     testqgssqlexpressioncompiler.cpp
+     --------------------------------
+    Date                 : October 2016
+    Copyright            : (C) 2016 by Sandro Mani
+    Email                : manisandro@gmail.com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest/QtTest>
+#include <QObject>
+#include <QString>
+
+#include "qgsapplication.h"
+#include "qgsconfig.h"
+#include "qgssqlexpressioncompiler.h"
+#include "qgsspatialiteexpressioncompiler.h"
+#ifdef HAVE_POSTGRESQL
+#include "qgspostgresexpressioncompiler.h"
+#endif
+
+//! compiler with a simple SQL dialect
+class TestCompiler : public QgsSqlExpressionCompiler
+{
+  public:
+    explicit TestCompiler( const QgsFields& fields ) : QgsSqlExpressionCompiler( fields ) {}
+
+  protected:
+    virtual QString quotedIdentifier( const QString& identifier ) override { return "\"" + identifier + "\""; }
+    virtual QString quotedValue( const QVariant& value ) override { return "'" + value.toString() + "'"; }
+};
+
+class TestQgsSqlExpressionCompiler: public QObject
+{
+    Q_OBJECT
+
+  private slots:
+    void initTestCase();// will be called before the first testfunction is executed.
+    void cleanupTestCase();// will be called after the last testfunction was executed.
+    void init() {} // will be called before each testfunction is executed.
+    void cleanup() {} // will be called after every testfunction.
+    void compile_data();
+    void compile();
+    void doubleLiterals();
+    void filterRect();
+    void spatialite_data();
+    void spatialite();
+#ifdef HAVE_POSTGRESQL
+    void postgres_data();
+    void postgres();
+#endif
+
+  private:
+    QgsFields mFields;
+};
+
+void TestQgsSqlExpressionCompiler::initTestCase()
+{
+  QgsApplication::init();
+  QgsApplication::initQgis();
+
+  mFields.append( QgsField( "pop", QVariant::Int, "int4" ) );
+  mFields.append( QgsField( "name", QVariant::String, "text" ) );
+  mFields.append( QgsField( "created", QVariant::Date, "date" ) );
+  mFields.append( QgsField( "area", QVariant::Double, "float8" ) );
+  mFields.append( QgsField( "amount", QVariant::Double, "numeric" ) );
+  mFields.append( QgsField( "ratio", QVariant::Double, "float4" ) );
+}
+
+void TestQgsSqlExpressionCompiler::cleanupTestCase()
+{
+  QgsApplication::exitQgis();
+}
+
+void TestQgsSqlExpressionCompiler::compile_data()
+{
+  QTest::addColumn<QString>( "expression" );
+  QTest::addColumn<int>( "result" );
+  QTest::addColumn<QString>( "sql" );
+
+  QTest::newRow( "numeric comparison" ) << "pop > 100" << int( QgsSqlExpressionCompiler::Complete ) << "(\"pop\" > 100)";
+  QTest::newRow( "double" ) << "area < 1.5" << int( QgsSqlExpressionCompiler::Complete ) << "(\"area\" < 1.5)";
+  QTest::newRow( "negative number" ) << "pop >= -5" << int( QgsSqlExpressionCompiler::Complete ) << "(\"pop\" >= (-5))";
+  QTest::newRow( "string equality" ) << "name = 'Bern'" << int( QgsSqlExpressionCompiler::Complete ) << "(\"name\" = 'Bern')";
+  QTest::newRow( "string order" ) << "name > 'Bern'" << int( QgsSqlExpressionCompiler::Fail ) << "";
+  QTest::newRow( "numeric string" ) << "name = '5'" << int( QgsSqlExpressionCompiler::Fail ) << "";
+  QTest::newRow( "mixed types" ) << "pop = 'Bern'" << int( QgsSqlExpressionCompiler::Fail ) << "";
+  QTest::newRow( "unsupported type" ) << "created IS NULL" << int( QgsSqlExpressionCompiler::Fail ) << "";
+  QTest::newRow( "is null" ) << "name IS NULL" << int( QgsSqlExpressionCompiler::Complete ) << "(\"name\" IS NULL)";
+  QTest::newRow( "like" ) << "name LIKE 'B%'" << int( QgsSqlExpressionCompiler::Complete ) << "(\"name\" LIKE 'B%')";
+  QTest::newRow( "ilike" ) << "name ILIKE 'b%'" << int( QgsSqlExpressionCompiler::Fail ) << "";
+  QTest::newRow( "in" ) << "pop IN (1, 2)" << int( QgsSqlExpressionCompiler::Complete ) << "(\"pop\" IN (1,2))";
+  QTest::newRow( "or" ) << "pop < 1 OR name = 'Bern'" << int( QgsSqlExpressionCompiler::Complete ) << "((\"pop\" < 1) OR (\"name\" = 'Bern'))";
+  QTest::newRow( "or with unknown column" ) << "pop < 1 OR other = 2" << int( QgsSqlExpressionCompiler::Fail ) << "";
+  QTest::newRow( "and with unknown column" ) << "pop < 1 AND other = 2" << int( QgsSqlExpressionCompiler::Partial ) << "(\"pop\" < 1)";
+  QTest::newRow( "not" ) << "NOT pop < 1" << int( QgsSqlExpressionCompiler::Complete ) << "(NOT (\"pop\" < 1))";
+  QTest::newRow( "not of partial" ) << "NOT ( pop < 1 AND other = 2 )" << int( QgsSqlExpressionCompiler::Fail ) << "";
+  QTest::newRow( "function" ) << "upper(name) = 'BERN'" << int( QgsSqlExpressionCompiler::Fail ) << "";
+}
+
+void TestQgsSqlExpressionCompiler::compile()
+{
+  QFETCH( QString, expression );
+  QFETCH( int, result );
+  QFETCH( QString, sql );
+
+  QgsExpression exp( expression );
+  QVERIFY( !exp.hasParserError() );
+
+  TestCompiler compiler( mFields );
+  QCOMPARE( int( compiler.compile( &exp ) ), result );
+  if ( result != QgsSqlExpressionCompiler::Fail )
+  {
+    QCOMPARE( compiler.result(), sql );
+  }
+}
+
+void TestQgsSqlExpressionCompiler::doubleLiterals()
+{
+  //the SQL literal has to be the same double as the literal of the expression
+  QList<double> values = QList<double>() << 0.1 << 1e-20 << 123456789.123456789 << 1.0 / 3.0 << 2e300;
+  foreach ( double value, values )
+  {
+    QgsExpression exp( QString( "area = %1" ).arg( value, 0, 'g', 17 ) );
+    QVERIFY( !exp.hasParserError() );
+
+    TestCompiler compiler( mFields );
+    QCOMPARE( compiler.compile( &exp ), QgsSqlExpressionCompiler::Complete );
+    QString sql = compiler.result();
+    QVERIFY( sql.startsWith( "(\"area\" = " ) && sql.endsWith( ")" ) );
+    bool ok;
+    double sqlValue = sql.mid( 10, sql.length() - 11 ).toDouble( &ok );
+    QVERIFY( ok );
+    QCOMPARE( sqlValue, value );
+  }
+}
+
+void TestQgsSqlExpressionCompiler::filterRect()
+{
+  QgsExpression exp( "intersects( $geometry, geomFromWKT( 'LINESTRING(1 2, 3 4)' ) ) AND pop > 100" );
+  QVERIFY( !exp.hasParserError() );
+
+  TestCompiler compiler( mFields );
+  QCOMPARE( compiler.compile( &exp ), QgsSqlExpressionCompiler::Partial );
+  QCOMPARE( compiler.result(), QString( "(\"pop\" > 100)" ) );
+  QCOMPARE( compiler.filterRect(), QgsRectangle( 1, 2, 3, 4 ) );
+}
+
+void TestQgsSqlExpressionCompiler::spatialite_data()
+{
+  QTest::addColumn<QString>( "expression" );
+  QTest::addColumn<int>( "result" );
+  QTest::addColumn<QString>( "sql" );
+
+  //the LIKE of SQLite ignores the case of ASCII characters
+  QTest::newRow( "like" ) << "name LIKE 'B%'" << int( QgsSqlExpressionCompiler::Partial ) << "(\"name\" LIKE 'B%')";
+  QTest::newRow( "not like" ) << "name NOT LIKE 'B%'" << int( QgsSqlExpressionCompiler::Fail ) << "";
+  QTest::newRow( "ilike" ) << "name ILIKE 'b%'" << int( QgsSqlExpressionCompiler::Complete ) << "(\"name\" LIKE 'b%')";
+  QTest::newRow( "not ilike" ) << "name NOT ILIKE 'b%'" << int( QgsSqlExpressionCompiler::Complete ) << "(\"name\" NOT LIKE 'b%')";
+  QTest::newRow( "non ascii ilike" ) << QString::fromUtf8( "name ILIKE '\xc3\xa4%'" ) << int( QgsSqlExpressionCompiler::Fail ) << "";
+  QTest::newRow( "quotes" ) << "name = 'it''s'" << int( QgsSqlExpressionCompiler::Complete ) << "(\"name\" = 'it''s')";
+}
+
+void TestQgsSqlExpressionCompiler::spatialite()
+{
+  QFETCH( QString, expression );
+  QFETCH( int, result );
+  QFETCH( QString, sql );
+
+  QgsExpression exp( expression );
+  QVERIFY( !exp.hasParserError() );
+
+  QgsSpatiaLiteExpressionCompiler compiler( mFields );
+  QCOMPARE( int( compiler.compile( &exp ) ), result );
+  if ( result != QgsSqlExpressionCompiler::Fail )
+  {
+    QCOMPARE( compiler.result(), sql );
+  }
+}
+
+#ifdef HAVE_POSTGRESQL
+void TestQgsSqlExpressionCompiler::postgres_data()
+{
+  QTest::addColumn<QString>( "expression" );
+  QTest::addColumn<int>( "result" );
+  QTest::addColumn<QString>( "sql" );
+
+  QTest::newRow( "like" ) << "name LIKE 'B%'" << int( QgsSqlExpressionCompiler::Complete ) << "(\"name\" LIKE 'B%')";
+  QTest::newRow( "ilike" ) << "name ILIKE 'b%'" << int( QgsSqlExpressionCompiler::Complete ) << "(\"name\" ILIKE 'b%')";
+  QTest::newRow( "not ilike" ) << "name NOT ILIKE 'b%'" << int( QgsSqlExpressionCompiler::Complete ) << "(\"name\" NOT ILIKE 'b%')";
+  QTest::newRow( "float8" ) << "area = 0.1" << int( QgsSqlExpressionCompiler::Complete ) << "(\"area\" = 0.10000000000000001)";
+  QTest::newRow( "numeric" ) << "amount = 0.1" << int( QgsSqlExpressionCompiler::Fail ) << "";
+  QTest::newRow( "float4" ) << "ratio > 0.5" << int( QgsSqlExpressionCompiler::Fail ) << "";
+}
+
+void TestQgsSqlExpressionCompiler::postgres()
+{
+  QFETCH( QString, expression );
+  QFETCH( int, result );
+  QFETCH( QString, sql );
+
+  QgsExpression exp( expression );
+  QVERIFY( !exp.hasParserError() );
+
+  QgsPostgresExpressionCompiler compiler( mFields );
+  QCOMPARE( int( compiler.compile( &exp ) ), result );
+  if ( result != QgsSqlExpressionCompiler::Fail )
+  {
+    QCOMPARE( compiler.result(), sql );
+  }
+}
+#endif
+
+QTEST_MAIN( TestQgsSqlExpressionCompiler )
+#include "testqgssqlexpressioncompiler.moc"
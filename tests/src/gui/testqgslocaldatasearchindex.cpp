@@ -0,0 +1,288 @@
+/***************************************************************************
+     testqgslocaldatasearchindex.cpp
+     -------------------------------
+    Date                 : October 2016
+    Copyright            : (C) 2016 by Sandro Mani
+    Email                : manisandro@gmail.com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest/QtTest>
+#include <QObject>
+#include <QScopedPointer>
+#include <QStringList>
+
+#include "qgsfeature.h"
+#include "qgsgeometry.h"
+#include "qgslocaldatasearchindex.h"
+#include "qgspoint.h"
+
+Q_DECLARE_METATYPE( QgsRectangle )
+
+/** \ingroup UnitTests
+ * Compares the trigram search of the local data search index with a scan of all indexed features
+ */
+class TestQgsLocalDataSearchIndex : public QObject
+{
+    Q_OBJECT
+
+  private slots:
+    void initTestCase() {}// will be called before the first testfunction is executed.
+    void cleanupTestCase() {}// will be called after the last testfunction was executed.
+    void init();// will be called before each testfunction is executed.
+    void cleanup() {} // will be called after every testfunction.
+    void searchEqualsScan_data();
+    void searchEqualsScan();
+    void paging_data();
+    void paging();
+    void replaceFeature();
+    void removeFeature();
+    void compaction();
+
+  private:
+    struct Entry
+    {
+      QgsFeatureId fid;
+      QStringList values;
+      QgsPoint pos;
+    };
+
+    //! adds the feature to the index and to the entries, replacing an existing entry
+    void addFeature( QgsFeatureId fid, const QStringList& values, const QgsPoint& pos );
+    void removeEntry( QgsFeatureId fid );
+    //! the expected result, the features whose values contain the text in the order they were added
+    QList<QgsFeatureId> scan( const QString& text, const QgsRectangle& filterRect ) const;
+    //! all results of the index, fetched in pages of the given size
+    static QList<QgsFeatureId> searchAll( const QgsLocalDataSearchIndex& index, const QString& text, const QgsRectangle& filterRect, int limit );
+
+    QScopedPointer<QgsLocalDataSearchIndex> mIndex;
+    QList<Entry> mEntries;
+};
+
+static const char* sNames[] = { "Bahnhofstrasse", "Bundesplatz", "Zürichbergstrasse", "Marktgasse", "Bernstrasse", "Seestrasse", "Rue de Berne" };
+
+void TestQgsLocalDataSearchIndex::init()
+{
+  mIndex.reset( new QgsLocalDataSearchIndex );
+  mEntries.clear();
+
+  // street names with numbers, scattered over a 1000 x 1000 extent
+  for ( int i = 0; i < 300; ++i )
+  {
+    QStringList values = QStringList() << QString::fromUtf8( sNames[i % 7] ) << QString::number( i % 40 + 1 );
+    if ( i % 11 == 0 )
+    {
+      values << "Gemeinde Bern";
+    }
+    addFeature( i + 1, values, QgsPoint(( i * 37 ) % 1000, ( i * 91 ) % 1000 ) );
+  }
+}
+
+void TestQgsLocalDataSearchIndex::addFeature( QgsFeatureId fid, const QStringList& values, const QgsPoint& pos )
+{
+  QgsAttributes attributes;
+  foreach ( const QString& value, values )
+  {
+    attributes.append( value );
+  }
+  // null values are not indexed
+  attributes.append( QVariant() );
+  QgsFeature feature( fid );
+  feature.setAttributes( attributes );
+  feature.setGeometry( QgsGeometry::fromPoint( pos ) );
+  mIndex->addFeature( feature );
+
+  removeEntry( fid );
+  Entry entry = { fid, values, pos };
+  mEntries.append( entry );
+}
+
+void TestQgsLocalDataSearchIndex::removeEntry( QgsFeatureId fid )
+{
+  for ( int i = 0; i < mEntries.size(); ++i )
+  {
+    if ( mEntries[i].fid == fid )
+    {
+      mEntries.removeAt( i );
+      break;
+    }
+  }
+}
+
+QList<QgsFeatureId> TestQgsLocalDataSearchIndex::scan( const QString& text, const QgsRectangle& filterRect ) const
+{
+  QList<QgsFeatureId> result;
+  foreach ( const Entry& entry, mEntries )
+  {
+    if ( !filterRect.isEmpty() && !filterRect.contains( entry.pos ) )
+    {
+      continue;
+    }
+    foreach ( const QString& value, entry.values )
+    {
+      if ( value.contains( text, Qt::CaseInsensitive ) )
+      {
+        result.append( entry.fid );
+        break;
+      }
+    }
+  }
+  return result;
+}
+
+QList<QgsFeatureId> TestQgsLocalDataSearchIndex::searchAll( const QgsLocalDataSearchIndex& index, const QString& text, const QgsRectangle& filterRect, int limit )
+{
+  QList<QgsFeatureId> result;
+  int position = 0;
+  while ( true )
+  {
+    int lastPosition = position;
+    QList<QgsFeatureId> page = index.search( text, filterRect, position, limit );
+    if ( page.isEmpty() )
+    {
+      break;
+    }
+    // the position advances with every page
+    if ( page.size() > limit || position <= lastPosition )
+    {
+      return QList<QgsFeatureId>() << -1;
+    }
+    result.append( page );
+  }
+  return result;
+}
+
+void TestQgsLocalDataSearchIndex::searchEqualsScan_data()
+{
+  QTest::addColumn<QString>( "text" );
+  QTest::addColumn<QgsRectangle>( "filterRect" );
+  QTest::addColumn<bool>( "hasMatches" );
+
+  QTest::newRow( "word" ) << QString( "strasse" ) << QgsRectangle() << true;
+  QTest::newRow( "case insensitive" ) << QString( "BERN" ) << QgsRectangle() << true;
+  QTest::newRow( "non ascii" ) << QString::fromUtf8( "zÜrich" ) << QgsRectangle() << true;
+  QTest::newRow( "across words" ) << QString( "rue de b" ) << QgsRectangle() << true;
+  QTest::newRow( "number" ) << QString( "12" ) << QgsRectangle() << true;
+  QTest::newRow( "single character" ) << QString( "z" ) << QgsRectangle() << true;
+  QTest::newRow( "filter rect" ) << QString( "bern" ) << QgsRectangle( 200, 100, 700, 600 ) << true;
+  QTest::newRow( "filter rect, short text" ) << QString( "3" ) << QgsRectangle( 0, 0, 500, 500 ) << true;
+  QTest::newRow( "unknown trigram" ) << QString( "xyz" ) << QgsRectangle() << false;
+  QTest::newRow( "known trigrams, no match" ) << QString( "strassebahn" ) << QgsRectangle() << false;
+}
+
+void TestQgsLocalDataSearchIndex::searchEqualsScan()
+{
+  QFETCH( QString, text );
+  QFETCH( QgsRectangle, filterRect );
+  QFETCH( bool, hasMatches );
+
+  QList<QgsFeatureId> expected = scan( text, filterRect );
+  QCOMPARE( !expected.isEmpty(), hasMatches );
+  QCOMPARE( searchAll( *mIndex, text, filterRect, 1000 ), expected );
+}
+
+void TestQgsLocalDataSearchIndex::paging_data()
+{
+  QTest::addColumn<QString>( "text" );
+
+  QTest::newRow( "trigrams" ) << QString( "strasse" );
+  QTest::newRow( "short text" ) << QString( "1" );
+}
+
+void TestQgsLocalDataSearchIndex::paging()
+{
+  QFETCH( QString, text );
+
+  QList<QgsFeatureId> expected = scan( text, QgsRectangle() );
+  QVERIFY( expected.size() > 20 );
+  foreach ( int limit, QList<int>() << 1 << 7 << expected.size() )
+  {
+    QCOMPARE( searchAll( *mIndex, text, QgsRectangle(), limit ), expected );
+  }
+
+  // full pages until the last one
+  int position = 0;
+  QCOMPARE( mIndex->search( text, QgsRectangle(), position, 7 ), expected.mid( 0, 7 ) );
+  QCOMPARE( mIndex->search( text, QgsRectangle(), position, 7 ), expected.mid( 7, 7 ) );
+}
+
+void TestQgsLocalDataSearchIndex::replaceFeature()
+{
+  // the replaced values are no longer found, the new ones are
+  addFeature( 5, QStringList() << "Kramgasse" << "49", QgsPoint( 500, 500 ) );
+  addFeature( 12, QStringList() << "Bundesplatz" << "3", QgsPoint( 900, 900 ) );
+  foreach ( const QString& text, QStringList() << "seestrasse" << "kramgasse" << "bundesplatz" << "3" )
+  {
+    QCOMPARE( searchAll( *mIndex, text, QgsRectangle(), 1000 ), scan( text, QgsRectangle() ) );
+  }
+  QCOMPARE( searchAll( *mIndex, "kramgasse", QgsRectangle(), 1000 ), QList<QgsFeatureId>() << 5 );
+  QVERIFY( !searchAll( *mIndex, "bahnhof", QgsRectangle(), 1000 ).contains( 5 ) );
+  QCOMPARE( searchAll( *mIndex, "bundesplatz", QgsRectangle(), 1000 ).count( 12 ), 1 );
+
+  // the bounding box is replaced as well
+  QCOMPARE( searchAll( *mIndex, "bundesplatz", QgsRectangle( 850, 850, 950, 950 ), 1000 ).count( 12 ), 1 );
+}
+
+void TestQgsLocalDataSearchIndex::removeFeature()
+{
+  for ( QgsFeatureId fid = 1; fid <= 300; fid += 3 )
+  {
+    mIndex->removeFeature( fid );
+    removeEntry( fid );
+  }
+  // removing an unknown feature is a no-op
+  mIndex->removeFeature( 1000 );
+  foreach ( const QString& text, QStringList() << "strasse" << "bern" << "1" )
+  {
+    QList<QgsFeatureId> result = searchAll( *mIndex, text, QgsRectangle(), 13 );
+    QCOMPARE( result, scan( text, QgsRectangle() ) );
+    QVERIFY( !result.contains( 1 ) );
+  }
+
+  // a removed feature can be added again
+  addFeature( 1, QStringList() << "Kramgasse", QgsPoint( 0, 0 ) );
+  QCOMPARE( searchAll( *mIndex, "gasse", QgsRectangle(), 1000 ), scan( "gasse", QgsRectangle() ) );
+  QVERIFY( searchAll( *mIndex, "kram", QgsRectangle(), 1000 ).contains( 1 ) );
+}
+
+void TestQgsLocalDataSearchIndex::compaction()
+{
+  QVERIFY( !mIndex->needsCompaction() );
+
+  // replace each feature several times and remove most of them, so that most documents only take up space
+  for ( int round = 0; round < 4; ++round )
+  {
+    for ( int i = 0; i < 300; ++i )
+    {
+      addFeature( i + 1, QStringList() << QString::fromUtf8( sNames[( i + round ) % 7] ) << QString::number( round ), QgsPoint( i, 1000 - i ) );
+    }
+  }
+  for ( QgsFeatureId fid = 1; fid <= 300; fid += 2 )
+  {
+    mIndex->removeFeature( fid );
+    removeEntry( fid );
+  }
+  QVERIFY( mIndex->needsCompaction() );
+
+  QScopedPointer<QgsLocalDataSearchIndex> compacted( mIndex->compacted() );
+  QVERIFY( !compacted->needsCompaction() );
+  foreach ( const QString& text, QStringList() << "strasse" << "bern" << "3" << "platz" << "xyz" )
+  {
+    QList<QgsFeatureId> expected = scan( text, QgsRectangle() );
+    QCOMPARE( searchAll( *mIndex, text, QgsRectangle(), 1000 ), expected );
+    QCOMPARE( searchAll( *compacted, text, QgsRectangle(), 9 ), expected );
+  }
+  QCOMPARE( searchAll( *compacted, "bern", QgsRectangle( 0, 800, 100, 1000 ), 1000 ), scan( "bern", QgsRectangle( 0, 800, 100, 1000 ) ) );
+
+  // the compacted index is updated like the original one
+  compacted->removeFeature( 2 );
+  QVERIFY( !searchAll( *compacted, "strasse", QgsRectangle(), 1000 ).contains( 2 ) );
+}
+
+QTEST_MAIN( TestQgsLocalDataSearchIndex )
+#include "testqgslocaldatasearchindex.moc"
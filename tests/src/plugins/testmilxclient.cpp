@@ -0,0 +1,311 @@
+/***************************************************************************
+     testmilxclient.cpp
+     ------------------
+    Date                 : October 2016
+    Copyright            : (C) 2016 by Sandro Mani
+    Email                : manisandro@gmail.com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest/QtTest>
+#include <QObject>
+#include <QDataStream>
+#include <QHash>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QThread>
+
+#include "MilXClient.hpp"
+#include "MilXCommands.hpp"
+
+/** Stand-in for the MilX server, which answers the requests used by the tests.
+ *  Symbols are moved by replacing the moved point, the symbol "invalid" fails with an error reply. */
+class MilXStandInServer : public QTcpServer
+{
+    Q_OBJECT
+
+  public:
+    MilXStandInServer() {}
+    //! number of symbols which were rendered by update requests
+    int updatedSymbols() const { return int( mUpdatedSymbols ); }
+
+  public slots:
+    bool start()
+    {
+      connect( this, SIGNAL( newConnection() ), this, SLOT( acceptConnection() ) );
+      return listen( QHostAddress::LocalHost );
+    }
+
+  private slots:
+    void acceptConnection()
+    {
+      while ( hasPendingConnections() )
+      {
+        QTcpSocket* socket = nextPendingConnection();
+        connect( socket, SIGNAL( readyRead() ), this, SLOT( readRequests() ) );
+        connect( socket, SIGNAL( disconnected() ), socket, SLOT( deleteLater() ) );
+      }
+    }
+
+    void readRequests()
+    {
+      QTcpSocket* socket = qobject_cast<QTcpSocket*>( sender() );
+      QByteArray& buffer = mBuffers[socket];
+      buffer += socket->readAll();
+      while ( buffer.size() >= int( sizeof( qint32 ) ) )
+      {
+        qint32 size = *reinterpret_cast<const qint32*>( buffer.constData() );
+        if ( buffer.size() < int( sizeof( qint32 ) ) + size )
+        {
+          break;
+        }
+        QByteArray response = processRequest( buffer.mid( sizeof( qint32 ), size ) );
+        buffer.remove( 0, sizeof( qint32 ) + size );
+        qint32 len = response.size();
+        socket->write( reinterpret_cast<char*>( &len ), sizeof( qint32 ) );
+        socket->write( response );
+        socket->flush();
+      }
+    }
+
+  private:
+    QByteArray processRequest( const QByteArray& request )
+    {
+      QDataStream istream( request );
+      MilXServerRequest req = 0; istream >> req;
+      QByteArray response;
+      QDataStream ostream( &response, QIODevice::WriteOnly );
+      if ( req == MILX_REQUEST_INIT )
+      {
+        ostream << MILX_REPLY_INIT_OK << QString( "standin" );
+      }
+      else if ( req == MILX_REQUEST_UPDATE_SYMBOLS )
+      {
+        QRect visibleExtent; int dpi; double scaleFactor; int nSymbols;
+        istream >> visibleExtent >> dpi >> scaleFactor >> nSymbols;
+        ostream << MILX_REPLY_UPDATE_SYMBOLS << nSymbols;
+        for ( int i = 0; i < nSymbols; ++i )
+        {
+          QString xml; QList<QPoint> points; QList<int> controlPoints; QList< QPair<int, double> > attributes; bool finalized, colored;
+          istream >> xml >> points >> controlPoints >> attributes >> finalized >> colored;
+          ostream << QByteArray() << points.front();
+        }
+        mUpdatedSymbols.fetchAndAddRelaxed( nSymbols );
+      }
+      else if ( req == MILX_REQUEST_MOVE_POINT )
+      {
+        QRect visibleExtent; int dpi; QString xml; QList<QPoint> points; QList<int> controlPoints; QList< QPair<int, double> > attributes; bool finalized, colored; int index; QPoint newPos;
+        istream >> visibleExtent >> dpi >> xml >> points >> controlPoints >> attributes >> finalized >> colored >> index >> newPos;
+        if ( xml == "invalid" || index < 0 || index >= points.size() )
+        {
+          ostream << MILX_REPLY_ERROR << QString( "Invalid symbol" );
+        }
+        else
+        {
+          points[index] = newPos;
+          ostream << MILX_REPLY_MOVE_POINT << QByteArray() << points.front() << points << controlPoints << attributes << QList< QPair<int, QPoint> >();
+        }
+      }
+      else
+      {
+        ostream << MILX_REPLY_ERROR << QString( "Unsupported request" );
+      }
+      return response;
+    }
+
+    QHash<QTcpSocket*, QByteArray> mBuffers;
+    QAtomicInt mUpdatedSymbols;
+};
+
+//! records the asynchronous edits delivered by the client
+class MilXEditReceiver : public QObject
+{
+    Q_OBJECT
+
+  public:
+    MilXEditReceiver()
+    {
+      connect( MilXClient::instance(), SIGNAL( symbolEdited( QObject*, int, MilXClient::NPointSymbolGraphic ) ), this, SLOT( symbolEdited( QObject*, int, MilXClient::NPointSymbolGraphic ) ) );
+      connect( MilXClient::instance(), SIGNAL( symbolEditFailed( QObject*, int, QString ) ), this, SLOT( symbolEditFailed( QObject*, int, QString ) ) );
+    }
+    //! processes events until the given number of edits has been delivered, returns false on timeout
+    bool waitForEdits( int count )
+    {
+      for ( int i = 0; i < 100 && editedIds.size() + failedIds.size() < count; ++i )
+      {
+        QTest::qWait( 50 );
+      }
+      return editedIds.size() + failedIds.size() == count;
+    }
+
+    QList<int> editedIds;
+    QList< QList<QPoint> > editedPoints;
+    QList<int> failedIds;
+    QStringList errors;
+
+  private slots:
+    void symbolEdited( QObject* owner, int requestId, const MilXClient::NPointSymbolGraphic& result )
+    {
+      if ( owner == this )
+      {
+        editedIds.append( requestId );
+        editedPoints.append( result.adjustedPoints );
+      }
+    }
+    void symbolEditFailed( QObject* owner, int requestId, const QString& error )
+    {
+      if ( owner == this )
+      {
+        failedIds.append( requestId );
+        errors.append( error );
+      }
+    }
+};
+
+/** \ingroup UnitTests
+ * Tests of the request/response path of the MilX client against a stand-in server
+ */
+class TestMilXClient : public QObject
+{
+    Q_OBJECT
+
+  private slots:
+    void initTestCase();// will be called before the first testfunction is executed.
+    void cleanupTestCase();// will be called after the last testfunction was executed.
+    void init() {} // will be called before each testfunction is executed.
+    void cleanup() {} // will be called after every testfunction.
+    void libraryVersionTag();
+    void movePoint();
+    void errorReply();
+    void movePointAsync();
+    void movePointAsyncFailure();
+    void updateSymbolsCache();
+
+  private:
+    static MilXClient::NPointSymbol symbol( const QString& xml, const QPoint& offset = QPoint() );
+
+    QThread mServerThread;
+    MilXStandInServer* mServer;
+};
+
+void TestMilXClient::initTestCase()
+{
+  // the server runs in its own thread, since the client blocks while waiting for synchronous replies
+  mServer = new MilXStandInServer;
+  mServer->moveToThread( &mServerThread );
+  connect( &mServerThread, SIGNAL( finished() ), mServer, SLOT( deleteLater() ) );
+  mServerThread.start();
+  bool listening = false;
+  QMetaObject::invokeMethod( mServer, "start", Qt::BlockingQueuedConnection, Q_RETURN_ARG( bool, listening ) );
+  QVERIFY( listening );
+
+  QByteArray port = QByteArray::number( mServer->serverPort() );
+  qputenv( "MILIX_SERVER_ADDR", "127.0.0.1" );
+  qputenv( "MILIX_SERVER_PORT_SYNC", port );
+  qputenv( "MILIX_SERVER_PORT_ASYNC", port );
+  QVERIFY( MilXClient::init() );
+}
+
+void TestMilXClient::cleanupTestCase()
+{
+  mServerThread.quit();
+  mServerThread.wait();
+}
+
+MilXClient::NPointSymbol TestMilXClient::symbol( const QString& xml, const QPoint& offset )
+{
+  QList<QPoint> points = QList<QPoint>() << QPoint( 10, 10 ) + offset << QPoint( 50, 20 ) + offset << QPoint( 90, 10 ) + offset;
+  return MilXClient::NPointSymbol( xml, points, QList<int>(), QList< QPair<int, double> >(), true, true );
+}
+
+void TestMilXClient::libraryVersionTag()
+{
+  QString versionTag;
+  QVERIFY( MilXClient::getCurrentLibraryVersionTag( versionTag ) );
+  QCOMPARE( versionTag, QString( "standin" ) );
+}
+
+void TestMilXClient::movePoint()
+{
+  MilXClient::NPointSymbolGraphic result;
+  QVERIFY( MilXClient::movePoint( QRect( 0, 0, 200, 100 ), 96, symbol( "line" ), 1, QPoint( 55, 40 ), result ) );
+  QCOMPARE( result.adjustedPoints, QList<QPoint>() << QPoint( 10, 10 ) << QPoint( 55, 40 ) << QPoint( 90, 10 ) );
+  QCOMPARE( result.offset, QPoint( 10, 10 ) );
+}
+
+void TestMilXClient::errorReply()
+{
+  MilXClient::NPointSymbolGraphic result;
+  QVERIFY( !MilXClient::movePoint( QRect( 0, 0, 200, 100 ), 96, symbol( "invalid" ), 1, QPoint( 55, 40 ), result ) );
+
+  // the connection is still usable after an error reply
+  QVERIFY( MilXClient::movePoint( QRect( 0, 0, 200, 100 ), 96, symbol( "line" ), 0, QPoint( 0, 0 ), result ) );
+  QCOMPARE( result.adjustedPoints.front(), QPoint( 0, 0 ) );
+}
+
+void TestMilXClient::movePointAsync()
+{
+  MilXEditReceiver receiver;
+  int id1 = MilXClient::movePointAsync( &receiver, QRect( 0, 0, 200, 100 ), 96, symbol( "line" ), 1, QPoint( 55, 40 ) );
+  int id2 = MilXClient::movePointAsync( &receiver, QRect( 0, 0, 200, 100 ), 96, symbol( "line" ), 2, QPoint( 95, 30 ) );
+  QVERIFY( id1 != id2 );
+
+  QVERIFY( receiver.waitForEdits( 2 ) );
+  QCOMPARE( receiver.editedIds, QList<int>() << id1 << id2 );
+  QCOMPARE( receiver.editedPoints[0], QList<QPoint>() << QPoint( 10, 10 ) << QPoint( 55, 40 ) << QPoint( 90, 10 ) );
+  QCOMPARE( receiver.editedPoints[1], QList<QPoint>() << QPoint( 10, 10 ) << QPoint( 50, 20 ) << QPoint( 95, 30 ) );
+  QVERIFY( receiver.failedIds.isEmpty() );
+}
+
+void TestMilXClient::movePointAsyncFailure()
+{
+  MilXEditReceiver receiver;
+  int failedId = MilXClient::movePointAsync( &receiver, QRect( 0, 0, 200, 100 ), 96, symbol( "invalid" ), 1, QPoint( 55, 40 ) );
+  int editedId = MilXClient::movePointAsync( &receiver, QRect( 0, 0, 200, 100 ), 96, symbol( "line" ), 1, QPoint( 55, 40 ) );
+
+  QVERIFY( receiver.waitForEdits( 2 ) );
+  QCOMPARE( receiver.failedIds, QList<int>() << failedId );
+  QCOMPARE( receiver.errors, QStringList() << "Invalid symbol" );
+  QCOMPARE( receiver.editedIds, QList<int>() << editedId );
+}
+
+void TestMilXClient::updateSymbolsCache()
+{
+  MilXClient::clearSymbolCache();
+  QRect extent( 0, 0, 200, 100 );
+  QList<MilXClient::NPointSymbol> symbols = QList<MilXClient::NPointSymbol>() << symbol( "line" ) << symbol( "arrow" );
+  int updated = mServer->updatedSymbols();
+
+  QList<MilXClient::NPointSymbolGraphic> result;
+  QVERIFY( MilXClient::updateSymbols( extent, 96, 1., symbols, result ) );
+  QCOMPARE( result.size(), 2 );
+  QCOMPARE( mServer->updatedSymbols(), updated + 2 );
+
+  // unchanged symbols are not sent again
+  result.clear();
+  QVERIFY( MilXClient::updateSymbols( extent, 96, 1., symbols, result ) );
+  QCOMPARE( result.size(), 2 );
+  QCOMPARE( mServer->updatedSymbols(), updated + 2 );
+
+  // nor after panning within the rendered margin
+  QList<MilXClient::NPointSymbol> panned = QList<MilXClient::NPointSymbol>() << symbol( "line", QPoint( 30, 20 ) ) << symbol( "arrow", QPoint( 30, 20 ) );
+  result.clear();
+  QVERIFY( MilXClient::updateSymbols( extent, 96, 1., panned, result ) );
+  QCOMPARE( result.size(), 2 );
+  QCOMPARE( mServer->updatedSymbols(), updated + 2 );
+
+  // only the changed symbol is sent
+  panned[1] = symbol( "arrow2", QPoint( 30, 20 ) );
+  result.clear();
+  QVERIFY( MilXClient::updateSymbols( extent, 96, 1., panned, result ) );
+  QCOMPARE( result.size(), 2 );
+  QCOMPARE( mServer->updatedSymbols(), updated + 3 );
+}
+
+QTEST_MAIN( TestMilXClient )
+#include "testmilxclient.moc"
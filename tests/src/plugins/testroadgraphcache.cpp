@@ -0,0 +1,155 @@
+/***************************************************************************
+     testroadgraphcache.cpp
+     ----------------------
+    Date                 : October 2016
+    Copyright            : (C) 2016 by Sandro Mani
+    Email                : manisandro@gmail.com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest/QtTest>
+#include <QObject>
+#include <QDir>
+
+#include "qgsapplication.h"
+#include "qgscoordinatereferencesystem.h"
+#include "qgsfeature.h"
+#include "qgsgeometry.h"
+#include "qgsgraph.h"
+#include "qgslinevectorlayerdirector.h"
+#include "qgsmaplayerregistry.h"
+#include "qgsvectordataprovider.h"
+#include "qgsvectorfilewriter.h"
+#include "qgsvectorlayer.h"
+
+#include "graphcache.h"
+#include "speedproperter.h"
+
+/** \ingroup UnitTests
+ * Tests of the graph cache of the roadgraph plugin
+ */
+class TestRgGraphCache : public QObject
+{
+    Q_OBJECT
+
+  private slots:
+    void initTestCase();// will be called before the first testfunction is executed.
+    void cleanupTestCase();// will be called after the last testfunction was executed.
+    void init() {} // will be called before each testfunction is executed.
+    void cleanup() {} // will be called after every testfunction.
+    void snapshotReused();
+    void attributeChangeRebuilds();
+
+  private:
+    //! cost of the single arc of the graph of a freshly opened layer, using a new cache
+    double arcCost();
+    QStringList snapshots() const;
+    static void removeDir( const QString& path );
+
+    QString mTempDir;
+    QString mShapefile;
+};
+
+void TestRgGraphCache::initTestCase()
+{
+  // the snapshots are stored in the settings directory
+  mTempDir = QDir::tempPath() + "/roadgraphcachetest";
+  removeDir( mTempDir );
+  QDir().mkpath( mTempDir + "/data" );
+  QgsApplication::init( mTempDir + "/settings" );
+  QgsApplication::initQgis();
+
+  mShapefile = mTempDir + "/data/roads.shp";
+  QgsFields fields;
+  fields.append( QgsField( "speed", QVariant::Double, "double", 10, 3 ) );
+  QgsCoordinateReferenceSystem crs( "EPSG:21781" );
+  QgsVectorFileWriter writer( mShapefile, "UTF-8", fields, QGis::WKBLineString, &crs );
+  QCOMPARE( writer.hasError(), QgsVectorFileWriter::NoError );
+  QgsFeature feature( fields );
+  feature.setGeometry( QgsGeometry::fromPolyline( QgsPolyline() << QgsPoint( 600000, 200000 ) << QgsPoint( 601000, 200000 ) ) );
+  feature.setAttribute( 0, 10.0 );
+  QVERIFY( writer.addFeature( feature ) );
+}
+
+void TestRgGraphCache::cleanupTestCase()
+{
+  QgsApplication::exitQgis();
+  removeDir( mTempDir );
+}
+
+void TestRgGraphCache::removeDir( const QString& path )
+{
+  QDir dir( path );
+  foreach ( const QFileInfo& info, dir.entryInfoList( QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot ) )
+  {
+    if ( info.isDir() )
+      removeDir( info.absoluteFilePath() );
+    else
+      QFile::remove( info.absoluteFilePath() );
+  }
+  dir.rmdir( path );
+}
+
+double TestRgGraphCache::arcCost()
+{
+  QgsVectorLayer* layer = new QgsVectorLayer( mShapefile, "roads", "ogr" );
+  QgsMapLayerRegistry::instance()->addMapLayers( QList<QgsMapLayer*>() << layer );
+
+  QgsLineVectorLayerDirector director( layer, -1, "", "", "", 3 );
+  director.addProperter( new RgSpeedProperter( 0, 1, 1 ) );
+
+  RgGraphCache cache;
+  QVector<QgsPoint> tiedPoints;
+  QgsGraph* graph = cache.makeGraph( layer, &director, "speed", layer->crs(), false, 0, QVector<QgsPoint>(), tiedPoints );
+  double cost = graph->arcCount() > 0 ? graph->arc( 0 ).property( 0 ).toDouble() : -1;
+  delete graph;
+
+  QgsMapLayerRegistry::instance()->removeMapLayers( QStringList() << layer->id() );
+  return cost;
+}
+
+QStringList TestRgGraphCache::snapshots() const
+{
+  return QDir( QgsApplication::qgisSettingsDirPath() + "roadgraph" ).entryList( QStringList() << "*.graph", QDir::Files );
+}
+
+void TestRgGraphCache::snapshotReused()
+{
+  double cost = arcCost();
+  QVERIFY( cost > 0 );
+  QCOMPARE( snapshots().size(), 1 );
+  QString snapshot = snapshots().first();
+
+  QCOMPARE( arcCost(), cost );
+  QCOMPARE( snapshots(), QStringList() << snapshot );
+}
+
+void TestRgGraphCache::attributeChangeRebuilds()
+{
+  double cost = arcCost();
+  QCOMPARE( snapshots().size(), 1 );
+  QString snapshot = snapshots().first();
+
+  // only the .dbf changes, make sure its modification time differs
+  QTest::qSleep( 1100 );
+  {
+    QgsVectorLayer layer( mShapefile, "roads", "ogr" );
+    QgsChangedAttributesMap changes;
+    changes[0][0] = 20.0;
+    QVERIFY( layer.dataProvider()->changeAttributeValues( changes ) );
+  }
+
+  // twice the speed, half the cost
+  QVERIFY( qAbs( arcCost() - cost / 2 ) < 1e-9 * cost );
+  // the snapshot of the old data was replaced
+  QCOMPARE( snapshots().size(), 1 );
+  QVERIFY( snapshots().first() != snapshot );
+}
+
+QTEST_MAIN( TestRgGraphCache )
+#include "testroadgraphcache.moc"
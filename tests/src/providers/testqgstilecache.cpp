@@ -0,0 +1,200 @@
+/***************************************************************************
+     testqgstilecache.cpp
+     --------------------
+    Date                 : October 2016
+    Copyright            : (C) 2016 by Sandro Mani
+    Email                : manisandro@gmail.com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest/QtTest>
+#include <QObject>
+#include <QBuffer>
+#include <QImage>
+#include <QUrl>
+#include <QtConcurrentMap>
+
+#include "qgsapplication.h"
+#include "qgstilecache.h"
+
+//! inserts and reads the tiles of one row from a worker thread
+struct TileRowWorker
+{
+  TileRowWorker( const QImage& image ) : mImage( image ) {}
+
+  void operator()( int row )
+  {
+    for ( int column = 0; column < 20; ++column )
+    {
+      QUrl url( QString( "http://tiles.example.com/%1/%2.png" ).arg( row ).arg( column ) );
+      QgsTileCache::insertTile( url, mImage );
+      QImage image;
+      QgsTileCache::tile( url, image );
+    }
+  }
+
+  QImage mImage;
+};
+
+/** \ingroup UnitTests
+ * Tests of the in-memory tile cache of the WMS provider
+ */
+class TestQgsTileCache : public QObject
+{
+    Q_OBJECT
+
+  private slots:
+    void initTestCase();// will be called before the first testfunction is executed.
+    void cleanupTestCase();// will be called after the last testfunction was executed.
+    void init();// will be called before each testfunction is executed.
+    void cleanup() {} // will be called after every testfunction.
+    void insertAndGet();
+    void boundedByBytes();
+    void shrink();
+    void compressed();
+    void concurrentAccess();
+
+  private:
+    static QImage tileImage( int value );
+    static QByteArray encode( const QImage& image );
+    static QUrl url( int i );
+};
+
+void TestQgsTileCache::initTestCase()
+{
+  QgsApplication::init();
+  QgsApplication::initQgis();
+}
+
+void TestQgsTileCache::cleanupTestCase()
+{
+  QgsApplication::exitQgis();
+}
+
+void TestQgsTileCache::init()
+{
+  // remove the tiles of the previous test
+  QgsTileCache::setMaxCost( 0 );
+  QgsTileCache::setMaxCost( 64 * 1024 * 1024 );
+  QgsTileCache::setStoreCompressed( false );
+  QgsTileCache::resetStatistics();
+}
+
+QImage TestQgsTileCache::tileImage( int value )
+{
+  QImage image( 64, 64, QImage::Format_ARGB32 );
+  image.fill( qRgb( value % 256, 0, 0 ) );
+  return image;
+}
+
+QByteArray TestQgsTileCache::encode( const QImage& image )
+{
+  QByteArray data;
+  QBuffer buffer( &data );
+  buffer.open( QIODevice::WriteOnly );
+  image.save( &buffer, "PNG" );
+  return data;
+}
+
+QUrl TestQgsTileCache::url( int i )
+{
+  return QUrl( QString( "http://tiles.example.com/0/%1.png" ).arg( i ) );
+}
+
+void TestQgsTileCache::insertAndGet()
+{
+  QgsTileCache::insertTile( url( 1 ), tileImage( 1 ) );
+  QVERIFY( QgsTileCache::contains( url( 1 ) ) );
+  QVERIFY( !QgsTileCache::contains( url( 2 ) ) );
+
+  QImage image;
+  QVERIFY( QgsTileCache::tile( url( 1 ), image ) );
+  QCOMPARE( image, tileImage( 1 ) );
+  QCOMPARE( QgsTileCache::hits(), 1 );
+  QCOMPARE( QgsTileCache::totalCost(), qint64( tileImage( 1 ).byteCount() ) );
+
+  // a tile without image is not cached
+  QgsTileCache::insertTile( url( 3 ), QImage() );
+  QVERIFY( !QgsTileCache::contains( url( 3 ) ) );
+}
+
+void TestQgsTileCache::boundedByBytes()
+{
+  // room for four tiles in each shard
+  int tileCost = tileImage( 0 ).byteCount();
+  QgsTileCache::setMaxCost( qint64( 16 ) * 4 * tileCost );
+  QCOMPARE( QgsTileCache::maxCost(), qint64( 16 ) * 4 * tileCost );
+
+  for ( int i = 0; i < 200; ++i )
+  {
+    QgsTileCache::insertTile( url( i ), tileImage( i ) );
+    QVERIFY( QgsTileCache::totalCost() <= QgsTileCache::maxCost() );
+  }
+  QVERIFY( QgsTileCache::evictions() > 0 );
+
+  int cached = 0;
+  for ( int i = 0; i < 200; ++i )
+  {
+    if ( QgsTileCache::contains( url( i ) ) )
+      ++cached;
+  }
+  QCOMPARE( cached + QgsTileCache::evictions(), 200 );
+  QCOMPARE( QgsTileCache::totalCost(), qint64( cached ) * tileCost );
+
+  // the last inserted tile is always kept
+  QVERIFY( QgsTileCache::contains( url( 199 ) ) );
+}
+
+void TestQgsTileCache::shrink()
+{
+  for ( int i = 0; i < 50; ++i )
+  {
+    QgsTileCache::insertTile( url( i ), tileImage( i ) );
+  }
+  QCOMPARE( QgsTileCache::evictions(), 0 );
+
+  QgsTileCache::setMaxCost( 0 );
+  QCOMPARE( QgsTileCache::totalCost(), qint64( 0 ) );
+  QCOMPARE( QgsTileCache::evictions(), 50 );
+}
+
+void TestQgsTileCache::compressed()
+{
+  QgsTileCache::setStoreCompressed( true );
+  QImage original = tileImage( 7 );
+  QByteArray data = encode( original );
+  QgsTileCache::insertTile( url( 1 ), original, data );
+
+  // the encoded data is stored and decoded on access
+  QCOMPARE( QgsTileCache::totalCost(), qint64( data.size() ) );
+  QImage image;
+  QVERIFY( QgsTileCache::tile( url( 1 ), image ) );
+  QCOMPARE( image.convertToFormat( original.format() ), original );
+
+  // without encoded data the image is stored
+  QgsTileCache::insertTile( url( 2 ), original );
+  QCOMPARE( QgsTileCache::totalCost(), qint64( data.size() + original.byteCount() ) );
+}
+
+void TestQgsTileCache::concurrentAccess()
+{
+  QList<int> rows;
+  for ( int row = 0; row < 50; ++row )
+    rows << row;
+  QtConcurrent::blockingMap( rows, TileRowWorker( tileImage( 3 ) ) );
+
+  QCOMPARE( QgsTileCache::hits(), 50 * 20 );
+  QCOMPARE( QgsTileCache::totalCost(), qint64( 50 * 20 * tileImage( 3 ).byteCount() ) );
+  for ( int row = 0; row < 50; ++row )
+  {
+    QVERIFY( QgsTileCache::contains( QUrl( QString( "http://tiles.example.com/%1/0.png" ).arg( row ) ) ) );
+  }
+}
+
+QTEST_MAIN( TestQgsTileCache )
+#include "testqgstilecache.moc"
@@ -0,0 +1,271 @@
+/***************************************************************************
+     testqgsmetatilecache.cpp
+     ------------------------
+    Date                 : October 2016
+    Copyright            : (C) 2016 by Sandro Mani
+    Email                : manisandro@gmail.com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest/QtTest>
+#include <QObject>
+#include <QImage>
+#include <QThread>
+
+#include "qgsmetatilecache.h"
+
+//! searches a tile in the cache from another request thread
+class TileSearchThread : public QThread
+{
+  public:
+    TileSearchThread( const QString& project, const QString& metaTileKey )
+        : mProject( project ), mMetaTileKey( metaTileKey ), mFound( false ) {}
+
+    void run() override
+    {
+      mFound = QgsMetaTileCache::instance()->tile( mProject, mMetaTileKey, 1, 0, mTile );
+    }
+
+    QString mProject;
+    QString mMetaTileKey;
+    bool mFound;
+    QImage mTile;
+};
+
+/** \ingroup UnitTests
+ * Tests of the tile grid, keys and tile storage of the meta tile cache of the server
+ */
+class TestQgsMetaTileCache : public QObject
+{
+    Q_OBJECT
+
+  private slots:
+    void initTestCase() {}// will be called before the first testfunction is executed.
+    void cleanupTestCase() {}// will be called after the last testfunction was executed.
+    void init() {} // will be called before each testfunction is executed.
+    void cleanup() {} // will be called after every testfunction.
+    void tileGrid_data();
+    void tileGrid();
+    void metaTileExtent();
+    void metaTileKey();
+    void insertMetaTile();
+    void cancelMetaTile();
+    void waitForMetaTile();
+
+  private:
+    QMap<QString, QString> parameters( const QString& bbox ) const;
+    //! meta tile of 2 x 2 tiles of 4 x 4 pixels, each tile filled with another color
+    QImage metaTile() const;
+};
+
+void TestQgsMetaTileCache::tileGrid_data()
+{
+  QTest::addColumn<double>( "xMin" );
+  QTest::addColumn<double>( "yMin" );
+  QTest::addColumn<double>( "tileSize" );
+  QTest::addColumn<qint64>( "metaColumn" );
+  QTest::addColumn<qint64>( "metaRow" );
+  QTest::addColumn<int>( "tileColumn" );
+  QTest::addColumn<int>( "tileRow" );
+  QTest::addColumn<int>( "phaseX" );
+  QTest::addColumn<int>( "phaseY" );
+
+  // meta tiles of 4 x 4 tiles, rows of the meta tile from the top
+  QTest::newRow( "origin" ) << 0. << 0. << 256. << qint64( 0 ) << qint64( 0 ) << 0 << 3 << 0 << 0;
+  QTest::newRow( "inside" ) << 512. << 256. << 256. << qint64( 0 ) << qint64( 0 ) << 2 << 2 << 0 << 0;
+  QTest::newRow( "second meta tile" ) << 1024. << 1792. << 256. << qint64( 4 ) << qint64( 4 ) << 0 << 0 << 0 << 0;
+  QTest::newRow( "negative" ) << -256. << -1024. << 256. << qint64( -4 ) << qint64( -4 ) << 3 << 3 << 0 << 0;
+  // rounding errors of the client do not move the tile to the neighbour
+  QTest::newRow( "rounding below" ) << 0.7 << 0.3 << 0.1 << qint64( 4 ) << qint64( 0 ) << 3 << 0 << 0 << 0;
+  QTest::newRow( "rounding above" ) << 0.30000000000000004 << 0.7 << 0.1 << qint64( 0 ) << qint64( 4 ) << 3 << 0 << 0 << 0;
+  // grid shifted against the origin
+  QTest::newRow( "shifted" ) << 100. << 768. + 64. << 256. << qint64( 0 ) << qint64( 0 ) << 0 << 0 << 3906 << 2500;
+}
+
+void TestQgsMetaTileCache::tileGrid()
+{
+  QFETCH( double, xMin );
+  QFETCH( double, yMin );
+  QFETCH( double, tileSize );
+  QFETCH( qint64, metaColumn );
+  QFETCH( qint64, metaRow );
+  QFETCH( int, tileColumn );
+  QFETCH( int, tileRow );
+  QFETCH( int, phaseX );
+  QFETCH( int, phaseY );
+
+  QgsMetaTileCache::TileGrid grid = QgsMetaTileCache::tileGrid( xMin, yMin, tileSize, tileSize, 4 );
+  QCOMPARE( grid.metaColumn, metaColumn );
+  QCOMPARE( grid.metaRow, metaRow );
+  QCOMPARE( grid.tileColumn, tileColumn );
+  QCOMPARE( grid.tileRow, tileRow );
+  QCOMPARE( grid.phaseX, phaseX );
+  QCOMPARE( grid.phaseY, phaseY );
+}
+
+void TestQgsMetaTileCache::metaTileExtent()
+{
+  // the tiles are at their position in the extent of the meta tile
+  const double tileWidth = 250, tileHeight = 125;
+  for ( int column = -5; column < 5; ++column )
+  {
+    for ( int row = -5; row < 5; ++row )
+    {
+      double xMin = 30 + column * tileWidth, yMin = 10 + row * tileHeight;
+      QgsMetaTileCache::TileGrid grid = QgsMetaTileCache::tileGrid( xMin, yMin, tileWidth, tileHeight, 3 );
+      QVERIFY( grid.tileColumn >= 0 && grid.tileColumn < 3 && grid.tileRow >= 0 && grid.tileRow < 3 );
+
+      QgsRectangle extent = QgsMetaTileCache::metaTileExtent( grid, tileWidth, tileHeight, 3 );
+      QVERIFY( qAbs( extent.width() - 3 * tileWidth ) < 1E-6 );
+      QVERIFY( qAbs( extent.height() - 3 * tileHeight ) < 1E-6 );
+      QVERIFY( qAbs( extent.xMinimum() + grid.tileColumn * tileWidth - xMin ) < 1E-6 );
+      QVERIFY( qAbs( extent.yMaximum() - ( grid.tileRow + 1 ) * tileHeight - yMin ) < 1E-6 );
+    }
+  }
+}
+
+QMap<QString, QString> TestQgsMetaTileCache::parameters( const QString& bbox ) const
+{
+  QMap<QString, QString> parameters;
+  parameters["REQUEST"] = "GetMap";
+  parameters["LAYERS"] = "roads";
+  parameters["FORMAT"] = "image/png";
+  parameters["BBOX"] = bbox;
+  parameters["WIDTH"] = "256";
+  parameters["HEIGHT"] = "256";
+  return parameters;
+}
+
+void TestQgsMetaTileCache::metaTileKey()
+{
+  QString project = "/nonexisting/project.qgs";
+  QgsMetaTileCache::TileGrid grid1 = QgsMetaTileCache::tileGrid( 0, 0, 256, 256, 4 );
+  QgsMetaTileCache::TileGrid grid2 = QgsMetaTileCache::tileGrid( 768, 512, 256, 256, 4 );
+  QgsMetaTileCache::TileGrid grid3 = QgsMetaTileCache::tileGrid( 1024, 0, 256, 256, 4 );
+  QString key1 = QgsMetaTileCache::metaTileKey( project, parameters( "0,0,256,256" ), 256, 256, 256, 256, grid1 );
+
+  // tiles of the same meta tile share the key, the extent of the tile is not part of it
+  QCOMPARE( QgsMetaTileCache::metaTileKey( project, parameters( "768,512,1024,768" ), 256, 256, 256, 256, grid2 ), key1 );
+  QVERIFY( QgsMetaTileCache::metaTileKey( project, parameters( "1024,0,1280,256" ), 256, 256, 256, 256, grid3 ) != key1 );
+
+  // other parameters, sizes and projects change the key
+  QMap<QString, QString> otherParameters = parameters( "0,0,256,256" );
+  otherParameters["LAYERS"] = "rivers";
+  QVERIFY( QgsMetaTileCache::metaTileKey( project, otherParameters, 256, 256, 256, 256, grid1 ) != key1 );
+  QVERIFY( QgsMetaTileCache::metaTileKey( project, parameters( "0,0,256,256" ), 512, 512, 256, 256, grid1 ) != key1 );
+  QVERIFY( QgsMetaTileCache::metaTileKey( project, parameters( "0,0,256,256" ), 256, 256, 128, 128, grid1 ) != key1 );
+  QVERIFY( QgsMetaTileCache::metaTileKey( "/other/project.qgs", parameters( "0,0,256,256" ), 256, 256, 256, 256, grid1 ) != key1 );
+
+  // shifted grids do not share meta tiles
+  QgsMetaTileCache::TileGrid shifted = QgsMetaTileCache::tileGrid( 100, 0, 256, 256, 4 );
+  QCOMPARE( shifted.metaColumn, grid1.metaColumn );
+  QVERIFY( QgsMetaTileCache::metaTileKey( project, parameters( "100,0,356,256" ), 256, 256, 256, 256, shifted ) != key1 );
+}
+
+QImage TestQgsMetaTileCache::metaTile() const
+{
+  QImage image( 8, 8, QImage::Format_ARGB32 );
+  for ( int row = 0; row < 2; ++row )
+  {
+    for ( int column = 0; column < 2; ++column )
+    {
+      for ( int y = 0; y < 4; ++y )
+      {
+        for ( int x = 0; x < 4; ++x )
+        {
+          image.setPixel( column * 4 + x, row * 4 + y, qRgb( 100 * column, 100 * row, 50 ) );
+        }
+      }
+    }
+  }
+  return image;
+}
+
+void TestQgsMetaTileCache::insertMetaTile()
+{
+  QgsMetaTileCache* cache = QgsMetaTileCache::instance();
+  QString project = "/nonexisting/project.qgs";
+  QString key = project + "\ninsert";
+  int misses = cache->misses();
+  int hits = cache->hits();
+
+  // the first search makes the caller render the meta tile
+  QImage tile;
+  QVERIFY( !cache->tile( project, key, 0, 0, tile ) );
+  QCOMPARE( cache->misses(), misses + 1 );
+  cache->insertMetaTile( project, key, metaTile(), 4, 4 );
+
+  // the meta tile is sliced into tiles, rows from the top
+  for ( int row = 0; row < 2; ++row )
+  {
+    for ( int column = 0; column < 2; ++column )
+    {
+      QVERIFY( cache->tile( project, key, column, row, tile ) );
+      QCOMPARE( tile.size(), QSize( 4, 4 ) );
+      QCOMPARE( tile.pixel( 0, 0 ), qRgb( 100 * column, 100 * row, 50 ) );
+      QCOMPARE( tile.pixel( 3, 3 ), qRgb( 100 * column, 100 * row, 50 ) );
+    }
+  }
+  QCOMPARE( cache->hits(), hits + 4 );
+  QCOMPARE( cache->misses(), misses + 1 );
+
+  // removing the tiles of the project makes them render again
+  cache->removeProjectTiles( project );
+  QVERIFY( !cache->tile( project, key, 0, 0, tile ) );
+  cache->cancelMetaTile( key );
+}
+
+void TestQgsMetaTileCache::cancelMetaTile()
+{
+  QgsMetaTileCache* cache = QgsMetaTileCache::instance();
+  QString project = "/nonexisting/project.qgs";
+  QString key = project + "\ncancel";
+
+  QImage tile;
+  QVERIFY( !cache->tile( project, key, 0, 0, tile ) );
+  cache->cancelMetaTile( key );
+
+  // the next search does not wait for the canceled meta tile, but renders it again
+  QVERIFY( !cache->tile( project, key, 1, 1, tile ) );
+  QVERIFY( tile.isNull() );
+  cache->insertMetaTile( project, key, metaTile(), 4, 4 );
+  QVERIFY( cache->tile( project, key, 1, 1, tile ) );
+  QCOMPARE( tile.pixel( 0, 0 ), qRgb( 100, 100, 50 ) );
+}
+
+void TestQgsMetaTileCache::waitForMetaTile()
+{
+  QgsMetaTileCache* cache = QgsMetaTileCache::instance();
+  QString project = "/nonexisting/project.qgs";
+  QString key = project + "\nwait";
+
+  // another thread waits while the meta tile is rendered and gets its tile afterwards
+  QImage tile;
+  QVERIFY( !cache->tile( project, key, 0, 0, tile ) );
+  TileSearchThread insertWaiter( project, key );
+  insertWaiter.start();
+  QVERIFY( !insertWaiter.wait( 100 ) );
+  cache->insertMetaTile( project, key, metaTile(), 4, 4 );
+  QVERIFY( insertWaiter.wait( 5000 ) );
+  QVERIFY( insertWaiter.mFound );
+  QCOMPARE( insertWaiter.mTile.pixel( 0, 0 ), qRgb( 100, 0, 50 ) );
+
+  // if the rendering is canceled, the waiting thread has to render the meta tile itself
+  QString canceledKey = project + "\nwait canceled";
+  QVERIFY( !cache->tile( project, canceledKey, 0, 0, tile ) );
+  TileSearchThread cancelWaiter( project, canceledKey );
+  cancelWaiter.start();
+  QVERIFY( !cancelWaiter.wait( 100 ) );
+  cache->cancelMetaTile( canceledKey );
+  QVERIFY( cancelWaiter.wait( 5000 ) );
+  QVERIFY( !cancelWaiter.mFound );
+  cache->cancelMetaTile( canceledKey );
+}
+
+QTEST_MAIN( TestQgsMetaTileCache )
+#include "testqgsmetatilecache.moc"
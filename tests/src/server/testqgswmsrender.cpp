@@ -0,0 +1,219 @@
+/***************************************************************************
+     testqgswmsrender.cpp
+     --------------------
+    Date                 : October 2016
+    Copyright            : (C) 2016 by Sandro Mani
+    Email                : manisandro@gmail.com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest/QtTest>
+#include <QObject>
+#include <QImage>
+#include <QPainter>
+
+#include "qgsapplication.h"
+#include "qgsfeature.h"
+#include "qgsgeometry.h"
+#include "qgsmaplayerregistry.h"
+#include "qgsmaprenderer.h"
+#include "qgsmarkersymbollayerv2.h"
+#include "qgspallabeling.h"
+#include "qgssinglesymbolrendererv2.h"
+#include "qgssymbolv2.h"
+#include "qgsvectordataprovider.h"
+#include "qgsvectorlayer.h"
+#include "qgswmsserver.h"
+
+/** \ingroup UnitTests
+ * Compares the maps rendered by the legacy renderer and by the map renderer jobs of the WMS server
+ */
+class TestQgsWMSRender : public QObject
+{
+    Q_OBJECT
+
+  private slots:
+    void initTestCase();// will be called before the first testfunction is executed.
+    void cleanupTestCase();// will be called after the last testfunction was executed.
+    void init() {} // will be called before each testfunction is executed.
+    void cleanup() {} // will be called after every testfunction.
+    void millimeterUnits();
+    void layersWithLabels();
+
+  private:
+    QImage render( const QStringList& layerIds, QgsMapRenderer::OutputUnits units, bool legacy, bool labels = false );
+    //! adds a layer with labeled features of the given geometry type to the registry
+    static QgsVectorLayer* addLabeledLayer( const QString& geometryType, const QList<QgsGeometry*>& geometries, QgsSymbolV2* symbol );
+    //! number of pixels which differ noticeably
+    static int differentPixels( const QImage& image1, const QImage& image2 );
+    static int paintedPixels( const QImage& image );
+
+    QgsVectorLayer* mLayer;
+    QStringList mLabeledLayerIds;
+};
+
+void TestQgsWMSRender::initTestCase()
+{
+  QgsApplication::init();
+  QgsApplication::initQgis();
+
+  mLayer = new QgsVectorLayer( "Point?crs=epsg:4326", "points", "memory" );
+  QgsFeatureList features;
+  for ( int i = 0; i < 5; ++i )
+  {
+    QgsFeature feature;
+    feature.setGeometry( QgsGeometry::fromPoint( QgsPoint( -8 + 4 * i, -6 + 3 * i ) ) );
+    features << feature;
+  }
+  mLayer->dataProvider()->addFeatures( features );
+
+  QgsStringMap props;
+  props["name"] = "circle";
+  props["color"] = "255,0,0";
+  props["size"] = "4";
+  mLayer->setRendererV2( new QgsSingleSymbolRendererV2( QgsMarkerSymbolV2::createSimple( props ) ) );
+  QgsMapLayerRegistry::instance()->addMapLayers( QList<QgsMapLayer*>() << mLayer );
+
+  // polygons below lines below points, each feature labeled with its name
+  QgsStringMap fillProps;
+  fillProps["color"] = "180,220,160";
+  fillProps["outline_color"] = "40,80,40";
+  QList<QgsGeometry*> polygons;
+  polygons << QgsGeometry::fromRect( QgsRectangle( -9, -9, -1, -2 ) ) << QgsGeometry::fromRect( QgsRectangle( 1, 2, 8, 9 ) );
+  mLabeledLayerIds.prepend( addLabeledLayer( "Polygon", polygons, QgsFillSymbolV2::createSimple( fillProps ) )->id() );
+
+  QgsStringMap lineProps;
+  lineProps["color"] = "0,0,255";
+  lineProps["width"] = "0.8";
+  QList<QgsGeometry*> lines;
+  lines << QgsGeometry::fromPolyline( QgsPolyline() << QgsPoint( -9, 0 ) << QgsPoint( 9, 1 ) )
+  << QgsGeometry::fromPolyline( QgsPolyline() << QgsPoint( -2, -9 ) << QgsPoint( 0, 9 ) );
+  mLabeledLayerIds.prepend( addLabeledLayer( "LineString", lines, QgsLineSymbolV2::createSimple( lineProps ) )->id() );
+
+  QgsStringMap markerProps;
+  markerProps["name"] = "square";
+  markerProps["color"] = "255,128,0";
+  markerProps["size"] = "3";
+  QList<QgsGeometry*> points;
+  points << QgsGeometry::fromPoint( QgsPoint( -5, 5 ) ) << QgsGeometry::fromPoint( QgsPoint( 5, -5 ) ) << QgsGeometry::fromPoint( QgsPoint( 3, 4 ) );
+  mLabeledLayerIds.prepend( addLabeledLayer( "Point", points, QgsMarkerSymbolV2::createSimple( markerProps ) )->id() );
+}
+
+QgsVectorLayer* TestQgsWMSRender::addLabeledLayer( const QString& geometryType, const QList<QgsGeometry*>& geometries, QgsSymbolV2* symbol )
+{
+  QgsVectorLayer* layer = new QgsVectorLayer( geometryType + "?crs=epsg:4326&field=name:string", geometryType.toLower(), "memory" );
+  QgsFeatureList features;
+  for ( int i = 0; i < geometries.size(); ++i )
+  {
+    QgsFeature feature( layer->dataProvider()->fields() );
+    feature.setGeometry( geometries[i] );
+    feature.setAttribute( "name", QString( "%1 %2" ).arg( geometryType ).arg( i + 1 ) );
+    features << feature;
+  }
+  layer->dataProvider()->addFeatures( features );
+  layer->setRendererV2( new QgsSingleSymbolRendererV2( symbol ) );
+
+  QgsPalLayerSettings labelSettings;
+  labelSettings.enabled = true;
+  labelSettings.fieldName = "name";
+  labelSettings.writeToLayer( layer );
+
+  QgsMapLayerRegistry::instance()->addMapLayers( QList<QgsMapLayer*>() << layer );
+  return layer;
+}
+
+void TestQgsWMSRender::cleanupTestCase()
+{
+  QgsWMSServer::setUseLegacyRenderer( false );
+  QgsApplication::exitQgis();
+}
+
+QImage TestQgsWMSRender::render( const QStringList& layerIds, QgsMapRenderer::OutputUnits units, bool legacy, bool labels )
+{
+  QgsMapRenderer renderer;
+  renderer.setOutputSize( QSize( 200, 200 ), 96 );
+  renderer.setLayerSet( layerIds );
+  renderer.setExtent( QgsRectangle( -10, -10, 10, 10 ) );
+  renderer.setOutputUnits( units );
+  if ( labels )
+  {
+    renderer.setLabelingEngine( new QgsPalLabeling() );
+  }
+
+  QImage image( 200, 200, QImage::Format_ARGB32_Premultiplied );
+  image.fill( 0 );
+  QPainter painter( &image );
+  painter.setRenderHint( QPainter::Antialiasing );
+  QgsWMSServer::setUseLegacyRenderer( legacy );
+  QgsWMSServer::drawMap( &renderer, &painter );
+  painter.end();
+  return image;
+}
+
+int TestQgsWMSRender::differentPixels( const QImage& image1, const QImage& image2 )
+{
+  int count = 0;
+  for ( int y = 0; y < image1.height(); ++y )
+  {
+    const QRgb* line1 = reinterpret_cast<const QRgb*>( image1.constScanLine( y ) );
+    const QRgb* line2 = reinterpret_cast<const QRgb*>( image2.constScanLine( y ) );
+    for ( int x = 0; x < image1.width(); ++x )
+    {
+      if ( qAbs( qRed( line1[x] ) - qRed( line2[x] ) ) > 32 || qAbs( qGreen( line1[x] ) - qGreen( line2[x] ) ) > 32 ||
+           qAbs( qBlue( line1[x] ) - qBlue( line2[x] ) ) > 32 || qAbs( qAlpha( line1[x] ) - qAlpha( line2[x] ) ) > 32 )
+      {
+        ++count;
+      }
+    }
+  }
+  return count;
+}
+
+int TestQgsWMSRender::paintedPixels( const QImage& image )
+{
+  int count = 0;
+  for ( int y = 0; y < image.height(); ++y )
+  {
+    const QRgb* line = reinterpret_cast<const QRgb*>( image.constScanLine( y ) );
+    for ( int x = 0; x < image.width(); ++x )
+    {
+      if ( qAlpha( line[x] ) > 0 )
+        ++count;
+    }
+  }
+  return count;
+}
+
+void TestQgsWMSRender::millimeterUnits()
+{
+  QImage legacyImage = render( QStringList() << mLayer->id(), QgsMapRenderer::Millimeters, true );
+  QImage jobImage = render( QStringList() << mLayer->id(), QgsMapRenderer::Millimeters, false );
+
+  QVERIFY( paintedPixels( legacyImage ) > 0 );
+  //antialiasing may differ at the edges of the symbols
+  QVERIFY( differentPixels( legacyImage, jobImage ) <= paintedPixels( legacyImage ) / 10 );
+}
+
+void TestQgsWMSRender::layersWithLabels()
+{
+  QImage legacyImage = render( mLabeledLayerIds, QgsMapRenderer::Millimeters, true, true );
+  QImage jobImage = render( mLabeledLayerIds, QgsMapRenderer::Millimeters, false, true );
+
+  //the layers are stacked and labeled as by the legacy renderer
+  QVERIFY( paintedPixels( legacyImage ) > 0 );
+  QVERIFY( differentPixels( legacyImage, jobImage ) <= paintedPixels( legacyImage ) / 10 );
+
+  //the job draws the labels on top of the layers
+  QImage unlabeledImage = render( mLabeledLayerIds, QgsMapRenderer::Millimeters, false, false );
+  int labelPixels = differentPixels( jobImage, unlabeledImage );
+  QVERIFY( labelPixels > 0 );
+  QVERIFY( differentPixels( legacyImage, jobImage ) < labelPixels );
+}
+
+QTEST_MAIN( TestQgsWMSRender )
+#include "testqgswmsrender.moc"